@@ -47,7 +47,12 @@
 #include "input.h"
 #include "modex.h"
 #include "photo.h"
+#include "prof.h"
+#include "quantize.h"
+#include "replay.h"
+#include "residency.h"
 #include "text.h"
+#include "tick.h"
 #include "world.h"
 #include "module/mtcp.h"
 #include "module/tuxctl-ioctl.h"
@@ -67,6 +72,24 @@ static int sanity_check(void);
 #define STATUS_MSG_LEN 40    /* maximum length of status message     */
 #define MOTION_SPEED   2     /* pixels moved per command             */
 
+/* print room photo residency statistics(see residency.h) on exit? */
+#ifndef REPORT_RESIDENCY
+#define REPORT_RESIDENCY 0
+#endif
+
+/*
+ * print screen update statistics(see get_modex_stats and
+ * get_entry_frame_stats) on exit?
+ */
+#ifndef REPORT_SCREENS
+#define REPORT_SCREENS 0
+#endif
+
+/* print game loop tick statistics(see get_ticker_stats) on exit? */
+#ifndef REPORT_TICKS
+#define REPORT_TICKS 0
+#endif
+
 /* outcome of the game */
 typedef enum {GAME_WON, GAME_QUIT} game_condition_t;
 
@@ -134,16 +157,16 @@ static const typed_cmd_t cmd_list[] = {
 /* local functions--see function headers for details */
 
 static void cancel_status_thread(void* ignore);
-static game_condition_t game_loop(void);
+static game_condition_t game_loop(ticker_t* ticker);
 static int32_t handle_typing(void);
 static void init_game(void);
 static void move_photo_down(void);
 static void move_photo_left(void);
 static void move_photo_right(void);
 static void move_photo_up(void);
+static void redraw_damage(void);
 static void redraw_room(void);
 static void* status_thread(void* ignore);
-static int time_is_after(struct timeval* t1, struct timeval* t2);
 static void* tux_thread(void* ignore);
 static void cancel_tux_thread(void* ignore);
 
@@ -151,7 +174,7 @@ static void cancel_tux_thread(void* ignore);
 /* file-scope variables */
 int32_t enter_room;      /* player has changed rooms        */
 static game_info_t game_info; /* game information */
-static char typing_buffer[21];
+static char shown_msg[STATUS_MSG_LEN + 1]; /* copy of status_msg for the status bar */
 static int time_counter;
 game_condition_t game;  /* outcome of playing */
 /*
@@ -167,6 +190,11 @@ game_condition_t game;  /* outcome of playing */
  * acquired before reading or writing the message.  Further, if the message
  * is changed, the helper thread must be notified by signaling it with the
  * condition variable msg_cv(while holding the msg_lock).
+ *
+ * Both the game loop and the Tux thread draw the room into the build
+ * buffer, which also builds the room layers kept by photo.c.  Either
+ * thread holds the cmd_lock mutex while carrying out commands or drawing
+ * the room.
  */
 static pthread_t status_thread_id, tux_thread_id;
 static pthread_mutex_t msg_lock = PTHREAD_MUTEX_INITIALIZER;
@@ -207,36 +235,23 @@ static void cancel_status_thread(void* ignore) {
 /*
  * game_loop
  *   DESCRIPTION: Main event loop for the adventure game.
- *   INPUTS: none
+ *   INPUTS: ticker -- ticker with a tick every TICK_USEC, watching the
+ *                     keyboard
  *   OUTPUTS: none
  *   RETURN VALUE: GAME_QUIT if the player quits, or GAME_WON if they have won
  *   SIDE EFFECTS: drives the display, etc.
  */
-static game_condition_t game_loop() {
-    /*
-     * Variables used to carry information between event loop ticks; see
-     * initialization below for explanations of purpose.
-     */
-    struct timeval start_time, tick_time;
-
-    struct timeval cur_time; /* current time(during tick)      */
+static game_condition_t game_loop(ticker_t* ticker) {
+    int32_t ticks;                /* ticks passed(0 if woken by input) */
     cmd_t cmd, tux_cmd;               /* command issued by input control */
+    cmd_t held = CMD_NONE;        /* view motion waiting for a tick    */
 
 
-    /* Record the starting time--assume success. */
-    (void)gettimeofday(&start_time, NULL);
-
-    /* Calculate the time at which the first event loop tick should occur. */
-    tick_time = start_time;
-    if ((tick_time.tv_usec += TICK_USEC) > 1000000) {
-        tick_time.tv_sec++;
-        tick_time.tv_usec -= 1000000;
-    }
-
     /* The player has just entered the first room. */
     enter_room = 1;
 
     /* The main event loop. */
+    PROF_BEGIN(PROF_TICK);
     while (1) {
         /*
          * Update the screen, preparing the VGA palette and photo-drawing
@@ -245,6 +260,15 @@ static game_condition_t game_loop() {
          * once you have it working).
          */
         if (enter_room) {
+            PROF_BEGIN(PROF_ENTER_ROOM);
+
+            /*
+             * Hold the command lock while drawing, including while the
+             * room's entry frame is copied, as the Tux thread draws too
+             * (see cmd_lock).
+             */
+            (void)pthread_mutex_lock(&cmd_lock);
+
             /* Reset the view window to(0,0). */
             game_info.map_x = game_info.map_y = 0;
             set_view_window(game_info.map_x, game_info.map_y);
@@ -252,80 +276,81 @@ static game_condition_t game_loop() {
             /* Discard any partially-typed command. */
             reset_typed_command();
 
-            /* Adjust colors and photo drawing for the current room photo. */
-            prep_room(game_info.where);
+            /*
+             * Adjust colors and photo drawing for the current room photo
+             * and draw the room, copying the frame rendered while the
+             * player was idle if it is still good.
+             */
+            if (!show_entry_frame(game_info.where)) {
+                prep_room(game_info.where);
+                redraw_room();
+            }
 
-            /* Draw the room(calls show). */
-            redraw_room();
+            /* Load photos for nearby rooms in the background. */
+            prefetch_near_room(game_info.where);
 
             /* Only draw once on entry. */
             enter_room = 0;
-			
-			show_status_bar(" ",3);
+            (void)pthread_mutex_unlock(&cmd_lock);
+            PROF_END(PROF_ENTER_ROOM);
         }
-		//critical section begin
+		//critical section begin: only take a copy of the message if it has changed
+		PROF_BEGIN(PROF_MSG_LOCK);
 		(void)pthread_mutex_lock(&msg_lock);
-		
-		//show_status_bar(" ",3);			//reset the status bar
-		//check whether the message in typing_buffer has changed
-		if(strcmp(typing_buffer, get_typed_command())){
-			show_status_bar(" ",3);			//reset the status bar
-			strcpy(typing_buffer, get_typed_command());
-		}
-		//check whether there is something in the status bar
-		if(status_msg[0] == '\0'){
-			show_status_bar(" ",3);			//reset the status bar
-			show_status_bar(room_name(game_info.where), 1);		//show the room name in the left of the status bar
-			const char *cmd = get_typed_command();				//show the typing message in the status bar
-			if('\0' != *cmd ){show_status_bar(get_typed_command(),2);}
-			else{show_status_bar("_",2);}
-		}
-		else{
-			show_status_bar(status_msg,0);		//show the message in the status_msg in the status bar
-
-		}
+		if(strcmp(shown_msg, status_msg))
+			strcpy(shown_msg, status_msg);
 		(void)pthread_mutex_unlock(&msg_lock); // critical section end
-        show_screen();
+		PROF_END(PROF_MSG_LOCK);
+		
+		//show the message, or else the room name on the left and the typing on the right(redrawn only if changed)
+		PROF_BEGIN(PROF_STATUS_BAR);
+		update_status_bar(room_name(game_info.where), get_typed_command(), shown_msg);
+		PROF_END(PROF_STATUS_BAR);
 
         /*
-         * Wait for tick.  The tick defines the basic timing of our
-         * event loop, and is the minimum amount of time between events.
+         * Show the screen under the command lock, so that lines drawn by
+         * the Tux thread are not lost from the rows to be copied later.
          */
-        do {
-            if (gettimeofday(&cur_time, NULL) != 0) {
-                /* Panic!(should never happen) */
-                clear_mode_X();
-                shutdown_input();
-                perror("gettimeofday");
-                exit(3);
-            }
-        } while (!time_is_after(&cur_time, &tick_time));
+        (void)pthread_mutex_lock(&cmd_lock);
+        show_screen();
+        (void)pthread_mutex_unlock(&cmd_lock);
+        script_shown();
 
         /*
-         * Advance the tick time.  If we missed one or more ticks completely,
-         * i.e., if the current time is already after the time for the next
-         * tick, just skip the extra ticks and advance the clock to the one
-         * that we haven't missed.
+         * Wait for tick, or for input.  The tick defines the basic timing
+         * of our event loop; input other than view motion is handled as
+         * soon as it arrives.  If we missed one or more ticks completely,
+         * the ticker skips the extra ticks and waits for the one that we
+         * haven't missed.  A recording being replayed sets its own pace
+         * (see replay.h).
          */
-        do {
-            if ((tick_time.tv_usec += TICK_USEC) > 1000000) {
-                tick_time.tv_sec++;
-                tick_time.tv_usec -= 1000000;
-            }
-        } while (time_is_after(&cur_time, &tick_time));
+        PROF_END(PROF_TICK);
+        PROF_BEGIN(PROF_WAIT);
+        if (0 > (ticks = script_wait(ticker))) {
+            /* Panic!(should never happen) */
+            clear_mode_X();
+            shutdown_input();
+            perror("script_wait");
+            exit(3);
+        }
+        PROF_END(PROF_WAIT);
+        PROF_POLL();
+        PROF_BEGIN(PROF_TICK);
 
         /*
          * Handle asynchronous events.  These events use real time rather
          * than tick counts for timing, although the real time is rounded
          * off to the nearest tick by definition.
          */
-        /*(none right now...) */
-		int current_time;
-		current_time = tick_time.tv_sec - start_time.tv_sec;
-		if(time_counter != current_time)
+		if(0 < ticks)
 		{
-			display_time_on_tux(current_time);
-			time_counter = current_time;
+			int current_time;
+			current_time = ticker_count(ticker) * TICK_USEC / 1000000;
+			if(time_counter != current_time)
+			{
+				display_time_on_tux(current_time);
+				time_counter = current_time;
+			}
 		}
 
         /*
@@ -337,10 +362,33 @@ static game_condition_t game_loop() {
 		(void)pthread_mutex_lock(&cmd_lock);
         
 		//tux_cmd = get_tux_command();
-		tux_cmd = get_tux_command();
-		cmd = get_command();
+		//a recording being replayed stands in for the devices
+		PROF_BEGIN(PROF_TUX);
+		tux_cmd = (replaying() ? CMD_NONE : get_tux_command());
+		PROF_END(PROF_TUX);
+		PROF_BEGIN(PROF_KEYBOARD);
+		cmd = (replaying() ? CMD_NONE : get_command());
+		PROF_END(PROF_KEYBOARD);
 		if(tux_cmd != CMD_NONE) cmd = CMD_NONE;
 
+		/*
+		 * Move the view at most once per tick, whatever the keyboard
+		 * autorepeat rate: an arrow key read between ticks waits for the
+		 * next tick, and any repeats before then replace it.
+		 */
+		if (CMD_RIGHT <= cmd && CMD_DOWN >= cmd && 0 == ticks) {
+			held = cmd;
+			cmd = CMD_NONE;
+		} else if (0 < ticks) {
+			if (CMD_NONE == cmd) {
+				cmd = held;
+			}
+			held = CMD_NONE;
+		}
+		script_typed();
+		cmd = script_command(SCRIPT_KEYS, cmd);
+
+		PROF_BEGIN(PROF_COMMAND);
 		switch (cmd) {
 				case CMD_UP:    move_photo_down();  break;
 				case CMD_RIGHT: move_photo_left();  break;
@@ -364,12 +412,26 @@ static game_condition_t game_loop() {
 				enter_room = 1;
 				}
 			}
+			PROF_END(PROF_COMMAND);
 
 		 
         /* If player wins the game, their room becomes NULL. */
         if (NULL == game_info.where) {
             return GAME_WON;
         }
+
+        /*
+         * If the player did nothing this tick, render the screen for one
+         * of the rooms next to theirs(see prerender_near_room), holding
+         * the command lock so that the Tux thread can't change the world.
+         */
+        if (0 < ticks && CMD_NONE == cmd && CMD_NONE == tux_cmd && !enter_room) {
+            PROF_BEGIN(PROF_PRERENDER);
+            (void)pthread_mutex_lock(&cmd_lock);
+            (void)prerender_near_room(game_info.where);
+            (void)pthread_mutex_unlock(&cmd_lock);
+            PROF_END(PROF_PRERENDER);
+        }
     } /* end of the main event loop */
 }
 
@@ -483,7 +545,9 @@ static int32_t handle_typing() {
         if (TC_ALLOW_EDIT != result) {
             reset_typed_command();
             if (TC_REDRAW_ROOM == result) {
-                redraw_room();
+                (void)pthread_mutex_lock(&cmd_lock);
+                redraw_damage();
+                (void)pthread_mutex_unlock(&cmd_lock);
             }
         }
         return 0;
@@ -627,21 +691,53 @@ static void move_photo_up() {
 }
 
 
+/*
+ * redraw_damage
+ *   DESCRIPTION: Draw the parts of the screen showing areas of the room
+ *                changed since the room was last drawn, or the whole
+ *                screen if the room's photo has changed.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Draws into the build buffer(but not the status bar).
+ */
+static void redraw_damage() {
+    room_damage_t rects[MAX_ROOM_DAMAGE]; /* changed areas of the room */
+    int32_t       n;                      /* number of changed areas   */
+    int32_t       i;                      /* index over changed areas  */
+
+    n = room_take_damage(game_info.where, rects);
+    if (0 > n) {
+        (void)draw_rect(0, 0, SCROLL_X_DIM, SCROLL_Y_DIM);
+        return;
+    }
+
+    /* draw_rect clips each area to the view window(skipping it if off screen). */
+    for (i = 0; n > i; i++) {
+        (void)draw_rect(rects[i].x - (int32_t)game_info.map_x,
+                        rects[i].y - (int32_t)game_info.map_y,
+                        rects[i].w, rects[i].h);
+    }
+}
+
+
 /*
  * redraw_room
- *   DESCRIPTION: Draw all lines on the screen.
+ *   DESCRIPTION: Draw the whole screen.
  *   INPUTS: none
  *   OUTPUTS: none
  *   RETURN VALUE: none
- *   SIDE EFFECTS: Draws the entire screen(but not the status bar).
+ *   SIDE EFFECTS: Draws the entire screen(but not the status bar);
+ *                 forgets the changed areas of the room.
  */
 static void redraw_room() {
-    int32_t i; /* index over rows */
+    room_damage_t rects[MAX_ROOM_DAMAGE]; /* changed areas(ignored) */
 
-    /* Draw all lines in the scroll region. */
-    for (i = 0; i < SCROLL_Y_DIM; i++) {
-        (void)draw_horiz_line(i);
-    }
+    /* Everything is drawn, so earlier changes need no more attention. */
+    (void)room_take_damage(game_info.where, rects);
+
+    /* Draw the whole scroll region at once. */
+    (void)draw_rect(0, 0, SCROLL_X_DIM, SCROLL_Y_DIM);
 }
 
 
@@ -718,20 +814,25 @@ static void* status_thread(void* ignore) {
  */
 static void* tux_thread(void* ignore)
 {
-    struct timeval start_time, tick_time;
-
-    struct timeval cur_time; /* current time(during tick)      */
+    ticker_t* ticker;        /* tick every TICK_USEC                   */
     cmd_t cmd;               /* command issued by input control */	
+
+	/* When a recording is replayed, the game loop carries out its Tux commands. */
+	if (replaying())
+		return NULL;
 	
-	/* Record the starting time--assume success. */
-    (void)gettimeofday(&start_time, NULL);
-   
-   /* Calculate the time at which the first event loop tick should occur. */
-    tick_time = start_time;
-    if ((tick_time.tv_usec += TICK_USEC) > 1000000) {
-        tick_time.tv_sec++;
-        tick_time.tv_usec -= 1000000;
+	/*
+	 * The Tux buttons are read by ioctl, and the line discipline offers
+	 * no poll, so the buttons are sampled once per tick.
+	 */
+    if (NULL == (ticker = ticker_create(TICK_USEC))) {
+        /* Panic!(should never happen) */
+        clear_mode_X();
+        shutdown_input();
+        perror("ticker_create");
+        exit(3);
     }
+    PROF_THREAD("tux");
 	    
 	while(1){
 
@@ -748,8 +849,11 @@ static void* tux_thread(void* ignore)
          * Note that typed commands that move objects may cause the room
          * to be redrawn.
          */
+		PROF_BEGIN(PROF_COMMAND);
 		(void)pthread_mutex_lock (&cmd_lock);
-        cmd = get_tux_command();
+		PROF_BEGIN(PROF_TUX);
+        cmd = script_command(SCRIPT_TUX, get_tux_command());
+		PROF_END(PROF_TUX);
         switch (cmd) {
             case CMD_UP:    move_photo_down();  break;
             case CMD_RIGHT: move_photo_left();  break;
@@ -768,6 +872,7 @@ static void* tux_thread(void* ignore)
             default: break;
         }
 		(void)pthread_mutex_unlock (&cmd_lock);
+		PROF_END(PROF_COMMAND);
         /* If player wins the game, their room becomes NULL. */
         if (NULL == game_info.where) {
             game = GAME_WON;
@@ -775,56 +880,23 @@ static void* tux_thread(void* ignore)
 	
 	
 	 /*
-         * Wait for tick.  The tick defines the basic timing of our
-         * event loop, and is the minimum amount of time between events.
-         */
-        do {
-            if (gettimeofday(&cur_time, NULL) != 0) {
-                /* Panic!(should never happen) */
-                clear_mode_X();
-                shutdown_input();
-                perror("gettimeofday");
-                exit(3);
-            }
-        } while (!time_is_after(&cur_time, &tick_time));
-
-        /*
-         * Advance the tick time.  If we missed one or more ticks completely,
-         * i.e., if the current time is already after the time for the next
-         * tick, just skip the extra ticks and advance the clock to the one
-         * that we haven't missed.
+         * Wait for the next tick.  Missed ticks are skipped by the ticker.
          */
-        do {
-            if ((tick_time.tv_usec += TICK_USEC) > 1000000) {
-                tick_time.tv_sec++;
-                tick_time.tv_usec -= 1000000;
-            }
-        } while (time_is_after(&cur_time, &tick_time));
+        PROF_BEGIN(PROF_WAIT);
+        if (0 > ticker_wait(ticker)) {
+            /* Panic!(should never happen) */
+            clear_mode_X();
+            shutdown_input();
+            perror("ticker_wait");
+            exit(3);
+        }
+        PROF_END(PROF_WAIT);
 	}	
 	return NULL;
 	
 }
 
 
-/*
- * time_is_after
- *   DESCRIPTION: Check whether one time is at or after a second time.
- *   INPUTS: t1 -- the first time
- *           t2 -- the second time
- *   OUTPUTS: none
- *   RETURN VALUE: 1 if t1 >= t2
- *                 0 if t1 < t2
- *   SIDE EFFECTS: none
- */
-static int time_is_after(struct timeval* t1, struct timeval* t2) {
-    if (t1->tv_sec == t2->tv_sec)
-        return (t1->tv_usec >= t2->tv_usec);
-    if (t1->tv_sec > t2->tv_sec)
-        return 1;
-    return 0;
-}
-
-
 /*
  * show_status(interface function; declared in world.h)
  *   DESCRIPTION: Show a specific status message of up to STATUS_MSG_LEN
@@ -856,18 +928,50 @@ void show_status(const char* s) {
 /*
  * main
  *   DESCRIPTION: Play the adventure game.
- *   INPUTS: none(command line arguments are ignored)
+ *   INPUTS: none(command line arguments are ignored; the QUANTIZER
+ *           environment variable can name the palette quantizer used for
+ *           room photos, in which case palettized(.pphoto) photos are
+ *           ignored, so that every photo is quantized with it, and
+ *           DRAW_WORKERS the number of threads redrawing the room, from
+ *           1 to 4; without QUANTIZER, a .pphoto file no older than its
+ *           photo supplies the photo's palette and pixels)
  *   OUTPUTS: none
  *   RETURN VALUE: 0 on success, 3 in panic situations
  */
 int main() {
 	//game_condition_t game;  /* outcome of playing */
-    /* Randomize for more fun(remove for deterministic layout). */
-    srand(time(NULL));
+    struct timeval play_start, play_end; /* time spent in game_loop */
+    ticker_t* ticker;                    /* game loop tick             */
+    tick_stats_t ticks;                  /* game loop tick statistics  */
+    unsigned int seed;                   /* seed for srand             */
+    const char* replay = getenv("REPLAY"); /* recording to replay      */
+    const char* record = getenv("RECORD"); /* file to record input in  */
+    const char* workers = getenv("DRAW_WORKERS"); /* redraw threads    */
 
     /* Provide some protection against fatal errors. */
     clean_on_signals();
 
+    /*
+     * Randomize for more fun(remove for deterministic layout), taking the
+     * seed from the recording to be replayed, if any, or recording it.
+     */
+    seed = time(NULL);
+    if (NULL != replay) {
+        if (0 != start_replay(replay, NULL != getenv("REPLAY_REALTIME"), &seed)) {
+            PANIC("cannot replay recording");
+        }
+    } else if (NULL != record && 0 != start_recording(record, seed)) {
+        PANIC("cannot record input");
+    }
+    push_cleanup((cleanup_fn_t)stop_script, NULL);
+    srand(seed);
+
+    /* Profile ticks(if built with PROFILE), dumping on SIGUSR1 and exit. */
+    PROF_INIT();
+    PROF_THREAD("game loop");
+
+    if (!select_quantizer(getenv("QUANTIZER"))) { PANIC("unknown quantizer"); }
+    set_pphoto_use(NULL == getenv("QUANTIZER"));
     if (!build_world()) { PANIC("can't build world"); }
     init_game();
 
@@ -890,23 +994,52 @@ int main() {
 
 
     /* Start mode X. */
-    if (0 != set_mode_X(fill_horiz_buffer, fill_vert_buffer)) {
+    if (0 != set_mode_X(fill_horiz_buffer, fill_vert_buffer, fill_rect_buffer)) {
         PANIC("cannot initialize mode X");
     }
     push_cleanup((cleanup_fn_t)clear_mode_X, NULL);
 
-    /* Initialize the keyboard and/or Tux controller. */
-    if (0 != init_input()) {
-        PANIC("cannot initialize input");
+    /* Redraw rooms in bands on several threads if asked(see modex.h). */
+    if (NULL != workers &&
+        0 != set_draw_workers(atoi(workers), fill_rect_band)) {
+        PANIC("cannot start drawing threads");
     }
-    push_cleanup((cleanup_fn_t)shutdown_input, NULL);
 
-    game = game_loop();
+    /*
+     * Initialize the keyboard and/or Tux controller(unless replaying, so
+     * that replays need no terminal).
+     */
+    if (!replaying()) {
+        if (0 != init_input()) {
+            PANIC("cannot initialize input");
+        }
+        push_cleanup((cleanup_fn_t)shutdown_input, NULL);
+    }
+
+    /*
+     * Tick the game loop, waking it early for keyboard input.  The Tux
+     * controller cannot be polled, so it is sampled on each tick.
+     */
+    if (NULL == (ticker = ticker_create(TICK_USEC)) ||
+        (!replaying() && 0 != ticker_watch(ticker, fileno(stdin), 0))) {
+        PANIC("cannot create game loop ticker");
+    }
+    push_cleanup((cleanup_fn_t)ticker_destroy, ticker);
+
+    (void)gettimeofday(&play_start, NULL);
+    game = game_loop(ticker);
+    (void)gettimeofday(&play_end, NULL);
+
+    get_ticker_stats(ticker, &ticks);
 
     pop_cleanup(1);
+    if (!replaying())
+        pop_cleanup(1);
     pop_cleanup(1);
     pop_cleanup(1);
 	pop_cleanup(1);
+	pop_cleanup(1);
+    PROF_DUMP();
 
     /* Print a message about the outcome. */
     switch (game) {
@@ -914,6 +1047,73 @@ int main() {
         case GAME_QUIT: printf("Quitter!\n"); break;
     }
 
+#if (REPORT_RESIDENCY != 0)
+    {
+        res_stats_t stats; /* room photo residency statistics */
+
+        get_residency_stats(&stats);
+        fprintf(stderr, "Room photos: %u hits, %u misses, %u prefetched, %u evicted; "
+                "%zu bytes resident(peak %zu, budget %zu).\n",
+                stats.hits, stats.misses, stats.prefetches, stats.evictions,
+                stats.resident_bytes, stats.peak_bytes, stats.budget);
+    }
+#endif /* REPORT_RESIDENCY */
+
+#if (REPORT_SCREENS != 0)
+    {
+        modex_stats_t stats; /* screen update statistics   */
+        entry_stats_t entry; /* entry frame statistics     */
+        double        secs;  /* seconds spent in game_loop */
+
+        get_modex_stats(&stats);
+        secs = (play_end.tv_sec - play_start.tv_sec) +
+               (play_end.tv_usec - play_start.tv_usec) / 1e6;
+        if (secs <= 0)
+            secs = 1;
+        fprintf(stderr, "Screens: %lu presented, %lu skipped(unchanged); "
+                "%.0f bytes copied per second.\n",
+                stats.frames_shown, stats.frames_skipped, stats.bytes_shown / secs);
+        get_entry_frame_stats(&entry);
+        fprintf(stderr, "Entry frames: %u rendered(%u after room changes); "
+                "%u rooms entered from a frame, %u without.\n",
+                entry.rendered, entry.stale, entry.shown, entry.missed);
+    }
+#endif /* REPORT_SCREENS */
+
+#if (REPORT_TICKS != 0)
+    {
+        int bin; /* index over jitter bins */
+
+        fprintf(stderr, "Ticks: %llu(%llu missed), %llu input wakeups; "
+                "worst lateness %u us.\n    lateness(us):",
+                (unsigned long long)ticks.ticks, (unsigned long long)ticks.missed,
+                (unsigned long long)ticks.input_wakes, ticks.worst_usec);
+        for (bin = 0; TICK_JITTER_BINS - 1 > bin; bin++) {
+            fprintf(stderr, " <%u:%llu", TICK_JITTER_BOUND(bin),
+                    (unsigned long long)ticks.jitter[bin]);
+        }
+        fprintf(stderr, " more:%llu\n", (unsigned long long)ticks.jitter[bin]);
+    }
+#endif /* REPORT_TICKS */
+
+    if (replaying()) {
+        replay_stats_t stats; /* replay statistics          */
+        modex_stats_t  shown; /* screen update statistics   */
+        double         secs;  /* seconds spent in game_loop */
+
+        get_replay_stats(&stats);
+        get_modex_stats(&shown);
+        secs = (play_end.tv_sec - play_start.tv_sec) +
+               (play_end.tv_usec - play_start.tv_usec) / 1e6;
+        if (secs <= 0)
+            secs = 1e-6;
+        fprintf(stderr, "Replay: %llu steps in %.1f ms(%.0f steps, %.0f screens per second); "
+                "%u commands, %.1f us mean and %.1f us worst to the next screen.\n",
+                (unsigned long long)stats.steps, secs * 1e3, stats.steps / secs,
+                shown.frames_shown / secs, stats.commands,
+                0 < stats.shown ? stats.latency_usec / stats.shown : 0.0, stats.worst_usec);
+    }
+
     /* Return success. */
     return 0;
 }
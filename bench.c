@@ -0,0 +1,1912 @@
+/* tab:4
+ *
+ * bench.c - microbenchmarks for the adventure game
+ *
+ * Permission to use, copy, modify, and distribute this software and its
+ * documentation for any purpose, without fee, and without written agreement is
+ * hereby granted, provided that the above copyright notice and the following
+ * two paragraphs appear in all copies of this software.
+ *
+ * IN NO EVENT SHALL THE AUTHOR OR THE UNIVERSITY OF ILLINOIS BE LIABLE TO
+ * ANY PARTY FOR DIRECT, INDIRECT, SPECIAL, INCIDENTAL, OR CONSEQUENTIAL
+ * DAMAGES ARISING OUT  OF THE USE OF THIS SOFTWARE AND ITS DOCUMENTATION,
+ * EVEN IF THE AUTHOR AND/OR THE UNIVERSITY OF ILLINOIS HAS BEEN ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THE AUTHOR AND THE UNIVERSITY OF ILLINOIS SPECIFICALLY DISCLAIM ANY
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  THE SOFTWARE
+ * PROVIDED HEREUNDER IS ON AN "AS IS" BASIS, AND NEITHER THE AUTHOR NOR
+ * THE UNIVERSITY OF ILLINOIS HAS ANY OBLIGATION TO PROVIDE MAINTENANCE,
+ * SUPPORT, UPDATES, ENHANCEMENTS, OR MODIFICATIONS."
+ *
+ * Filename:      bench.c
+ *
+ * Run from the directory holding images/ (as for the game itself):
+ *
+ *     ./bench [passes [frame.ppm [results.json]]]
+ *
+ * The mode X code is linked for an emulated VGA(MODEX_HEADLESS), so the
+ * screens drawn can be timed without a VGA; given a file name(other than
+ * "-"), the first screen shown is also written to it as a PPM image.  The
+ * suite of microbenchmarks run last(see bench_suite) times single calls
+ * and reports their median and 99th percentile; given a third file name,
+ * its results are also written there as JSON, for comparing builds.
+ */
+
+
+#include <glob.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "modex.h"
+#include "photo.h"
+#include "photo_headers.h"
+#include "prof.h"
+#include "quantize.h"
+#include "text.h"
+#include "tick.h"
+#include "world.h"
+
+
+/* parameters defined for this file */
+#define BENCH_PASSES 20    /* default number of passes over the corpus */
+#define SCENE_DIM    1024  /* size of the scene scrolled by bench_ring */
+#define BENCH_TICK   2000  /* tick length for bench_ticks(microseconds) */
+#define SUITE_ROOMS  4     /* rooms visited by bench_suite               */
+#define SUITE_STEP   2     /* pixels scrolled per step(as in the game)   */
+
+
+/* types local to this file */
+
+/* samples of one microbenchmark in bench_suite */
+typedef struct sample_set_t sample_set_t;
+struct sample_set_t {
+    double* ns;      /* time taken by each sample(nanoseconds) */
+    int32_t n;       /* number of samples                      */
+    int32_t max;     /* room for samples                       */
+    double  bytes;   /* bytes handled by all samples           */
+    double  pixels;  /* pixels handled by all samples          */
+};
+
+
+/* file-scope variables */
+
+/* photo drawn by the mode X callbacks during bench_present */
+static const photo_t* present_photo = NULL;
+
+
+/* local functions--see function headers for details */
+static int32_t bench_decoders(const char* pattern, const char* label,
+                              uint32_t pixel_size, int32_t passes);
+static int32_t bench_present(const char* pattern, int32_t passes,
+                             const char* ppm);
+#if (PROFILE != 0)
+static int32_t bench_profile(int32_t passes);
+#endif
+static int32_t bench_quant_kernels(const char* pattern, int32_t passes);
+static int32_t bench_quantizers(const char* pattern, int32_t passes);
+static int32_t bench_ring(int32_t passes);
+static int32_t bench_scatter(int32_t passes);
+static int32_t bench_scroll(const char* pattern, int32_t passes);
+static int32_t bench_sprites(const char* pattern, int32_t passes);
+static int32_t bench_status(int32_t passes);
+static int32_t bench_suite(int32_t passes, const char* json_name);
+static int32_t bench_ticks(int32_t passes);
+static int compare_double(const void* a, const void* b);
+static double cpu_msec(void);
+static void* input_writer(void* arg);
+static void print_jitter(const char* label, const uint64_t* jitter,
+                         uint32_t worst, double cpu_pct);
+static double scroll_lines(const photo_t* p, int32_t vert, double* n_lines);
+static uint8_t* bulk_read_pixels(const char* fname, uint32_t pixel_size,
+                                 photo_header_t* hdr);
+static double elapsed_msec(const struct timespec* start);
+static void present_horiz_line(int x, int y, unsigned char buf[SCROLL_X_DIM]);
+static void present_rect(int x, int y, int w, int h, unsigned char buf[][SCROLL_X_DIM]);
+static void present_vert_line(int x, int y, unsigned char buf[SCROLL_Y_DIM]);
+static unsigned char scene_pixel(int x, int y);
+static void scene_horiz_line(int x, int y, unsigned char buf[SCROLL_X_DIM]);
+static void scene_rect(int x, int y, int w, int h, unsigned char buf[][SCROLL_X_DIM]);
+static void scene_vert_line(int x, int y, unsigned char buf[SCROLL_Y_DIM]);
+static uint8_t* ref_read_pixels(const char* fname, uint32_t pixel_size,
+                                photo_header_t* hdr);
+static int32_t sample_add(sample_set_t* set, const struct timespec* start,
+                          double bytes, double pixels);
+static void sample_report(const char* name, sample_set_t* set, FILE* json);
+static int32_t suite_room(room_t* r, int32_t passes, sample_set_t set[]);
+static void ref_sprite_line(const uint8_t* pixels, const photo_header_t* hdr,
+                            int32_t vert, int off, int k, unsigned char* buf);
+static double sprite_lines(const image_t* im, const uint8_t* pixels,
+                           const photo_header_t* hdr, int32_t vert, int32_t ref,
+                           int32_t passes, unsigned char* buf);
+
+
+/*
+ * bench_decoders
+ *   DESCRIPTION: Time the per-pixel reference decoder against the bulk
+ *                decoder in photo.c on every file matching a pattern, and
+ *                check that both produce the same pixels.
+ *   INPUTS: pattern -- glob pattern for the files
+ *           label -- name for the files in the report
+ *           pixel_size -- bytes per pixel in the files
+ *           passes -- number of times to decode each file
+ *   OUTPUTS: none
+ *   RETURN VALUE: 1 on success, or 0 on failure
+ *   SIDE EFFECTS: prints a report to stdout and errors to stderr
+ */
+static int32_t bench_decoders(const char* pattern, const char* label,
+                              uint32_t pixel_size, int32_t passes) {
+    glob_t          files;      /* files to decode                  */
+    size_t          idx;        /* index over files                 */
+    int32_t         pass;       /* index over passes                */
+    photo_header_t  ref_hdr;    /* header from reference decoder    */
+    photo_header_t  bulk_hdr;   /* header from bulk decoder         */
+    uint8_t*        ref_pix;    /* pixels from reference decoder    */
+    uint8_t*        bulk_pix;   /* pixels from bulk decoder         */
+    double          bytes = 0;  /* pixel bytes decoded per pass     */
+    double          ref_msec;   /* time taken by reference decoder  */
+    double          bulk_msec;  /* time taken by bulk decoder       */
+    struct timespec start;      /* start time of a measurement      */
+
+    if (0 != glob(pattern, 0, NULL, &files)) {
+        fprintf(stderr, "No files match %s.\n", pattern);
+        return 0;
+    }
+
+    /* Check that both decoders agree before timing anything. */
+    for (idx = 0; files.gl_pathc > idx; idx++) {
+        ref_pix = ref_read_pixels(files.gl_pathv[idx], pixel_size, &ref_hdr);
+        bulk_pix = bulk_read_pixels(files.gl_pathv[idx], pixel_size, &bulk_hdr);
+        if (NULL == ref_pix || NULL == bulk_pix ||
+            ref_hdr.width != bulk_hdr.width || ref_hdr.height != bulk_hdr.height ||
+            0 != memcmp(ref_pix, bulk_pix, (size_t)ref_hdr.width * ref_hdr.height * pixel_size)) {
+            fprintf(stderr, "Decoders disagree on %s.\n", files.gl_pathv[idx]);
+            free(ref_pix);
+            free(bulk_pix);
+            globfree(&files);
+            return 0;
+        }
+        bytes += (double)ref_hdr.width * ref_hdr.height * pixel_size;
+        free(ref_pix);
+        free(bulk_pix);
+    }
+
+    (void)clock_gettime(CLOCK_MONOTONIC, &start);
+    for (pass = 0; passes > pass; pass++) {
+        for (idx = 0; files.gl_pathc > idx; idx++) {
+            free(ref_read_pixels(files.gl_pathv[idx], pixel_size, &ref_hdr));
+        }
+    }
+    ref_msec = elapsed_msec(&start);
+
+    (void)clock_gettime(CLOCK_MONOTONIC, &start);
+    for (pass = 0; passes > pass; pass++) {
+        for (idx = 0; files.gl_pathc > idx; idx++) {
+            free(bulk_read_pixels(files.gl_pathv[idx], pixel_size, &bulk_hdr));
+        }
+    }
+    bulk_msec = elapsed_msec(&start);
+
+    printf("%s: %zu files, %.2f MB of pixels, %d passes\n",
+           label, files.gl_pathc, bytes / 1048576, passes);
+    printf("    per-pixel fread %9.2f ms/pass %9.1f MB/s\n",
+           ref_msec / passes, bytes * passes / 1048576 / (ref_msec / 1000));
+    printf("    bulk            %9.2f ms/pass %9.1f MB/s   %.1fx\n",
+           bulk_msec / passes, bytes * passes / 1048576 / (bulk_msec / 1000),
+           ref_msec / bulk_msec);
+
+    globfree(&files);
+    return 1;
+}
+
+
+/*
+ * bench_present
+ *   DESCRIPTION: Time drawing screens of every photo matching a pattern
+ *                into the mode X build buffer and showing them on the
+ *                emulated VGA: whole screens(draw_rect, as on entering a
+ *                room), screens scrolled one pixel right at a time(one
+ *                draw_vert_line each), screens with nothing new(as on
+ *                idle ticks) and screens with a small object redrawn(a
+ *                32x32 draw_rect).  show_screen copies only the rows that
+ *                changed, plane by plane, so report the bytes copied too.
+ *   INPUTS: pattern -- glob pattern for the photos
+ *           passes -- number of whole screens drawn for each photo
+ *           ppm -- file for the first screen shown, or NULL
+ *   OUTPUTS: none
+ *   RETURN VALUE: 1 on success, or 0 on failure
+ *   SIDE EFFECTS: prints a report to stdout and errors to stderr; may
+ *                 write the file
+ */
+static int32_t bench_present(const char* pattern, int32_t passes,
+                             const char* ppm) {
+    glob_t          files;        /* photos to draw                     */
+    size_t          idx;          /* index over photos                  */
+    photo_t*        p;            /* a photo                            */
+    int32_t         pass;         /* index over passes                  */
+    static const char* const kind[4] = {"whole", "scrolled", "idle", "object"};
+    int             x;            /* view window position               */
+    int             k;            /* index over kinds of frame          */
+    double          msec[4];      /* time for frames of each kind       */
+    double          n_frames[4];  /* frames of each kind                */
+    double          bytes[4];     /* bytes shown for each kind          */
+    modex_stats_t   before;       /* counts before a measurement        */
+    modex_stats_t   after;        /* counts after a measurement         */
+    struct timespec start;        /* start of measurement               */
+    int32_t         ok = 1;       /* success of the benchmark           */
+
+    if (0 != glob(pattern, 0, NULL, &files)) {
+        fprintf(stderr, "No files match %s.\n", pattern);
+        return 0;
+    }
+    if (0 != set_mode_X(present_horiz_line, present_vert_line, present_rect)) {
+        fprintf(stderr, "Cannot set up mode X.\n");
+        globfree(&files);
+        return 0;
+    }
+
+    (void)memset(msec, 0, sizeof (msec));
+    (void)memset(n_frames, 0, sizeof (n_frames));
+    (void)memset(bytes, 0, sizeof (bytes));
+    for (idx = 0; ok && files.gl_pathc > idx; idx++) {
+        if (NULL == (p = read_photo(files.gl_pathv[idx]))) {
+            fprintf(stderr, "Cannot read %s.\n", files.gl_pathv[idx]);
+            ok = 0;
+            break;
+        }
+        present_photo = p;
+        fill_palette(photo_palette(p));
+        set_view_window(0, 0);
+        show_status_bar(" ", 3);
+        show_status_bar(files.gl_pathv[idx], 1);
+
+        get_modex_stats(&before);
+        (void)clock_gettime(CLOCK_MONOTONIC, &start);
+        for (pass = 0; passes > pass; pass++) {
+            (void)draw_rect(0, 0, SCROLL_X_DIM, SCROLL_Y_DIM);
+            show_screen();
+        }
+        msec[0] += elapsed_msec(&start);
+        n_frames[0] += passes;
+        get_modex_stats(&after);
+        bytes[0] += after.bytes_shown - before.bytes_shown;
+        if (0 == idx && NULL != ppm && 0 != dump_frame_ppm(ppm)) {
+            ok = 0;
+        }
+
+        get_modex_stats(&before);
+        (void)clock_gettime(CLOCK_MONOTONIC, &start);
+        for (x = 1; (int)photo_width(p) - SCROLL_X_DIM >= x; x++) {
+            set_view_window(x, 0);
+            (void)draw_vert_line(SCROLL_X_DIM - 1);
+            show_screen();
+            n_frames[1]++;
+        }
+        msec[1] += elapsed_msec(&start);
+        get_modex_stats(&after);
+        bytes[1] += after.bytes_shown - before.bytes_shown;
+
+        get_modex_stats(&before);
+        (void)clock_gettime(CLOCK_MONOTONIC, &start);
+        for (pass = 0; passes > pass; pass++) {
+            show_screen();
+        }
+        msec[2] += elapsed_msec(&start);
+        n_frames[2] += passes;
+        get_modex_stats(&after);
+        bytes[2] += after.bytes_shown - before.bytes_shown;
+
+        get_modex_stats(&before);
+        (void)clock_gettime(CLOCK_MONOTONIC, &start);
+        for (pass = 0; passes > pass; pass++) {
+            (void)draw_rect(8 * (pass & 15), 64, 32, 32);
+            show_screen();
+        }
+        msec[3] += elapsed_msec(&start);
+        n_frames[3] += passes;
+        get_modex_stats(&after);
+        bytes[3] += after.bytes_shown - before.bytes_shown;
+
+        present_photo = NULL;
+        free_photo(p);
+    }
+    clear_mode_X();
+
+    if (ok) {
+        printf("screens: %zu photos on an emulated VGA(ns per frame shown)\n",
+               files.gl_pathc);
+        for (k = 0; 4 > k; k++) {
+            if (0 < n_frames[k]) {
+                printf("    %-9s %10.1f ns   %8.1f B shown\n", kind[k],
+                       msec[k] * 1e6 / n_frames[k], bytes[k] / n_frames[k]);
+            }
+        }
+        printf("    video memory written %.1f MB/s(whole screens)\n",
+               bytes[0] / (msec[0] * 1e3));
+    }
+    globfree(&files);
+    return ok;
+}
+
+
+#if (PROFILE != 0)
+/*
+ * bench_profile
+ *   DESCRIPTION: Time marking the start and end of a phase(see prof.h).
+ *                The rest of the benchmarks are profiled too, and the
+ *                profile is dumped when they finish.
+ *   INPUTS: passes -- number of hundreds of thousands of phases marked
+ *   OUTPUTS: none
+ *   RETURN VALUE: 1
+ *   SIDE EFFECTS: prints a report to stdout; adds to the profile
+ */
+static int32_t bench_profile(int32_t passes) {
+    int32_t         pass;         /* index over phases marked */
+    struct timespec start;        /* start of measurement     */
+
+    (void)clock_gettime(CLOCK_MONOTONIC, &start);
+    for (pass = 0; 100000 * passes > pass; pass++) {
+        PROF_BEGIN(PROF_COMMAND);
+        PROF_END(PROF_COMMAND);
+    }
+    printf("profiler: %.1f ns per phase marked\n",
+           elapsed_msec(&start) * 1e6 / (100000.0 * passes));
+    return 1;
+}
+#endif /* PROFILE */
+
+
+/*
+ * bench_quant_kernels
+ *   DESCRIPTION: Time the octree quantizer with each index kernel that the
+ *                CPU supports on every room photo matching a pattern, and
+ *                check that every kernel gives the same result as the
+ *                plain C one.
+ *   INPUTS: pattern -- glob pattern for the photos
+ *           passes -- number of times to quantize each photo
+ *   OUTPUTS: none
+ *   RETURN VALUE: 1 on success, or 0 on failure
+ *   SIDE EFFECTS: prints a report to stdout and errors to stderr; leaves
+ *                 the default quantizer and kernel selected
+ */
+static int32_t bench_quant_kernels(const char* pattern, int32_t passes) {
+    glob_t          files;        /* photos to quantize              */
+    size_t          idx;          /* index over photos               */
+    int32_t         k_idx;        /* index over kernels              */
+    const char*     kernel;       /* name of one kernel              */
+    int32_t         pass;         /* index over passes               */
+    photo_header_t  hdr;          /* header of a photo               */
+    uint16_t*       pixels;       /* 5:6:5 pixels of a photo         */
+    uint32_t        n_pixels;     /* pixels in a photo               */
+    uint8_t*        ref_img;      /* photo from the plain C kernel   */
+    uint8_t*        img;          /* photo from the kernel timed     */
+    uint8_t         ref_palette[QUANT_N_COLORS][3]; /* its palette   */
+    uint8_t         palette[QUANT_N_COLORS][3];     /* its palette   */
+    double          msec;         /* time taken by one kernel        */
+    int32_t         ok = 1;       /* success of the benchmark        */
+    struct timespec start;        /* start time of a measurement     */
+
+    if (0 != glob(pattern, 0, NULL, &files)) {
+        fprintf(stderr, "No files match %s.\n", pattern);
+        return 0;
+    }
+    (void)select_quantizer("octree");
+
+    printf("octree index kernels: %zu photos, %d passes(ms per photo)\n",
+           files.gl_pathc, passes);
+    for (k_idx = 0; ok && NULL != (kernel = quant_kernel_by_index(k_idx)); k_idx++) {
+        if (!select_quant_kernel(kernel)) {
+            printf("    %-8s not supported by this CPU\n", kernel);
+            continue;
+        }
+        msec = 0;
+        for (idx = 0; ok && files.gl_pathc > idx; idx++) {
+            if (NULL == (pixels = read_photo_pixels(files.gl_pathv[idx], &hdr))) {
+                fprintf(stderr, "Cannot read %s.\n", files.gl_pathv[idx]);
+                ok = 0;
+                break;
+            }
+            n_pixels = (uint32_t)hdr.width * hdr.height;
+            ref_img = malloc(0 < n_pixels ? n_pixels : 1);
+            img = malloc(0 < n_pixels ? n_pixels : 1);
+            if (NULL == ref_img || NULL == img) {
+                ok = 0;
+            } else {
+                (void)clock_gettime(CLOCK_MONOTONIC, &start);
+                for (pass = 0; passes > pass; pass++) {
+                    quantize_photo(pixels, n_pixels, palette, img);
+                }
+                msec += elapsed_msec(&start) / passes;
+
+                (void)select_quant_kernel("scalar");
+                quantize_photo(pixels, n_pixels, ref_palette, ref_img);
+                (void)select_quant_kernel(kernel);
+                if (0 != memcmp(palette, ref_palette, sizeof (palette)) ||
+                    0 != memcmp(img, ref_img, n_pixels)) {
+                    fprintf(stderr, "Kernel %s disagrees on %s.\n", kernel,
+                            files.gl_pathv[idx]);
+                    ok = 0;
+                }
+            }
+            free(img);
+            free(ref_img);
+            free(pixels);
+        }
+        if (ok && 0 < files.gl_pathc) {
+            printf("    %-8s %8.3f ms\n", kernel, msec / files.gl_pathc);
+        }
+    }
+
+    (void)select_quant_kernel(NULL);
+    (void)select_quantizer(NULL);
+    globfree(&files);
+    return ok;
+}
+
+
+/*
+ * bench_quantizers
+ *   DESCRIPTION: Time each palette quantizer on every room photo matching
+ *                a pattern and measure its quality as the mean squared
+ *                error between the 5:6:5 source pixels and the palette
+ *                colors chosen for them(6:6:6 RGB, summed over channels).
+ *   INPUTS: pattern -- glob pattern for the photos
+ *           passes -- number of times to quantize each photo
+ *   OUTPUTS: none
+ *   RETURN VALUE: 1 on success, or 0 on failure
+ *   SIDE EFFECTS: prints a report to stdout and errors to stderr
+ */
+static int32_t bench_quantizers(const char* pattern, int32_t passes) {
+    glob_t             files;       /* photos to quantize             */
+    size_t             idx;         /* index over photos              */
+    int32_t            q_idx;       /* index over quantizers          */
+    const quantizer_t* q;           /* one quantizer                  */
+    int32_t            pass;        /* index over passes              */
+    photo_header_t     hdr;         /* header of a photo              */
+    uint16_t*          pixels;      /* 5:6:5 pixels of a photo        */
+    uint8_t*           img;         /* VGA colors chosen for pixels   */
+    uint8_t            palette[QUANT_N_COLORS][3]; /* chosen palette  */
+    uint32_t           n_pixels;    /* pixels in a photo              */
+    uint32_t           i;           /* index over pixels              */
+    const uint8_t*     c;           /* palette color of one pixel     */
+    int32_t            dr, dg, db;  /* error in one pixel             */
+    double             err;         /* squared error over a photo     */
+    double             msec;        /* time taken on a photo          */
+    double             total_msec;  /* time taken on all photos       */
+    double             total_mse;   /* sum of MSE over all photos     */
+    struct timespec    start;       /* start time of a measurement    */
+
+    if (0 != glob(pattern, 0, NULL, &files)) {
+        fprintf(stderr, "No files match %s.\n", pattern);
+        return 0;
+    }
+
+    printf("quantizers: %zu photos, %d passes(ms per photo, MSE in 6-bit RGB)\n",
+           files.gl_pathc, passes);
+    for (q_idx = 0; NULL != (q = quantizer_by_index(q_idx)); q_idx++) {
+        printf("  %s: %s\n", q->name, q->description);
+        total_msec = total_mse = 0;
+        for (idx = 0; files.gl_pathc > idx; idx++) {
+            if (NULL == (pixels = read_photo_pixels(files.gl_pathv[idx], &hdr))) {
+                fprintf(stderr, "Cannot read %s.\n", files.gl_pathv[idx]);
+                globfree(&files);
+                return 0;
+            }
+            n_pixels = (uint32_t)hdr.width * hdr.height;
+            if (NULL == (img = malloc(0 < n_pixels ? n_pixels : 1))) {
+                free(pixels);
+                globfree(&files);
+                return 0;
+            }
+
+            (void)clock_gettime(CLOCK_MONOTONIC, &start);
+            for (pass = 0; passes > pass; pass++) {
+                q->quantize(pixels, n_pixels, palette, img);
+            }
+            msec = elapsed_msec(&start) / passes;
+
+            for (i = 0, err = 0; n_pixels > i; i++) {
+                c = palette[img[i] - QUANT_FIRST_COLOR];
+                dr = c[0] - (((pixels[i] >> 11) & 0x1F) << 1);
+                dg = c[1] - ((pixels[i] >> 5) & 0x3F);
+                db = c[2] - ((pixels[i] & 0x1F) << 1);
+                err += dr * dr + dg * dg + db * db;
+            }
+            err = (0 < n_pixels ? err / n_pixels : 0);
+
+            printf("    %-28s %8.2f ms %8.2f MSE\n", files.gl_pathv[idx], msec, err);
+            total_msec += msec;
+            total_mse += err;
+            free(img);
+            free(pixels);
+        }
+        if (0 < files.gl_pathc) {
+            printf("    %-28s %8.2f ms %8.2f MSE\n", "(average)",
+                   total_msec / files.gl_pathc, total_mse / files.gl_pathc);
+        }
+    }
+
+    globfree(&files);
+    return 1;
+}
+
+
+/*
+ * bench_ring
+ *   DESCRIPTION: Time long scrolls one pixel per frame around the edges of
+ *                a SCENE_DIM x SCENE_DIM scene(a pattern rather than a
+ *                photo, since no room photo is that large) with the build
+ *                buffer addressed as a ring and as a window that
+ *                set_view_window moves, drawing only the exposed lines and
+ *                showing each frame on the emulated VGA.  Report the time
+ *                and bytes copied per frame for each.
+ *   INPUTS: passes -- number of laps around the scene
+ *   OUTPUTS: none
+ *   RETURN VALUE: 1 on success, or 0 on failure
+ *   SIDE EFFECTS: prints a report to stdout and errors to stderr; leaves
+ *                 the build buffer addressed as a ring
+ */
+static int32_t bench_ring(int32_t passes) {
+    static const char* const layout[2] = {"window", "ring"};
+    static const int step[4][2] = {{1, 0}, {0, 1}, {-1, 0}, {0, -1}};
+    int             ring;         /* 1 for a ring, 0 for a window       */
+    int32_t         pass;         /* index over laps                    */
+    int             leg;          /* index over edges of the scene      */
+    int             x, y;         /* view window position               */
+    int             n;            /* frames left on an edge             */
+    double          n_frames;     /* frames shown                       */
+    double          msec;         /* time taken                         */
+    double          frame_msec;   /* time taken by one frame            */
+    double          worst;        /* longest time taken by a frame      */
+    modex_stats_t   before;       /* counts before the laps             */
+    modex_stats_t   after;        /* counts after the laps              */
+    struct timespec start;        /* start of measurement               */
+
+    if (0 != set_mode_X(scene_horiz_line, scene_vert_line, scene_rect)) {
+        fprintf(stderr, "Cannot set up mode X.\n");
+        return 0;
+    }
+
+    printf("long scrolls: %d laps around a %dx%d scene(per frame shown)\n",
+           passes, SCENE_DIM, SCENE_DIM);
+    for (ring = 0; 2 > ring; ring++) {
+        set_ring_build(ring);
+        (void)draw_rect(0, 0, SCROLL_X_DIM, SCROLL_Y_DIM);
+        show_screen();
+        x = y = 0;
+        n_frames = msec = worst = 0;
+        get_modex_stats(&before);
+
+        for (pass = 0; passes > pass; pass++) {
+            for (leg = 0; 4 > leg; leg++) {
+                n = (0 != step[leg][0] ? SCENE_DIM - SCROLL_X_DIM : SCENE_DIM - SCROLL_Y_DIM);
+                for (; 0 < n; n--) {
+                    x += step[leg][0];
+                    y += step[leg][1];
+                    (void)clock_gettime(CLOCK_MONOTONIC, &start);
+                    set_view_window(x, y);
+                    if (0 < step[leg][0]) {
+                        (void)draw_vert_line(SCROLL_X_DIM - 1);
+                    } else if (0 > step[leg][0]) {
+                        (void)draw_vert_line(0);
+                    } else if (0 < step[leg][1]) {
+                        (void)draw_horiz_line(SCROLL_Y_DIM - 1);
+                    } else {
+                        (void)draw_horiz_line(0);
+                    }
+                    show_screen();
+                    frame_msec = elapsed_msec(&start);
+                    msec += frame_msec;
+                    if (worst < frame_msec) {
+                        worst = frame_msec;
+                    }
+                    n_frames++;
+                }
+            }
+        }
+        get_modex_stats(&after);
+        printf("    %-6s %7.1f ns(worst %6.1f us)   moved %8.1f B   shown %8.1f B in %.2f copies\n",
+               layout[ring], msec * 1e6 / n_frames, worst * 1e3,
+               (after.bytes_moved - before.bytes_moved) / n_frames,
+               (after.bytes_shown - before.bytes_shown) / n_frames,
+               (after.copies_shown - before.copies_shown) / n_frames);
+    }
+    clear_mode_X();
+    return 1;
+}
+
+
+/*
+ * bench_scatter
+ *   DESCRIPTION: Time scattering lines of pixels into the four planes of
+ *                the mode X build buffer(scatter_planes, as used by
+ *                draw_horiz_line and draw_rect) with each kernel that the
+ *                CPU supports, at each of the four starting columns mod 4,
+ *                and check that every kernel gives the same planes as the
+ *                plain C one.
+ *   INPUTS: passes -- number of thousands of lines scattered by each kernel
+ *                     at each phase
+ *   OUTPUTS: none
+ *   RETURN VALUE: 1 on success, or 0 on failure
+ *   SIDE EFFECTS: prints a report to stdout and errors to stderr; leaves
+ *                 the default kernel selected
+ */
+static int32_t bench_scatter(int32_t passes) {
+    static unsigned char src[SCROLL_X_DIM];           /* line to scatter      */
+    static unsigned char ref[4][SCROLL_X_WIDTH + 1];  /* planes from scalar   */
+    static unsigned char out[4][SCROLL_X_WIDTH + 1];  /* planes from a kernel */
+    unsigned char*  ref_plane[4]; /* planes for the plain C kernel   */
+    unsigned char*  plane[4];     /* planes for the kernel timed     */
+    int32_t         k_idx;        /* index over kernels              */
+    const char*     kernel;       /* name of one kernel              */
+    int             phase;        /* first column of the line mod 4  */
+    int             i;            /* index over pixels/planes        */
+    int32_t         pass;         /* index over lines scattered      */
+    double          msec[4];      /* time taken at each phase        */
+    int32_t         ok = 1;       /* success of the benchmark        */
+    struct timespec start;        /* start time of a measurement     */
+
+    for (i = 0; SCROLL_X_DIM > i; i++) {
+        src[i] = (unsigned char)(i * 37 + 11);
+    }
+    for (i = 0; 4 > i; i++) {
+        ref_plane[i] = ref[i];
+        plane[i] = out[i];
+    }
+
+    printf("plane scatter kernels: %d-pixel lines(ns per line at phase 0-3)\n",
+           SCROLL_X_DIM);
+    for (k_idx = 0; ok && NULL != (kernel = scatter_kernel_by_index(k_idx)); k_idx++) {
+        if (!select_scatter_kernel(kernel)) {
+            printf("    %-8s not supported by this CPU\n", kernel);
+            continue;
+        }
+        for (phase = 0; ok && 4 > phase; phase++) {
+            /* Leave out the last pixel so that the end of the line moves too. */
+            (void)clock_gettime(CLOCK_MONOTONIC, &start);
+            for (pass = 0; 1000 * passes > pass; pass++) {
+                scatter_planes(src, SCROLL_X_DIM - (pass & 1), phase, plane);
+            }
+            msec[phase] = elapsed_msec(&start);
+
+            (void)memset(ref, 0, sizeof (ref));
+            (void)memset(out, 0, sizeof (out));
+            (void)select_scatter_kernel("scalar");
+            scatter_planes(src, SCROLL_X_DIM - 1, phase, ref_plane);
+            (void)select_scatter_kernel(kernel);
+            scatter_planes(src, SCROLL_X_DIM - 1, phase, plane);
+            if (0 != memcmp(out, ref, sizeof (out))) {
+                fprintf(stderr, "Kernel %s disagrees at phase %d.\n", kernel, phase);
+                ok = 0;
+            }
+        }
+        if (ok) {
+            printf("    %-8s", kernel);
+            for (phase = 0; 4 > phase; phase++) {
+                printf(" %8.1f ns", msec[phase] * 1e3 / passes);
+            }
+            printf("\n");
+        }
+    }
+
+    (void)select_scatter_kernel(NULL);
+    return ok;
+}
+
+
+/*
+ * bench_scroll
+ *   DESCRIPTION: Time drawing the lines of room photo exposed by scrolling
+ *                for every photo matching a pattern, with photos stored by
+ *                row and in tiles, and check that both layouts draw the
+ *                same lines.  Scrolling horizontally draws vertical lines,
+ *                and scrolling vertically draws horizontal ones.
+ *   INPUTS: pattern -- glob pattern for the photos
+ *           passes -- number of times to scroll across each photo
+ *   OUTPUTS: none
+ *   RETURN VALUE: 1 on success, or 0 on failure
+ *   SIDE EFFECTS: prints a report to stdout and errors to stderr; leaves
+ *                 photos stored by row
+ */
+static int32_t bench_scroll(const char* pattern, int32_t passes) {
+    static const char* const layout[2] = {"by row", "tiled"};
+    glob_t          files;       /* photos to draw                       */
+    size_t          idx;         /* index over photos                    */
+    photo_t*        p[2];        /* photo in each layout                 */
+    int32_t         tiled;       /* index over layouts                   */
+    int32_t         vert;        /* 1 for vertical lines, 0 horizontal   */
+    int32_t         pass;        /* index over passes                    */
+    int             x, y;        /* line position                        */
+    unsigned char   hbuf[2][SCROLL_X_DIM]; /* a horizontal line, each    */
+    unsigned char   vbuf[2][SCROLL_Y_DIM]; /* a vertical line, each      */
+    double          msec[2][2];  /* time by layout and line direction    */
+    double          n_lines[2];  /* lines drawn by direction, per pass   */
+    int32_t         ok = 1;      /* success of the benchmark             */
+
+    if (0 != glob(pattern, 0, NULL, &files)) {
+        fprintf(stderr, "No files match %s.\n", pattern);
+        return 0;
+    }
+
+    (void)memset(msec, 0, sizeof (msec));
+    for (idx = 0; ok && files.gl_pathc > idx; idx++) {
+        for (tiled = 0; 2 > tiled; tiled++) {
+            set_photo_tiling(tiled);
+            p[tiled] = read_photo(files.gl_pathv[idx]);
+        }
+        if (NULL == p[0] || NULL == p[1]) {
+            fprintf(stderr, "Cannot read %s.\n", files.gl_pathv[idx]);
+            ok = 0;
+        }
+
+        /* Both layouts must draw every line the same way. */
+        for (y = -1; ok && (int)photo_height(p[0]) > y; y += 3) {
+            for (x = -SCROLL_X_DIM / 2; ok && (int)photo_width(p[0]) > x; x += 3) {
+                if (0 <= y) {
+                    photo_horiz_line(p[0], x, y, hbuf[0]);
+                    photo_horiz_line(p[1], x, y, hbuf[1]);
+                    ok = (0 == memcmp(hbuf[0], hbuf[1], SCROLL_X_DIM));
+                }
+                if (ok && 0 <= x) {
+                    photo_vert_line(p[0], x, y, vbuf[0]);
+                    photo_vert_line(p[1], x, y, vbuf[1]);
+                    ok = (0 == memcmp(vbuf[0], vbuf[1], SCROLL_Y_DIM));
+                }
+                if (!ok) {
+                    fprintf(stderr, "Layouts disagree on %s at(%d,%d).\n",
+                            files.gl_pathv[idx], x, y);
+                }
+            }
+        }
+
+        for (tiled = 0; ok && 2 > tiled; tiled++) {
+            for (vert = 0; 2 > vert; vert++) {
+                for (pass = 0; passes > pass; pass++) {
+                    msec[tiled][vert] += scroll_lines(p[tiled], vert, &n_lines[vert]);
+                }
+            }
+        }
+        free_photo(p[0]);
+        free_photo(p[1]);
+    }
+    set_photo_tiling(0);
+
+    if (ok) {
+        printf("scrolling: %zu photos, %d passes(ns per line drawn)\n",
+               files.gl_pathc, passes);
+        for (tiled = 0; 2 > tiled; tiled++) {
+            printf("    %-8s horizontal %8.1f ns   vertical %8.1f ns\n",
+                   layout[tiled],
+                   msec[tiled][1] * 1e6 / (n_lines[1] * passes * files.gl_pathc),
+                   msec[tiled][0] * 1e6 / (n_lines[0] * passes * files.gl_pathc));
+        }
+    }
+    globfree(&files);
+    return ok;
+}
+
+
+/*
+ * bench_sprites
+ *   DESCRIPTION: Time drawing object images onto lines, pixel by pixel
+ *                as the game used to and with the opaque run tables built
+ *                by read_obj_image, for every object image matching a
+ *                pattern, and check that both draw the same lines.  Also
+ *                report the memory taken by the run tables.
+ *   INPUTS: pattern -- glob pattern for the object images
+ *           passes -- number of times to draw each line
+ *   OUTPUTS: none
+ *   RETURN VALUE: 1 on success, or 0 on failure
+ *   SIDE EFFECTS: prints a report to stdout and errors to stderr
+ */
+static int32_t bench_sprites(const char* pattern, int32_t passes) {
+    static const char* const dir[2] = {"horizontal", "vertical"};
+    glob_t          files;        /* images to draw                     */
+    size_t          idx;          /* index over images                  */
+    image_t*        im;           /* an image, with its run tables      */
+    photo_header_t  hdr;          /* header of the image                */
+    uint8_t*        pixels;       /* pixels of the image                */
+    int32_t         vert;         /* 1 for vertical lines, 0 horizontal */
+    int32_t         ref;          /* 1 for per-pixel drawing, 0 runs    */
+    unsigned char   buf[2][SCROLL_X_DIM > SCROLL_Y_DIM ? SCROLL_X_DIM : SCROLL_Y_DIM];
+    double          msec[2][2];   /* time by direction and method       */
+    double          n_lines[2];   /* lines drawn by direction, per pass */
+    double          pixel_bytes = 0; /* bytes of image pixels           */
+    double          span_bytes = 0;  /* bytes of run tables             */
+    int32_t         ok = 1;       /* success of the benchmark           */
+
+    if (0 != glob(pattern, 0, NULL, &files)) {
+        fprintf(stderr, "No files match %s.\n", pattern);
+        return 0;
+    }
+
+    (void)memset(msec, 0, sizeof (msec));
+    (void)memset(n_lines, 0, sizeof (n_lines));
+    for (idx = 0; ok && files.gl_pathc > idx; idx++) {
+        im = read_obj_image(files.gl_pathv[idx]);
+        pixels = read_obj_pixels(files.gl_pathv[idx], &hdr);
+        if (NULL == im || NULL == pixels) {
+            fprintf(stderr, "Cannot read %s.\n", files.gl_pathv[idx]);
+            free(pixels);
+            ok = 0;
+            break;
+        }
+        pixel_bytes += (double)hdr.width * hdr.height;
+        span_bytes += image_span_bytes(im);
+
+        for (vert = 0; ok && 2 > vert; vert++) {
+            /* The final buffers of both methods must match. */
+            (void)sprite_lines(im, pixels, &hdr, vert, 1, 1, buf[1]);
+            (void)sprite_lines(im, pixels, &hdr, vert, 0, 1, buf[0]);
+            if (0 != memcmp(buf[0], buf[1], sizeof (buf[0]))) {
+                fprintf(stderr, "Run tables disagree on %s.\n", files.gl_pathv[idx]);
+                ok = 0;
+            }
+            for (ref = 0; ok && 2 > ref; ref++) {
+                msec[vert][ref] += sprite_lines(im, pixels, &hdr, vert, ref, passes, buf[ref]);
+            }
+            n_lines[vert] += 3.0 * (vert ? hdr.width : hdr.height);
+        }
+        free(pixels);
+        /* Object images are never freed by the game(see photo.h). */
+    }
+
+    if (ok) {
+        printf("sprites: %zu images, %d passes(ns per line drawn)\n",
+               files.gl_pathc, passes);
+        printf("    run tables %.1f kB for %.1f kB of pixels(%.1f%%)\n",
+               span_bytes / 1024, pixel_bytes / 1024,
+               0 < pixel_bytes ? 100 * span_bytes / pixel_bytes : 0);
+        for (vert = 0; 2 > vert; vert++) {
+            printf("    %-10s per pixel %8.1f ns   runs %8.1f ns   %.1fx\n", dir[vert],
+                   msec[vert][1] * 1e6 / (n_lines[vert] * passes),
+                   msec[vert][0] * 1e6 / (n_lines[vert] * passes),
+                   msec[vert][1] / msec[vert][0]);
+        }
+    }
+    globfree(&files);
+    return ok;
+}
+
+
+/*
+ * bench_status
+ *   DESCRIPTION: Time the status bar work done on each game tick: drawing
+ *                the whole bar and copying it to the emulated VGA every
+ *                tick(as the game used to) against update_status_bar when
+ *                nothing changed, when one character is typed, and when a
+ *                message comes and goes.
+ *   INPUTS: passes -- number of thousands of ticks timed for each case
+ *   OUTPUTS: none
+ *   RETURN VALUE: 1 on success, or 0 on failure
+ *   SIDE EFFECTS: prints a report to stdout and errors to stderr
+ */
+static int32_t bench_status(int32_t passes) {
+    static const char* const typed[2] = {"go nort", "go north"};
+    static const char* const msg[2] = {"", "You cannot go that way."};
+    static const char* const kind[4] = {
+        "every tick", "unchanged", "typing", "message"
+    };
+    const char*     room = "ECEB second floor";  /* room name shown */
+    int32_t         pass;         /* index over ticks                   */
+    int             k;            /* index over cases                   */
+    double          msec[4];      /* time for each case                 */
+    struct timespec start;        /* start of measurement               */
+
+    if (0 != set_mode_X(present_horiz_line, present_vert_line, present_rect)) {
+        fprintf(stderr, "Cannot set up mode X.\n");
+        return 0;
+    }
+
+    for (k = 0; 4 > k; k++) {
+        (void)clock_gettime(CLOCK_MONOTONIC, &start);
+        for (pass = 0; 1000 * passes > pass; pass++) {
+            if (0 == k) {
+                show_status_bar(" ", 3);
+                show_status_bar(room, 1);
+                show_status_bar(typed[pass & 1], 2);
+            } else {
+                update_status_bar(room, typed[1 < k ? pass & 1 : 0],
+                                  msg[3 == k ? pass & 1 : 0]);
+            }
+        }
+        msec[k] = elapsed_msec(&start);
+    }
+    clear_mode_X();
+
+    printf("status bar: ns per tick\n");
+    for (k = 0; 4 > k; k++) {
+        printf("    %-10s %8.1f ns\n", kind[k], msec[k] * 1e3 / passes);
+    }
+    return 1;
+}
+
+
+/*
+ * bench_suite
+ *   DESCRIPTION: Time single calls of the asset and rendering paths of the
+ *                game, as the game makes them: reading room photos and
+ *                object images, filling lines of rooms, drawing lines into
+ *                the build buffer, scrolling, drawing status bar text, and
+ *                redrawing whole rooms(see suite_room), and entering rooms
+ *                with the room drawn by 1, 2 and 4 threads or copied from
+ *                an entry frame rendered beforehand(timing the rendering
+ *                too; see prerender_near_room).  Report the median
+ *                and 99th percentile time per call and the bytes and pixels
+ *                handled per second, to stdout and optionally as JSON.
+ *   INPUTS: passes -- number of times to repeat each sequence of calls
+ *           json_name -- file for JSON results, or NULL for none
+ *   OUTPUTS: none
+ *   RETURN VALUE: 1 on success, or 0 on failure
+ *   SIDE EFFECTS: builds the game world(so the game's object images stay
+ *                 in memory); prints a report to stdout and errors to
+ *                 stderr; writes the JSON file
+ */
+static int32_t bench_suite(int32_t passes, const char* json_name) {
+    static const char* const name[] = {
+        "read_photo", "read_obj_image", "fill_horiz_buffer",
+        "fill_vert_buffer", "draw_horiz_line", "draw_vert_line",
+        "set_view_window scroll", "convert_text_graph", "room redraw",
+        "room entry(1 worker)", "room entry(2 workers)", "room entry(4 workers)",
+        "entry frame render", "room entry(frame)"
+    };
+    static const char* const text[4] = {
+        "You cannot go that way.", "ECEB second floor", "go north", " "
+    };
+    sample_set_t    set[sizeof (name) / sizeof (name[0])]; /* by benchmark */
+    const int32_t   n_sets = sizeof (name) / sizeof (name[0]);
+    glob_t          files;        /* room photos or object images       */
+    size_t          idx;          /* index over files                   */
+    struct stat     st;           /* size of a file                     */
+    photo_t*        p;            /* a room photo                       */
+    image_t*        im;           /* an object image                    */
+    room_t*         r;            /* a room visited                     */
+    room_t*         visited[SUITE_ROOMS]; /* rooms visited              */
+    int32_t         n_rooms;      /* rooms visited                      */
+    int32_t         i;            /* index over rooms visited           */
+    int32_t         pass;         /* index over passes                  */
+    int32_t         k;            /* index over benchmarks or strings   */
+    int32_t         ok = 1;       /* success of the benchmark           */
+    FILE*           json = NULL;  /* JSON results                       */
+    struct timespec start;        /* start of a sample                  */
+
+    (void)memset(set, 0, sizeof (set));
+
+    /* Read every room photo and object image. */
+    for (k = 0; ok && 2 > k; k++) {
+        if (0 != glob(0 == k ? "images/*.photo" : "images/*.obj", 0, NULL, &files)) {
+            fprintf(stderr, "No files match images/%s.\n", 0 == k ? "*.photo" : "*.obj");
+            return 0;
+        }
+        for (pass = 0; ok && passes > pass; pass++) {
+            for (idx = 0; ok && files.gl_pathc > idx; idx++) {
+                if (0 != stat(files.gl_pathv[idx], &st)) {
+                    ok = 0;
+                    break;
+                }
+                (void)clock_gettime(CLOCK_MONOTONIC, &start);
+                if (0 == k) {
+                    if (NULL != (p = read_photo(files.gl_pathv[idx]))) {
+                        ok = sample_add(&set[0], &start, st.st_size,
+                                        (double)photo_width(p) * photo_height(p));
+                        free_photo(p);
+                    }
+                } else {
+                    /* Object images are never freed by the game(see photo.h). */
+                    if (NULL != (im = read_obj_image(files.gl_pathv[idx]))) {
+                        ok = sample_add(&set[1], &start, st.st_size,
+                                        (double)image_width(im) * image_height(im));
+                    }
+                }
+                if ((0 == k && NULL == p) || (1 == k && NULL == im)) {
+                    fprintf(stderr, "Cannot read %s.\n", files.gl_pathv[idx]);
+                    ok = 0;
+                }
+            }
+        }
+        globfree(&files);
+    }
+
+    /* Visit rooms to the right of the starting room, as the player could. */
+    if (ok && !build_world()) {
+        fprintf(stderr, "Cannot build the game world.\n");
+        ok = 0;
+    }
+    if (ok && 0 != set_mode_X(fill_horiz_buffer, fill_vert_buffer, fill_rect_buffer)) {
+        fprintf(stderr, "Cannot set up mode X.\n");
+        ok = 0;
+    }
+    for (r = start_in_room(), n_rooms = 0; ok && SUITE_ROOMS > n_rooms; n_rooms++) {
+        visited[n_rooms] = r;
+        ok = suite_room(r, passes, set);
+        if (TC_CHANGE_ROOM != try_to_move_right(&r)) {
+            n_rooms++;
+            break;
+        }
+    }
+
+    /*
+     * Enter each room visited as the game does(preparing the room, then
+     * redrawing and showing the whole screen), with the room drawn by 1, 2
+     * and 4 threads(see set_draw_workers).
+     */
+    for (k = 0; ok && 3 > k; k++) {
+        if (0 != set_draw_workers(1 << k, fill_rect_band)) {
+            fprintf(stderr, "Cannot start %d drawing threads.\n", 1 << k);
+            ok = 0;
+        }
+        for (pass = 0; ok && 10 * passes > pass; pass++) {
+            for (i = 0; ok && n_rooms > i; i++) {
+                (void)clock_gettime(CLOCK_MONOTONIC, &start);
+                prep_room(visited[i]);
+                set_view_window(0, 0);
+                (void)draw_rect(0, 0, SCROLL_X_DIM, SCROLL_Y_DIM);
+                show_screen();
+                ok = sample_add(&set[9 + k], &start, SCROLL_X_DIM * SCROLL_Y_DIM,
+                                SCROLL_X_DIM * SCROLL_Y_DIM);
+            }
+        }
+    }
+    if (ok && 0 != set_draw_workers(1, NULL)) {
+        ok = 0;
+    }
+
+    /*
+     * Enter each room visited after the first from the frame rendered
+     * while in the room before it(to whose right it lies).  Frames are
+     * rendered again once their slots have gone to other rooms.
+     */
+    for (pass = 0; ok && 10 * passes > pass; pass++) {
+        for (i = 1; ok && n_rooms > i; i++) {
+            do {
+                (void)clock_gettime(CLOCK_MONOTONIC, &start);
+                k = prerender_near_room(visited[i - 1]);
+                if (k) {
+                    ok = sample_add(&set[12], &start, FRAME_SIZE,
+                                    SCROLL_X_DIM * SCROLL_Y_DIM);
+                }
+            } while (ok && k);
+            (void)clock_gettime(CLOCK_MONOTONIC, &start);
+            set_view_window(0, 0);
+            if (!show_entry_frame(visited[i])) {
+                fprintf(stderr, "No entry frame for %s.\n", room_name(visited[i]));
+                ok = 0;
+                break;
+            }
+            show_screen();
+            ok = sample_add(&set[13], &start, FRAME_SIZE, SCROLL_X_DIM * SCROLL_Y_DIM);
+        }
+    }
+
+    /* Draw status bar text. */
+    for (pass = 0; ok && 100 * passes > pass; pass++) {
+        for (k = 0; ok && 4 > k; k++) {
+            (void)clock_gettime(CLOCK_MONOTONIC, &start);
+            convert_text_graph(text[k], k);
+            ok = sample_add(&set[7], &start, STATUS_BAR_SIZE,
+                            3 == k ? STATUS_BAR_SIZE : strlen(text[k]) * 8 * FONT_HEIGHT);
+        }
+    }
+    clear_mode_X();
+
+    if (ok && NULL != json_name && NULL == (json = fopen(json_name, "w"))) {
+        perror(json_name);
+        ok = 0;
+    }
+    if (ok) {
+        printf("suite: %d rooms, %d passes(per call)\n", n_rooms, passes);
+        if (NULL != json) {
+            fprintf(json, "{\"passes\": %d, \"rooms\": %d, \"benchmarks\": [", passes, n_rooms);
+        }
+        for (k = 0; n_sets > k; k++) {
+            if (NULL != json && 0 < k) {
+                fprintf(json, ",");
+            }
+            sample_report(name[k], &set[k], json);
+        }
+        if (NULL != json) {
+            fprintf(json, "\n]}\n");
+            if (0 != fclose(json)) {
+                perror(json_name);
+                ok = 0;
+            }
+        }
+    }
+    for (k = 0; n_sets > k; k++) {
+        free(set[k].ns);
+    }
+    return ok;
+}
+
+
+/*
+ * bench_ticks
+ *   DESCRIPTION: Run a tick loop with a ticker and by spinning on
+ *                gettimeofday(as the game used to), reporting how late
+ *                each woke for its ticks and the processor time used,
+ *                and time how soon input on a watched socket wakes a
+ *                ticker.
+ *   INPUTS: passes -- number of tens of ticks and of input wakeups
+ *   OUTPUTS: none
+ *   RETURN VALUE: 1 on success, or 0 on failure
+ *   SIDE EFFECTS: prints a report to stdout and errors to stderr
+ */
+static int32_t bench_ticks(int32_t passes) {
+    int32_t         n = 10 * passes; /* ticks and wakeups to time         */
+    ticker_t*       t;            /* ticker under test                    */
+    tick_stats_t    stats;        /* ticker statistics                    */
+    uint64_t        spin_jitter[TICK_JITTER_BINS]; /* spinning lateness   */
+    uint32_t        spin_worst;   /* worst spinning lateness              */
+    struct timeval  cur;          /* current time(spinning)               */
+    struct timeval  next;         /* time of the next tick(spinning)      */
+    long            late;         /* lateness in microseconds(spinning)   */
+    int32_t         tick;         /* index over ticks                     */
+    int             bin;          /* index over jitter bins               */
+    char            bound[16];    /* heading for a jitter bin             */
+    int             sock_fd[2];   /* input socket pair for wakeups        */
+    pthread_t       writer;       /* thread writing to the pipe           */
+    struct timespec sent;         /* time input was written               */
+    double          wake;         /* one wakeup latency(microseconds)     */
+    double          wake_sum = 0; /* sum of wakeup latencies              */
+    double          wake_worst = 0; /* worst wakeup latency               */
+    double          cpu;          /* processor time at start              */
+    double          wall;         /* elapsed time                         */
+    struct timespec start;        /* start of measurement                 */
+
+    /* Tick with the ticker. */
+    if (NULL == (t = ticker_create(BENCH_TICK))) {
+        perror("ticker_create");
+        return 0;
+    }
+    cpu = cpu_msec();
+    (void)clock_gettime(CLOCK_MONOTONIC, &start);
+    while (n > ticker_count(t)) {
+        if (0 > ticker_wait(t)) {
+            perror("ticker_wait");
+            ticker_destroy(t);
+            return 0;
+        }
+    }
+    wall = elapsed_msec(&start);
+    get_ticker_stats(t, &stats);
+    ticker_destroy(t);
+    printf("ticks: %d of %d us(count by lateness in us)\n    %-9s", n, BENCH_TICK, "");
+    for (bin = 0; TICK_JITTER_BINS - 1 > bin; bin++) {
+        (void)snprintf(bound, sizeof (bound), "<%u", TICK_JITTER_BOUND(bin));
+        printf(" %7s", bound);
+    }
+    printf("    more  worst us   cpu\n");
+    print_jitter("ticker", stats.jitter, stats.worst_usec,
+                 100 * (cpu_msec() - cpu) / wall);
+
+    /* Tick by spinning on the clock, skipping missed ticks. */
+    (void)memset(spin_jitter, 0, sizeof (spin_jitter));
+    spin_worst = 0;
+    cpu = cpu_msec();
+    (void)clock_gettime(CLOCK_MONOTONIC, &start);
+    (void)gettimeofday(&next, NULL);
+    for (tick = 0; n > tick; tick++) {
+        if (1000000 <= (next.tv_usec += BENCH_TICK)) {
+            next.tv_sec++;
+            next.tv_usec -= 1000000;
+        }
+        do {
+            (void)gettimeofday(&cur, NULL);
+            late = (cur.tv_sec - next.tv_sec) * 1000000L + cur.tv_usec - next.tv_usec;
+        } while (0 > late);
+        for (bin = 0; TICK_JITTER_BINS - 1 > bin && TICK_JITTER_BOUND(bin) <= late; bin++) {
+        }
+        spin_jitter[bin]++;
+        if (spin_worst < late) {
+            spin_worst = late;
+        }
+        while (BENCH_TICK <= late) {
+            if (1000000 <= (next.tv_usec += BENCH_TICK)) {
+                next.tv_sec++;
+                next.tv_usec -= 1000000;
+            }
+            late -= BENCH_TICK;
+            tick++;
+        }
+    }
+    wall = elapsed_msec(&start);
+    print_jitter("spinning", spin_jitter, spin_worst, 100 * (cpu_msec() - cpu) / wall);
+
+    /* Time input wakeups, with ticks too far apart to interfere. */
+    if (0 != socketpair(AF_UNIX, SOCK_STREAM, 0, sock_fd)) {
+        perror("socketpair");
+        return 0;
+    }
+    if (NULL == (t = ticker_create(1000000)) || 0 != ticker_watch(t, sock_fd[0], 0) ||
+        0 != pthread_create(&writer, NULL, input_writer, &sock_fd[1])) {
+        perror("ticker");
+        ticker_destroy(t);
+        (void)close(sock_fd[0]);
+        (void)close(sock_fd[1]);
+        return 0;
+    }
+    for (tick = 0; n > tick; ) {
+        if (0 > ticker_wait(t)) {
+            perror("ticker_wait");
+            break;
+        }
+        while (sizeof (sent) == read(sock_fd[0], &sent, sizeof (sent))) {
+            wake = elapsed_msec(&sent) * 1000;
+            wake_sum += wake;
+            if (wake_worst < wake) {
+                wake_worst = wake;
+            }
+            if (n == ++tick) {
+                break;
+            }
+        }
+    }
+    (void)close(sock_fd[0]);
+    (void)pthread_join(writer, NULL);
+    ticker_destroy(t);
+    printf("    input wakeup %.1f us mean, %.1f us worst(ticks %d us apart)\n",
+           wake_sum / (0 < tick ? tick : 1), wake_worst, 1000000);
+    return (n == tick);
+}
+
+
+/*
+ * bulk_read_pixels
+ *   DESCRIPTION: Decode a room photo or object image file with the bulk
+ *                decoder used by the game.
+ *   INPUTS: fname -- file name for input
+ *           pixel_size -- bytes per pixel in the file(2 for photos, 1
+ *                         for objects)
+ *   OUTPUTS: hdr -- header of the file
+ *   RETURN VALUE: pointer to newly allocated pixel data(top row first)
+ *                 on success, or NULL on failure
+ *   SIDE EFFECTS: dynamically allocates memory for the pixels
+ */
+static uint8_t* bulk_read_pixels(const char* fname, uint32_t pixel_size,
+                                 photo_header_t* hdr) {
+    if (sizeof (uint16_t) == pixel_size) {
+        return (uint8_t*)read_photo_pixels(fname, hdr);
+    }
+    return read_obj_pixels(fname, hdr);
+}
+
+
+/*
+ * compare_double
+ *   DESCRIPTION: Order two doubles(for qsort).
+ *   INPUTS: a, b -- pointers to the doubles
+ *   OUTPUTS: none
+ *   RETURN VALUE: negative, zero, or positive as *a is less than, equal
+ *                 to, or greater than *b
+ *   SIDE EFFECTS: none
+ */
+static int compare_double(const void* a, const void* b) {
+    double x = *(const double*)a; /* first double  */
+    double y = *(const double*)b; /* second double */
+
+    return (x > y) - (x < y);
+}
+
+
+/*
+ * cpu_msec
+ *   DESCRIPTION: Read the processor time used by the process.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: processor time in milliseconds
+ *   SIDE EFFECTS: none
+ */
+static double cpu_msec() {
+    struct timespec now; /* processor time used */
+
+    (void)clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &now);
+    return now.tv_sec * 1000.0 + now.tv_nsec / 1000000.0;
+}
+
+
+/*
+ * elapsed_msec
+ *   DESCRIPTION: Compute the time elapsed since a given start time.
+ *   INPUTS: start -- start time(from CLOCK_MONOTONIC)
+ *   OUTPUTS: none
+ *   RETURN VALUE: elapsed time in milliseconds
+ *   SIDE EFFECTS: none
+ */
+static double elapsed_msec(const struct timespec* start) {
+    struct timespec now; /* current time */
+
+    (void)clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1000.0 +
+           (now.tv_nsec - start->tv_nsec) / 1000000.0;
+}
+
+
+/*
+ * input_writer
+ *   DESCRIPTION: Thread for bench_ticks: every half millisecond, write
+ *                the current time to a socket pair until its reader
+ *                closes it.
+ *   INPUTS: arg -- pointer to the descriptor for writing to the pipe
+ *   OUTPUTS: none
+ *   RETURN VALUE: NULL
+ *   SIDE EFFECTS: closes the descriptor
+ */
+static void* input_writer(void* arg) {
+    int             wfd = *(int*)arg; /* descriptor for the pipe */
+    struct timespec now;              /* time written            */
+    struct timespec gap = {0, 500000}; /* time between writes    */
+
+    do {
+        (void)nanosleep(&gap, NULL);
+        (void)clock_gettime(CLOCK_MONOTONIC, &now);
+    } while (sizeof (now) == send(wfd, &now, sizeof (now), MSG_NOSIGNAL));
+    (void)close(wfd);
+    return NULL;
+}
+
+
+/*
+ * present_horiz_line
+ *   DESCRIPTION: Mode X callback for bench_present: draw a horizontal line
+ *                of the photo being shown.
+ *   INPUTS:(x,y) -- leftmost pixel of line to be drawn
+ *   OUTPUTS: buf -- buffer holding image data for the line
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void present_horiz_line(int x, int y, unsigned char buf[SCROLL_X_DIM]) {
+    photo_horiz_line(present_photo, x, y, buf);
+}
+
+
+/*
+ * present_rect
+ *   DESCRIPTION: Mode X callback for bench_present: draw a rectangle of
+ *                the photo being shown.
+ *   INPUTS:(x,y) -- upper left pixel of rectangle to be drawn
+ *          w, h -- width and height of rectangle
+ *   OUTPUTS: buf -- buffer holding image data for the rectangle
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void present_rect(int x, int y, int w, int h, unsigned char buf[][SCROLL_X_DIM]) {
+    int i;    /* loop index over rows */
+
+    for (i = 0; h > i; i++) {
+        photo_horiz_line(present_photo, x, y + i, buf[i]);
+    }
+}
+
+
+/*
+ * present_vert_line
+ *   DESCRIPTION: Mode X callback for bench_present: draw a vertical line
+ *                of the photo being shown.
+ *   INPUTS:(x,y) -- top pixel of line to be drawn
+ *   OUTPUTS: buf -- buffer holding image data for the line
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void present_vert_line(int x, int y, unsigned char buf[SCROLL_Y_DIM]) {
+    photo_vert_line(present_photo, x, y, buf);
+}
+
+
+/*
+ * print_jitter
+ *   DESCRIPTION: Print one line of the bench_ticks report.
+ *   INPUTS: label -- name of the tick loop
+ *           jitter -- ticks counted by lateness(TICK_JITTER_BINS bins)
+ *           worst -- largest lateness in microseconds
+ *           cpu_pct -- processor time used, in percent of elapsed time
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: prints to stdout
+ */
+static void print_jitter(const char* label, const uint64_t* jitter,
+                         uint32_t worst, double cpu_pct) {
+    int bin; /* index over jitter bins */
+
+    printf("    %-9s", label);
+    for (bin = 0; TICK_JITTER_BINS > bin; bin++) {
+        printf(" %7llu", (unsigned long long)jitter[bin]);
+    }
+    printf("  %8u  %3.0f%%\n", worst, cpu_pct);
+}
+
+
+/*
+ * ref_read_pixels
+ *   DESCRIPTION: Decode a room photo or object image file one pixel at a
+ *                time with fread, as read_photo and read_obj_image did
+ *                before the bulk decoder.  Used as the baseline.
+ *   INPUTS: fname -- file name for input
+ *           pixel_size -- bytes per pixel in the file
+ *   OUTPUTS: hdr -- header of the file
+ *   RETURN VALUE: pointer to newly allocated pixel data(top row first)
+ *                 on success, or NULL on failure
+ *   SIDE EFFECTS: dynamically allocates memory for the pixels
+ */
+static uint8_t* ref_read_pixels(const char* fname, uint32_t pixel_size,
+                                photo_header_t* hdr) {
+    FILE*    in;           /* input file               */
+    uint8_t* pixels;       /* pixel data, top down     */
+    uint16_t x;            /* index over image columns */
+    uint16_t y;            /* index over image rows    */
+    uint8_t  pixel[2];     /* one pixel from the file  */
+
+    if (NULL == (in = fopen(fname, "r+b"))) {
+        return NULL;
+    }
+    if (1 != fread(hdr, sizeof (*hdr), 1, in) ||
+        NULL == (pixels = malloc((size_t)hdr->width * hdr->height * pixel_size))) {
+        (void)fclose(in);
+        return NULL;
+    }
+    for (y = hdr->height; y-- > 0; ) {
+        for (x = 0; hdr->width > x; x++) {
+            if (1 != fread(pixel, pixel_size, 1, in)) {
+                free(pixels);
+                (void)fclose(in);
+                return NULL;
+            }
+            (void)memcpy(&pixels[((size_t)hdr->width * y + x) * pixel_size], pixel, pixel_size);
+        }
+    }
+    (void)fclose(in);
+    return pixels;
+}
+
+
+/*
+ * ref_sprite_line
+ *   DESCRIPTION: Draw one row or column of an object image onto a line a
+ *                pixel at a time, skipping transparent pixels, as
+ *                fill_horiz_buffer and fill_vert_buffer used to.
+ *   INPUTS: pixels -- pixels of the image
+ *           hdr -- size of the image
+ *           vert -- 1 to draw a column on a vertical line, 0 to draw a
+ *                   row on a horizontal line
+ *           off -- position on the line of the image's first pixel
+ *           k -- row or column of the image to draw
+ *           buf -- line to draw on
+ *   OUTPUTS: buf -- line with the image's opaque pixels drawn
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void ref_sprite_line(const uint8_t* pixels, const photo_header_t* hdr,
+                            int32_t vert, int off, int k, unsigned char* buf) {
+    int     line_len = (vert ? SCROLL_Y_DIM : SCROLL_X_DIM); /* line size  */
+    int     n = (vert ? hdr->height : hdr->width);  /* image pixels on line */
+    int     step = (vert ? hdr->width : 1);         /* between image pixels */
+    int     idx;                                    /* index over line      */
+    int     i;                                      /* index over image     */
+    uint8_t pixel;                                  /* one image pixel      */
+
+    pixels += (vert ? k : k * hdr->width);
+    if (0 <= off) {
+        idx = off;
+        i = 0;
+    } else {
+        idx = 0;
+        i = -off;
+    }
+    for (; line_len > idx && n > i; idx++, i++) {
+        pixel = pixels[i * step];
+        if (OBJ_CLR_TRANSP != pixel) {
+            buf[idx] = pixel;
+        }
+    }
+}
+
+
+/*
+ * scroll_lines
+ *   DESCRIPTION: Draw the lines of a room photo exposed by scrolling all
+ *                the way across it, one screen-sized band of the photo at
+ *                a time.
+ *   INPUTS: p -- the room photo
+ *           vert -- 1 to scroll horizontally(drawing vertical lines), or
+ *                   0 to scroll vertically(drawing horizontal lines)
+ *   OUTPUTS: n_lines -- number of lines drawn
+ *   RETURN VALUE: time taken in milliseconds
+ *   SIDE EFFECTS: none
+ */
+static double scroll_lines(const photo_t* p, int32_t vert, double* n_lines) {
+    unsigned char   hbuf[SCROLL_X_DIM]; /* a horizontal line             */
+    unsigned char   vbuf[SCROLL_Y_DIM]; /* a vertical line               */
+    int             width = photo_width(p);   /* photo width             */
+    int             height = photo_height(p); /* photo height            */
+    int             x, y;                     /* line position           */
+    struct timespec start;                    /* start of measurement    */
+
+    *n_lines = 0;
+    (void)clock_gettime(CLOCK_MONOTONIC, &start);
+    if (vert) {
+        for (y = 0; height > y; y += SCROLL_Y_DIM) {
+            for (x = 0; width > x; x++) {
+                photo_vert_line(p, x, y, vbuf);
+            }
+            *n_lines += width;
+        }
+    } else {
+        for (x = 0; width > x; x += SCROLL_X_DIM) {
+            for (y = 0; height > y; y++) {
+                photo_horiz_line(p, x, y, hbuf);
+            }
+            *n_lines += height;
+        }
+    }
+    return elapsed_msec(&start);
+}
+
+
+/*
+ * suite_room
+ *   DESCRIPTION: Time single calls of the rendering paths of the game in
+ *                a room for bench_suite: filling lines of the room photo
+ *                (with objects), drawing lines into the build buffer,
+ *                scrolling the view window SUITE_STEP pixels at a time
+ *                across the room and back as the game does(moving the
+ *                window, drawing the new lines, and showing the screen),
+ *                and redrawing and showing the whole screen.
+ *   INPUTS: r -- the room
+ *           passes -- number of times to repeat each sequence of calls
+ *           set -- samples by microbenchmark(in the order of names in
+ *                  bench_suite)
+ *   OUTPUTS: set -- with the room's samples added
+ *   RETURN VALUE: 1 on success, or 0 on failure
+ *   SIDE EFFECTS: draws into the emulated VGA
+ */
+static int32_t suite_room(room_t* r, int32_t passes, sample_set_t set[]) {
+    int32_t         w = room_photo_width(r);   /* room photo width      */
+    int32_t         h = room_photo_height(r);  /* room photo height     */
+    int32_t         max_x = (SCROLL_X_DIM < w ? w - SCROLL_X_DIM : 0); /* view */
+    int32_t         max_y = (SCROLL_Y_DIM < h ? h - SCROLL_Y_DIM : 0); /* limits */
+    unsigned char   buf[SCROLL_X_DIM > SCROLL_Y_DIM ? SCROLL_X_DIM : SCROLL_Y_DIM];
+    int32_t         pass;         /* index over passes                  */
+    int32_t         i;            /* index over lines                   */
+    int32_t         leg;          /* index over legs of a scroll        */
+    int32_t         x, y;         /* view window position               */
+    int32_t         dx, dy;       /* motion of the view window          */
+    modex_stats_t   before;       /* screen statistics before a sample  */
+    modex_stats_t   after;        /* screen statistics after a sample   */
+    int32_t         ok = 1;       /* success of the benchmark           */
+    struct timespec start;        /* start of a sample                  */
+
+    prep_room(r);
+    for (pass = 0; ok && passes > pass; pass++) {
+        /* Fill lines across the room photo. */
+        for (i = 0; ok && h > i; i += 4) {
+            (void)clock_gettime(CLOCK_MONOTONIC, &start);
+            fill_horiz_buffer((i * 7) % (max_x + 1), i, buf);
+            ok = sample_add(&set[2], &start, SCROLL_X_DIM, SCROLL_X_DIM);
+        }
+        for (i = 0; ok && w > i; i += 4) {
+            (void)clock_gettime(CLOCK_MONOTONIC, &start);
+            fill_vert_buffer(i, (i * 7) % (max_y + 1), buf);
+            ok = sample_add(&set[3], &start, SCROLL_Y_DIM, SCROLL_Y_DIM);
+        }
+
+        /* Draw every line of the screen. */
+        set_view_window(0, 0);
+        for (i = 0; ok && SCROLL_Y_DIM > i; i++) {
+            (void)clock_gettime(CLOCK_MONOTONIC, &start);
+            (void)draw_horiz_line(i);
+            ok = sample_add(&set[4], &start, SCROLL_X_DIM, SCROLL_X_DIM);
+        }
+        for (i = 0; ok && SCROLL_X_DIM > i; i++) {
+            (void)clock_gettime(CLOCK_MONOTONIC, &start);
+            (void)draw_vert_line(i);
+            ok = sample_add(&set[5], &start, SCROLL_Y_DIM, SCROLL_Y_DIM);
+        }
+
+        /* Scroll right, down, left, and up around the room. */
+        x = y = 0;
+        for (leg = 0; ok && 4 > leg; leg++) {
+            dx = (0 == leg ? SUITE_STEP : (2 == leg ? -SUITE_STEP : 0));
+            dy = (1 == leg ? SUITE_STEP : (3 == leg ? -SUITE_STEP : 0));
+            while (ok && 0 <= x + dx && max_x >= x + dx && 0 <= y + dy && max_y >= y + dy &&
+                   (0 != dx || 0 != dy)) {
+                get_modex_stats(&before);
+                (void)clock_gettime(CLOCK_MONOTONIC, &start);
+                x += dx;
+                y += dy;
+                set_view_window(x, y);
+                for (i = 0; SUITE_STEP > i; i++) {
+                    if (0 < dx) {
+                        (void)draw_vert_line(SCROLL_X_DIM - 1 - i);
+                    } else if (0 > dx) {
+                        (void)draw_vert_line(i);
+                    } else if (0 < dy) {
+                        (void)draw_horiz_line(SCROLL_Y_DIM - 1 - i);
+                    } else {
+                        (void)draw_horiz_line(i);
+                    }
+                }
+                show_screen();
+                get_modex_stats(&after);
+                ok = sample_add(&set[6], &start, after.bytes_shown - before.bytes_shown,
+                                SUITE_STEP * (0 != dx ? SCROLL_Y_DIM : SCROLL_X_DIM));
+            }
+        }
+
+        /* Redraw the whole screen, as on entering the room. */
+        for (i = 0; ok && 10 > i; i++) {
+            get_modex_stats(&before);
+            (void)clock_gettime(CLOCK_MONOTONIC, &start);
+            set_view_window(0, 0);
+            (void)draw_rect(0, 0, SCROLL_X_DIM, SCROLL_Y_DIM);
+            show_screen();
+            get_modex_stats(&after);
+            ok = sample_add(&set[8], &start, after.bytes_shown - before.bytes_shown,
+                            SCROLL_X_DIM * SCROLL_Y_DIM);
+        }
+    }
+    return ok;
+}
+
+
+/*
+ * sprite_lines
+ *   DESCRIPTION: Draw every row(or column) of an object image onto a line
+ *                at three positions: hanging off the start of the line,
+ *                at its start, and hanging off its end.
+ *   INPUTS: im -- the image, with its run tables
+ *           pixels -- pixels of the image
+ *           hdr -- size of the image
+ *           vert -- 1 to draw columns on vertical lines, 0 to draw rows
+ *                   on horizontal lines
+ *           ref -- 1 to draw a pixel at a time(ref_sprite_line), or 0 to
+ *                  draw with the run tables
+ *           passes -- number of times to draw each line
+ *           buf -- line to draw on(at least SCROLL_X_DIM bytes)
+ *   OUTPUTS: buf -- cleared, then drawn on over and over
+ *   RETURN VALUE: time taken in milliseconds
+ *   SIDE EFFECTS: none
+ */
+static double sprite_lines(const image_t* im, const uint8_t* pixels,
+                           const photo_header_t* hdr, int32_t vert, int32_t ref,
+                           int32_t passes, unsigned char* buf) {
+    int             line_len = (vert ? SCROLL_Y_DIM : SCROLL_X_DIM); /* line  */
+    int             n = (vert ? hdr->height : hdr->width); /* pixels on line  */
+    int             n_k = (vert ? hdr->width : hdr->height); /* lines to draw */
+    int             off[3];     /* positions of image on line  */
+    int             o;          /* index over positions        */
+    int             k;          /* index over rows/columns     */
+    int32_t         pass;       /* index over passes           */
+    struct timespec start;      /* start of measurement        */
+
+    off[0] = -n / 2;
+    off[1] = 0;
+    off[2] = line_len - n / 2;
+    (void)memset(buf, 0, SCROLL_X_DIM > SCROLL_Y_DIM ? SCROLL_X_DIM : SCROLL_Y_DIM);
+
+    (void)clock_gettime(CLOCK_MONOTONIC, &start);
+    for (pass = 0; passes > pass; pass++) {
+        for (o = 0; 3 > o; o++) {
+            for (k = 0; n_k > k; k++) {
+                if (ref) {
+                    ref_sprite_line(pixels, hdr, vert, off[o], k, buf);
+                } else if (vert) {
+                    image_vert_line(im, off[o], k, buf);
+                } else {
+                    image_horiz_line(im, off[o], k, buf);
+                }
+            }
+        }
+    }
+    return elapsed_msec(&start);
+}
+
+
+/*
+ * scene_pixel
+ *   DESCRIPTION: Get a pixel of the scene scrolled by bench_ring.
+ *   INPUTS:(x,y) -- the pixel
+ *   OUTPUTS: none
+ *   RETURN VALUE: its color
+ *   SIDE EFFECTS: none
+ */
+static unsigned char scene_pixel(int x, int y) {
+    return (unsigned char)((x >> 3) ^ (y >> 2) ^ (x * y));
+}
+
+
+/*
+ * scene_horiz_line
+ *   DESCRIPTION: Mode X callback for bench_ring: draw a horizontal line
+ *                of the scene.
+ *   INPUTS:(x,y) -- leftmost pixel of line to be drawn
+ *   OUTPUTS: buf -- buffer holding image data for the line
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void scene_horiz_line(int x, int y, unsigned char buf[SCROLL_X_DIM]) {
+    int i;    /* loop index over pixels */
+
+    for (i = 0; SCROLL_X_DIM > i; i++) {
+        buf[i] = scene_pixel(x + i, y);
+    }
+}
+
+
+/*
+ * scene_rect
+ *   DESCRIPTION: Mode X callback for bench_ring: draw a rectangle of the
+ *                scene.
+ *   INPUTS:(x,y) -- upper left pixel of rectangle to be drawn
+ *          w, h -- width and height of rectangle
+ *   OUTPUTS: buf -- buffer holding image data for the rectangle
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void scene_rect(int x, int y, int w, int h, unsigned char buf[][SCROLL_X_DIM]) {
+    int i;    /* loop index over rows   */
+    int j;    /* loop index over pixels */
+
+    for (i = 0; h > i; i++) {
+        for (j = 0; w > j; j++) {
+            buf[i][j] = scene_pixel(x + j, y + i);
+        }
+    }
+}
+
+
+/*
+ * scene_vert_line
+ *   DESCRIPTION: Mode X callback for bench_ring: draw a vertical line of
+ *                the scene.
+ *   INPUTS:(x,y) -- top pixel of line to be drawn
+ *   OUTPUTS: buf -- buffer holding image data for the line
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void scene_vert_line(int x, int y, unsigned char buf[SCROLL_Y_DIM]) {
+    int i;    /* loop index over pixels */
+
+    for (i = 0; SCROLL_Y_DIM > i; i++) {
+        buf[i] = scene_pixel(x, y + i);
+    }
+}
+
+
+/*
+ * sample_add
+ *   DESCRIPTION: Add a sample to a microbenchmark of bench_suite, ending
+ *                it now.
+ *   INPUTS: set -- samples of the microbenchmark
+ *           start -- start time of the sample(from CLOCK_MONOTONIC)
+ *           bytes -- bytes handled by the sample
+ *           pixels -- pixels handled by the sample
+ *   OUTPUTS: set -- with the sample added
+ *   RETURN VALUE: 1 on success, or 0 if out of memory
+ *   SIDE EFFECTS: may reallocate the samples
+ */
+static int32_t sample_add(sample_set_t* set, const struct timespec* start,
+                          double bytes, double pixels) {
+    double  ns = elapsed_msec(start) * 1e6; /* time taken by the sample */
+    double* grown;                           /* reallocated samples      */
+
+    if (set->n == set->max) {
+        set->max = (0 == set->max ? 1024 : 2 * set->max);
+        if (NULL == (grown = realloc(set->ns, set->max * sizeof (*set->ns)))) {
+            fprintf(stderr, "Out of memory for samples.\n");
+            return 0;
+        }
+        set->ns = grown;
+    }
+    set->ns[set->n++] = ns;
+    set->bytes += bytes;
+    set->pixels += pixels;
+    return 1;
+}
+
+
+/*
+ * sample_report
+ *   DESCRIPTION: Report a microbenchmark of bench_suite: the median and
+ *                99th percentile times of its samples, and the bytes and
+ *                pixels handled per second over all samples.
+ *   INPUTS: name -- name of the microbenchmark
+ *           set -- samples of the microbenchmark
+ *           json -- file for JSON results, or NULL for none
+ *   OUTPUTS: set -- samples sorted
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: prints a line to stdout; writes a JSON object to json
+ */
+static void sample_report(const char* name, sample_set_t* set, FILE* json) {
+    double  total = 0; /* total time of all samples(ns) */
+    double  median;    /* median time(ns)               */
+    double  p99;       /* 99th percentile time(ns)      */
+    int32_t i;         /* index over samples            */
+
+    if (0 == set->n) {
+        return;
+    }
+    qsort(set->ns, set->n, sizeof (*set->ns), compare_double);
+    for (i = 0; set->n > i; i++) {
+        total += set->ns[i];
+    }
+    median = set->ns[set->n / 2];
+    p99 = set->ns[(int32_t)(0.99 * (set->n - 1))];
+
+    printf("    %-22s %7d calls  median %10.1f ns  p99 %10.1f ns  %8.1f MB/s  %8.1f Mpixel/s\n",
+           name, set->n, median, p99, set->bytes * 1e3 / total, set->pixels * 1e3 / total);
+    if (NULL != json) {
+        fprintf(json, "\n  {\"name\": \"%s\", \"calls\": %d, \"median_ns\": %.1f, "
+                "\"p99_ns\": %.1f, \"mean_ns\": %.1f, \"bytes_per_sec\": %.0f, "
+                "\"pixels_per_sec\": %.0f}", name, set->n, median, p99,
+                total / set->n, set->bytes * 1e9 / total, set->pixels * 1e9 / total);
+    }
+}
+
+
+/*
+ * show_status
+ *   DESCRIPTION: Stand-in for the game's status message routine, which
+ *                world.c calls but which lives in adventure.c.
+ *   INPUTS: s -- new status message(ignored)
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void show_status(const char* s) {
+}
+
+
+/*
+ * main
+ *   DESCRIPTION: Run the benchmarks.
+ *   INPUTS: argc, argv -- optional number of passes in argv[1], and file
+ *                         for the first screen shown in argv[2]
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, 2 on bad arguments, 3 on failure
+ *   SIDE EFFECTS: prints results to stdout
+ */
+int main(int argc, char** argv) {
+    int32_t     passes = BENCH_PASSES; /* passes over each corpus  */
+    const char* ppm = NULL;            /* file for first screen    */
+    const char* json = NULL;           /* file for suite results   */
+
+    if ((1 < argc && 0 >= (passes = atoi(argv[1]))) || 4 < argc) {
+        fprintf(stderr, "usage: %s [passes [frame.ppm [results.json]]]\n", argv[0]);
+        return 2;
+    }
+    if (2 < argc && 0 != strcmp(argv[2], "-")) {
+        ppm = argv[2];
+    }
+    if (3 < argc) {
+        json = argv[3];
+    }
+
+    PROF_THREAD("bench");
+#if (PROFILE != 0)
+    (void)bench_profile(passes);
+#endif
+    if (!bench_decoders("images/*.photo", "room photos", sizeof (uint16_t), passes) ||
+        !bench_decoders("images/*.obj", "object images", sizeof (uint8_t), passes) ||
+        !bench_quant_kernels("images/*.photo", passes) ||
+        !bench_quantizers("images/*.photo", passes) ||
+        !bench_scatter(passes) ||
+        !bench_scroll("images/*.photo", passes) ||
+        !bench_sprites("images/*.obj", passes) ||
+        !bench_status(passes) ||
+        !bench_ticks(passes) ||
+        !bench_present("images/*.photo", passes, ppm) ||
+        !bench_ring(passes) ||
+        !bench_suite(passes, json)) {
+        return 3;
+    }
+    PROF_DUMP();
+    return 0;
+}
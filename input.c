@@ -143,6 +143,11 @@ void reset_typed_command() {
     typing[0] = '\0';
 }
 
+void set_typed_command(const char* s) {
+    strncpy(typing, s, MAX_TYPED_LEN);
+    typing[MAX_TYPED_LEN] = '\0';
+}
+
 static int32_t valid_typing(char c) {
     /* Valid typing include letters, numbers, space, and backspace/delete. */
     return (isalpha(c) || isdigit(c) || ' ' == c || 8 == c || 127 == c);
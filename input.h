@@ -66,6 +66,9 @@ extern const char* get_typed_command();
 /* Reset typed command. */
 extern void reset_typed_command();
 
+/* Replace typed command(used to replay recorded input). */
+extern void set_typed_command(const char* s);
+
 /* Shut down the input device. */
 extern void shutdown_input();
 
@@ -41,6 +41,7 @@
  */
 
 #include <fcntl.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <string.h>
 #include <sys/io.h>
@@ -48,9 +49,28 @@
 #include <unistd.h>
 
 #include "modex.h"
+#include "prof.h"
 #include "text.h"
 
 
+/*
+ * If MODEX_SIMD is set to 0, only the plain C kernel for scattering lines
+ * into planes(scatter_planes) is built.  Otherwise the SSE2 and SSSE3
+ * kernels are also built when compiling for x86 with gcc, and are used if
+ * the CPU supports them.
+ */
+#ifndef MODEX_SIMD
+#define MODEX_SIMD 1
+#endif
+
+#if (MODEX_SIMD != 0 && defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__)))
+#define HAVE_X86_SCATTER 1
+#include <immintrin.h>
+#else
+#define HAVE_X86_SCATTER 0
+#endif
+
+
 /*
  * Calculate the image build buffer parameters. SCROLL_SIZE is the space
  * needed for one plane of an image. SCREEN_SIZE is the space needed for
@@ -74,6 +94,18 @@
 #define BUILD_BUF_SIZE     (SCREEN_SIZE + 20000)
 #define BUILD_BASE_INIT    ((BUILD_BUF_SIZE - SCREEN_SIZE) / 2)
 
+/*
+ * If MODEX_RING_BUILD is not 0, the build buffer starts out addressed as a
+ * ring(see set_ring_build): logical offsets past the end of the buffer
+ * wrap around to its start, so the logical view window never has to be
+ * moved within the buffer.  Any SCREEN_SIZE bytes of consecutive logical
+ * offsets fit, so the planes of the screen never overlap, and each plane
+ * of the screen is at most two contiguous pieces of the buffer.
+ */
+#ifndef MODEX_RING_BUILD
+#define MODEX_RING_BUILD 1
+#endif
+
 /* Mode X and general VGA parameters */
 #define VID_MEM_SIZE        131072
 #define MODE_X_MEM_SIZE      65536
@@ -105,6 +137,7 @@ static unsigned short mode_X_graphics[NUM_GRAPHICS_REGS] = {
     0xFF08
 };
 
+#if (MODEX_HEADLESS == 0)
 /* VGA register settings for text mode 3(color text) */
 static unsigned short text_seq[NUM_SEQUENCER_REGS] = {
     0x0100, 0x2001, 0x0302, 0x0003, 0x0204
@@ -127,6 +160,9 @@ static unsigned short text_graphics[NUM_GRAPHICS_REGS] = {
     0x0000, 0x0001, 0x0002, 0x0003, 0x0004, 0x1005, 0x0E06, 0x0007,
     0xFF08
 };
+#elif defined(TEXT_RESTORE_PROGRAM)
+#error "the text restoration program needs a real VGA(MODEX_HEADLESS 0)"
+#endif
 
 
 /* local functions--see function headers for details */
@@ -137,12 +173,65 @@ static void set_CRTC_registers(unsigned short table[NUM_CRTC_REGS]);
 static void set_attr_registers(unsigned char table[NUM_ATTR_REGS * 2]);
 static void set_graphics_registers(unsigned short table[NUM_GRAPHICS_REGS]);
 static void fill_palette_mode_x();
+#if (MODEX_HEADLESS == 0)
 static void fill_palette_text();
 static void write_font_data();
 static void set_text_mode_3(int clear_scr);
-static void copy_image(unsigned char* img, unsigned short scr_addr);
+#endif
+static unsigned char* build_addr(int off, int* run);
+#ifndef TEXT_RESTORE_PROGRAM
+static void build_scatter(const unsigned char* src, int n, int x, int y);
+static void draw_band(int band, int fill);
+static void draw_bands(int x, int y, int w, int h);
+static void* draw_worker(void* arg);
+static void stop_draw_workers();
+#endif
+static void mark_rows(int lo, int hi);
+static int bar_field_changed(char* shown, const char* s);
+static void copy_bar_planes();
+static void show_rows(int lo, int hi);
+static void copy_image(unsigned char* img, unsigned short scr_addr, int len);
 static void copy_status_bar(unsigned char* bar, unsigned short scr_addr);
+#if (MODEX_HEADLESS != 0)
+static void vga_outb(unsigned short port, unsigned char val);
+static void vga_outw(unsigned short port, unsigned short val);
+static void vga_write_planes(unsigned short scr_addr, const unsigned char* src, int len);
+#endif
 //static void fill_palette(unsigned char my_palette[192][3]);
+static const struct scatter_kernel_t* get_scatter_kernel();
+static void scatter_scalar(const unsigned char* src, int n, unsigned char* const dst[4]);
+#if (HAVE_X86_SCATTER != 0)
+static int has_sse2();
+static int has_ssse3();
+static void scatter_sse2(const unsigned char* src, int n, unsigned char* const dst[4]);
+static void scatter_ssse3(const unsigned char* src, int n, unsigned char* const dst[4]);
+#endif
+
+
+/*
+ * kernels for scatter_planes, fastest first; each takes a line starting
+ * at a column that is a multiple of four(see scatter_scalar); the list
+ * ends with an entry with a NULL name
+ */
+struct scatter_kernel_t {
+    const char* name;               /* name used to select the kernel */
+    int (*supported)();             /* CPU check(NULL if none needed)  */
+    void (*scatter)(const unsigned char* src, int n, unsigned char* const dst[4]);
+};
+static const struct scatter_kernel_t scatter_kernels[] = {
+#if (HAVE_X86_SCATTER != 0)
+    {"ssse3", has_ssse3, scatter_ssse3},
+    {"sse2", has_sse2, scatter_sse2},
+#endif
+    {"scalar", NULL, scatter_scalar},
+    {NULL, NULL, NULL}
+};
+
+/*
+ * The scatter kernel chosen with select_scatter_kernel, or NULL to use the
+ * fastest one that the CPU supports.
+ */
+static const struct scatter_kernel_t* cur_scatter = NULL;
 
 
 /*
@@ -181,11 +270,53 @@ static unsigned char build[BUILD_BUF_SIZE + 2 * MEM_FENCE_WIDTH];
 static int img3_off;            /* offset of upper left pixel  */
 static unsigned char* img3;     /* pointer to upper left pixel */
 static int show_x, show_y;      /* logical view coordinates    */
+static int build_ring = (MODEX_RING_BUILD != 0); /* build buffer is a ring */
+static modex_stats_t stats;     /* counts of work done         */
 
 /* displayed video memory variables */
 static unsigned char* mem_image;    /* pointer to start of video memory */
 static unsigned short target_img;   /* offset of displayed screen image */
 
+/*
+ * Rows of the logical view window that have been drawn(or moved with the
+ * view) since each of the two screen pages in video memory was last
+ * filled, as a range from stale_lo to stale_hi(empty if stale_lo is
+ * greater), indexed by bit 14 of the page's offset.  show_screen copies
+ * only those rows, and nothing at all unless frame_changed is set by a
+ * change since the last page flip.  Nothing may be drawn while
+ * show_screen runs, or the rows drawn may never be copied.
+ */
+static int stale_lo[2], stale_hi[2];
+static int frame_changed;
+
+/*
+ * What update_status_bar last drew in the status bar: whether video memory
+ * holds it(bar_valid), whether it was a message, and the strings drawn.
+ * Strings too long for these buffers are always drawn again.
+ */
+#define BAR_FIELD_LEN 64
+static int bar_valid = 0;
+static int bar_msg_mode;
+static char bar_room[BAR_FIELD_LEN];
+static char bar_typed[BAR_FIELD_LEN];
+static char bar_msg[BAR_FIELD_LEN];
+
+#if (MODEX_HEADLESS != 0)
+/*
+ * The emulated VGA(see MODEX_HEADLESS in modex.h).  Only the state needed
+ * to know what the display shows is kept: video memory, the sequencer
+ * registers(for the plane write mask), the CRTC registers(for the start
+ * address, line compare and display size) and the palette.  The palette
+ * is written a component at a time starting from the index given to port
+ * 0x03C8, as on the real adapter.
+ */
+static unsigned char vga_mem[4][MODE_X_MEM_SIZE];   /* video memory planes    */
+static unsigned char vga_seq[256];                  /* sequencer registers    */
+static unsigned char vga_crtc[256];                 /* CRTC registers         */
+static unsigned char vga_dac[256][3];               /* palette(6-bit values)  */
+static int vga_dac_pos;                             /* next palette component */
+#endif
+
 
 /*
  * functions provided by the caller to set_mode_X() and used to obtain
@@ -195,6 +326,70 @@ static unsigned short target_img;   /* offset of displayed screen image */
 static void(*horiz_line_fn)(int, int, unsigned char[SCROLL_X_DIM]);
 static void(*vert_line_fn)(int, int, unsigned char[SCROLL_Y_DIM]);
 
+/*
+ * Threads helping draw_rect draw large rectangles(see set_draw_workers).
+ * The rectangle is split into one band of rows per thread, counting the
+ * caller's, which draws band 0; each band is filled into its rows of
+ * rect_buf(by rect_image_fn for band 0 and by band_image_fn for the rest)
+ * and scattered into its rows of the build buffer, which no other band
+ * touches.  The band job is handed out under draw_lock: draw_gen
+ * counts jobs, and draw_pending counts helpers yet to finish the current
+ * one.  Rectangles with fewer than DRAW_BAND_MIN rows per band are drawn
+ * by the caller alone.
+ */
+#define MAX_DRAW_WORKERS 4
+#define DRAW_BAND_MIN   16
+#ifndef TEXT_RESTORE_PROGRAM
+static pthread_t draw_thread[MAX_DRAW_WORKERS];  /* helpers(index 0 unused) */
+static int draw_workers = 1;        /* threads drawing, counting the caller */
+static pthread_mutex_t draw_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t draw_start = PTHREAD_COND_INITIALIZER; /* new job     */
+static pthread_cond_t draw_done = PTHREAD_COND_INITIALIZER;  /* job drawn   */
+static unsigned draw_gen;           /* number of jobs handed out            */
+static int draw_pending;            /* helpers still drawing the job        */
+static int draw_quit;               /* helpers should exit                  */
+static int job_x, job_y, job_w, job_h; /* logical rectangle of the job      */
+static void(*band_image_fn)(int, int, int, int, unsigned char[][SCROLL_X_DIM]);
+
+/*
+ * function provided by the caller to set_mode_X() and used to obtain the
+ * graphic image of a rectangle of the logical view window in one call,
+ * along with the buffer into which draw_rect has the image written(one
+ * row of the rectangle per row of the buffer)
+ */
+static void(*rect_image_fn)(int, int, int, int, unsigned char[][SCROLL_X_DIM]);
+static unsigned char rect_buf[SCROLL_Y_DIM][SCROLL_X_DIM];
+#endif
+
+
+#if (MODEX_HEADLESS != 0)
+
+/*
+ * port writes for the emulated VGA--same uses as the macros below,
+ * but calling vga_outb and vga_outw instead of writing to ports
+ */
+#define SET_WRITE_MASK(mask_hi_bits)                    \
+    vga_outw(0x03C4, ((mask_hi_bits) & 0xFF00) | 0x02)
+#define OUTB(port, val)                                 \
+    vga_outb((port), (val))
+#define OUTW(port, val)                                 \
+    vga_outw((port), (val))
+#define REP_OUTSW(port, source, count)                  \
+do {                                                    \
+    const unsigned short* _src = (const unsigned short*)(source); \
+    int _n;                                             \
+    for (_n = 0; _n < (count); _n++)                    \
+        vga_outw((port), _src[_n]);                     \
+} while (0)
+#define REP_OUTSB(port, source, count)                  \
+do {                                                    \
+    const unsigned char* _src = (const unsigned char*)(source); \
+    int _n;                                             \
+    for (_n = 0; _n < (count); _n++)                    \
+        vga_outb((port), _src[_n]);                     \
+} while (0)
+
+#else /* MODEX_HEADLESS == 0 */
 
 /*
  * macro used to target a specific video plane or planes when writing
@@ -274,6 +469,8 @@ do {                                                    \
     );                                                  \
 } while (0)
 
+#endif /* MODEX_HEADLESS */
+
 
 /*
  * set_mode_X
@@ -286,28 +483,37 @@ do {                                                    \
  *                             draw_vert_line) to obtain a graphical
  *                             image of a particular logical line for
  *                             drawing to the build buffer
+ *             rect_fill_fn -- this function is used as a callback(by
+ *                             draw_rect) to obtain a graphical image
+ *                             of a logical rectangle for drawing to
+ *                             the build buffer
  *     OUTPUTS: none
  *     RETURN VALUE: 0 on success, -1 on failure
  *     SIDE EFFECTS: initializes the logical view window; maps video memory
  *                   and obtains permission for VGA ports; clears video memory
  */
 int set_mode_X(void(*horiz_fill_fn)(int, int, unsigned char[SCROLL_X_DIM]),
-               void(*vert_fill_fn)(int, int, unsigned char[SCROLL_Y_DIM])) {
+               void(*vert_fill_fn)(int, int, unsigned char[SCROLL_Y_DIM]),
+               void(*rect_fill_fn)(int, int, int, int, unsigned char[][SCROLL_X_DIM])) {
     int i; /* loop index for filling memory fence with magic numbers */
 
     /*
      * Record callback functions for obtaining horizontal and vertical
-     * line images.
+     * line images and rectangle images.
      */
-    if (horiz_fill_fn == NULL || vert_fill_fn == NULL)
+    if (horiz_fill_fn == NULL || vert_fill_fn == NULL || rect_fill_fn == NULL)
         return -1;
     horiz_line_fn = horiz_fill_fn;
     vert_line_fn = vert_fill_fn;
+#ifndef TEXT_RESTORE_PROGRAM
+    rect_image_fn = rect_fill_fn;
+#endif
 
     /* Initialize the logical view window to position(0,0). */
     show_x = show_y = 0;
     img3_off = BUILD_BASE_INIT;
     img3 = build + img3_off + MEM_FENCE_WIDTH;
+    memset(&stats, 0, sizeof(stats));
 
     /* Set up the memory fence on the build buffer. */
     for (i = 0; i < MEM_FENCE_WIDTH; i++) {
@@ -360,11 +566,18 @@ int set_mode_X(void(*horiz_fill_fn)(int, int, unsigned char[SCROLL_X_DIM]),
 void clear_mode_X() {
     int i;     /* loop index for checking memory fence */
 
+#ifndef TEXT_RESTORE_PROGRAM
+    /* Stop any threads helping to draw. */
+    stop_draw_workers();
+#endif
+
+#if (MODEX_HEADLESS == 0)
     /* Put VGA into text mode, restore font data, and clear screens. */
     set_text_mode_3(1);
 
     /* Unmap video memory. */
     (void)munmap(mem_image, VID_MEM_SIZE);
+#endif
 
     /* Check validity of build buffer memory fence.    Report breakage. */
     for (i = 0; i < MEM_FENCE_WIDTH; i++) {
@@ -415,6 +628,14 @@ void set_view_window(int scr_x, int scr_y) {
     show_x = scr_x;
     show_y = scr_y;
 
+    /* Every row of the screen shows something new unless the view stays. */
+    if (scr_x != old_x || scr_y != old_y)
+        mark_rows(0, SCROLL_Y_DIM - 1);
+
+    /* A ring never needs the window moved(see MODEX_RING_BUILD). */
+    if (build_ring)
+        return;
+
     /*
      * If the new view window fits within the boundaries of the build
      * buffer, we need move nothing around.
@@ -484,6 +705,7 @@ void set_view_window(int scr_x, int scr_y) {
      * new one.    The areas may overlap, so copy direction is important.
      *(You should be able to explain why!)
      */
+    PROF_BEGIN(PROF_VIEW_MOVE);
     if (start_addr < target_addr) {
         for (i = length; i-- > 0; ) {
             target_addr[i] = start_addr[i];
@@ -494,22 +716,87 @@ void set_view_window(int scr_x, int scr_y) {
             target_addr[i] = start_addr[i];
         }
     }
+    stats.bytes_moved += length;
+    PROF_END(PROF_VIEW_MOVE);
 }
 
 
 /*
- * show_screen
- *     DESCRIPTION: Show the logical view window on the video display.
+ * set_ring_build
+ *     DESCRIPTION: Choose how the build buffer is addressed: as a ring
+ *                  (see MODEX_RING_BUILD), or as a window that
+ *                  set_view_window moves within the buffer when the view
+ *                  leaves it.
+ *     INPUTS: ring -- nonzero for a ring, 0 for a moving window
+ *     OUTPUTS: none
+ *     RETURN VALUE: none
+ *     SIDE EFFECTS: returns the logical view window to (0,0); the contents
+ *                   of the build buffer are no longer valid
+ */
+void set_ring_build(int ring) {
+    build_ring = (ring != 0);
+    show_x = show_y = 0;
+    img3_off = BUILD_BASE_INIT;
+    img3 = build + img3_off + MEM_FENCE_WIDTH;
+    mark_rows(0, SCROLL_Y_DIM - 1);
+}
+
+
+/*
+ * get_modex_stats
+ *     DESCRIPTION: Get the counts of work done since set_mode_X.
  *     INPUTS: none
+ *     OUTPUTS: stats_out -- the counts
+ *     RETURN VALUE: none
+ *     SIDE EFFECTS: none
+ */
+void get_modex_stats(modex_stats_t* stats_out) {
+    *stats_out = stats;
+}
+
+
+/*
+ * mark_rows
+ *     DESCRIPTION: Note that rows of the logical view window have changed,
+ *                  so that show_screen copies them to both screen pages.
+ *     INPUTS: lo -- first row changed
+ *             hi -- last row changed
  *     OUTPUTS: none
  *     RETURN VALUE: none
- *     SIDE EFFECTS: copies from the build buffer to video memory;
- *                   shifts the VGA display source to point to the new image
+ *     SIDE EFFECTS: widens the ranges of stale rows of both pages
  */
-void show_screen() {
-    unsigned char* addr;    /* source address for copy             */
-    int p_off;              /* plane offset of first display plane */
-    int i;                  /* loop index over video planes        */
+static void mark_rows(int lo, int hi) {
+    int i;    /* loop index over pages */
+
+    for (i = 0; i < 2; i++) {
+        if (stale_lo[i] > lo)
+            stale_lo[i] = lo;
+        if (stale_hi[i] < hi)
+            stale_hi[i] = hi;
+    }
+    frame_changed = 1;
+}
+
+
+/*
+ * show_rows
+ *     DESCRIPTION: Copy rows of the logical view window from the build
+ *                  buffer to the screen page at target_img, each plane in
+ *                  one piece, or two if it wraps around the end of the
+ *                  build buffer ring.
+ *     INPUTS: lo -- first row to copy
+ *             hi -- last row to copy
+ *     OUTPUTS: none
+ *     RETURN VALUE: none
+ *     SIDE EFFECTS: copies from the build buffer to video memory
+ */
+static void show_rows(int lo, int hi) {
+    unsigned char* addr;    /* source address for copy                       */
+    unsigned short dest;    /* destination offset in video memory            */
+    int p_off;              /* plane offset of first display plane           */
+    int len;                /* bytes of each plane to copy                   */
+    int run;                /* bytes of the plane before the end of the ring */
+    int i;                  /* loop index over video planes                  */
 
     /*
      * Calculate offset of build buffer plane to be mapped into plane 0
@@ -517,24 +804,161 @@ void show_screen() {
      */
     p_off = (3 - (show_x & 3));
 
-    /* Switch to the other target screen in video memory. */
-    target_img ^= 0x4000;
+    dest = target_img + lo * SCROLL_X_WIDTH;
+    len = (hi - lo + 1) * SCROLL_X_WIDTH;
+    for (i = 0; i < 4; i++) {
+        SET_WRITE_MASK(1 << (i + 8));
+        addr = build_addr(((p_off - i + 4) & 3) * SCROLL_SIZE + (p_off < i) +
+                          (show_x >> 2) + (show_y + lo) * SCROLL_X_WIDTH, &run);
+        if (run >= len) {
+            copy_image(addr, dest, len);
+            stats.copies_shown++;
+        } else {
+            copy_image(addr, dest, run);
+            copy_image(build + MEM_FENCE_WIDTH, dest + run, len - run);
+            stats.copies_shown += 2;
+        }
+    }
+    stats.bytes_shown += 4 * len;
+}
 
-    /* Calculate the source address. */
-    addr = img3 + (show_x >> 2) + show_y * SCROLL_X_WIDTH;
 
-    /* Draw to each plane in the video memory. */
+/*
+ * build_addr
+ *     DESCRIPTION: Find a logical offset in the build buffer, wrapping
+ *                  around its end if the buffer is a ring.
+ *     INPUTS: off -- offset relative to the upper left pixel of plane 3
+ *                    at logical position (0,0)
+ *     OUTPUTS: run -- number of bytes from the address to the end of the
+ *                     buffer(the bytes that can be used without wrapping)
+ *     RETURN VALUE: the address in the build buffer
+ *     SIDE EFFECTS: none
+ */
+static unsigned char* build_addr(int off, int* run) {
+    off += img3_off;
+    if (build_ring) {
+        off %= BUILD_BUF_SIZE;
+        if (off < 0)
+            off += BUILD_BUF_SIZE;
+    }
+    *run = BUILD_BUF_SIZE - off;
+    return build + MEM_FENCE_WIDTH + off;
+}
+
+
+#ifndef TEXT_RESTORE_PROGRAM
+/*
+ * build_scatter
+ *     DESCRIPTION: Store a row of pixels in the build buffer.  A row whose
+ *                  bytes in some plane wrap around the end of the ring is
+ *                  built in a scratch row that is then copied in two pieces
+ *                  per plane.  Only the bytes holding pixels of the row are
+ *                  written; the bytes shared with the rows before and after
+ *                  it are left alone, as another thread may be drawing
+ *                  those rows(see draw_bands).
+ *     INPUTS: src -- the pixels
+ *             n -- number of pixels(at most SCROLL_X_DIM)
+ *             (x,y) -- logical position of the first pixel
+ *     OUTPUTS: none
+ *     RETURN VALUE: none
+ *     SIDE EFFECTS: writes into the build buffer
+ */
+static void build_scatter(const unsigned char* src, int n, int x, int y) {
+    unsigned char tmp[4][SCROLL_X_WIDTH + 1]; /* scratch row for each plane */
+    unsigned char* plane[4];    /* address of first pixel group in each plane */
+    unsigned char* scratch[4];  /* first pixel group in each scratch plane    */
+    int run[4];                 /* bytes before the end of the ring           */
+    int len;                    /* bytes of the row in each plane             */
+    int wrap = 0;               /* whether the row wraps around in any plane  */
+    int first;                  /* first byte of a plane holding row pixels   */
+    int end;                    /* byte after the last one holding pixels     */
+    int last_col;               /* last pixel column, counted from x & ~3     */
+    int from;                   /* first of the bytes past the end of ring    */
+    int i;                      /* loop index over planes                     */
+
+    /* Pixel columns 0 to 3 mod 4 go to build buffer planes 3 to 0. */
+    len = ((x & 3) + n + 3) >> 2;
     for (i = 0; i < 4; i++) {
-        SET_WRITE_MASK(1 << (i + 8));
-        copy_image(addr + ((p_off - i + 4) & 3) * SCROLL_SIZE + (p_off < i), target_img);
+        plane[i] = build_addr((3 - i) * SCROLL_SIZE + (x >> 2) + y * SCROLL_X_WIDTH, &run[i]);
+        wrap |= (run[i] < len);
+    }
+    if (!wrap) {
+        scatter_planes(src, n, x & 3, plane);
+        return;
+    }
+
+    for (i = 0; i < 4; i++)
+        scratch[i] = tmp[i];
+    scatter_planes(src, n, x & 3, scratch);
+
+    /*
+     * Copy back the bytes of each plane from the first to the last pixel
+     * column of the row in that plane: plane i holds columns i mod 4.
+     */
+    last_col = (x & 3) + n - 1;
+    for (i = 0; i < 4; i++) {
+        if (last_col < i)
+            continue;
+        first = (i < (x & 3));
+        end = ((last_col - i) >> 2) + 1;
+        if (first >= end)
+            continue;
+        if (first < run[i])
+            memcpy(plane[i] + first, tmp[i] + first,
+                   (end < run[i] ? end : run[i]) - first);
+        if (end > run[i]) {
+            from = (first > run[i] ? first : run[i]);
+            memcpy(build + MEM_FENCE_WIDTH + (from - run[i]), tmp[i] + from, end - from);
+        }
+    }
+}
+#endif /* !defined(TEXT_RESTORE_PROGRAM) */
+
+
+/*
+ * show_screen
+ *     DESCRIPTION: Show the logical view window on the video display.  If
+ *                  nothing has been drawn and the view has not moved since
+ *                  the last call, the displayed page is already up to date
+ *                  and nothing is done.  Otherwise only the rows that have
+ *                  changed since the other page was last shown are copied
+ *                  to it before the pages are flipped.  No other thread
+ *                  may draw meanwhile.
+ *     INPUTS: none
+ *     OUTPUTS: none
+ *     RETURN VALUE: none
+ *     SIDE EFFECTS: copies from the build buffer to video memory;
+ *                   shifts the VGA display source to point to the new image
+ */
+void show_screen() {
+    int page;               /* index of the page being filled */
+
+    if (!frame_changed) {
+        stats.frames_skipped++;
+        return;
     }
 
+    PROF_BEGIN(PROF_SHOW_SCREEN);
+
+    /* Switch to the other target screen in video memory. */
+    target_img ^= 0x4000;
+
+    /* Copy the rows that the page lacks. */
+    page = ((target_img & 0x4000) != 0);
+    if (stale_lo[page] <= stale_hi[page])
+        show_rows(stale_lo[page], stale_hi[page]);
+    stale_lo[page] = SCROLL_Y_DIM;
+    stale_hi[page] = -1;
+    frame_changed = 0;
+    stats.frames_shown++;
+
     /*
      * Change the VGA registers to point the top left of the screen
      * to the video memory that we just filled.
      */
     OUTW(0x03D4, (target_img & 0xFF00) | 0x0C);
     OUTW(0x03D4, ((target_img & 0x00FF) << 8) | 0x0D);
+    PROF_END(PROF_SHOW_SCREEN);
 }
 
 
@@ -547,11 +971,19 @@ void show_screen() {
  *     SIDE EFFECTS: fills all 256kB of VGA video memory with zeroes
  */
 void clear_screens() {
+    /* Both pages and the status bar must be filled again. */
+    mark_rows(0, SCROLL_Y_DIM - 1);
+    bar_valid = 0;
+
     /* Write to all four planes at once. */
     SET_WRITE_MASK(0x0F00);
 
     /* Set 64kB to zero(times four planes = 256kB). */
+#if (MODEX_HEADLESS != 0)
+    vga_write_planes(0, NULL, MODE_X_MEM_SIZE);
+#else
     memset(mem_image, 0, MODE_X_MEM_SIZE);
+#endif
 }
 
 
@@ -568,18 +1000,382 @@ void clear_screens() {
  */
 extern unsigned char status_bar[STATUS_BAR_SIZE];
 void show_status_bar(const char * str, int mode) {
-	int i;
+	bar_valid = 0;								//update_status_bar must redraw
 	convert_text_graph(str,mode);				//prudece the status bar buffer
 	
 	if (mode == 3) return;    					//return if just need to return.
-    /* Draw to each plane in the video memory. */	
-	for(i=0; i<4; i++){
-		SET_WRITE_MASK(1<<(i+8));
-		copy_status_bar(status_bar+(i*PLANE_STATUS_BAR_SIZE), 0x0000);
-	}
+	copy_bar_planes();
+}
+
+
+/*
+ * update_status_bar
+ *     DESCRIPTION: Show the room name(on the left) and the typed command(on
+ *                  the right) in the status bar, or a message(centered)
+ *                  instead if there is one.  Only what changed since the
+ *                  last call is drawn: a new typed command clears and draws
+ *                  just its own columns unless it meets the room name.  The
+ *                  bar is copied to video memory only if it changed.
+ *     INPUTS: room -- the room name
+ *             typed -- the typed command
+ *             msg -- the message, or "" for none
+ *     OUTPUTS: none
+ *     RETURN VALUE: none
+ *     SIDE EFFECTS: changes the status bar buffer and video memory
+ */
+void update_status_bar(const char* room, const char* typed, const char* msg) {
+    int redraw;                 /* whether the whole bar must be drawn    */
+    int changed;                /* whether the bar changed                */
+    int room_x, room_w;         /* columns covered by the room name       */
+    int old_x, old_w;           /* columns covered by the old command     */
+    int new_x, new_w;           /* columns covered by the new command     */
+
+    if (msg[0] != '\0') {
+        redraw = (bar_field_changed(bar_msg, msg) || !bar_msg_mode || !bar_valid);
+        bar_msg_mode = 1;
+        if (redraw)
+            convert_text_graph(msg, 0);
+        changed = redraw;
+    } else {
+        redraw = (bar_field_changed(bar_room, room) || bar_msg_mode || !bar_valid);
+        bar_msg_mode = 0;
+        text_graph_extent(bar_typed, 2, &old_x, &old_w);
+        changed = (bar_field_changed(bar_typed, typed) || redraw);
+        if (changed && !redraw) {
+            /* Only the command changed: draw it alone if it misses the room name. */
+            text_graph_extent(room, 1, &room_x, &room_w);
+            text_graph_extent(typed, 2, &new_x, &new_w);
+            if (old_x < room_x + room_w || new_x < room_x + room_w) {
+                redraw = 1;
+            } else {
+                clear_text_graph(old_x, old_w);
+                convert_text_graph(typed, 2);
+            }
+        }
+        if (redraw) {
+            convert_text_graph(" ", 3);
+            convert_text_graph(room, 1);
+            convert_text_graph(typed, 2);
+        }
+    }
+
+    if (changed)
+        copy_bar_planes();
+    bar_valid = 1;
+}
+
+
+/*
+ * bar_field_changed
+ *     DESCRIPTION: Check whether a string shown in the status bar has
+ *                  changed, and record the new one.
+ *     INPUTS: shown -- the string last shown(BAR_FIELD_LEN bytes)
+ *             s -- the string to show
+ *     OUTPUTS: shown -- s, or "" if s does not fit
+ *     RETURN VALUE: 1 if s differs from the string last shown(or does not
+ *                   fit), 0 if not
+ *     SIDE EFFECTS: none
+ */
+static int bar_field_changed(char* shown, const char* s) {
+    if (strlen(s) >= BAR_FIELD_LEN) {
+        shown[0] = '\0';
+        return 1;
+    }
+    if (strcmp(shown, s) == 0)
+        return 0;
+    strcpy(shown, s);
+    return 1;
+}
+
+
+/*
+ * copy_bar_planes
+ *     DESCRIPTION: Copy the status bar buffer to video memory.
+ *     INPUTS: none
+ *     OUTPUTS: none
+ *     RETURN VALUE: none
+ *     SIDE EFFECTS: copies the status bar to video memory
+ */
+static void copy_bar_planes() {
+    int i;    /* loop index over video planes */
+
+    /* Draw to each plane in the video memory. */
+    for (i = 0; i < 4; i++) {
+        SET_WRITE_MASK(1 << (i + 8));
+        copy_status_bar(status_bar + (i * PLANE_STATUS_BAR_SIZE), 0x0000);
+    }
+}
+
+
+
+/*
+ * scatter_planes
+ *     DESCRIPTION: Scatter a line of pixels into the four planes of a mode X
+ *                  image(the build buffer or the status bar).  Pixels up to
+ *                  the first column that is a multiple of four are stored
+ *                  one at a time; the rest go to the fastest kernel that
+ *                  the CPU supports(or the one chosen with
+ *                  select_scatter_kernel).
+ *     INPUTS: src -- the pixels
+ *             n -- number of pixels
+ *             phase -- column of the first pixel, mod 4
+ *             plane -- address of the first group of four columns in each
+ *                      plane(pixel i goes to byte (phase + i) / 4 of
+ *                      plane[(phase + i) % 4])
+ *     OUTPUTS: none
+ *     RETURN VALUE: none
+ *     SIDE EFFECTS: writes into the planes
+ */
+void scatter_planes(const unsigned char* src, int n, int phase,
+                    unsigned char* const plane[4]) {
+    unsigned char* dst[4];  /* address of first whole group in each plane */
+    int i;                  /* loop index over pixels/planes              */
+
+    for (i = 0; i < n && ((phase + i) & 3) != 0; i++) {
+        plane[phase + i][0] = src[i];
+    }
+    for (phase = (phase != 0), n -= i, src += i, i = 0; i < 4; i++) {
+        dst[i] = plane[i] + phase;
+    }
+    (*get_scatter_kernel()->scatter)(src, n, dst);
+}
+
+
+/*
+ * select_scatter_kernel
+ *     DESCRIPTION: Choose the kernel used by scatter_planes.
+ *     INPUTS: name -- "scalar", "sse2" or "ssse3", or NULL to use the
+ *                     fastest kernel that the CPU supports
+ *     OUTPUTS: none
+ *     RETURN VALUE: 1 on success, or 0 if there is no kernel by that name
+ *                   or the CPU lacks support for it
+ *     SIDE EFFECTS: changes the kernel used by scatter_planes
+ */
+int select_scatter_kernel(const char* name) {
+    const struct scatter_kernel_t* k; /* index over kernels */
+
+    if (name == NULL) {
+        cur_scatter = NULL;
+        return 1;
+    }
+    for (k = scatter_kernels; k->name != NULL; k++) {
+        if (strcmp(name, k->name) == 0) {
+            if (k->supported != NULL && !k->supported())
+                return 0;
+            cur_scatter = k;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+/*
+ * scatter_kernel_by_index
+ *     DESCRIPTION: Get the name of one of the scatter kernels built in.
+ *     INPUTS: idx -- index of the kernel(0 is the fastest)
+ *     OUTPUTS: none
+ *     RETURN VALUE: the kernel's name, or NULL if idx is out of range
+ *     SIDE EFFECTS: none
+ */
+const char* scatter_kernel_by_index(int idx) {
+    int n;    /* number of kernels */
+
+    for (n = 0; scatter_kernels[n].name != NULL; n++);
+    return (idx >= 0 && idx < n ? scatter_kernels[idx].name : NULL);
 }
 
 
+/*
+ * get_scatter_kernel
+ *     DESCRIPTION: Find the kernel used by scatter_planes.
+ *     INPUTS: none
+ *     OUTPUTS: none
+ *     RETURN VALUE: the kernel chosen with select_scatter_kernel, or else
+ *                   the fastest kernel that the CPU supports
+ *     SIDE EFFECTS: none
+ */
+static const struct scatter_kernel_t* get_scatter_kernel() {
+    static const struct scatter_kernel_t* best = NULL; /* fastest supported */
+    const struct scatter_kernel_t* k;                  /* index over kernels */
+
+    if (cur_scatter != NULL)
+        return cur_scatter;
+    if (best == NULL) {
+        /* The plain C kernel, last in the list, needs no support. */
+        for (k = scatter_kernels; k->supported != NULL && !k->supported(); k++);
+        best = k;
+    }
+    return best;
+}
+
+
+/*
+ * scatter_scalar
+ *     DESCRIPTION: Scatter kernel in plain C.  The first pixel is in column
+ *                  0 mod 4, so each group of four pixels puts one byte into
+ *                  each plane.
+ *     INPUTS: src -- the pixels
+ *             n -- number of pixels
+ *             dst -- address in each plane for the first group of pixels
+ *     OUTPUTS: none
+ *     RETURN VALUE: none
+ *     SIDE EFFECTS: writes into the planes
+ */
+static void scatter_scalar(const unsigned char* src, int n, unsigned char* const dst[4]) {
+    int i;    /* loop index over pixels */
+
+    for (i = 0; i + 4 <= n; i += 4) {
+        dst[0][i >> 2] = src[i];
+        dst[1][i >> 2] = src[i + 1];
+        dst[2][i >> 2] = src[i + 2];
+        dst[3][i >> 2] = src[i + 3];
+    }
+    for (; i < n; i++) {
+        dst[i & 3][i >> 2] = src[i];
+    }
+}
+
+
+#if (HAVE_X86_SCATTER != 0)
+/*
+ * has_sse2
+ *     DESCRIPTION: Check whether the CPU supports SSE2.
+ *     INPUTS: none
+ *     OUTPUTS: none
+ *     RETURN VALUE: 1 if so, 0 if not
+ *     SIDE EFFECTS: none
+ */
+static int has_sse2() {
+    __builtin_cpu_init();
+    return (__builtin_cpu_supports("sse2") != 0);
+}
+
+
+/*
+ * has_ssse3
+ *     DESCRIPTION: Check whether the CPU supports SSSE3.
+ *     INPUTS: none
+ *     OUTPUTS: none
+ *     RETURN VALUE: 1 if so, 0 if not
+ *     SIDE EFFECTS: none
+ */
+static int has_ssse3() {
+    __builtin_cpu_init();
+    return (__builtin_cpu_supports("ssse3") != 0);
+}
+
+
+/*
+ * scatter_sse2
+ *     DESCRIPTION: Scatter kernel using SSE2(see scatter_scalar).  Each
+ *                  32-bit lane holds one group of four pixels; shifting and
+ *                  masking leaves one plane's byte in each lane, and two
+ *                  packs gather those bytes from four vectors, so 64 pixels
+ *                  give 16 contiguous bytes for each plane.  Use only if the
+ *                  CPU supports SSE2.
+ *     INPUTS: src -- the pixels
+ *             n -- number of pixels
+ *             dst -- address in each plane for the first group of pixels
+ *     OUTPUTS: none
+ *     RETURN VALUE: none
+ *     SIDE EFFECTS: writes into the planes
+ */
+__attribute__((target("sse2")))
+static void scatter_sse2(const unsigned char* src, int n, unsigned char* const dst[4]) {
+    const __m128i low = _mm_set1_epi32(0xFF); /* low byte of each lane  */
+    __m128i a, b, c, d;                       /* 16 pixels each         */
+    __m128i cnt;                              /* shift to plane's byte  */
+    int     i;                                /* loop index over pixels */
+    int     k;                                /* loop index over planes */
+    int     word;                             /* four bytes of a plane  */
+    unsigned char* out[4];                    /* rest of each plane     */
+
+    for (i = 0; i + 64 <= n; i += 64) {
+        a = _mm_loadu_si128((const __m128i*)&src[i]);
+        b = _mm_loadu_si128((const __m128i*)&src[i + 16]);
+        c = _mm_loadu_si128((const __m128i*)&src[i + 32]);
+        d = _mm_loadu_si128((const __m128i*)&src[i + 48]);
+        for (k = 0; k < 4; k++) {
+            cnt = _mm_cvtsi32_si128(8 * k);
+            _mm_storeu_si128((__m128i*)&dst[k][i >> 2], _mm_packus_epi16(
+                _mm_packs_epi32(_mm_and_si128(_mm_srl_epi32(a, cnt), low),
+                                _mm_and_si128(_mm_srl_epi32(b, cnt), low)),
+                _mm_packs_epi32(_mm_and_si128(_mm_srl_epi32(c, cnt), low),
+                                _mm_and_si128(_mm_srl_epi32(d, cnt), low))));
+        }
+    }
+    for (; i + 16 <= n; i += 16) {
+        a = _mm_loadu_si128((const __m128i*)&src[i]);
+        for (k = 0; k < 4; k++) {
+            cnt = _mm_cvtsi32_si128(8 * k);
+            b = _mm_packs_epi32(_mm_and_si128(_mm_srl_epi32(a, cnt), low), low);
+            word = _mm_cvtsi128_si32(_mm_packus_epi16(b, b));
+            memcpy(&dst[k][i >> 2], &word, 4);
+        }
+    }
+    for (k = 0; k < 4; k++) {
+        out[k] = dst[k] + (i >> 2);
+    }
+    scatter_scalar(&src[i], n - i, out);
+}
+
+
+/*
+ * scatter_ssse3
+ *     DESCRIPTION: Scatter kernel using SSSE3(see scatter_scalar).  One
+ *                  shuffle sorts 16 pixels by plane, leaving four bytes of
+ *                  plane k in 32-bit lane k; for 64 pixels, a 4x4 transpose
+ *                  of the lanes of four such vectors gives 16 contiguous
+ *                  bytes for each plane.  Use only if the CPU supports SSSE3.
+ *     INPUTS: src -- the pixels
+ *             n -- number of pixels
+ *             dst -- address in each plane for the first group of pixels
+ *     OUTPUTS: none
+ *     RETURN VALUE: none
+ *     SIDE EFFECTS: writes into the planes
+ */
+__attribute__((target("ssse3")))
+static void scatter_ssse3(const unsigned char* src, int n, unsigned char* const dst[4]) {
+    const __m128i by_plane = _mm_setr_epi8(0, 4, 8, 12, 1, 5, 9, 13,
+                                           2, 6, 10, 14, 3, 7, 11, 15);
+    __m128i a, b, c, d;     /* 16 pixels each, sorted by plane      */
+    __m128i ab_lo, cd_lo;   /* planes 0 and 1 of a/b and of c/d     */
+    __m128i ab_hi, cd_hi;   /* planes 2 and 3 of a/b and of c/d     */
+    int     i;              /* loop index over pixels               */
+    int     k;              /* loop index over planes               */
+    int     word;           /* four bytes of a plane                */
+    unsigned char* out[4];  /* rest of each plane                   */
+
+    for (i = 0; i + 64 <= n; i += 64) {
+        a = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)&src[i]), by_plane);
+        b = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)&src[i + 16]), by_plane);
+        c = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)&src[i + 32]), by_plane);
+        d = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)&src[i + 48]), by_plane);
+        ab_lo = _mm_unpacklo_epi32(a, b);
+        cd_lo = _mm_unpacklo_epi32(c, d);
+        ab_hi = _mm_unpackhi_epi32(a, b);
+        cd_hi = _mm_unpackhi_epi32(c, d);
+        _mm_storeu_si128((__m128i*)&dst[0][i >> 2], _mm_unpacklo_epi64(ab_lo, cd_lo));
+        _mm_storeu_si128((__m128i*)&dst[1][i >> 2], _mm_unpackhi_epi64(ab_lo, cd_lo));
+        _mm_storeu_si128((__m128i*)&dst[2][i >> 2], _mm_unpacklo_epi64(ab_hi, cd_hi));
+        _mm_storeu_si128((__m128i*)&dst[3][i >> 2], _mm_unpackhi_epi64(ab_hi, cd_hi));
+    }
+    for (; i + 16 <= n; i += 16) {
+        a = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)&src[i]), by_plane);
+        for (k = 0; k < 4; k++) {
+            word = _mm_cvtsi128_si32(a);
+            memcpy(&dst[k][i >> 2], &word, 4);
+            a = _mm_srli_si128(a, 4);
+        }
+    }
+    for (k = 0; k < 4; k++) {
+        out[k] = dst[k] + (i >> 2);
+    }
+    scatter_scalar(&src[i], n - i, out);
+}
+#endif /* HAVE_X86_SCATTER */
+
 
 /*
  * The functions inside the preprocessor block below rely on functions
@@ -606,15 +1402,17 @@ void show_status_bar(const char * str, int mode) {
  */
 int draw_vert_line(int x) {
     /* to be written... */
-	unsigned char buf[SCROLL_Y_DIM]; /* buffer for graphical image of line                            */
-    unsigned char* addr;             /* address of first pixel in build buffer (without plane offset) */
-    int p_off;                       /* offset of plane of first pixel                                */
+    unsigned char buf[SCROLL_Y_DIM]; /* buffer for graphical image of line                            */
+    unsigned char* addr;             /* address of pixel in build buffer                              */
+    int run;                         /* bytes from the pixel to the end of the build buffer           */
     int i;                           /* loop index over pixels                                        */
 
     /* Check whether requested line falls in the logical view window. */
     if (x < 0 || x >= SCROLL_X_DIM)
     return -1;
 
+    PROF_BEGIN(PROF_DRAW_LINE);
+
     /* Adjust x to the logical colomn value. */
     x += show_x;
 
@@ -622,16 +1420,22 @@ int draw_vert_line(int x) {
     (*vert_line_fn)(x, show_y, buf);
 
     /* Calculate starting address in build buffer. */
-    addr = img3 + (x >> 2) + show_y * SCROLL_X_WIDTH;
-
-    /* Calculate plane offset of first pixel. */
-    p_off = (3 - (x & 3));
+    addr = build_addr((3 - (x & 3)) * SCROLL_SIZE + (x >> 2) + show_y * SCROLL_X_WIDTH, &run);
 
-    /* Copy image data into appropriate planes in build buffer. */
+    /*
+     * Copy image data into appropriate plane in build buffer, wrapping
+     * around the end of the build buffer ring.
+     */
     for (i = 0; i < SCROLL_Y_DIM; i++) {
-        addr[p_off * SCROLL_SIZE] = buf[i];
-        addr+=SCROLL_X_WIDTH;
+        *addr = buf[i];
+        addr += SCROLL_X_WIDTH;
+        if ((run -= SCROLL_X_WIDTH) <= 0) {
+            addr -= BUILD_BUF_SIZE;
+            run += BUILD_BUF_SIZE;
+        }
     }
+    mark_rows(0, SCROLL_Y_DIM - 1);
+    PROF_END(PROF_DRAW_LINE);
 
     /* Return success. */
     return 0;
@@ -653,39 +1457,296 @@ int draw_vert_line(int x) {
  */
 int draw_horiz_line(int y) {
     unsigned char buf[SCROLL_X_DIM]; /* buffer for graphical image of line                            */
-    unsigned char* addr;             /* address of first pixel in build buffer (without plane offset) */
-    int p_off;                       /* offset of plane of first pixel                                */
-    int i;                           /* loop index over pixels                                        */
 
     /* Check whether requested line falls in the logical view window. */
     if (y < 0 || y >= SCROLL_Y_DIM)
     return -1;
 
+    PROF_BEGIN(PROF_DRAW_LINE);
+
     /* Adjust y to the logical row value. */
     y += show_y;
 
     /* Get the image of the line. */
     (*horiz_line_fn)(show_x, y, buf);
 
-    /* Calculate starting address in build buffer. */
-    addr = img3 + (show_x >> 2) + y * SCROLL_X_WIDTH;
+    /* Copy image data into appropriate planes in build buffer. */
+    build_scatter(buf, SCROLL_X_DIM, show_x, y);
+    mark_rows(y - show_y, y - show_y);
+    PROF_END(PROF_DRAW_LINE);
 
-    /* Calculate plane offset of first pixel. */
-    p_off = (3 - (show_x & 3));
+    /* Return success. */
+    return 0;
+}
 
-    /* Copy image data into appropriate planes in build buffer. */
-    for (i = 0; i < SCROLL_X_DIM; i++) {
-        addr[p_off * SCROLL_SIZE] = buf[i];
-        if (--p_off < 0) {
-            p_off = 3;
-            addr++;
+
+/*
+ * draw_rect
+ *     DESCRIPTION: Draw a rectangle of the map into the build buffer. The
+ *                  rectangle is given relative to the upper left corner
+ *                  of the logical view window and is clipped to that
+ *                  window.  The image of the whole rectangle is obtained
+ *                  with one call to the rectangle callback, then written
+ *                  into the build buffer one plane at a time for each row.
+ *     INPUTS: (x,y) -- the 0-based pixel column and row of the upper left
+ *                      corner of the rectangle within the logical view
+ *                      window
+ *             w, h -- the width and height of the rectangle in pixels
+ *     OUTPUTS: none
+ *     RETURN VALUE: Returns 0 on success. If no part of the rectangle is
+ *                   within the logical view window, the function returns -1.
+ *     SIDE EFFECTS: draws into the build buffer
+ */
+int draw_rect(int x, int y, int w, int h) {
+    int i;                  /* loop index over rows                        */
+
+    /* Clip the rectangle to the logical view window. */
+    if (x < 0) {
+        w += x;
+        x = 0;
+    }
+    if (y < 0) {
+        h += y;
+        y = 0;
+    }
+    if (w > SCROLL_X_DIM - x)
+        w = SCROLL_X_DIM - x;
+    if (h > SCROLL_Y_DIM - y)
+        h = SCROLL_Y_DIM - y;
+    if (w <= 0 || h <= 0)
+        return -1;
+
+    PROF_BEGIN(PROF_DRAW_RECT);
+
+    /* Adjust x and y to the logical column and row values. */
+    x += show_x;
+    y += show_y;
+
+    if (draw_workers > 1 && h >= draw_workers * DRAW_BAND_MIN) {
+        /* Draw bands of rows on all drawing threads at once. */
+        draw_bands(x, y, w, h);
+    } else {
+        /* Get the image of the rectangle. */
+        (*rect_image_fn)(x, y, w, h, rect_buf);
+
+        /* Copy image data into the build buffer a row at a time. */
+        for (i = 0; i < h; i++) {
+            build_scatter(rect_buf[i], w, x, y + i);
         }
     }
+    mark_rows(y - show_y, y - show_y + h - 1);
+    PROF_END(PROF_DRAW_RECT);
 
     /* Return success. */
     return 0;
 }
 
+
+
+/*
+ * draw_frame
+ *     DESCRIPTION: Copy a planar frame(see modex.h) of the whole logical
+ *                  view window into the build buffer, one plane at a time,
+ *                  wrapping around the end of the build buffer ring.
+ *     INPUTS: frame -- the frame
+ *     OUTPUTS: none
+ *     RETURN VALUE: Returns 0 on success. If the left edge of the logical
+ *                   view window is not a multiple of four pixels(so the
+ *                   frame's planes do not line up with the build buffer's),
+ *                   the function returns -1.
+ *     SIDE EFFECTS: draws into the build buffer
+ */
+int draw_frame(const unsigned char* frame) {
+    unsigned char* addr;    /* start of plane's view in build buffer  */
+    int run;                /* bytes from there to the end of the buffer */
+    int p;                  /* loop index over planes                 */
+
+    if ((show_x & 3) != 0)
+        return -1;
+
+    PROF_BEGIN(PROF_DRAW_RECT);
+    for (p = 0; p < 4; p++, frame += FRAME_PLANE_SIZE) {
+        addr = build_addr(p * SCROLL_SIZE + (show_x >> 2) + show_y * SCROLL_X_WIDTH, &run);
+        if (run >= FRAME_PLANE_SIZE) {
+            memcpy(addr, frame, FRAME_PLANE_SIZE);
+        } else {
+            memcpy(addr, frame, run);
+            memcpy(build + MEM_FENCE_WIDTH, frame + run, FRAME_PLANE_SIZE - run);
+        }
+    }
+    mark_rows(0, SCROLL_Y_DIM - 1);
+    PROF_END(PROF_DRAW_RECT);
+
+    /* Return success. */
+    return 0;
+}
+
+
+/*
+ * set_draw_workers
+ *     DESCRIPTION: Choose the number of threads that draw_rect uses to draw
+ *                  large rectangles, such as the whole screen on entering a
+ *                  room, counting the thread calling draw_rect.  Helper
+ *                  threads are started once and wait between rectangles.
+ *                  The caller gets the image of band 0 from the rectangle
+ *                  callback given to set_mode_X before starting the
+ *                  helpers, which then get their bands from band_fill_fn
+ *                  at the same time.  band_fill_fn must therefore only
+ *                  read data shared between threads; data built lazily,
+ *                  such as room layers in photo.c, is built by the
+ *                  caller's call, if at all.
+ *     INPUTS: n -- number of threads(1 to draw serially, at most
+ *                  MAX_DRAW_WORKERS)
+ *             band_fill_fn -- callback used by the helper threads to obtain
+ *                             the image of their bands(ignored if n is 1)
+ *     OUTPUTS: none
+ *     RETURN VALUE: 0 on success, or -1 if n is out of range, band_fill_fn
+ *                   is missing, or threads cannot be started(drawing is
+ *                   then serial)
+ *     SIDE EFFECTS: starts or stops helper threads
+ */
+int set_draw_workers(int n,
+                     void(*band_fill_fn)(int, int, int, int, unsigned char[][SCROLL_X_DIM])) {
+    int i; /* loop index over helper threads */
+
+    if (n < 1 || n > MAX_DRAW_WORKERS || (n > 1 && band_fill_fn == NULL))
+        return -1;
+    stop_draw_workers();
+    band_image_fn = band_fill_fn;
+
+    /* Pick the scatter kernel now, rather than racing to in the helpers. */
+    (void)get_scatter_kernel();
+
+    /* Helpers start waiting for job 1, whenever they get to run. */
+    draw_gen = 0;
+    draw_quit = 0;
+    for (i = 1; i < n; i++) {
+        if (pthread_create(&draw_thread[i], NULL, draw_worker, (void*)(long)i) != 0) {
+            stop_draw_workers();
+            return -1;
+        }
+        draw_workers = i + 1;
+    }
+    return 0;
+}
+
+
+/*
+ * stop_draw_workers
+ *     DESCRIPTION: Stop the threads helping draw_rect, if any.
+ *     INPUTS: none
+ *     OUTPUTS: none
+ *     RETURN VALUE: none
+ *     SIDE EFFECTS: joins the helper threads; draw_rect draws serially
+ */
+static void stop_draw_workers() {
+    int i; /* loop index over helper threads */
+
+    if (draw_workers <= 1)
+        return;
+    pthread_mutex_lock(&draw_lock);
+    draw_quit = 1;
+    pthread_cond_broadcast(&draw_start);
+    pthread_mutex_unlock(&draw_lock);
+    for (i = 1; i < draw_workers; i++)
+        (void)pthread_join(draw_thread[i], NULL);
+    draw_workers = 1;
+}
+
+
+/*
+ * draw_band
+ *     DESCRIPTION: Draw one band of rows of the current job of the drawing
+ *                  threads(see draw_bands).
+ *     INPUTS: band -- index of the band(0 to draw_workers - 1)
+ *             fill -- nonzero to get the image of the band's rows from
+ *                     band_image_fn, 0 if they are already in rect_buf
+ *     OUTPUTS: none
+ *     RETURN VALUE: none
+ *     SIDE EFFECTS: writes the band's rows of rect_buf and of the build
+ *                   buffer
+ */
+static void draw_band(int band, int fill) {
+    int lo = job_h * band / draw_workers;       /* first row of band  */
+    int hi = job_h * (band + 1) / draw_workers; /* row after the band */
+    int i;                                      /* loop index over rows */
+
+    if (fill)
+        (*band_image_fn)(job_x, job_y + lo, job_w, hi - lo, rect_buf + lo);
+    for (i = lo; i < hi; i++) {
+        build_scatter(rect_buf[i], job_w, job_x, job_y + i);
+    }
+}
+
+
+/*
+ * draw_bands
+ *     DESCRIPTION: Draw a rectangle on all drawing threads, one band of
+ *                  rows each.  The image of band 0 is obtained before the
+ *                  helpers start(see set_draw_workers); the caller then
+ *                  scatters band 0 while the helpers draw theirs, and waits
+ *                  for them to finish.
+ *     INPUTS: (x,y) -- logical column and row of the upper left corner
+ *             w, h -- width and height of the rectangle(clipped to the
+ *                     logical view window)
+ *     OUTPUTS: none
+ *     RETURN VALUE: none
+ *     SIDE EFFECTS: draws into the build buffer
+ */
+static void draw_bands(int x, int y, int w, int h) {
+    job_x = x;
+    job_y = y;
+    job_w = w;
+    job_h = h;
+    (*rect_image_fn)(x, y, w, h / draw_workers, rect_buf);
+
+    pthread_mutex_lock(&draw_lock);
+    draw_gen++;
+    draw_pending = draw_workers - 1;
+    pthread_cond_broadcast(&draw_start);
+    pthread_mutex_unlock(&draw_lock);
+
+    draw_band(0, 0);
+
+    pthread_mutex_lock(&draw_lock);
+    while (draw_pending > 0)
+        pthread_cond_wait(&draw_done, &draw_lock);
+    pthread_mutex_unlock(&draw_lock);
+}
+
+
+/*
+ * draw_worker
+ *     DESCRIPTION: Function executed by a thread helping draw_rect: waits
+ *                  for each new job and draws its band of it.
+ *     INPUTS: arg -- index of the thread's band(1 to MAX_DRAW_WORKERS - 1)
+ *     OUTPUTS: none
+ *     RETURN VALUE: NULL
+ *     SIDE EFFECTS: draws into the build buffer
+ */
+static void* draw_worker(void* arg) {
+    int band = (int)(long)arg; /* band drawn by this thread */
+    unsigned gen = 0;          /* last job drawn            */
+
+    pthread_mutex_lock(&draw_lock);
+    while (1) {
+        while (gen == draw_gen && !draw_quit)
+            pthread_cond_wait(&draw_start, &draw_lock);
+        if (draw_quit)
+            break;
+        gen = draw_gen;
+        pthread_mutex_unlock(&draw_lock);
+
+        draw_band(band, 1);
+
+        pthread_mutex_lock(&draw_lock);
+        if (--draw_pending == 0)
+            pthread_cond_signal(&draw_done);
+    }
+    pthread_mutex_unlock(&draw_lock);
+    return NULL;
+}
+
 #endif /* !defined(TEXT_RESTORE_PROGRAM) */
 
 
@@ -699,6 +1760,11 @@ int draw_horiz_line(int y) {
  *     SIDE EFFECTS: prints an error message to stdout on failure
  */
 static int open_memory_and_ports() {
+#if (MODEX_HEADLESS != 0)
+    /* The emulated VGA needs no mapping or permission. */
+    mem_image = NULL;
+    return 0;
+#else
     int mem_fd;    /* file descriptor for physical memory image */
 
     /* Obtain permission to access ports 0x03C0 through 0x03DA. */
@@ -723,6 +1789,7 @@ static int open_memory_and_ports() {
     /* Close /dev/mem file descriptor and return success. */
     (void)close(mem_fd);
     return 0;
+#endif /* MODEX_HEADLESS */
 }
 
 
@@ -741,6 +1808,10 @@ static void VGA_blank(int blank_bit) {
      */
     blank_bit = ((blank_bit & 1) << 5);
 
+#if (MODEX_HEADLESS != 0)
+    /* The emulated display is never blanked. */
+    (void)blank_bit;
+#else
     asm volatile("                                                      \n\
         movb $0x01, %%al        /* Set sequencer index to 1 */          \n\
         movw $0x03C4, %%dx                                              \n\
@@ -760,6 +1831,7 @@ static void VGA_blank(int blank_bit) {
         : "g"(blank_bit)
         : "eax", "edx", "memory"
     );
+#endif /* MODEX_HEADLESS */
 }
 
 
@@ -820,6 +1892,7 @@ static void set_CRTC_registers(unsigned short table[NUM_CRTC_REGS]) {
  */
 static void set_attr_registers(unsigned char table[NUM_ATTR_REGS * 2]) {
     /* Reset attribute register to write index next rather than data. */
+#if (MODEX_HEADLESS == 0)
     asm volatile("          \n\
         inb (%%dx), %%al    \n\
         "
@@ -827,6 +1900,7 @@ static void set_attr_registers(unsigned char table[NUM_ATTR_REGS * 2]) {
         : "d"(0x03DA)
         : "eax", "memory"
     );
+#endif
     REP_OUTSB(0x03C0, table, NUM_ATTR_REGS * 2);
 }
 
@@ -899,6 +1973,8 @@ static void fill_palette_mode_x() {
 }
 
 
+#if (MODEX_HEADLESS == 0)
+
 /*
  * fill_palette_text
  *     DESCRIPTION: Fill VGA palette with default VGA colors.
@@ -936,6 +2012,8 @@ static void fill_palette_text() {
     REP_OUTSB(0x03C9, palette_RGB, 32 * 3);
 }
 
+#endif /* MODEX_HEADLESS == 0 */
+
 /*fill palette
  *	DESVRIPTION: fill the last 192 palettes
  *	inputs: my_palette from photo
@@ -952,6 +2030,8 @@ void fill_palette(const void * my_palette){
     /* Write all 32 colors from array. */
     REP_OUTSB(0x03C9, my_palette, 192 * 3);				//192 and 3 is the size of palette
 }
+#if (MODEX_HEADLESS == 0)
+
 /*
  * write_font_data
  *     DESCRIPTION: Copy font data into VGA memory, changing and restoring
@@ -1024,17 +2104,24 @@ static void set_text_mode_3(int clear_scr) {
     VGA_blank(0);        /* unblank the screen      */
 }
 
+#endif /* MODEX_HEADLESS == 0 */
+
 
 /*
  * copy_image
- *     DESCRIPTION: Copy one plane of a screen from the build buffer to the video memory.
- *     INPUTS: img -- a pointer to a single screen plane in the build buffer
+ *     DESCRIPTION: Copy one plane of a screen(or a piece of one) from the
+ *                  build buffer to the video memory.
+ *     INPUTS: img -- a pointer to the plane in the build buffer
  *             scr_addr -- the destination offset in video memory
+ *             len -- number of bytes to copy
  *     OUTPUTS: none
  *     RETURN VALUE: none
  *     SIDE EFFECTS: copies a plane from the build buffer to video memory
  */
-static void copy_image(unsigned char* img, unsigned short scr_addr) {
+static void copy_image(unsigned char* img, unsigned short scr_addr, int len) {
+#if (MODEX_HEADLESS != 0)
+    vga_write_planes(scr_addr, img, len);
+#else
     /*
      * memcpy is actually probably good enough here, and is usually
      * implemented using ISA-specific features like those below,
@@ -1042,13 +2129,14 @@ static void copy_image(unsigned char* img, unsigned short scr_addr) {
      */
     asm volatile("                                                  \n\
         cld                                                         \n\
-        movl $14560, %%ecx                                          \n\
+        movl %2, %%ecx                                              \n\
         rep movsb        /* copy ECX bytes from M[ESI] to M[EDI] */ \n\
         "
         : /* no outputs */
-        : "S"(img), "D"(mem_image + scr_addr)
+        : "S"(img), "D"(mem_image + scr_addr), "g"(len)
         : "eax", "ecx", "memory"
     );
+#endif /* MODEX_HEADLESS */
 }
 
 
@@ -1064,6 +2152,9 @@ static void copy_image(unsigned char* img, unsigned short scr_addr) {
  *     SIDE EFFECTS: copies a status_bar from the status_bar_buffer to video memory
  */
 static void copy_status_bar(unsigned char* bar, unsigned short scr_addr) {
+#if (MODEX_HEADLESS != 0)
+    vga_write_planes(scr_addr, bar, PLANE_STATUS_BAR_SIZE);
+#else
     /*
      * memcpy is actually probably good enough here, and is usually
      * implemented using ISA-specific features like those below,
@@ -1078,8 +2169,144 @@ static void copy_status_bar(unsigned char* bar, unsigned short scr_addr) {
         : "S"(bar), "D"(mem_image + scr_addr)
         : "eax", "ecx", "memory"
     );
+#endif /* MODEX_HEADLESS */
+}
+
+
+#if (MODEX_HEADLESS != 0)
+
+/*
+ * vga_outb
+ *     DESCRIPTION: Write a byte to a port of the emulated VGA.  Only the
+ *                  palette ports(0x03C8 and 0x03C9) change any state.
+ *     INPUTS: port -- the port
+ *             val -- the value written
+ *     OUTPUTS: none
+ *     RETURN VALUE: none
+ *     SIDE EFFECTS: may change the emulated palette
+ */
+static void vga_outb(unsigned short port, unsigned char val) {
+    if (port == 0x03C8) {
+        vga_dac_pos = val * 3;
+    } else if (port == 0x03C9) {
+        vga_dac[(vga_dac_pos / 3) & 0xFF][vga_dac_pos % 3] = (val & 0x3F);
+        vga_dac_pos = (vga_dac_pos + 1) % (256 * 3);
+    }
+}
+
+
+/*
+ * vga_outw
+ *     DESCRIPTION: Write two bytes to two consecutive ports of the emulated
+ *                  VGA: a register index(low byte) and the value for that
+ *                  register(high byte).  Sequencer and CRTC registers are
+ *                  recorded; others are ignored.
+ *     INPUTS: port -- the index port
+ *             val -- the index and value
+ *     OUTPUTS: none
+ *     RETURN VALUE: none
+ *     SIDE EFFECTS: may change the emulated registers
+ */
+static void vga_outw(unsigned short port, unsigned short val) {
+    if (port == 0x03C4) {
+        vga_seq[val & 0xFF] = (val >> 8);
+    } else if (port == 0x03D4) {
+        vga_crtc[val & 0xFF] = (val >> 8);
+    }
+}
+
+
+/*
+ * vga_write_planes
+ *     DESCRIPTION: Write bytes to the emulated video memory at an address,
+ *                  into each plane enabled by the write mask(sequencer
+ *                  register 2).
+ *     INPUTS: scr_addr -- the destination offset in video memory
+ *             src -- the bytes to write, or NULL to write zeroes
+ *             len -- number of bytes
+ *     OUTPUTS: none
+ *     RETURN VALUE: none
+ *     SIDE EFFECTS: changes emulated video memory
+ */
+static void vga_write_planes(unsigned short scr_addr, const unsigned char* src, int len) {
+    int i;    /* loop index over planes */
+
+    for (i = 0; i < 4; i++) {
+        if (vga_seq[0x02] & (1 << i)) {
+            if (src == NULL)
+                memset(&vga_mem[i][scr_addr], 0, len);
+            else
+                memcpy(&vga_mem[i][scr_addr], src, len);
+        }
+    }
+}
+
+
+/*
+ * dump_frame_ppm
+ *     DESCRIPTION: Write the screen shown by the emulated VGA to a file
+ *                  as a binary(P6) PPM image, one pixel per mode X pixel.
+ *                  The image is found as the adapter would find it: rows
+ *                  start at the CRTC start address, are the CRTC offset
+ *                  apart, and start again at address 0 after the line
+ *                  compare scan line(which puts the status bar at the
+ *                  bottom of the screen).
+ *     INPUTS: fname -- name of the file
+ *     OUTPUTS: none
+ *     RETURN VALUE: 0 on success, -1 on failure
+ *     SIDE EFFECTS: creates or replaces the file
+ */
+int dump_frame_ppm(const char* fname) {
+    FILE* f;            /* the file                               */
+    int width;          /* pixels per row                         */
+    int scan_lines;     /* scan lines displayed                   */
+    int row_scans;      /* scan lines per row of pixels           */
+    int line_cmp;       /* scan line after which addresses restart */
+    unsigned int start; /* start address                          */
+    unsigned int pitch; /* addresses from one row to the next     */
+    unsigned int addr;  /* address of first pixel of a row        */
+    unsigned char c;    /* color of a pixel                       */
+    int s;              /* loop index over scan lines             */
+    int x;              /* loop index over pixels in a row        */
+
+    width = (vga_crtc[0x01] + 1) * 4;
+    scan_lines = (vga_crtc[0x12] | ((vga_crtc[0x07] & 0x02) << 7) |
+                  ((vga_crtc[0x07] & 0x40) << 3)) + 1;
+    row_scans = (vga_crtc[0x09] & 0x1F) + 1;
+    line_cmp = (vga_crtc[0x18] | ((vga_crtc[0x07] & 0x10) << 4) |
+                ((vga_crtc[0x09] & 0x40) << 3));
+    start = (vga_crtc[0x0C] << 8) | vga_crtc[0x0D];
+    pitch = vga_crtc[0x13] * 2;
+
+    if ((f = fopen(fname, "wb")) == NULL) {
+        perror(fname);
+        return -1;
+    }
+    fprintf(f, "P6\n%d %d\n255\n", width, scan_lines / row_scans);
+
+    /* Emit the first scan line of each row of pixels. */
+    for (s = 0; s + row_scans <= scan_lines; s += row_scans) {
+        if (s <= line_cmp)
+            addr = start + (s / row_scans) * pitch;
+        else
+            addr = ((s - line_cmp - 1) / row_scans) * pitch;
+        for (x = 0; x < width; x++) {
+            c = vga_mem[x & 3][(addr + (x >> 2)) & (MODE_X_MEM_SIZE - 1)];
+            (void)putc(vga_dac[c][0] * 255 / 63, f);
+            (void)putc(vga_dac[c][1] * 255 / 63, f);
+            (void)putc(vga_dac[c][2] * 255 / 63, f);
+        }
+    }
+
+    if (fclose(f) != 0) {
+        perror(fname);
+        return -1;
+    }
+    return 0;
 }
 
+#endif /* MODEX_HEADLESS */
+
 #ifdef TEXT_RESTORE_PROGRAM
 
 /*
@@ -63,6 +63,28 @@
 #define PLANE_STATUS_BAR_SIZE STATUS_BAR_SIZE/4			/*the status bar in each plane is 1440*/
 unsigned char status_bar[STATUS_BAR_SIZE];   /*the buffer of the status bar*/
 
+/*
+ * If MODEX_HEADLESS is not 0, modex.c draws into an emulated VGA held in
+ * memory(four 64kB planes, the palette and the CRTC registers) rather than
+ * into the real adapter, so that programs using it need neither a VGA nor
+ * permission to use one.  Writes to video memory still go through the
+ * plane write mask, so the work measured is that of the real planar path.
+ */
+#ifndef MODEX_HEADLESS
+#define MODEX_HEADLESS 0
+#endif
+
+
+/* counts of work done by modex.c(see get_modex_stats) */
+typedef struct modex_stats_t modex_stats_t;
+struct modex_stats_t {
+    unsigned long bytes_moved;    /* build buffer bytes moved by set_view_window */
+    unsigned long bytes_shown;    /* bytes copied to video memory by show_screen */
+    unsigned long copies_shown;   /* contiguous copies made by show_screen       */
+    unsigned long frames_shown;   /* calls to show_screen that flipped pages     */
+    unsigned long frames_skipped; /* calls to show_screen with nothing to show   */
+};
+
 
 /*
  * NOTES
@@ -117,7 +139,8 @@ unsigned char status_bar[STATUS_BAR_SIZE];   /*the buffer of the status bar*/
 
 /* configure VGA for mode X; initializes logical view to (0, 0) */
 extern int set_mode_X(void(*horiz_fill_fn)(int, int, unsigned char[SCROLL_X_DIM]),
-                      void(*vert_fill_fn)(int, int, unsigned char[SCROLL_Y_DIM]));
+                      void(*vert_fill_fn)(int, int, unsigned char[SCROLL_Y_DIM]),
+                      void(*rect_fill_fn)(int, int, int, int, unsigned char[][SCROLL_X_DIM]));
 
 /* return to text mode */
 extern void clear_mode_X();
@@ -125,7 +148,22 @@ extern void clear_mode_X();
 /* set logical view window coordinates */
 extern void set_view_window(int scr_x, int scr_y);
 
-/* show the logical view window on the monitor */
+/*
+ * address the build buffer as a ring(nonzero, the default) or as a window
+ * that is moved when the view leaves it(0); the view returns to (0, 0),
+ * and the whole screen must be drawn again
+ */
+extern void set_ring_build(int ring);
+
+/* get the counts of work done since set_mode_X */
+extern void get_modex_stats(modex_stats_t* stats);
+
+/*
+ * show the logical view window on the monitor(copying only the rows drawn
+ * or moved since the page being filled was last shown, and nothing at all
+ * if nothing has changed since the last call); nothing may be drawn on
+ * other threads meanwhile
+ */
 extern void show_screen();
 
 /* clear the video memory in mode X */
@@ -134,12 +172,65 @@ extern void clear_screens();
 /*show the status_bar on the monitor*/
 extern void show_status_bar();
 
+/*
+ * show the room name and typed command in the status bar, or a message
+ * instead if msg is not empty; only the parts that changed since the last
+ * call are drawn, and video memory is written only if the bar changed
+ */
+extern void update_status_bar(const char* room, const char* typed, const char* msg);
+
 /* draw a horizontal line at vertical pixel y within the logical view window */
 extern int draw_horiz_line(int y);
 
 /* draw a vertical line at horizontal pixel x within the logical view window */
 extern int draw_vert_line(int x);
 
+/* draw a rectangle at pixel (x,y) of size w x h within the logical view window */
+extern int draw_rect(int x, int y, int w, int h);
+
+/*
+ * A planar frame holds an image of the whole logical view window as the
+ * build buffer does: four planes of FRAME_PLANE_SIZE bytes, each a row of
+ * SCROLL_X_WIDTH bytes at a time, with pixel columns 3, 2, 1 and 0 mod 4
+ * in planes 0 to 3.  Copy one into the build buffer with draw_frame(the
+ * left edge of the view window must be a multiple of four pixels; returns
+ * 0 on success).
+ */
+#define FRAME_PLANE_SIZE (SCROLL_X_WIDTH * SCROLL_Y_DIM)
+#define FRAME_SIZE       (FRAME_PLANE_SIZE * 4)
+extern int draw_frame(const unsigned char* frame);
+
+/*
+ * draw large rectangles with n threads(1 to 4; 1, the default, draws
+ * serially), each drawing a band of rows; the calling thread uses the
+ * rectangle callback for the first band, and the others use band_fill_fn,
+ * which must only read shared data; returns 0 on success
+ */
+extern int set_draw_workers(int n,
+                            void(*band_fill_fn)(int, int, int, int,
+                                                unsigned char[][SCROLL_X_DIM]));
+
+/*
+ * scatter a line of n pixels into the four planes of a mode X image: pixel
+ * i is column phase + i(phase 0 to 3) and goes to byte (phase + i) / 4 of
+ * plane[(phase + i) % 4]
+ */
+extern void scatter_planes(const unsigned char* src, int n, int phase,
+                           unsigned char* const plane[4]);
+
+/*
+ * choose the kernel("scalar", "sse2" or "ssse3") used by scatter_planes,
+ * or NULL for the fastest that the CPU supports; returns 0 if there is no
+ * kernel by that name or the CPU lacks support for it, or 1 on success
+ */
+extern int select_scatter_kernel(const char* name);
+
+/* get the name of the idx'th scatter kernel built in (NULL past the end) */
+extern const char* scatter_kernel_by_index(int idx);
+
 void fill_palette(const void * my_palette);
 
+/* write the screen shown by the emulated VGA to a PPM file(MODEX_HEADLESS only) */
+extern int dump_frame_ppm(const char* fname);
+
 #endif /* MODEX_H */
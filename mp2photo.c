@@ -47,6 +47,14 @@
  * row.  The header simply gives the dimensions of the image.
  */
 
+/*
+ * Built with WRITE_PALETTIZED_PHOTO(as mp2pphoto), it instead chooses the
+ * palette for a room photo offline, exactly as the game would, and writes
+ * a palettized photo(see photo_headers.h) that the game can load without
+ * further work.  The input may then be either a BMP or a 5:6:5 room photo,
+ * and an optional third argument names the quantizer(see quantize.h) used.
+ */
+
 
 #include <stdint.h>
 #include <stdio.h>
@@ -54,11 +62,18 @@
 #include <string.h>
 
 #include "photo_headers.h"
+#include "quantize.h"
 
 
 #ifndef WRITE_OBJECT_IMAGE
 #define WRITE_OBJECT_IMAGE 0        /* output defaults to room photo */
 #endif
+#ifndef WRITE_PALETTIZED_PHOTO
+#define WRITE_PALETTIZED_PHOTO 0    /* output defaults to 5:6:5 pixels */
+#endif
+
+// Largest palettized photo accepted(same limit as BMP input).
+#define MAX_PPHOTO_DIM 4096
 
 
 /*
@@ -119,6 +134,7 @@ static uint8_t* read_bmp_image_data(FILE* in, const bmp_header_t* h) {
     return img_data;
 }
 
+#if (1 != WRITE_PALETTIZED_PHOTO)
 // Write header and data as either 5:6:5 RGB words(little endian) or
 // 2:2:2 RGB bytes, row by row, to the output file.  Return 1 on success,
 // 0 on failure.
@@ -168,19 +184,134 @@ static int write_output_file(FILE* out, const bmp_header_t* h, const uint8_t* im
 
     return 1;
 }
+#endif /* WRITE_PALETTIZED_PHOTO */
 
-int main(int argc, char* argv[]) {
-    FILE*        in;
-    FILE*        out;
+#if (1 == WRITE_PALETTIZED_PHOTO)
+// Read 5:6:5 pixels from a BMP file or from a room photo file into
+// dynamically allocated memory, top row first.  Return pointer to memory
+// on success, or NULL on failure.
+static uint16_t* read_input_pixels(const char* fname, FILE* in, photo_header_t* hdr) {
     bmp_header_t bmp_header;
+    char         magic[2];
     uint8_t*     img_data;
-    int32_t      written;
+    uint16_t*    pixels;
+    uint32_t     row_width;
+    uint16_t     x;
+    uint16_t     y;
+
+    if (2 != fread(magic, sizeof (magic[0]), 2, in) || 0 != fseek(in, 0, SEEK_SET)) {
+        fprintf(stderr, "%s is too short.\n", fname);
+        return NULL;
+    }
+
+    // A room photo: read all pixels at once, then flip the rows in place.
+    if (0 != memcmp(magic, BMP_MAGIC, 2)) {
+        if (1 != fread(hdr, sizeof (*hdr), 1, in) ||
+            MAX_PPHOTO_DIM < hdr->width || MAX_PPHOTO_DIM < hdr->height) {
+            fprintf(stderr, "%s does not appear to be a BMP file or a room photo.\n", fname);
+            return NULL;
+        }
+        if (NULL == (pixels = malloc(hdr->width * hdr->height * sizeof (pixels[0]))) ||
+            (0 < hdr->width * hdr->height &&
+             1 != fread(pixels, hdr->width * hdr->height * sizeof (pixels[0]), 1, in))) {
+            if (NULL != pixels) {
+                free(pixels);
+            }
+            perror("allocate and read photo");
+            return NULL;
+        }
+        for (y = 0; hdr->height / 2 > y; y++) {
+            for (x = 0; hdr->width > x; x++) {
+                uint16_t tmp = pixels[hdr->width * y + x];
+                pixels[hdr->width * y + x] = pixels[hdr->width * (hdr->height - 1 - y) + x];
+                pixels[hdr->width * (hdr->height - 1 - y) + x] = tmp;
+            }
+        }
+        return pixels;
+    }
+
+    // A BMP: convert to 5:6:5 as for a room photo, top row first.
+    if (!bmp_header_check(fname, in, &bmp_header) ||
+        NULL == (img_data = read_bmp_image_data(in, &bmp_header))) {
+        return NULL;
+    }
+    hdr->width = bmp_header.img_width;
+    hdr->height = bmp_header.img_height;
+    if (NULL == (pixels = malloc(hdr->width * hdr->height * sizeof (pixels[0])))) {
+        free(img_data);
+        perror("allocate photo");
+        return NULL;
+    }
+    row_width = bmp_row_width(&bmp_header);
+    for (y = 0; hdr->height > y; y++) {
+        for (x = 0; hdr->width > x; x++) {
+            pixels[hdr->width * (hdr->height - 1 - y) + x] =
+            ((img_data[row_width * y + 3 * x + 2] >> 3) << 11) |
+            ((img_data[row_width * y + 3 * x + 1] >> 2) << 5) |
+            (img_data[row_width * y + 3 * x] >> 3);
+        }
+    }
+    free(img_data);
+    return pixels;
+}
+
+// Choose the palette for a room photo and write the palettized photo to
+// the output file.  Return 1 on success, 0 on failure.
+static int write_pphoto_file(FILE* out, const photo_header_t* hdr, const uint16_t* pixels) {
+    uint8_t  palette[PPHOTO_COLORS][3];
+    uint8_t* img;
+    int      written;
+
+    if (NULL == (img = malloc(hdr->width * hdr->height))) {
+        perror("allocate palettized photo");
+        return 0;
+    }
+    quantize_photo(pixels, hdr->width * hdr->height, palette, img);
+
+    written = (1 == fwrite(PPHOTO_MAGIC, PPHOTO_MAGIC_LEN, 1, out) &&
+               1 == fwrite(hdr, sizeof (*hdr), 1, out) &&
+               1 == fwrite(palette, sizeof (palette), 1, out) &&
+               (0 == hdr->width * hdr->height ||
+                1 == fwrite(img, hdr->width * hdr->height, 1, out)));
+    if (!written) {
+        perror("write palettized photo to output file");
+    }
+    free(img);
+    return written;
+}
+#endif /* WRITE_PALETTIZED_PHOTO */
+
+int main(int argc, char* argv[]) {
+    FILE*          in;
+    FILE*          out;
+#if (1 == WRITE_PALETTIZED_PHOTO)
+    photo_header_t     photo_header;
+    uint16_t*          pixels;
+    const quantizer_t* q;
+    int32_t            q_idx;
+#else
+    bmp_header_t   bmp_header;
+    uint8_t*       img_data;
+#endif
+    int32_t        written;
 
     // Check syntax of invocation.
+#if (1 == WRITE_PALETTIZED_PHOTO)
+    // An optional third argument names the palette quantizer.
+    if ((3 != argc && 4 != argc) || (4 == argc && !select_quantizer(argv[3]))) {
+        fprintf(stderr, "usage: %s <BMP or photo file name> <output file> [quantizer]\n", argv[0]);
+        fprintf(stderr, "quantizers:\n");
+        for (q_idx = 0; NULL != (q = quantizer_by_index(q_idx)); q_idx++) {
+            fprintf(stderr, "    %-12s %s\n", q->name, q->description);
+        }
+        return 2;
+    }
+#else
     if (3 != argc) {
         fprintf(stderr, "usage: %s <BMP file name> <output file>\n", argv[0]);
         return 2;
     }
+#endif
 
     // Try to open the two files.
     if (NULL == (in = fopen(argv[1], "r+b"))) {
@@ -193,6 +324,27 @@ int main(int argc, char* argv[]) {
         return 2;
     }
 
+#if (1 == WRITE_PALETTIZED_PHOTO)
+    // Read image data from input file as 5:6:5 pixels.
+    if (NULL == (pixels = read_input_pixels(argv[1], in, &photo_header))) {
+        fclose(in);
+        fclose(out);
+        return 2;
+    }
+
+    // Done with the input file.  Ignore remaining errors.
+    (void)fclose(in);
+
+    // Try to write, then close, the output file.
+    written = write_pphoto_file(out, &photo_header, pixels);
+    if (EOF == fclose(out)) {
+        perror("close output file");
+        written = 0;
+    }
+
+    // Free the image data.
+    free(pixels);
+#else /* (1 != WRITE_PALETTIZED_PHOTO) */
     // Check validity of input file, then read image data from input file.
     if (!bmp_header_check(argv[1], in, &bmp_header) ||
         NULL == (img_data = read_bmp_image_data(in, &bmp_header))) {
@@ -213,6 +365,7 @@ int main(int argc, char* argv[]) {
 
     // Free the image data.
     free(img_data);
+#endif /* WRITE_PALETTIZED_PHOTO */
 
     // Return value based on success of output file write and close.
     return (written ? 0 : 3);
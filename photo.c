@@ -36,15 +36,63 @@
  */
 
 
+#include <fcntl.h>
+#include <limits.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "assert.h"
 #include "modex.h"
 #include "photo.h"
 #include "photo_headers.h"
+#include "quantize.h"
 #include "world.h"
 
 
+/* parameters defined for this file */
+
+/*
+ * Room photo pixels are normally stored a row at a time.  If PHOTO_TILED
+ * is 1, photos are instead stored in square tiles of PHOTO_TILE_DIM
+ * pixels on a side, so that a vertical line touches a few pixels in each
+ * cache line rather than one.  The layout can also be chosen at run time
+ * with set_photo_tiling.
+ */
+#ifndef PHOTO_TILED
+#define PHOTO_TILED      0
+#endif
+#define PHOTO_TILE_SHIFT 4                         /* log2 of tile size  */
+#define PHOTO_TILE_DIM   (1 << PHOTO_TILE_SHIFT)   /* pixels on a side   */
+#define PHOTO_TILE_MASK  (PHOTO_TILE_DIM - 1)      /* pixel within tile  */
+
+/*
+ * Lines of the room on the screen are normally drawn from the room photo
+ * and the objects in the room.  If ROOM_CACHE_SLOTS is not 0, that many
+ * rooms(the current room and those shown most recently) instead keep a
+ * layer: an image of the photo with the objects already drawn on it, from
+ * which lines are simply copied.  A layer is built when first needed and
+ * rebuilt when the room's objects(or photo) change.  Each layer takes one
+ * byte per photo pixel.  The number can be changed with set_room_cache.
+ */
+#ifndef ROOM_CACHE_SLOTS
+#define ROOM_CACHE_SLOTS 4
+#endif
+
+/*
+ * While the player is idle, the game renders the screen seen on entering
+ * each room next to the player's(see prerender_near_room) into one of
+ * ENTRY_FRAMES planar frames, so that entering the room need only copy
+ * the frame into the build buffer(see show_entry_frame).  A frame is used
+ * only if the room has not changed since it was rendered.  Each frame
+ * takes FRAME_SIZE bytes, allocated when first used; 0 turns frames off.
+ */
+#ifndef ENTRY_FRAMES
+#define ENTRY_FRAMES 4
+#endif
+#define ENTRY_BAND   16  /* rows filled at a time when rendering a frame */
+
+
 /* types local to this file(declared in types.h) */
 
 /*
@@ -54,11 +102,35 @@
  * Pixel data are stored as one-byte values starting from the upper
  * left and traversing the top row before returning to the left of
  * the second row, and so forth.  No padding should be used.
+ *
+ * If the photo is tiled(tile_cols is not 0), the pixel data are instead
+ * stored as PHOTO_TILE_DIM x PHOTO_TILE_DIM tiles, each stored as above,
+ * with the tiles in the same order as pixels(see tile_offset).  Partial
+ * tiles at the right and bottom edges are padded.
  */
 struct photo_t {
     photo_header_t hdr;            /* defines height and width */
-    uint8_t        palette[192][3];     /* optimized palette colors */
+    uint8_t        palette[QUANT_N_COLORS][3]; /* optimized palette colors */
     uint8_t*       img;                 /* pixel data               */
+    uint32_t       tile_cols;           /* tiles per row, or 0      */
+};
+
+/* a run of opaque pixels in one row or column of an object image */
+typedef struct obj_span_t obj_span_t;
+struct obj_span_t {
+    uint8_t start; /* offset of first opaque pixel in row/column */
+    uint8_t len;   /* number of opaque pixels                    */
+};
+
+/*
+ * The runs of opaque pixels in each row(or each column) of an object
+ * image, so that transparent pixels need not be looked at when drawing.
+ * The runs of line i are spans[first[i]] up to spans[first[i + 1]].
+ */
+typedef struct span_table_t span_table_t;
+struct span_table_t {
+    uint16_t*   first; /* first run of each line, then total runs */
+    obj_span_t* spans; /* the runs, line by line                  */
 };
 
 /*
@@ -68,27 +140,58 @@ struct photo_t {
  * transparent pixels(value OBJ_CLR_TRANSP).  As with the room photos,
  * pixel data are stored as one-byte values starting from the upper
  * left and traversing the top row before returning to the left of the
- * second row, and so forth.  No padding is used.
+ * second row, and so forth.  No padding is used.  The opaque runs of
+ * each row and column are found when the image is read.
  */
 struct image_t {
-    photo_header_t hdr;  /* defines height and width */
-    uint8_t*       img;  /* pixel data               */
+    photo_header_t hdr;  /* defines height and width   */
+    uint8_t*       img;  /* pixel data                 */
+    span_table_t   rows; /* opaque runs in each row    */
+    span_table_t   cols; /* opaque runs in each column */
 };
 
 
-/* file-scope variables */
+/*
+ * A room's photo with its objects drawn on it(see ROOM_CACHE_SLOTS).  The
+ * layer is at least as large as the screen, with black beyond the photo.
+ */
+typedef struct room_layer_t room_layer_t;
+struct room_layer_t {
+    const room_t* room;     /* room shown, or NULL if slot unused     */
+    uint32_t      version;  /* room_version when built                */
+    uint32_t      width;    /* pixels per row                         */
+    uint32_t      height;   /* number of rows                         */
+    uint32_t      last_use; /* layer_clock when last used             */
+    uint8_t*      img;      /* pixel data, top row first              */
+};
 
-/*the struction of octree node*/
-struct octree_node {
-	uint16_t idx_by_rgb;
-	uint16_t level2_idx;
-	uint16_t palette_idx;
-	unsigned long int red_sum;
-	unsigned long int green_sum;
-	unsigned long int blue_sum;
-	unsigned int pixel_number;
+/*
+ * The screen seen on entering a room(with the view window at (0,0)), in
+ * the planar layout taken by draw_frame, and the room's palette(see
+ * ENTRY_FRAMES).
+ */
+typedef struct entry_frame_t entry_frame_t;
+struct entry_frame_t {
+    const room_t* room;      /* room shown, or NULL if slot unused  */
+    uint32_t      version;   /* room_version when rendered          */
+    uint32_t      last_use;  /* entry_clock when last rendered/shown */
+    uint8_t       palette[QUANT_N_COLORS][3]; /* room photo palette */
+    uint8_t*      planes;    /* FRAME_SIZE bytes(NULL until used)   */
 };
 
+/*
+ * The pixels of a mapped room photo file, read a row at a time by the
+ * quantizer(see photo_file_row).
+ */
+typedef struct photo_file_t photo_file_t;
+struct photo_file_t {
+    const uint8_t* pixels; /* pixel data in the file, bottom row first */
+    uint32_t       width;  /* pixels per row                          */
+    uint32_t       height; /* number of rows                          */
+};
+
+
+/* file-scope variables */
 
 /*
  * The room currently shown on the screen.  This value is not known to
@@ -98,6 +201,270 @@ struct octree_node {
  */
 static const room_t* cur_room = NULL;
 
+/*
+ * Whether photos are tiled when read.  Set only by set_photo_tiling, which
+ * must not be called while photos are being read.
+ */
+static int32_t photo_tiling = PHOTO_TILED;
+
+/*
+ * Whether read_photo uses palettized photos.  Set only by set_pphoto_use,
+ * which must not be called while photos are being read.
+ */
+static int32_t pphoto_use = 1;
+
+/*
+ * Room layers(see ROOM_CACHE_SLOTS), of which the first n_layers slots
+ * are in use, and a counter used to find the least recently used layer.
+ * Changed only by threads drawing the room(the game loop and the Tux
+ * thread, which take turns by holding cmd_lock in adventure.c); threads
+ * helping one draw a rectangle only read the layers(see find_room_layer).
+ */
+static room_layer_t layer[MAX_ROOM_CACHE_SLOTS];
+static int32_t      n_layers = (MAX_ROOM_CACHE_SLOTS < ROOM_CACHE_SLOTS ?
+                                MAX_ROOM_CACHE_SLOTS : ROOM_CACHE_SLOTS);
+static uint32_t     layer_clock = 0;
+
+/*
+ * Entry frames(see ENTRY_FRAMES), a counter used to find the least
+ * recently used frame, and counts of their use.  Used only by threads
+ * drawing the room, which take turns as for the room layers.
+ */
+static entry_frame_t entry[ENTRY_FRAMES > 0 ? ENTRY_FRAMES : 1];
+static uint32_t      entry_clock = 0;
+static entry_stats_t entry_stats;
+
+
+/* local functions--see function headers for details */
+static int32_t build_layer(room_layer_t* lay, const room_t* r);
+static int32_t build_spans(const uint8_t* img, uint32_t n_lines, uint32_t line_len,
+                           uint32_t line_step, uint32_t pixel_step,
+                           span_table_t* table);
+static int32_t check_image_header(const photo_header_t* hdr, uint32_t max_width,
+                                  uint32_t max_height, uint32_t pixel_size,
+                                  size_t file_size);
+static entry_frame_t* entry_frame_slot(const room_t* const exits[N_ROOM_EXITS]);
+static void fill_room_rect(const room_t* r, const photo_t* view, int x, int y,
+                           int w, int h, unsigned char buf[][SCROLL_X_DIM]);
+static entry_frame_t* find_entry_frame(const room_t* r);
+static const room_layer_t* find_room_layer(const room_t* r);
+static void layer_horiz_line(const room_layer_t* lay, int x, int y,
+                             unsigned char buf[SCROLL_X_DIM]);
+static void layer_vert_line(const room_layer_t* lay, int x, int y,
+                            unsigned char buf[SCROLL_Y_DIM]);
+static const uint8_t* map_file(const char* fname, size_t min_len, size_t* map_len);
+static const uint8_t* map_image_file(const char* fname, uint32_t max_width,
+                                     uint32_t max_height, uint32_t pixel_size,
+                                     photo_header_t* hdr, size_t* map_len);
+static const uint16_t* photo_file_row(const void* src, uint32_t y);
+static void* read_image_pixels(const char* fname, uint32_t max_width,
+                               uint32_t max_height, uint32_t pixel_size,
+                               photo_header_t* hdr);
+static int32_t read_photo_mapped(const char* fname, photo_t* p);
+static int32_t read_pphoto(const char* fname, photo_t* p);
+static int32_t render_entry_frame(entry_frame_t* f, const room_t* r,
+                                  const photo_t* view);
+static const room_layer_t* room_layer(const room_t* r);
+static size_t tile_offset(const photo_t* p, uint32_t x, uint32_t y);
+static void tile_photo(photo_t* p);
+
+
+/*
+ * build_layer
+ *   DESCRIPTION: Draw a room's photo and the objects in the room into a
+ *                room layer, in the same order that fill_horiz_buffer
+ *                draws them.
+ *   INPUTS: lay -- the layer(its image is reallocated to fit the room)
+ *           r -- the room
+ *   OUTPUTS: lay -- image, size and version filled in
+ *   RETURN VALUE: 1 on success, or 0 if memory runs out(the layer is
+ *                 then left unused)
+ *   SIDE EFFECTS: dynamically allocates memory for the image
+ */
+static int32_t build_layer(room_layer_t* lay, const room_t* r) {
+    const photo_t*    view;  /* room photo                          */
+    const object_t*   obj;   /* loop index over objects in the room */
+    const image_t*    img;   /* object image                        */
+    const obj_span_t* span;  /* index over runs of an image row     */
+    const obj_span_t* end;   /* after last run of the row           */
+    unsigned char     buf[SCROLL_X_DIM]; /* one photo line          */
+    uint8_t*          new_img; /* resized image                     */
+    uint32_t          width; /* pixels per layer row                */
+    uint32_t          height; /* layer rows                         */
+    uint32_t          x;     /* index over layer columns            */
+    uint32_t          y;     /* index over layer rows               */
+    uint32_t          row;   /* index over object image rows        */
+    uint32_t          lo;    /* first layer column of a run         */
+    uint32_t          hi;    /* after last layer column of a run    */
+
+    view = room_photo(r);
+    width = (SCROLL_X_DIM > view->hdr.width ? SCROLL_X_DIM : view->hdr.width);
+    height = (SCROLL_Y_DIM > view->hdr.height ? SCROLL_Y_DIM : view->hdr.height);
+    if (width * height != lay->width * lay->height) {
+        if (NULL == (new_img = realloc(lay->img, (size_t)width * height))) {
+            free(lay->img);
+            lay->img = NULL;
+            lay->room = NULL;
+            lay->width = lay->height = 0;
+            return 0;
+        }
+        lay->img = new_img;
+    }
+    lay->room = r;
+    lay->version = room_version(r);
+    lay->width = width;
+    lay->height = height;
+
+    /* Copy the photo a screen width at a time, with black below it. */
+    for (y = 0; height > y; y++) {
+        if (view->hdr.height <= y) {
+            (void)memset(&lay->img[(size_t)width * y], 0, width);
+            continue;
+        }
+        for (x = 0; width > x; x += SCROLL_X_DIM) {
+            photo_horiz_line(view, x, y, buf);
+            (void)memcpy(&lay->img[(size_t)width * y + x], buf,
+                         (SCROLL_X_DIM < width - x ? SCROLL_X_DIM : width - x));
+        }
+    }
+
+    /* Draw the opaque runs of each object over it. */
+    for (obj = room_contents_iterate(r); NULL != obj; obj = obj_next(obj)) {
+        img = obj_image(obj);
+        x = obj_get_x(obj);
+        for (row = 0; img->hdr.height > row && height > obj_get_y(obj) + row; row++) {
+            y = obj_get_y(obj) + row;
+            end = &img->rows.spans[img->rows.first[row + 1]];
+            for (span = &img->rows.spans[img->rows.first[row]]; end > span; span++) {
+                lo = x + span->start;
+                hi = lo + span->len;
+                hi = (width < hi ? width : hi);
+                if (lo < hi) {
+                    (void)memcpy(&lay->img[(size_t)width * y + lo],
+                                 &img->img[img->hdr.width * row + lo - x], hi - lo);
+                }
+            }
+        }
+    }
+    return 1;
+}
+
+
+/*
+ * build_spans
+ *   DESCRIPTION: Find the runs of opaque pixels in each row or each column
+ *                of an object image.
+ *   INPUTS: img -- pixel data of the image
+ *           n_lines -- number of rows(or columns)
+ *           line_len -- pixels in a row(or column)
+ *           line_step -- distance in img from one line to the next
+ *           pixel_step -- distance in img from one pixel of a line to
+ *                         the next
+ *   OUTPUTS: table -- the runs found
+ *   RETURN VALUE: 1 on success, or 0 if memory runs out
+ *   SIDE EFFECTS: dynamically allocates memory for the table
+ */
+static int32_t build_spans(const uint8_t* img, uint32_t n_lines, uint32_t line_len,
+                           uint32_t line_step, uint32_t pixel_step,
+                           span_table_t* table) {
+    const uint8_t* line;    /* first pixel of a line        */
+    uint32_t       i;       /* index over lines             */
+    uint32_t       k;       /* index over pixels in a line  */
+    uint32_t       start;   /* first pixel of a run         */
+    uint32_t       n_spans; /* number of runs found         */
+    int32_t        store;   /* 0 to count runs, 1 to record */
+
+    if (NULL == (table->first = malloc((n_lines + 1) * sizeof (table->first[0])))) {
+        return 0;
+    }
+    table->spans = NULL;
+
+    /* Count the runs, then allocate space and find them again. */
+    for (store = 0; 2 > store; store++) {
+        n_spans = 0;
+        for (i = 0, line = img; n_lines > i; i++, line += line_step) {
+            table->first[i] = n_spans;
+            for (k = 0; line_len > k; ) {
+                if (OBJ_CLR_TRANSP == line[k * pixel_step]) {
+                    k++;
+                    continue;
+                }
+                for (start = k; line_len > k && OBJ_CLR_TRANSP != line[k * pixel_step]; k++) {
+                }
+                if (store) {
+                    table->spans[n_spans].start = start;
+                    table->spans[n_spans].len = k - start;
+                }
+                n_spans++;
+            }
+        }
+        table->first[n_lines] = n_spans;
+        if (!store &&
+            NULL == (table->spans = malloc((0 < n_spans ? n_spans : 1) * sizeof (table->spans[0])))) {
+            free(table->first);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+
+/*
+ * check_image_header
+ *   DESCRIPTION: Sanity check the header of a room photo or object image
+ *                file against the size limits for that kind of image and
+ *                against the size of the file.
+ *   INPUTS: hdr -- header read from the file
+ *           max_width -- largest width allowed, in pixels
+ *           max_height -- largest height allowed, in pixels
+ *           pixel_size -- bytes per pixel in the file
+ *           file_size -- size of the whole file in bytes
+ *   OUTPUTS: none
+ *   RETURN VALUE: 1 if the header is acceptable, or 0 if not
+ *   SIDE EFFECTS: none
+ */
+static int32_t check_image_header(const photo_header_t* hdr, uint32_t max_width,
+                                  uint32_t max_height, uint32_t pixel_size,
+                                  size_t file_size) {
+    if (max_width < hdr->width || max_height < hdr->height) {
+        return 0;
+    }
+
+    /* The pixel data must all be present(trailing bytes are ignored). */
+    return (sizeof (*hdr) + (size_t)hdr->width * hdr->height * pixel_size <= file_size);
+}
+
+
+/*
+ * entry_frame_slot
+ *   DESCRIPTION: Choose an entry frame to render a new room into: an
+ *                unused frame, or else the least recently used frame not
+ *                holding one of the rooms next to the player's.
+ *   INPUTS: exits -- rooms next to the player's(NULL where none)
+ *   OUTPUTS: none
+ *   RETURN VALUE: the frame, or NULL if every frame holds one of exits
+ *   SIDE EFFECTS: none
+ */
+static entry_frame_t* entry_frame_slot(const room_t* const exits[N_ROOM_EXITS]) {
+    entry_frame_t* best = NULL; /* frame chosen so far  */
+    int32_t        idx;         /* index over frames    */
+    int32_t        e;           /* index over exits     */
+
+    for (idx = 0; ENTRY_FRAMES > idx; idx++) {
+        for (e = 0; N_ROOM_EXITS > e && entry[idx].room != exits[e]; e++);
+        if (NULL != entry[idx].room && N_ROOM_EXITS > e) {
+            continue;
+        }
+        if (NULL == entry[idx].room) {
+            return &entry[idx];
+        }
+        if (NULL == best || entry[idx].last_use < best->last_use) {
+            best = &entry[idx];
+        }
+    }
+    return best;
+}
+
 
 /*
  * fill_horiz_buffer
@@ -115,26 +482,29 @@ static const room_t* cur_room = NULL;
  *   SIDE EFFECTS: none
  */
 void fill_horiz_buffer(int x, int y, unsigned char buf[SCROLL_X_DIM]) {
-    int            idx;   /* loop index over pixels in the line          */
-    object_t*      obj;   /* loop index over objects in the current room */
-    int            imgx;  /* loop index over pixels in object image      */
-    int            yoff;  /* y offset into object image                  */
-    uint8_t        pixel; /* pixel from object image                     */
+    const obj_link_t* link; /* loop index over objects near the line     */
+    object_t*      obj;   /* an object in the current room               */
     const photo_t* view;  /* room photo                                  */
     int32_t        obj_x; /* object x position                           */
     int32_t        obj_y; /* object y position                           */
     const image_t* img;   /* object image                                */
+    const room_layer_t* lay; /* room layer, if kept                      */
+
+    /* Copy the line from the room layer if there is one. */
+    if (NULL != (lay = room_layer(cur_room))) {
+        layer_horiz_line(lay, x, y, buf);
+        return;
+    }
 
     /* Get pointer to current photo of current room. */
     view = room_photo(cur_room);
 
-    /* Loop over pixels in line. */
-    for (idx = 0; idx < SCROLL_X_DIM; idx++) {
-        buf[idx] = (0 <= x + idx && view->hdr.width > x + idx ? view->img[view->hdr.width * y + x + idx] : 0);
-    }
+    /* Draw the photo. */
+    photo_horiz_line(view, x, y, buf);
 
-    /* Loop over objects in the current room. */
-    for (obj = room_contents_iterate(cur_room); NULL != obj; obj = obj_next(obj)) {
+    /* Loop over objects in the current room that may cover the line. */
+    for (link = room_row_iterate(cur_room, y); NULL != link; link = obj_link_next(link)) {
+        obj = obj_link_object(link);
         obj_x = obj_get_x(obj);
         obj_y = obj_get_y(obj);
         img = obj_image(obj);
@@ -144,31 +514,8 @@ void fill_horiz_buffer(int x, int y, unsigned char buf[SCROLL_X_DIM]) {
             continue;
         }
 
-        /* The y offset of drawing is fixed. */
-        yoff = (y - obj_y) * img->hdr.width;
-
-        /*
-         * The x offsets depend on whether the object starts to the left
-         * or to the right of the starting point for the line being drawn.
-         */
-        if (x <= obj_x) {
-            idx = obj_x - x;
-            imgx = 0;
-        }
-        else {
-            idx = 0;
-            imgx = x - obj_x;
-        }
-
-        /* Copy the object's pixel data. */
-        for (; SCROLL_X_DIM > idx && img->hdr.width > imgx; idx++, imgx++) {
-            pixel = img->img[yoff + imgx];
-
-            /* Don't copy transparent pixels. */
-            if (OBJ_CLR_TRANSP != pixel) {
-                buf[idx] = pixel;
-            }
-        }
+        /* Copy the opaque pixels of the object's row. */
+        image_horiz_line(img, obj_x - x, y - obj_y, buf);
     }
 }
 
@@ -189,26 +536,29 @@ void fill_horiz_buffer(int x, int y, unsigned char buf[SCROLL_X_DIM]) {
  *   SIDE EFFECTS: none
  */
 void fill_vert_buffer(int x, int y, unsigned char buf[SCROLL_Y_DIM]) {
-    int            idx;   /* loop index over pixels in the line          */
-    object_t*      obj;   /* loop index over objects in the current room */
-    int            imgy;  /* loop index over pixels in object image      */
-    int            xoff;  /* x offset into object image                  */
-    uint8_t        pixel; /* pixel from object image                     */
+    const obj_link_t* link; /* loop index over objects near the line     */
+    object_t*      obj;   /* an object in the current room               */
     const photo_t* view;  /* room photo                                  */
     int32_t        obj_x; /* object x position                           */
     int32_t        obj_y; /* object y position                           */
     const image_t* img;   /* object image                                */
+    const room_layer_t* lay; /* room layer, if kept                      */
+
+    /* Copy the line from the room layer if there is one. */
+    if (NULL != (lay = room_layer(cur_room))) {
+        layer_vert_line(lay, x, y, buf);
+        return;
+    }
 
     /* Get pointer to current photo of current room. */
     view = room_photo(cur_room);
 
-    /* Loop over pixels in line. */
-    for (idx = 0; idx < SCROLL_Y_DIM; idx++) {
-        buf[idx] = (0 <= y + idx && view->hdr.height > y + idx ? view->img[view->hdr.width *(y + idx) + x] : 0);
-    }
+    /* Draw the photo. */
+    photo_vert_line(view, x, y, buf);
 
-    /* Loop over objects in the current room. */
-    for (obj = room_contents_iterate(cur_room); NULL != obj; obj = obj_next(obj)) {
+    /* Loop over objects in the current room that may cover the line. */
+    for (link = room_col_iterate(cur_room, x); NULL != link; link = obj_link_next(link)) {
+        obj = obj_link_object(link);
         obj_x = obj_get_x(obj);
         obj_y = obj_get_y(obj);
         img = obj_image(obj);
@@ -219,35 +569,196 @@ void fill_vert_buffer(int x, int y, unsigned char buf[SCROLL_Y_DIM]) {
             continue;
         }
 
-        /* The x offset of drawing is fixed. */
-        xoff = x - obj_x;
+        /* Copy the opaque pixels of the object's column. */
+        image_vert_line(img, obj_y - y, x - obj_x, buf);
+    }
+}
 
-        /*
-         * The y offsets depend on whether the object starts below or
-         * above the starting point for the line being drawn.
-         */
-        if (y <= obj_y) {
-            idx = obj_y - y;
-            imgy = 0;
+
+/*
+ * fill_rect_buffer
+ *   DESCRIPTION: Given the(x,y) map pixel coordinate of the upper left
+ *                pixel of a rectangle to be drawn on the screen, this
+ *                routine produces an image of the rectangle, one row of
+ *                the rectangle per row of the buffer.  The photo rows are
+ *                copied first, then the objects that overlap the
+ *                rectangle are drawn one row band(see room_row_iterate)
+ *                at a time, each over all of its rows in the band, in the
+ *                same order fill_horiz_buffer draws them.
+ *
+ *                Each row of the buffer may be written past the width of
+ *                the rectangle(up to SCROLL_X_DIM pixels).
+ *
+ *   INPUTS:(x,y) -- upper left pixel of rectangle to be drawn
+ *          w, h -- width and height of rectangle(at most SCROLL_X_DIM
+ *                  and SCROLL_Y_DIM)
+ *   OUTPUTS: buf -- buffer holding image data for the rectangle
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void fill_rect_buffer(int x, int y, int w, int h, unsigned char buf[][SCROLL_X_DIM]) {
+    int            i;     /* loop index over rows                        */
+    const room_layer_t* lay; /* room layer, if kept                      */
+
+    /* Copy the rows from the room layer if there is one. */
+    if (NULL != (lay = room_layer(cur_room))) {
+        for (i = 0; h > i; i++) {
+            layer_horiz_line(lay, x, y + i, buf[i]);
         }
-        else {
-            idx = 0;
-            imgy = y - obj_y;
+        return;
+    }
+
+    /* Draw the current photo of the current room and its objects. */
+    fill_room_rect(cur_room, room_photo(cur_room), x, y, w, h, buf);
+}
+
+
+/*
+ * fill_rect_band
+ *   DESCRIPTION: Produce an image of a rectangle of the current room, as
+ *                fill_rect_buffer does, for a thread helping to draw the
+ *                rectangle(see set_draw_workers).  An up-to-date room
+ *                layer is copied if one is kept, but it is never built or
+ *                marked used, so several threads may call this routine at
+ *                once.
+ *   INPUTS:(x,y) -- upper left pixel of rectangle to be drawn
+ *          w, h -- width and height of rectangle(at most SCROLL_X_DIM
+ *                  and SCROLL_Y_DIM)
+ *   OUTPUTS: buf -- buffer holding image data for the rectangle
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void fill_rect_band(int x, int y, int w, int h, unsigned char buf[][SCROLL_X_DIM]) {
+    int            i;     /* loop index over rows                        */
+    const room_layer_t* lay; /* room layer, if kept and up to date      */
+
+    /* Copy the rows from the room layer if there is one. */
+    if (NULL != (lay = find_room_layer(cur_room))) {
+        for (i = 0; h > i; i++) {
+            layer_horiz_line(lay, x, y + i, buf[i]);
         }
+        return;
+    }
+
+    /* Draw the current photo of the current room and its objects. */
+    fill_room_rect(cur_room, room_photo(cur_room), x, y, w, h, buf);
+}
 
-        /* Copy the object's pixel data. */
-        for (; SCROLL_Y_DIM > idx && img->hdr.height > imgy; idx++, imgy++) {
-            pixel = img->img[xoff + img->hdr.width * imgy];
 
-            /* Don't copy transparent pixels. */
-            if (OBJ_CLR_TRANSP != pixel) {
-                buf[idx] = pixel;
+/*
+ * fill_room_rect
+ *   DESCRIPTION: Produce an image of a rectangle of a room from its photo
+ *                and objects, as fill_rect_buffer does for the current
+ *                room without a layer.
+ *   INPUTS: r -- the room
+ *           view -- the room's photo
+ *           (x,y) -- upper left pixel of rectangle to be drawn
+ *           w, h -- width and height of rectangle(at most SCROLL_X_DIM
+ *                   and SCROLL_Y_DIM)
+ *   OUTPUTS: buf -- buffer holding image data for the rectangle
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void fill_room_rect(const room_t* r, const photo_t* view, int x, int y,
+                           int w, int h, unsigned char buf[][SCROLL_X_DIM]) {
+    const obj_link_t* link; /* loop index over objects in a row band     */
+    object_t*      obj;   /* object in the room                          */
+    int32_t        obj_x; /* object x position                           */
+    int32_t        obj_y; /* object y position                           */
+    const image_t* img;   /* object image                                */
+    int32_t        top;   /* first row of rectangle in current band      */
+    int32_t        bot;   /* one past last row of rectangle in band      */
+    int            lo;    /* first row of band part covered by object    */
+    int            hi;    /* one past last row covered by object         */
+    int            i;     /* loop index over rows                        */
+
+    /* Draw the photo. */
+    for (i = 0; h > i; i++) {
+        photo_horiz_line(view, x, y + i, buf[i]);
+    }
+
+    /*
+     * Loop over the row bands covering the rectangle(see room_row_iterate),
+     * and over the objects that may cover each band.  An object covering
+     * several bands is drawn over only its rows in each band, so that no
+     * row is drawn twice and each row has its objects drawn in the same
+     * order as fill_horiz_buffer draws them.
+     */
+    for (top = y; y + h > top; top = bot) {
+        if (y + h < (bot = room_row_band_end(top))) {
+            bot = y + h;
+        }
+        for (link = room_row_iterate(r, top); NULL != link; link = obj_link_next(link)) {
+            obj = obj_link_object(link);
+            obj_x = obj_get_x(obj);
+            obj_y = obj_get_y(obj);
+            img = obj_image(obj);
+
+            /* Is object outside of the part of the band we're drawing? */
+            if (bot <= obj_y || top >= obj_y + img->hdr.height || x + w <= obj_x || x >= obj_x + img->hdr.width) {
+                continue;
+            }
+
+            /* Copy the opaque pixels of the object's rows in the band. */
+            lo = (top > obj_y ? top : obj_y);
+            hi = (bot < obj_y + (int)img->hdr.height ? bot : obj_y + (int)img->hdr.height);
+            for (i = lo; hi > i; i++) {
+                image_horiz_line(img, obj_x - x, i - obj_y, buf[i - y]);
             }
         }
     }
 }
 
 
+/*
+ * find_entry_frame
+ *   DESCRIPTION: Find the entry frame rendered for a room, if any.
+ *   INPUTS: r -- the room
+ *   OUTPUTS: none
+ *   RETURN VALUE: the frame(which may be out of date), or NULL if none
+ *   SIDE EFFECTS: none
+ */
+static entry_frame_t* find_entry_frame(const room_t* r) {
+    int32_t idx; /* index over frames */
+
+    for (idx = 0; ENTRY_FRAMES > idx; idx++) {
+        if (r == entry[idx].room) {
+            return &entry[idx];
+        }
+    }
+    return NULL;
+}
+
+
+/*
+ * free_photo
+ *   DESCRIPTION: Free a room photo created by read_photo.
+ *   INPUTS: p -- room photo pointer(may be NULL)
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: frees the photo's dynamically allocated memory
+ */
+void free_photo(photo_t* p) {
+    if (NULL != p) {
+        free(p->img);
+        free(p);
+    }
+}
+
+
+/*
+ * get_entry_frame_stats
+ *   DESCRIPTION: Get the counts of entry frames rendered and used.
+ *   INPUTS: none
+ *   OUTPUTS: stats -- the counts
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void get_entry_frame_stats(entry_stats_t* stats) {
+    *stats = entry_stats;
+}
+
+
 /*
  * image_height
  *   DESCRIPTION: Get height of object image in pixels.
@@ -261,6 +772,96 @@ uint32_t image_height(const image_t* im) {
 }
 
 
+/*
+ * image_horiz_line
+ *   DESCRIPTION: Draw one row of an object image onto a horizontal line,
+ *                copying each run of opaque pixels and skipping the
+ *                transparent ones.
+ *   INPUTS: im -- object image pointer
+ *           off -- position on the line of the image's left edge(may be
+ *                  off either end of the line)
+ *           row -- row of the image to draw(must be within the image)
+ *           buf -- line to draw on
+ *   OUTPUTS: buf -- line with the image's opaque pixels drawn
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void image_horiz_line(const image_t* im, int off, int row, unsigned char buf[SCROLL_X_DIM]) {
+    const obj_span_t* span; /* index over runs                */
+    const obj_span_t* end;  /* after last run of the row      */
+    const uint8_t*    src;  /* pixel data of the row          */
+    int               lo;   /* first pixel drawn from a run   */
+    int               hi;   /* after last pixel drawn         */
+
+    src = &im->img[im->hdr.width * row];
+    end = &im->rows.spans[im->rows.first[row + 1]];
+    for (span = &im->rows.spans[im->rows.first[row]]; end > span; span++) {
+        lo = off + span->start;
+        hi = lo + span->len;
+        lo = (0 > lo ? 0 : lo);
+        hi = (SCROLL_X_DIM < hi ? SCROLL_X_DIM : hi);
+        if (lo < hi) {
+            (void)memcpy(&buf[lo], &src[lo - off], hi - lo);
+        }
+    }
+}
+
+
+/*
+ * image_span_bytes
+ *   DESCRIPTION: Get the memory used by the opaque run tables of an
+ *                object image(not counting allocator overhead).
+ *   INPUTS: im -- object image pointer
+ *   OUTPUTS: none
+ *   RETURN VALUE: size of the tables in bytes
+ *   SIDE EFFECTS: none
+ */
+size_t image_span_bytes(const image_t* im) {
+    return ((im->hdr.height + 1 + im->hdr.width + 1) * sizeof (im->rows.first[0]) +
+            (im->rows.first[im->hdr.height] + im->cols.first[im->hdr.width]) *
+            sizeof (im->rows.spans[0]));
+}
+
+
+/*
+ * image_vert_line
+ *   DESCRIPTION: Draw one column of an object image onto a vertical line,
+ *                copying each run of opaque pixels and skipping the
+ *                transparent ones.
+ *   INPUTS: im -- object image pointer
+ *           off -- position on the line of the image's top edge(may be
+ *                  off either end of the line)
+ *           col -- column of the image to draw(must be within the image)
+ *           buf -- line to draw on
+ *   OUTPUTS: buf -- line with the image's opaque pixels drawn
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void image_vert_line(const image_t* im, int off, int col, unsigned char buf[SCROLL_Y_DIM]) {
+    const obj_span_t* span; /* index over runs                */
+    const obj_span_t* end;  /* after last run of the column   */
+    const uint8_t*    src;  /* pixel data                     */
+    int               lo;   /* first pixel drawn from a run   */
+    int               hi;   /* after last pixel drawn         */
+    int               idx;  /* index over pixels in the line  */
+
+    end = &im->cols.spans[im->cols.first[col + 1]];
+    for (span = &im->cols.spans[im->cols.first[col]]; end > span; span++) {
+        lo = off + span->start;
+        hi = lo + span->len;
+        lo = (0 > lo ? 0 : lo);
+        hi = (SCROLL_Y_DIM < hi ? SCROLL_Y_DIM : hi);
+        if (lo >= hi) {
+            continue;
+        }
+        src = &im->img[im->hdr.width * (lo - off) + col];
+        for (idx = lo; hi > idx; idx++, src += im->hdr.width) {
+            buf[idx] = *src;
+        }
+    }
+}
+
+
 /*
  * image_width
  *   DESCRIPTION: Get width of object image in pixels.
@@ -273,6 +874,147 @@ uint32_t image_width(const image_t* im) {
     return im->hdr.width;
 }
 
+/*
+ * layer_horiz_line
+ *   DESCRIPTION: Copy a horizontal line of a room layer into a buffer.
+ *                Pixels beyond the left and right edges of the layer are
+ *                black.
+ *   INPUTS: lay -- the room layer
+ *          (x,y) -- leftmost pixel of line(y must be within the layer)
+ *   OUTPUTS: buf -- buffer holding image data for the line
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void layer_horiz_line(const room_layer_t* lay, int x, int y,
+                             unsigned char buf[SCROLL_X_DIM]) {
+    int lo;  /* first pixel in line within the layer */
+    int hi;  /* one past last pixel within the layer */
+
+    lo = (0 > x ? (SCROLL_X_DIM < -x ? SCROLL_X_DIM : -x) : 0);
+    hi = (SCROLL_X_DIM < (int)lay->width - x ? SCROLL_X_DIM : (int)lay->width - x);
+    if (lo > hi) {
+        hi = lo;
+    }
+    (void)memset(buf, 0, lo);
+    (void)memcpy(&buf[lo], &lay->img[(size_t)lay->width * y + x + lo], hi - lo);
+    (void)memset(&buf[hi], 0, SCROLL_X_DIM - hi);
+}
+
+
+/*
+ * layer_vert_line
+ *   DESCRIPTION: Copy a vertical line of a room layer into a buffer.
+ *                Pixels beyond the top and bottom edges of the layer are
+ *                black.
+ *   INPUTS: lay -- the room layer
+ *          (x,y) -- top pixel of line(x must be within the layer)
+ *   OUTPUTS: buf -- buffer holding image data for the line
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void layer_vert_line(const room_layer_t* lay, int x, int y,
+                            unsigned char buf[SCROLL_Y_DIM]) {
+    int            lo;  /* first pixel in line within the layer */
+    int            hi;  /* one past last pixel within the layer */
+    int            idx; /* index over pixels in the line        */
+    const uint8_t* src; /* pixel data                           */
+
+    lo = (0 > y ? (SCROLL_Y_DIM < -y ? SCROLL_Y_DIM : -y) : 0);
+    hi = (SCROLL_Y_DIM < (int)lay->height - y ? SCROLL_Y_DIM : (int)lay->height - y);
+    if (lo > hi) {
+        hi = lo;
+    }
+    (void)memset(buf, 0, lo);
+    (void)memset(&buf[hi], 0, SCROLL_Y_DIM - hi);
+    src = &lay->img[(size_t)lay->width * (y + lo) + x];
+    for (idx = lo; hi > idx; idx++, src += lay->width) {
+        buf[idx] = *src;
+    }
+}
+
+
+/*
+ * map_file
+ *   DESCRIPTION: Map a whole file into memory(read only), so that its
+ *                contents can be copied out in bulk rather than read a
+ *                piece at a time.
+ *   INPUTS: fname -- file name for input
+ *           min_len -- smallest acceptable file length in bytes
+ *   OUTPUTS: map_len -- length of the mapping(for munmap)
+ *   RETURN VALUE: pointer to the mapped file on success, or NULL on
+ *                 failure
+ *   SIDE EFFECTS: caller must munmap the returned pointer
+ */
+static const uint8_t* map_file(const char* fname, size_t min_len, size_t* map_len) {
+    int         fd;  /* input file descriptor */
+    struct stat st;  /* input file status     */
+    void*       map; /* the file, mapped      */
+
+    if (0 > (fd = open(fname, O_RDONLY))) {
+        return NULL;
+    }
+    if (0 != fstat(fd, &st) || 0 == st.st_size || min_len > (size_t)st.st_size ||
+        MAP_FAILED == (map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0))) {
+        (void)close(fd);
+        return NULL;
+    }
+
+    /* The mapping stays valid after the descriptor is closed. */
+    (void)close(fd);
+    *map_len = st.st_size;
+    return map;
+}
+
+
+/*
+ * map_image_file
+ *   DESCRIPTION: Map a room photo or object image file into memory and
+ *                check its header.
+ *   INPUTS: fname -- file name for input
+ *           max_width -- largest width allowed, in pixels
+ *           max_height -- largest height allowed, in pixels
+ *           pixel_size -- bytes per pixel in the file
+ *   OUTPUTS: hdr -- header of the file
+ *            map_len -- length of the mapping(for munmap)
+ *   RETURN VALUE: pointer to the mapped file on success(pixel data start
+ *                 sizeof (*hdr) bytes in), or NULL on failure
+ *   SIDE EFFECTS: caller must munmap the returned pointer
+ */
+static const uint8_t* map_image_file(const char* fname, uint32_t max_width,
+                                     uint32_t max_height, uint32_t pixel_size,
+                                     photo_header_t* hdr, size_t* map_len) {
+    const uint8_t* map; /* the file, mapped */
+
+    if (NULL == (map = map_file(fname, sizeof (*hdr), map_len))) {
+        return NULL;
+    }
+    (void)memcpy(hdr, map, sizeof (*hdr));
+    if (!check_image_header(hdr, max_width, max_height, pixel_size, *map_len)) {
+        (void)munmap((void*)map, *map_len);
+        return NULL;
+    }
+    return map;
+}
+
+
+/*
+ * photo_file_row
+ *   DESCRIPTION: Row function(see quant_row_fn) for a mapped room photo
+ *                file.  The file holds the rows bottom to top.
+ *   INPUTS: src -- the photo_file_t for the file
+ *           y -- row wanted(0 is the top row)
+ *   OUTPUTS: none
+ *   RETURN VALUE: the 5:6:5 pixels of the row, in the file
+ *   SIDE EFFECTS: none
+ */
+static const uint16_t* photo_file_row(const void* src, uint32_t y) {
+    const photo_file_t* f = src; /* the mapped file */
+
+    return (const uint16_t*)(f->pixels +
+                             (size_t)(f->height - 1 - y) * f->width * sizeof (uint16_t));
+}
+
+
 /*
  * photo_height
  *   DESCRIPTION: Get height of room photo in pixels.
@@ -286,6 +1028,118 @@ uint32_t photo_height(const photo_t* p) {
 }
 
 
+/*
+ * photo_horiz_line
+ *   DESCRIPTION: Copy a horizontal line of a room photo(without any
+ *                objects) into a buffer.  Pixels beyond the left and
+ *                right edges of the photo are black.  Tiled photos are
+ *                copied a tile row at a time.
+ *   INPUTS: p -- room photo pointer
+ *          (x,y) -- leftmost pixel of line(y must be within the photo)
+ *   OUTPUTS: buf -- buffer holding image data for the line
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void photo_horiz_line(const photo_t* p, int x, int y, unsigned char buf[SCROLL_X_DIM]) {
+    int            lo;  /* first pixel in line within the photo */
+    int            hi;  /* one past last pixel within the photo */
+    int            idx; /* index over pixels in the line        */
+    int            run; /* pixels copied from one tile          */
+    const uint8_t* src; /* pixel data                           */
+
+    lo = (0 > x ? (SCROLL_X_DIM < -x ? SCROLL_X_DIM : -x) : 0);
+    hi = (SCROLL_X_DIM < (int)p->hdr.width - x ? SCROLL_X_DIM : (int)p->hdr.width - x);
+    if (lo > hi) {
+        hi = lo;
+    }
+    (void)memset(buf, 0, lo);
+    (void)memset(&buf[hi], 0, SCROLL_X_DIM - hi);
+
+    if (0 == p->tile_cols) {
+        (void)memcpy(&buf[lo], &p->img[(size_t)p->hdr.width * y + x + lo], hi - lo);
+        return;
+    }
+    if (lo == hi) {
+        return;
+    }
+
+    /* Copy to the end of the row of each tile, then go on to the next. */
+    src = &p->img[tile_offset(p, x + lo, y)];
+    for (idx = lo; ; src += run + PHOTO_TILE_DIM * PHOTO_TILE_MASK) {
+        run = PHOTO_TILE_DIM - ((x + idx) & PHOTO_TILE_MASK);
+        if (run >= hi - idx) {
+            (void)memcpy(&buf[idx], src, hi - idx);
+            return;
+        }
+        (void)memcpy(&buf[idx], src, run);
+        idx += run;
+    }
+}
+
+
+/*
+ * photo_palette
+ *   DESCRIPTION: Get the optimized palette colors of a room photo, in the
+ *                form taken by fill_palette.
+ *   INPUTS: p -- room photo pointer
+ *   OUTPUTS: none
+ *   RETURN VALUE: the palette colors of room photo p
+ *   SIDE EFFECTS: none
+ */
+const void* photo_palette(const photo_t* p) {
+    return p->palette;
+}
+
+
+/*
+ * photo_vert_line
+ *   DESCRIPTION: Copy a vertical line of a room photo(without any
+ *                objects) into a buffer.  Pixels beyond the top and
+ *                bottom edges of the photo are black.  In a tiled photo,
+ *                the pixels within a tile are PHOTO_TILE_DIM bytes apart
+ *                rather than a whole photo row.
+ *   INPUTS: p -- room photo pointer
+ *          (x,y) -- top pixel of line(x must be within the photo)
+ *   OUTPUTS: buf -- buffer holding image data for the line
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void photo_vert_line(const photo_t* p, int x, int y, unsigned char buf[SCROLL_Y_DIM]) {
+    int            lo;   /* first pixel in line within the photo */
+    int            hi;   /* one past last pixel within the photo */
+    int            idx;  /* index over pixels in the line        */
+    size_t         down; /* step from tile's last row to next tile */
+    const uint8_t* src;  /* pixel data                            */
+
+    lo = (0 > y ? (SCROLL_Y_DIM < -y ? SCROLL_Y_DIM : -y) : 0);
+    hi = (SCROLL_Y_DIM < (int)p->hdr.height - y ? SCROLL_Y_DIM : (int)p->hdr.height - y);
+    if (lo > hi) {
+        hi = lo;
+    }
+    (void)memset(buf, 0, lo);
+    (void)memset(&buf[hi], 0, SCROLL_Y_DIM - hi);
+
+    if (0 == p->tile_cols) {
+        src = &p->img[(size_t)p->hdr.width * (y + lo) + x];
+        for (idx = lo; hi > idx; idx++, src += p->hdr.width) {
+            buf[idx] = *src;
+        }
+        return;
+    }
+    if (lo == hi) {
+        return;
+    }
+    down = ((size_t)p->tile_cols << (2 * PHOTO_TILE_SHIFT)) -
+           (PHOTO_TILE_MASK << PHOTO_TILE_SHIFT);
+    src = &p->img[tile_offset(p, x, y + lo)];
+    for (idx = lo; hi - 1 > idx; idx++) {
+        buf[idx] = *src;
+        src += (PHOTO_TILE_MASK != ((y + idx) & PHOTO_TILE_MASK) ? PHOTO_TILE_DIM : down);
+    }
+    buf[idx] = *src;
+}
+
+
 /*
  * photo_width
  *   DESCRIPTION: Get width of room photo in pixels.
@@ -314,13 +1168,115 @@ void prep_room(const room_t* r) {
 	photo_t *p = room_photo(r);
 	fill_palette(p->palette);
     cur_room = r;
+
+    /* Build the room's layer now(if kept) rather than on the first line. */
+    (void)room_layer(r);
+}
+
+
+/*
+ * prerender_near_room
+ *   DESCRIPTION: Render the entry frame of one room next to the player's
+ *                (through left, enter, or right) that has no frame or
+ *                whose frame is out of date.  Rooms whose photos are not
+ *                in memory are skipped(the prefetch thread loads them),
+ *                so the call never waits to read a file.  Meant to be
+ *                called while the player is idle, once per tick; the
+ *                caller must keep the world from changing meanwhile.
+ *   INPUTS: r -- the player's room
+ *   OUTPUTS: none
+ *   RETURN VALUE: 1 if a frame was rendered, or 0 if there was nothing
+ *                 to do(or no memory for a frame)
+ *   SIDE EFFECTS: may render over the least recently used frame
+ */
+int32_t prerender_near_room(const room_t* r) {
+    const room_t*  exits[N_ROOM_EXITS]; /* rooms next to the player's */
+    entry_frame_t* f;                   /* frame for a room           */
+    const photo_t* view;                /* the room's photo           */
+    int32_t        e;                   /* index over exits           */
+
+    if (0 >= ENTRY_FRAMES) {
+        return 0;
+    }
+    room_exits(r, exits);
+    for (e = 0; N_ROOM_EXITS > e; e++) {
+        if (NULL == exits[e] || r == exits[e]) {
+            continue;
+        }
+        f = find_entry_frame(exits[e]);
+        if (NULL != f && room_version(exits[e]) == f->version) {
+            continue;
+        }
+        if (NULL == (view = room_photo_resident(exits[e]))) {
+            continue;
+        }
+        if (NULL != f) {
+            entry_stats.stale++;
+        } else if (NULL == (f = entry_frame_slot(exits))) {
+            return 0;
+        }
+        return render_entry_frame(f, exits[e], view);
+    }
+    return 0;
+}
+
+
+/*
+ * read_image_pixels
+ *   DESCRIPTION: Read the header and pixel data of a room photo or object
+ *                image file.  Rather than reading one pixel at a time,
+ *                the file is mapped and the pixels copied out a row at a
+ *                time.
+ *   INPUTS: fname -- file name for input
+ *           max_width -- largest width allowed, in pixels
+ *           max_height -- largest height allowed, in pixels
+ *           pixel_size -- bytes per pixel in the file
+ *   OUTPUTS: hdr -- header of the file
+ *   RETURN VALUE: pointer to newly allocated pixel data(top row first)
+ *                 on success, or NULL on failure
+ *   SIDE EFFECTS: dynamically allocates memory for the pixels
+ */
+static void* read_image_pixels(const char* fname, uint32_t max_width,
+                               uint32_t max_height, uint32_t pixel_size,
+                               photo_header_t* hdr) {
+    const uint8_t* map;       /* input file, mapped      */
+    size_t         map_len;   /* length of mapping       */
+    const uint8_t* src;       /* pixel data in the file  */
+    uint8_t*       pixels;    /* pixel data, top down    */
+    size_t         row_bytes; /* bytes in one row        */
+    uint16_t       y;         /* index over image rows   */
+
+    if (NULL == (map = map_image_file(fname, max_width, max_height,
+                                      pixel_size, hdr, &map_len))) {
+        return NULL;
+    }
+    row_bytes = (size_t)hdr->width * pixel_size;
+    if (NULL == (pixels = malloc(row_bytes * hdr->height))) {
+        (void)munmap((void*)map, map_len);
+        return NULL;
+    }
+
+    /*
+     * Copy rows from bottom to top.  Note that the file is stored in
+     * this order, whereas in memory we store the data in the reverse
+     * order(top to bottom).
+     */
+    src = map + sizeof (*hdr);
+    for (y = hdr->height; y-- > 0; src += row_bytes) {
+        (void)memcpy(&pixels[row_bytes * y], src, row_bytes);
+    }
+
+    (void)munmap((void*)map, map_len);
+    return pixels;
 }
 
 
 /*
  * read_obj_image
  *   DESCRIPTION: Read size and pixel data in 2:2:2 RGB format from a
- *                photo file and create an image structure from it.
+ *                photo file and create an image structure from it,
+ *                including the runs of opaque pixels in each row and
+ *                column.
  *   INPUTS: fname -- file name for input
  *   OUTPUTS: none
  *   RETURN VALUE: pointer to newly allocated photo on success, or NULL
@@ -328,77 +1284,71 @@ void prep_room(const room_t* r) {
  *   SIDE EFFECTS: dynamically allocates memory for the image
  */
 image_t* read_obj_image(const char* fname) {
-    FILE*    in;        /* input file               */
-    image_t* img = NULL;    /* image structure          */
-    uint16_t x;            /* index over image columns */
-    uint16_t y;            /* index over image rows    */
-    uint8_t  pixel;        /* one pixel from the file  */
+    image_t* img = NULL; /* image structure */
 
     /*
-     * Open the file, allocate the structure, read the header, do some
-     * sanity checks on it, and allocate space to hold the image pixels.
-     * If anything fails, clean up as necessary and return NULL.
+     * Allocate the structure and read the header and pixels.  If
+     * anything fails, clean up as necessary and return NULL.
      */
-    if (NULL == (in = fopen(fname, "r+b")) ||
-        NULL == (img = malloc(sizeof (*img))) ||
-        NULL != (img->img = NULL) || /* false clause for initialization */
-        1 != fread(&img->hdr, sizeof (img->hdr), 1, in) ||
-        MAX_OBJECT_WIDTH < img->hdr.width ||
-        MAX_OBJECT_HEIGHT < img->hdr.height ||
-        NULL == (img->img = malloc
-        (img->hdr.width * img->hdr.height * sizeof (img->img[0])))) {
+    if (NULL == (img = malloc(sizeof (*img))) ||
+        NULL == (img->img = read_obj_pixels(fname, &img->hdr))) {
         if (NULL != img) {
-            if (NULL != img->img) {
-                free(img->img);
-            }
             free(img);
         }
-        if (NULL != in) {
-            (void)fclose(in);
-        }
         return NULL;
     }
 
-    /*
-     * Loop over rows from bottom to top.  Note that the file is stored
-     * in this order, whereas in memory we store the data in the reverse
-     * order(top to bottom).
-     */
-    for (y = img->hdr.height; y-- > 0; ) {
-
-        /* Loop over columns from left to right. */
-        for (x = 0; img->hdr.width > x; x++) {
-
-            /*
-             * Try to read one 8-bit pixel.  On failure, clean up and
-             * return NULL.
-             */
-            if (1 != fread(&pixel, sizeof (pixel), 1, in)) {
-                free(img->img);
-                free(img);
-                (void)fclose(in);
-                return NULL;
-            }
-
-            /* Store the pixel in the image data. */
-            img->img[img->hdr.width * y + x] = pixel;
-        }
+    /* Find the opaque runs of the rows and of the columns. */
+    if (!build_spans(img->img, img->hdr.height, img->hdr.width, img->hdr.width, 1,
+                     &img->rows)) {
+        free(img->img);
+        free(img);
+        return NULL;
+    }
+    if (!build_spans(img->img, img->hdr.width, img->hdr.height, 1, img->hdr.width,
+                     &img->cols)) {
+        free(img->rows.spans);
+        free(img->rows.first);
+        free(img->img);
+        free(img);
+        return NULL;
     }
 
     /* All done.  Return success. */
-    (void)fclose(in);
     return img;
 }
 
 
+/*
+ * read_obj_pixels
+ *   DESCRIPTION: Read size and pixel data in 2:2:2 RGB format from an
+ *                object image file.
+ *   INPUTS: fname -- file name for input
+ *   OUTPUTS: hdr -- header(size) of the image
+ *   RETURN VALUE: pointer to newly allocated pixel data, stored from the
+ *                 upper left as with image_t, on success, or NULL on
+ *                 failure
+ *   SIDE EFFECTS: dynamically allocates memory for the pixels
+ */
+uint8_t* read_obj_pixels(const char* fname, photo_header_t* hdr) {
+    return read_image_pixels(fname, MAX_OBJECT_WIDTH, MAX_OBJECT_HEIGHT, sizeof (uint8_t), hdr);
+}
+
+
 /*
  * read_photo
- *   DESCRIPTION: Read size and pixel data in 5:6:5 RGB format from a
- *                photo file and create a photo structure from it.
- *                Code provided simply maps to 2:2:2 RGB.  You must
- *                replace this code with palette color selection, and
- *                must map the image pixels into the palette colors that
- *                you have defined.
+ *   DESCRIPTION: Read a room photo and create a photo structure from it.
+ *                If a palettized version of the photo(written by
+ *                mp2pphoto, with the file extension changed to .pphoto)
+ *                exists and is no older than the photo, the palette and
+ *                pixels are simply read from it, unless palettized photos
+ *                are turned off(see set_pphoto_use).  Otherwise, size
+ *                and pixel data are read in 5:6:5 RGB format from the
+ *                photo file, and a palette is chosen and the pixels
+ *                mapped to it(see quantize_photo).  If the quantizer can
+ *                read the pixels a row at a time, that is done straight
+ *                from the mapped file, so the 5:6:5 pixels are never
+ *                copied.
  *   INPUTS: fname -- file name for input
  *   OUTPUTS: none
  *   RETURN VALUE: pointer to newly allocated photo on success, or NULL
@@ -406,223 +1356,454 @@ image_t* read_obj_image(const char* fname) {
  *   SIDE EFFECTS: dynamically allocates memory for the photo
  */
 photo_t* read_photo(const char* fname) {
-    FILE*    in;    /* input file               */
-    photo_t* p = NULL;    /* photo structure          */
-    uint16_t x;        /* index over image columns */
-    uint16_t y;        /* index over image rows    */
-    uint16_t pixel;    /* one pixel from the file  */
+    photo_t*  p = NULL;    /* photo structure        */
+    uint16_t* pixels_data; /* 5:6:5 pixels, top down */
+
+    if (NULL == (p = malloc(sizeof (*p)))) {
+        return NULL;
+    }
+    p->tile_cols = 0;
 
     /*
-     * Open the file, allocate the structure, read the header, do some
-     * sanity checks on it, and allocate space to hold the photo pixels.
-     * If anything fails, clean up as necessary and return NULL.
+     * Use the palettized photo if there is one(and they are in use);
+     * otherwise quantize from the mapped file if the quantizer can.
      */
-    if (NULL == (in = fopen(fname, "r+b")) ||
-        NULL == (p = malloc(sizeof (*p))) ||
-        NULL != (p->img = NULL) || /* false clause for initialization */
-        1 != fread(&p->hdr, sizeof (p->hdr), 1, in) ||
-        MAX_PHOTO_WIDTH < p->hdr.width ||
-        MAX_PHOTO_HEIGHT < p->hdr.height ||
-        NULL == (p->img = malloc
-        (p->hdr.width * p->hdr.height * sizeof (p->img[0])))) {
-        if (NULL != p) {
-            if (NULL != p->img) {
-                free(p->img);
+    if (!(pphoto_use && read_pphoto(fname, p)) && !read_photo_mapped(fname, p)) {
+
+        /*
+         * Read the pixels and allocate space to hold the photo pixels.  If
+         * anything fails, clean up as necessary and return NULL.
+         */
+        if (NULL == (pixels_data = read_photo_pixels(fname, &p->hdr)) ||
+            NULL == (p->img = malloc
+            (p->hdr.width * p->hdr.height * sizeof (p->img[0])))) {
+            if (NULL != pixels_data) {
+                free(pixels_data);
             }
             free(p);
+            return NULL;
         }
-        if (NULL != in) {
-            (void)fclose(in);
-        }
-        return NULL;
+
+        /* Choose the palette and map the pixels into it. */
+        quantize_photo(pixels_data, p->hdr.width * p->hdr.height, p->palette, p->img);
+        free(pixels_data);
     }
-	
-	struct octree_node level4[LEVEL4_NODE_NUMBER]; 										//the nodes for level4
-	struct octree_node level2[LEVEL2_NODE_NUMBER];										//the nodes for level2
-	
-	int level4_new_index[LEVEL4_NODE_NUMBER];
-	uint32_t image_size;																//
-	uint32_t i;																			// for index
-	uint16_t pixels_data[p->hdr.height * p->hdr.width];
-	uint32_t r_average, g_average, b_average;
-	int index; 
-	
-	image_size = p->hdr.height * p->hdr.width;
-	//initial level 4:
-	for(i=0; i<LEVEL4_NODE_NUMBER; i++){
-		level4[i].idx_by_rgb = i;
-		level4[i].level2_idx = 65;						//because level2 has only 64 bits
-		level4[i].palette_idx = -1;
-		level4[i].red_sum = 0;
-		level4[i].green_sum = 0;
-		level4[i].blue_sum = 0;
-		level4[i].pixel_number = 0;
-		level4_new_index[i] = -1;
-	}
-
-	//initial level 2:				level2_idx and palette_idx for level2 will not be used
-	for(i=0; i<LEVEL2_NODE_NUMBER; i++){
-		level2[i].idx_by_rgb = i;
-		level2[i].level2_idx = 65;						//because level2 has only 64 bits
-		level2[i].palette_idx = -1;
-		level2[i].red_sum = 0;
-		level2[i].green_sum = 0;
-		level2[i].blue_sum = 0;
-		level2[i].pixel_number = 0;
-	}
-		
-    /*
-     * Loop over rows from bottom to top.  Note that the file is stored
-     * in this order, whereas in memory we store the data in the reverse
-     * order(top to bottom).
-     */
-    for (y = p->hdr.height; y-- > 0; ) {
-
-        /* Loop over columns from left to right. */
-        for (x = 0; p->hdr.width > x; x++) {
-
-            /*
-             * Try to read one 16-bit pixel.  On failure, clean up and
-             * return NULL.
-             */
-            if (1 != fread(&pixel, sizeof (pixel), 1, in)) {
-                free(p->img);
-                free(p);
-                (void)fclose(in);
-                return NULL;
+
+    /* Rearrange the pixels into tiles if asked to. */
+    if (photo_tiling) {
+        tile_photo(p);
+    }
+
+    /* All done.  Return success. */
+    return p;
+}
+
+
+/*
+ * read_photo_header
+ *   DESCRIPTION: Read and check the header(size) of a room photo file
+ *                without reading its pixels.
+ *   INPUTS: fname -- file name for input
+ *   OUTPUTS: hdr -- header of the photo
+ *   RETURN VALUE: 1 on success, or 0 on failure
+ *   SIDE EFFECTS: none
+ */
+int32_t read_photo_header(const char* fname, photo_header_t* hdr) {
+    const uint8_t* map;     /* input file, mapped */
+    size_t         map_len; /* length of mapping  */
+
+    if (NULL == (map = map_image_file(fname, MAX_PHOTO_WIDTH, MAX_PHOTO_HEIGHT,
+                                      sizeof (uint16_t), hdr, &map_len))) {
+        return 0;
+    }
+    (void)munmap((void*)map, map_len);
+    return 1;
+}
+
+
+/*
+ * read_photo_pixels
+ *   DESCRIPTION: Read size and pixel data in 5:6:5 RGB format from a
+ *                room photo file.
+ *   INPUTS: fname -- file name for input
+ *   OUTPUTS: hdr -- header(size) of the photo
+ *   RETURN VALUE: pointer to newly allocated pixel data, stored from the
+ *                 upper left as with photo_t, on success, or NULL on
+ *                 failure
+ *   SIDE EFFECTS: dynamically allocates memory for the pixels
+ */
+uint16_t* read_photo_pixels(const char* fname, photo_header_t* hdr) {
+    return read_image_pixels(fname, MAX_PHOTO_WIDTH, MAX_PHOTO_HEIGHT, sizeof (uint16_t), hdr);
+}
+
+
+/*
+ * read_photo_mapped
+ *   DESCRIPTION: Read a room photo by mapping its file and quantizing the
+ *                pixels a row at a time straight from the mapping(see
+ *                quantize_photo_rows), without first copying them out.
+ *   INPUTS: fname -- file name for input
+ *   OUTPUTS: p -- header, palette and pixels filled in
+ *   RETURN VALUE: 1 on success, or 0 if the file cannot be read, memory
+ *                 runs out, or the quantizer cannot read rows
+ *   SIDE EFFECTS: dynamically allocates memory for the pixels
+ */
+static int32_t read_photo_mapped(const char* fname, photo_t* p) {
+    const uint8_t* map;     /* input file, mapped          */
+    size_t         map_len; /* length of mapping           */
+    photo_file_t   f;       /* pixels in the file, by row  */
+
+    if (NULL == (map = map_image_file(fname, MAX_PHOTO_WIDTH, MAX_PHOTO_HEIGHT,
+                                      sizeof (uint16_t), &p->hdr, &map_len))) {
+        return 0;
+    }
+    f.pixels = map + sizeof (p->hdr);
+    f.width = p->hdr.width;
+    f.height = p->hdr.height;
+    if (NULL == (p->img = malloc((size_t)f.width * f.height * sizeof (p->img[0])))) {
+        (void)munmap((void*)map, map_len);
+        return 0;
+    }
+    if (!quantize_photo_rows(photo_file_row, &f, f.width, f.height, p->palette, p->img)) {
+        free(p->img);
+        (void)munmap((void*)map, map_len);
+        return 0;
+    }
+
+    (void)munmap((void*)map, map_len);
+    return 1;
+}
+
+
+/*
+ * render_entry_frame
+ *   DESCRIPTION: Render the screen seen on entering a room into an entry
+ *                frame, a band of rows at a time, along with the room's
+ *                palette.
+ *   INPUTS: f -- the frame
+ *           r -- the room
+ *           view -- the room's photo
+ *   OUTPUTS: f -- frame filled in
+ *   RETURN VALUE: 1 on success, or 0 if memory runs out(the frame is
+ *                 then left unused)
+ *   SIDE EFFECTS: allocates the frame's planes when first used
+ */
+static int32_t render_entry_frame(entry_frame_t* f, const room_t* r,
+                                  const photo_t* view) {
+    unsigned char  rows[ENTRY_BAND][SCROLL_X_DIM]; /* a band of rows */
+    unsigned char* plane[4]; /* row in frame plane for each pixel column mod 4 */
+    int            y;        /* first row of band                  */
+    int            n;        /* rows in band                       */
+    int            i;        /* index over rows of band            */
+    int            k;        /* index over planes                  */
+
+    f->room = NULL;
+    if (NULL == f->planes && NULL == (f->planes = malloc(FRAME_SIZE))) {
+        return 0;
+    }
+    for (y = 0; SCROLL_Y_DIM > y; y += n) {
+        n = (ENTRY_BAND < SCROLL_Y_DIM - y ? ENTRY_BAND : SCROLL_Y_DIM - y);
+        fill_room_rect(r, view, 0, y, SCROLL_X_DIM, n, rows);
+        for (i = 0; n > i; i++) {
+            /* Pixel columns 0 to 3 mod 4 go to frame planes 3 to 0. */
+            for (k = 0; 4 > k; k++) {
+                plane[k] = f->planes + (3 - k) * FRAME_PLANE_SIZE + (y + i) * SCROLL_X_WIDTH;
             }
-            /*
-             * 16-bit pixel is coded as 5:6:5 RGB(5 bits red, 6 bits green,
-             * and 6 bits blue).  We change to 2:2:2, which we've set for the
-             * game objects.  You need to use the other 192 palette colors
-             * to specialize the appearance of each photo.
-             *
-             * In this code, you need to calculate the p->palette values,
-             * which encode 6-bit RGB as arrays of three uint8_t's.  When
-             * the game puts up a photo, you should then change the palette
-             * to match the colors needed for that photo.
-             */
-
-			index = idx_in_level(pixel, 4);
-			 
-			level4[index].pixel_number++;
-			level4[index].red_sum += (pixel >> 11) & 0x001F;		//// 0x1F because just need the last 5 bits
-			level4[index].green_sum += (pixel >> 5) & 0x003F;		// 0x3F because just need the last 6 bits
-			level4[index].blue_sum += (pixel) & 0x001F;				// 0x1F because just need the last 5 bits
-			level4[index].level2_idx = idx_in_level(pixel, 2);
-			level4[index].idx_by_rgb = index;
-			 
-			 
-			index = idx_in_level(pixel, 2);
-			level2[index].pixel_number++;
-			level2[index].red_sum += (pixel >> 11) & 0x001F;		//// 0x1F because just need the last 5 bits
-			level2[index].green_sum += (pixel >> 5) & 0x003F;		// 0x3F because just need the last 6 bits
-			level2[index].blue_sum += (pixel) & 0x001F;				// 0x1F because just need the last 5 bits			 
-
-			pixels_data[(y * p->hdr.width) + x] = pixel; 
+            scatter_planes(rows[i], SCROLL_X_DIM, 0, plane);
         }
     }
+    (void)memcpy(f->palette, view->palette, sizeof (f->palette));
+    f->room = r;
+    f->version = room_version(r);
+    f->last_use = ++entry_clock;
+    entry_stats.rendered++;
+    return 1;
+}
 
-    /* All done.  Return success. */
-    (void)fclose(in);
-    
-	qsort(level4, LEVEL4_NODE_NUMBER, sizeof(struct octree_node), compar);
-			
-	
-	for(i=0; i<LEVEL4_NODE_USED; i++){
-		if(level4[i].pixel_number != 0){
-			r_average = level4[i].red_sum / level4[i].pixel_number;
-			g_average = level4[i].green_sum / level4[i].pixel_number;
-			b_average = level4[i].blue_sum / level4[i].pixel_number;
-		}else{
-			r_average = 0;
-			g_average = 0;
-			b_average = 0;
-		}
-		p->palette[i][0] = (uint8_t)(r_average & 0x1F) << 1;			//just need the last 5 bits
-		p->palette[i][1] = (uint8_t)(g_average & 0x3F);					//just need the last 6 bits
-		p->palette[i][2] = (uint8_t)(b_average & 0x1F) << 1;			//just need the last 5 bits
-		
-		level4[i].palette_idx = 64 + i;						//because there are 64 palette that has been used
-		level4_new_index[level4[i].idx_by_rgb] = i;
-	}
-	
-	for(i=0; i < LEVEL2_NODE_NUMBER; i++){
-		if(level2[i].pixel_number != 0){
-			r_average = level2[i].red_sum / level2[i].pixel_number;
-			g_average = level2[i].green_sum / level2[i].pixel_number;
-			b_average = level2[i].blue_sum / level2[i].pixel_number;
-		}else{
-			r_average = 0;
-			g_average = 0;
-			b_average = 0;
-		}
-		//level4_new_index[level4[i].idx_by_rgb] = i;
-		p->palette[i + LEVEL4_NODE_USED][0] = (uint8_t)(r_average & 0x1F) << 1;		//just need the last 5 bits
-		p->palette[i + LEVEL4_NODE_USED][1] = (uint8_t)(g_average & 0x3F);			//just need the last 6 bits
-		p->palette[i + LEVEL4_NODE_USED][2] = (uint8_t)(b_average & 0x1F) << 1;		//just need the last 5 bits
-		
-		level2[i].palette_idx = 64 + LEVEL4_NODE_USED + i;    //64 because there are 64 palette that has been used
-	}
-	for(i = LEVEL4_NODE_USED; i < LEVEL4_NODE_NUMBER; i++){
-		level4_new_index[level4[i].idx_by_rgb] = i;
-		if(level4[i].level2_idx < 64){	//64 is the index of level2
-			level4[i].palette_idx = level2[level4[i].level2_idx].palette_idx;
-		}
-	}
-	for(i = 0; i<image_size; i++){
-		index = level4_new_index[idx_in_level(pixels_data[i],4)];
-		p->img[i] = level4[index].palette_idx;
-		
-	}
-	
-	return p;
-}
-
-
-/*
- * idx_in_level
- *   DESCRIPTION: find the index in level 2 or level 4
-
- *   INPUTS: pixel : pixel that need to find index
- *			  k: level 2 or 4
- *   OUTPUTS: the index in level 2 or level 4
- *   
- *   
+
+/*
+ * find_room_layer
+ *   DESCRIPTION: Find the layer kept for a room, if it is up to date,
+ *                without building it or marking it used.  Only reads the
+ *                layers, so threads drawing bands of a rectangle together
+ *                may call it at once(see fill_rect_band).
+ *   INPUTS: r -- the room
+ *   OUTPUTS: none
+ *   RETURN VALUE: the room's layer, or NULL if it has none or the room has
+ *                 changed since it was built
  *   SIDE EFFECTS: none
  */
+static const room_layer_t* find_room_layer(const room_t* r) {
+    int32_t idx; /* index over layers */
+
+    for (idx = 0; n_layers > idx; idx++) {
+        if (r == layer[idx].room) {
+            return (room_version(r) == layer[idx].version ? &layer[idx] : NULL);
+        }
+    }
+    return NULL;
+}
+
+
+/*
+ * room_layer
+ *   DESCRIPTION: Find the layer kept for a room, building it if the room
+ *                has none or if the room has changed since it was built.
+ *                A room without a layer takes the least recently used
+ *                slot.
+ *   INPUTS: r -- the room
+ *   OUTPUTS: none
+ *   RETURN VALUE: the room's layer, or NULL if no layers are kept or
+ *                 memory runs out
+ *   SIDE EFFECTS: may build a layer, replacing that of another room
+ */
+static const room_layer_t* room_layer(const room_t* r) {
+    room_layer_t* lay;    /* the room's layer, or the slot to use */
+    int32_t       idx;    /* index over layers                    */
+
+    if (0 >= n_layers) {
+        return NULL;
+    }
+    lay = &layer[0];
+    for (idx = 0; n_layers > idx; idx++) {
+        if (r == layer[idx].room) {
+            lay = &layer[idx];
+            break;
+        }
+        if (NULL == layer[idx].room ||
+            (NULL != lay->room && layer[idx].last_use < lay->last_use)) {
+            lay = &layer[idx];
+        }
+    }
+    lay->last_use = ++layer_clock;
+    if (r == lay->room && room_version(r) == lay->version) {
+        return lay;
+    }
+    return (build_layer(lay, r) ? lay : NULL);
+}
+
+
+/*
+ * set_photo_tiling
+ *   DESCRIPTION: Choose the layout of the pixel data of room photos read
+ *                from now on(see photo_t).  Photos already read keep
+ *                their layout.  Must not be called while photos are
+ *                being read.
+ *   INPUTS: tiled -- 1 to store photos in tiles, 0 to store them by row
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: changes the layout used by read_photo
+ */
+void set_photo_tiling(int32_t tiled) {
+    photo_tiling = tiled;
+}
+
+
+/*
+ * set_pphoto_use
+ *   DESCRIPTION: Choose whether read_photo reads palettized photos(.pphoto
+ *                files) when they are up to date, or always quantizes the
+ *                5:6:5 photo.  Must not be called while photos are being
+ *                read.
+ *   INPUTS: use -- 1 to read palettized photos, 0 to ignore them
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: changes how read_photo gets a photo's palette
+ */
+void set_pphoto_use(int32_t use) {
+    pphoto_use = use;
+}
+
+
+/*
+ * set_room_cache
+ *   DESCRIPTION: Choose how many rooms keep a layer(see ROOM_CACHE_SLOTS).
+ *                All layers kept are freed; they are built again as
+ *                needed.  Must not be called while the room is being
+ *                drawn(see layer).
+ *   INPUTS: slots -- number of rooms(at most MAX_ROOM_CACHE_SLOTS), or 0
+ *                    to draw lines from the photo and objects every time
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: frees the memory of the layers
+ */
+void set_room_cache(int32_t slots) {
+    int32_t idx;  /* index over layers */
+
+    for (idx = 0; MAX_ROOM_CACHE_SLOTS > idx; idx++) {
+        free(layer[idx].img);
+        layer[idx].img = NULL;
+        layer[idx].room = NULL;
+        layer[idx].width = layer[idx].height = 0;
+    }
+    n_layers = (MAX_ROOM_CACHE_SLOTS < slots ? MAX_ROOM_CACHE_SLOTS : slots);
+}
+
+
+/*
+ * show_entry_frame
+ *   DESCRIPTION: Prepare a room that the player has just entered for
+ *                display and draw the whole screen, as prep_room and a
+ *                full redraw would, by copying the room's entry frame into
+ *                the build buffer, if the room has an up-to-date frame.
+ *                The room's layer(if kept) is built when first needed
+ *                rather than now.  The room's changed areas are forgotten.
+ *                As cur_room changes, no other thread may be drawing the
+ *                room meanwhile(see layer).
+ *   INPUTS: r -- the room(with the view window at (0,0))
+ *   OUTPUTS: none
+ *   RETURN VALUE: 1 if the screen was drawn, or 0 if the room has no
+ *                 up-to-date frame(nothing is then done)
+ *   SIDE EFFECTS: changes recorded cur_room for this file; sets the VGA
+ *                 palette; draws into the build buffer
+ */
+int32_t show_entry_frame(room_t* r) {
+    room_damage_t  rects[MAX_ROOM_DAMAGE]; /* changed areas(ignored) */
+    entry_frame_t* f;                      /* the room's frame       */
+
+    if (NULL == (f = find_entry_frame(r)) || room_version(r) != f->version ||
+        0 != draw_frame(f->planes)) {
+        entry_stats.missed++;
+        return 0;
+    }
+
+    /* Keep the photo in memory for the lines drawn as the view moves. */
+    (void)room_photo(r);
+    fill_palette(f->palette);
+    cur_room = r;
+    (void)room_take_damage(r, rects);
 
-uint16_t idx_in_level(uint16_t pixel, int k){
-	if(k == 2){			//RRRRRGGGGGGBBBBB -> 0000000000RRGGBB
-		return  (((pixel >> 14) << 4) | (((pixel >> 9) & 0x3) << 2) | ((pixel >> 3) & 0x3));		//0x3 because only need the last 2 bits
-	}
-	if(k == 4){				//RRRRRGGGGGGBBBBB -> 0000RRRRGGGGBBBB
-		return (((pixel >> 12) << 8) | (((pixel >> 7) & 0xF) << 4) | ((pixel >> 1) & 0xF));		//0x3 because only need the last 2 bits
-	}
-	else {
-		return -1;
-	}
+    f->last_use = ++entry_clock;
+    entry_stats.shown++;
+    return 1;
 }
-	
+
+
 /*
- * compar
- *   DESCRIPTION: determine the order of the node 
+ * read_pphoto
+ *   DESCRIPTION: Read a palettized room photo(see photo_headers.h) into
+ *                a photo structure.  The palettized file for a photo is
+ *                found by changing the photo file's extension to .pphoto.
+ *                A palettized file older than the photo is out of date
+ *                and is ignored.
+ *   INPUTS: fname -- file name of the 5:6:5 room photo
+ *   OUTPUTS: p -- header, palette and pixels filled in
+ *   RETURN VALUE: 1 on success, or 0 if there is no(valid, up-to-date)
+ *                 palettized photo
+ *   SIDE EFFECTS: dynamically allocates memory for the pixels
+ */
+static int32_t read_pphoto(const char* fname, photo_t* p) {
+    char           pname[PATH_MAX]; /* palettized photo file name */
+    const char*    dot;             /* start of file extension    */
+    const uint8_t* map;             /* input file, mapped         */
+    size_t         map_len;         /* length of mapping          */
+    const uint8_t* src;             /* current data in the file   */
+    size_t         n_pixels;        /* number of pixels in photo  */
+    struct stat    st;              /* status of photo file       */
+    struct stat    pst;             /* status of palettized file  */
+
+    /* Build the file name: base name of photo file plus .pphoto. */
+    if (NULL == (dot = strrchr(fname, '.')) || NULL != strchr(dot, '/')) {
+        dot = fname + strlen(fname);
+    }
+    if (sizeof (pname) <= (size_t)snprintf(pname, sizeof (pname), "%.*s.pphoto",
+                                           (int)(dot - fname), fname)) {
+        return 0;
+    }
+
+    /* Skip a palettized file older than the photo(or missing). */
+    if (0 != stat(fname, &st) || 0 != stat(pname, &pst) ||
+        pst.st_mtime < st.st_mtime) {
+        return 0;
+    }
+
+    /* Map the file and check the magic sequence and header. */
+    if (NULL == (map = map_file(pname, PPHOTO_MAGIC_LEN + sizeof (p->hdr) +
+                                sizeof (p->palette), &map_len))) {
+        return 0;
+    }
+    src = map + PPHOTO_MAGIC_LEN;
+    (void)memcpy(&p->hdr, src, sizeof (p->hdr));
+    if (0 != memcmp(map, PPHOTO_MAGIC, PPHOTO_MAGIC_LEN) ||
+        !check_image_header(&p->hdr, MAX_PHOTO_WIDTH, MAX_PHOTO_HEIGHT, sizeof (p->img[0]),
+                            map_len - PPHOTO_MAGIC_LEN - sizeof (p->palette))) {
+        (void)munmap((void*)map, map_len);
+        return 0;
+    }
+    src += sizeof (p->hdr);
+
+    /* The palette and pixels are stored just as in the photo structure. */
+    n_pixels = (size_t)p->hdr.width * p->hdr.height;
+    if (NULL == (p->img = malloc(n_pixels * sizeof (p->img[0])))) {
+        (void)munmap((void*)map, map_len);
+        return 0;
+    }
+    (void)memcpy(p->palette, src, sizeof (p->palette));
+    (void)memcpy(p->img, src + sizeof (p->palette), n_pixels * sizeof (p->img[0]));
+
+    (void)munmap((void*)map, map_len);
+    return 1;
+}
 
- *   INPUTS: p1 --first node to be compared
- *			 p2 --second node to be compared
+
+/*
+ * tile_offset
+ *   DESCRIPTION: Find a pixel in the pixel data of a tiled room photo.
+ *   INPUTS: p -- tiled room photo pointer
+ *          (x,y) -- pixel position in the photo
  *   OUTPUTS: none
- *   RETURN VALUE: -1 if p1 is before p2
- *					0 if the order is not sure
- *					1 if p1 is after p2
+ *   RETURN VALUE: offset of the pixel in p->img
  *   SIDE EFFECTS: none
  */
-	
-int compar(const void *p1, const void *p2){
-	const struct octree_node* node_1 = p1;
-	const struct octree_node* node_2 = p2;
-	if(node_2->pixel_number < node_1->pixel_number)  return -1;
-	if(node_2->pixel_number > node_1->pixel_number)  return 1;
-	else{return 0;}
+static size_t tile_offset(const photo_t* p, uint32_t x, uint32_t y) {
+    size_t tile; /* index of tile holding the pixel */
+
+    tile = (size_t)(y >> PHOTO_TILE_SHIFT) * p->tile_cols + (x >> PHOTO_TILE_SHIFT);
+    return ((tile << (2 * PHOTO_TILE_SHIFT)) |
+            ((y & PHOTO_TILE_MASK) << PHOTO_TILE_SHIFT) | (x & PHOTO_TILE_MASK));
 }
 
-	
+
+/*
+ * tile_photo
+ *   DESCRIPTION: Rearrange the pixel data of a room photo stored by row
+ *                into tiles(see photo_t).  If memory runs out, the photo
+ *                is left as it was.
+ *   INPUTS: p -- room photo pointer(not tiled)
+ *   OUTPUTS: p -- pixel data and tile_cols replaced
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: dynamically allocates memory for the tiles and frees
+ *                 the old pixel data
+ */
+static void tile_photo(photo_t* p) {
+    uint32_t       tile_rows; /* rows of tiles                  */
+    uint8_t*       tiles;     /* pixel data, tiled              */
+    const uint8_t* src;       /* one row of the old pixel data  */
+    uint32_t       x;         /* index over pixels in a row     */
+    uint32_t       y;         /* index over rows                */
+    uint32_t       run;       /* pixels of a row in one tile    */
+
+    /* Padding in partial tiles is cleared(it is never drawn). */
+    tile_rows = (p->hdr.height + PHOTO_TILE_MASK) >> PHOTO_TILE_SHIFT;
+    p->tile_cols = (p->hdr.width + PHOTO_TILE_MASK) >> PHOTO_TILE_SHIFT;
+    if (NULL == (tiles = calloc((size_t)tile_rows * p->tile_cols,
+                                PHOTO_TILE_DIM * PHOTO_TILE_DIM))) {
+        p->tile_cols = 0;
+        return;
+    }
+
+    /* Copy each row a tile's width at a time. */
+    for (y = 0; p->hdr.height > y; y++) {
+        src = &p->img[(size_t)p->hdr.width * y];
+        for (x = 0; p->hdr.width > x; x += run) {
+            run = p->hdr.width - x;
+            if (PHOTO_TILE_DIM < run) {
+                run = PHOTO_TILE_DIM;
+            }
+            (void)memcpy(&tiles[tile_offset(p, x, y)], &src[x], run);
+        }
+    }
+
+    free(p->img);
+    p->img = tiles;
+}
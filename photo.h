@@ -38,6 +38,7 @@
 #define PHOTO_H
 
 
+#include <stddef.h>
 #include <stdint.h>
 
 #include "types.h"
@@ -51,9 +52,6 @@
 #define MAX_PHOTO_HEIGHT  1024
 #define MAX_OBJECT_WIDTH   160
 #define MAX_OBJECT_HEIGHT  100
-#define LEVEL4_NODE_NUMBER 4096
-#define LEVEL2_NODE_NUMBER 64
-#define LEVEL4_NODE_USED 128
 
 
 
@@ -63,18 +61,82 @@ extern void fill_horiz_buffer(int x, int y, unsigned char buf[SCROLL_X_DIM]);
 /* Fill a buffer with the pixels for a vertical line of current room. */
 extern void fill_vert_buffer(int x, int y, unsigned char buf[SCROLL_Y_DIM]);
 
+/* Fill a buffer with the pixels for a rectangle of current room. */
+extern void fill_rect_buffer(int x, int y, int w, int h, unsigned char buf[][SCROLL_X_DIM]);
+
+/*
+ * Fill a buffer with the pixels for a rectangle of current room without
+ * building anything(for threads helping draw_rect; see set_draw_workers).
+ */
+extern void fill_rect_band(int x, int y, int w, int h, unsigned char buf[][SCROLL_X_DIM]);
+
+/* Free a room photo created by read_photo. */
+extern void free_photo(photo_t* p);
+
+/* counts of entry frames rendered and used(see get_entry_frame_stats) */
+typedef struct entry_stats_t entry_stats_t;
+struct entry_stats_t {
+    uint32_t rendered;  /* frames rendered while the player was idle   */
+    uint32_t shown;     /* rooms entered by copying a frame            */
+    uint32_t missed;    /* rooms entered without an up-to-date frame   */
+    uint32_t stale;     /* frames rendered again after the room changed */
+};
+
+/*
+ * Render the screen seen on entering one room next to the player's(that
+ * has no up-to-date frame and whose photo is in memory) into a frame
+ * cache.  Call while the player is idle, keeping the world from changing;
+ * returns 1 if a frame was rendered, or 0 if there was nothing to do.
+ */
+extern int32_t prerender_near_room(const room_t* r);
+
+/*
+ * Prepare a room just entered and draw the screen(with the view window at
+ * (0,0)) from its frame, as prep_room and a full redraw would; returns 0,
+ * doing nothing, if the room has no up-to-date frame.  No other thread
+ * may be drawing the room meanwhile.
+ */
+extern int32_t show_entry_frame(room_t* r);
+
+/* Get the counts of entry frames rendered and used. */
+extern void get_entry_frame_stats(entry_stats_t* stats);
+
 /* Get height of object image in pixels. */
 extern uint32_t image_height(const image_t* im);
 
 /* Get width of object image in pixels. */
 extern uint32_t image_width(const image_t* im);
 
+/*
+ * Draw the opaque pixels of one row of an object image onto a horizontal
+ * line, with the image's left edge at position off on the line.
+ */
+extern void image_horiz_line(const image_t* im, int off, int row, unsigned char buf[SCROLL_X_DIM]);
+
+/* Get bytes used by the opaque run tables of an object image. */
+extern size_t image_span_bytes(const image_t* im);
+
+/*
+ * Draw the opaque pixels of one column of an object image onto a vertical
+ * line, with the image's top edge at position off on the line.
+ */
+extern void image_vert_line(const image_t* im, int off, int col, unsigned char buf[SCROLL_Y_DIM]);
+
 /* Get height of room photo in pixels. */
 extern uint32_t photo_height(const photo_t* p);
 
 /* Get width of room photo in pixels. */
 extern uint32_t photo_width(const photo_t* p);
 
+/* Get the palette colors of a room photo(for fill_palette). */
+extern const void* photo_palette(const photo_t* p);
+
+/* Copy a horizontal line of a room photo(no objects) into a buffer. */
+extern void photo_horiz_line(const photo_t* p, int x, int y, unsigned char buf[SCROLL_X_DIM]);
+
+/* Copy a vertical line of a room photo(no objects) into a buffer. */
+extern void photo_vert_line(const photo_t* p, int x, int y, unsigned char buf[SCROLL_Y_DIM]);
+
 /*
  * Prepare room for display(record pointer for use by callbacks, set up
  * VGA palette, etc.).
@@ -84,12 +146,38 @@ extern void prep_room(const room_t* r);
 /* Read object image from a file into a dynamically allocated structure. */
 extern image_t* read_obj_image(const char* fname);
 
-extern uint16_t idx_in_level(uint16_t pixel, int k);
+/* Read object image 2:2:2 pixels(top row first) into a dynamic buffer. */
+extern uint8_t* read_obj_pixels(const char* fname, photo_header_t* hdr);
 
 /* Read room photo from a file into a dynamically allocated structure. */
 extern photo_t* read_photo(const char* fname);
 
-extern int compar(const void *p1, const void *p2);
+/* Read and check the header(size) of a room photo file. */
+extern int32_t read_photo_header(const char* fname, photo_header_t* hdr);
+
+/* Read room photo 5:6:5 pixels(top row first) into a dynamic buffer. */
+extern uint16_t* read_photo_pixels(const char* fname, photo_header_t* hdr);
+
+/*
+ * Choose whether room photos read from now on are stored in tiles(1) or
+ * by row(0).  Call only while no photos are being read.
+ */
+extern void set_photo_tiling(int32_t tiled);
+
+/*
+ * Choose whether room photos read from now on come from up-to-date
+ * palettized(.pphoto) files when there are some(1) or are always
+ * quantized(0).  Call only while no photos are being read.
+ */
+extern void set_pphoto_use(int32_t use);
+
+/*
+ * Choose how many rooms(the current room and those shown most recently)
+ * keep an image of their photo with their objects already drawn(0 for
+ * none, at most MAX_ROOM_CACHE_SLOTS).  Frees any images kept.
+ */
+#define MAX_ROOM_CACHE_SLOTS 8
+extern void set_room_cache(int32_t slots);
 
 
 
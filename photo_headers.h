@@ -81,4 +81,21 @@ struct photo_header_t {
     uint16_t height;    /* image height in pixels */
 };
 
+/*
+ * Palettized room photo file for the ECE391 adventure game, written
+ * offline by mp2pphoto so that the game need not choose a palette for
+ * each photo when it starts.
+ *
+ * The file starts with PPHOTO_MAGIC, then a photo_header_t, then the
+ * PPHOTO_COLORS palette colors chosen for the photo(6:6:6 RGB, three
+ * bytes each) for VGA colors PPHOTO_FIRST_COLOR and up.  One byte of VGA
+ * color index per pixel follows.  Unlike the other formats, pixels start
+ * from the upper left of the image, scanning across the row to the right
+ * and then proceeding downwards.  No padding is used.
+ */
+#define PPHOTO_MAGIC       "PPH1"  /* palettized photo file magic sequence */
+#define PPHOTO_MAGIC_LEN   4       /* length of magic sequence             */
+#define PPHOTO_COLORS      192     /* colors in palettized photo palette   */
+#define PPHOTO_FIRST_COLOR 64      /* VGA color of first palette entry     */
+
 #endif /* PHOTO_HEADERS_H */
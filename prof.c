@@ -0,0 +1,377 @@
+/* tab:4
+ *
+ * prof.c - per-tick phase profiler
+ *
+ * Permission to use, copy, modify, and distribute this software and its
+ * documentation for any purpose, without fee, and without written agreement is
+ * hereby granted, provided that the above copyright notice and the following
+ * two paragraphs appear in all copies of this software.
+ *
+ * IN NO EVENT SHALL THE AUTHOR OR THE UNIVERSITY OF ILLINOIS BE LIABLE TO
+ * ANY PARTY FOR DIRECT, INDIRECT, SPECIAL, INCIDENTAL, OR CONSEQUENTIAL
+ * DAMAGES ARISING OUT  OF THE USE OF THIS SOFTWARE AND ITS DOCUMENTATION,
+ * EVEN IF THE AUTHOR AND/OR THE UNIVERSITY OF ILLINOIS HAS BEEN ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THE AUTHOR AND THE UNIVERSITY OF ILLINOIS SPECIFICALLY DISCLAIM ANY
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  THE SOFTWARE
+ * PROVIDED HEREUNDER IS ON AN "AS IS" BASIS, AND NEITHER THE AUTHOR NOR
+ * THE UNIVERSITY OF ILLINOIS HAS ANY OBLIGATION TO PROVIDE MAINTENANCE,
+ * SUPPORT, UPDATES, ENHANCEMENTS, OR MODIFICATIONS."
+ *
+ * Filename:      prof.c
+ */
+
+
+/*
+ * Each thread that marks phases gets a ring of the most recent phases
+ * it finished, and counts all of its phases in histograms by length.  A
+ * thread writes only its own ring and histograms, so no locks are needed;
+ * the thread that dumps the profile reads the rings while they may still
+ * be written, and drops any events that might have been overwritten
+ * while it read them.
+ */
+
+
+#include "prof.h"
+
+#if (PROFILE != 0)
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+
+/* parameters defined for this file */
+#ifndef PROF_RING_SIZE
+#define PROF_RING_SIZE   65536 /* phases kept per thread(a power of 2)   */
+#endif
+#define PROF_MAX_THREADS 4     /* threads that can mark phases           */
+#define PROF_NAME_LEN    24    /* longest thread name kept               */
+#define PROF_HIST_BINS   16    /* bins: < 1 us, < 2 us, < 4 us, and so on */
+
+
+/* types local to this file */
+
+/* one phase in a trace */
+typedef struct prof_event_t prof_event_t;
+struct prof_event_t {
+    uint64_t start;             /* start time in nanoseconds   */
+    uint32_t len;               /* length in nanoseconds       */
+    uint32_t phase;             /* kind of phase(prof_phase_t) */
+};
+
+/* the profile of one thread */
+typedef struct prof_ring_t prof_ring_t;
+struct prof_ring_t {
+    char         name[PROF_NAME_LEN];       /* thread name                */
+    uint64_t     head;                      /* phases ever recorded       */
+    uint64_t     begin[NUM_PROF_PHASES];    /* start of each open phase   */
+    uint64_t     hist[NUM_PROF_PHASES][PROF_HIST_BINS]; /* phases by length */
+    uint64_t     total[NUM_PROF_PHASES];    /* total length of each kind  */
+    uint32_t     worst[NUM_PROF_PHASES];    /* longest of each kind       */
+    prof_event_t ev[PROF_RING_SIZE];        /* most recent phases         */
+};
+
+
+/* file-scope variables */
+
+static const char* const phase_name[NUM_PROF_PHASES] = {
+    "tick", "wait", "keyboard", "tux", "msg_lock", "status_bar", "command",
+    "enter_room", "draw_line", "draw_rect", "view_move", "show_screen",
+    "prerender"
+};
+
+static prof_ring_t rings[PROF_MAX_THREADS];  /* profiles by thread        */
+static uint32_t n_rings = 0;                 /* rings claimed(atomic)     */
+static __thread prof_ring_t* my_ring = NULL; /* the calling thread's ring */
+static volatile sig_atomic_t dump_wanted = 0; /* SIGUSR1 has arrived      */
+
+
+/* local functions--see function headers for details */
+static prof_ring_t* claim_ring(void);
+static void catch_usr1(int sig);
+static uint64_t prof_now(void);
+
+
+/*
+ * prof_init
+ *   DESCRIPTION: Arrange for SIGUSR1 to ask for a dump of the profile.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: changes the behavior of SIGUSR1
+ */
+void prof_init() {
+    struct sigaction sa; /* signal behavior definition */
+
+    (void)memset(&sa, 0, sizeof (sa));
+    sa.sa_handler = catch_usr1;
+    sa.sa_flags = SA_RESTART;
+    (void)sigemptyset(&sa.sa_mask);
+    (void)sigaction(SIGUSR1, &sa, NULL);
+}
+
+
+/*
+ * prof_thread
+ *   DESCRIPTION: Name the calling thread in the trace.
+ *   INPUTS: name -- the name
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: claims a ring for the thread if it has none
+ */
+void prof_thread(const char* name) {
+    prof_ring_t* r = claim_ring(); /* the thread's ring */
+
+    if (NULL != r) {
+        strncpy(r->name, name, PROF_NAME_LEN - 1);
+    }
+}
+
+
+/*
+ * prof_begin
+ *   DESCRIPTION: Mark the start of a phase in the calling thread.
+ *   INPUTS: phase -- kind of phase
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: claims a ring for the thread if it has none
+ */
+void prof_begin(prof_phase_t phase) {
+    prof_ring_t* r = (NULL != my_ring ? my_ring : claim_ring()); /* ring */
+
+    if (NULL != r) {
+        r->begin[phase] = prof_now();
+    }
+}
+
+
+/*
+ * prof_end
+ *   DESCRIPTION: Mark the end of a phase in the calling thread, and
+ *                record the phase.
+ *   INPUTS: phase -- kind of phase(begun with prof_begin)
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: changes the thread's ring and histograms
+ */
+void prof_end(prof_phase_t phase) {
+    prof_ring_t*  r = my_ring;    /* the thread's ring         */
+    uint64_t      len;            /* length of the phase       */
+    prof_event_t* e;              /* place to record the phase */
+    int           bin;            /* histogram bin             */
+
+    if (NULL == r || 0 == r->begin[phase]) {
+        return;
+    }
+    len = prof_now() - r->begin[phase];
+    if (0xFFFFFFFF < len) {
+        len = 0xFFFFFFFF;
+    }
+
+    e = &r->ev[r->head & (PROF_RING_SIZE - 1)];
+    e->start = r->begin[phase];
+    e->len = len;
+    e->phase = phase;
+    __atomic_store_n(&r->head, r->head + 1, __ATOMIC_RELEASE);
+    r->begin[phase] = 0;
+
+    bin = (1000 > len ? 0 : 64 - __builtin_clzll(len / 1000));
+    r->hist[phase][PROF_HIST_BINS > bin ? bin : PROF_HIST_BINS - 1]++;
+    r->total[phase] += len;
+    if (r->worst[phase] < len) {
+        r->worst[phase] = len;
+    }
+}
+
+
+/*
+ * prof_poll
+ *   DESCRIPTION: Dump the profile if SIGUSR1 has arrived since the last
+ *                dump.  Call once per tick.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: see prof_dump
+ */
+void prof_poll() {
+    if (dump_wanted) {
+        dump_wanted = 0;
+        prof_dump();
+    }
+}
+
+
+/*
+ * prof_dump
+ *   DESCRIPTION: Write the phases kept in every thread's ring as a
+ *                Chrome/Perfetto trace("X" events, one track per
+ *                thread), and print each thread's histograms of phase
+ *                length to stderr.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: writes the file named by PROF_TRACE(or
+ *                 adventure-trace.json)
+ */
+void prof_dump() {
+    const char*   fname = getenv("PROF_TRACE"); /* trace file name       */
+    FILE*         f;             /* trace file                           */
+    uint32_t      n = __atomic_load_n(&n_rings, __ATOMIC_ACQUIRE); /* rings */
+    uint32_t      t;             /* index over rings                     */
+    prof_ring_t*  r;             /* a thread's ring                      */
+    prof_event_t* copy;          /* copy of a ring's events              */
+    uint64_t      head;          /* phases recorded before the copy      */
+    uint64_t      first;         /* oldest phase copied                  */
+    uint64_t      safe;          /* oldest phase not overwritten         */
+    uint64_t      i;             /* index over phases                    */
+    uint64_t      base = ~0ULL;  /* earliest start(trace time 0)         */
+    uint64_t      count;         /* phases of one kind                   */
+    int           p;             /* index over kinds of phase            */
+    int           bin;           /* index over histogram bins            */
+    const char*   sep = "";      /* separator between trace events       */
+
+    if (NULL == fname) {
+        fname = "adventure-trace.json";
+    }
+    if (NULL == (copy = malloc(sizeof (rings[0].ev))) ||
+        NULL == (f = fopen(fname, "w"))) {
+        perror(fname);
+        free(copy);
+        return;
+    }
+
+    for (t = 0; n > t; t++) {
+        head = __atomic_load_n(&rings[t].head, __ATOMIC_ACQUIRE);
+        i = (PROF_RING_SIZE < head ? head : 0) & (PROF_RING_SIZE - 1);
+        if (0 != head && base > rings[t].ev[i].start) {
+            base = rings[t].ev[i].start;
+        }
+    }
+
+    fprintf(f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+    for (t = 0; n > t; t++) {
+        r = &rings[t];
+        fprintf(f, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,"
+                "\"args\":{\"name\":\"%s\"}}", sep, t + 1,
+                '\0' != r->name[0] ? r->name : "thread");
+        sep = ",";
+
+        /*
+         * Copy the ring, then keep what the thread cannot have overwritten.
+         * Once the head reads h, the thread may already be writing event h
+         * into the slot of event h - PROF_RING_SIZE, so that event is
+         * dropped too.  The fence keeps the copy's reads before that of
+         * the head.
+         */
+        head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+        first = (PROF_RING_SIZE < head ? head - PROF_RING_SIZE : 0);
+        for (i = first; head > i; i++) {
+            copy[i & (PROF_RING_SIZE - 1)] = r->ev[i & (PROF_RING_SIZE - 1)];
+        }
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        safe = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+        safe = (PROF_RING_SIZE <= safe ? safe - PROF_RING_SIZE + 1 : 0);
+        for (i = (first > safe ? first : safe); head > i; i++) {
+            prof_event_t* e = &copy[i & (PROF_RING_SIZE - 1)];
+
+            fprintf(f, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,"
+                    "\"ts\":%.3f,\"dur\":%.3f}", phase_name[e->phase], t + 1,
+                    (e->start - (base < e->start ? base : e->start)) / 1000.0,
+                    e->len / 1000.0);
+        }
+    }
+    fprintf(f, "\n]}\n");
+    (void)fclose(f);
+    free(copy);
+
+    fprintf(stderr, "Profile written to %s; phase lengths(us):\n", fname);
+    for (t = 0; n > t; t++) {
+        r = &rings[t];
+        fprintf(stderr, "  %s\n", '\0' != r->name[0] ? r->name : "thread");
+        for (p = 0; NUM_PROF_PHASES > p; p++) {
+            for (count = 0, bin = 0; PROF_HIST_BINS > bin; bin++) {
+                count += r->hist[p][bin];
+            }
+            if (0 == count) {
+                continue;
+            }
+            fprintf(stderr, "    %-11s %8llu  mean %9.1f  worst %9.1f |", phase_name[p],
+                    (unsigned long long)count, r->total[p] / 1000.0 / count,
+                    r->worst[p] / 1000.0);
+            for (bin = 0; PROF_HIST_BINS > bin; bin++) {
+                if (0 == r->hist[p][bin]) {
+                    continue;
+                }
+                if (PROF_HIST_BINS - 1 > bin) {
+                    fprintf(stderr, " <%u:%llu", 1U << bin,
+                            (unsigned long long)r->hist[p][bin]);
+                } else {
+                    fprintf(stderr, " more:%llu", (unsigned long long)r->hist[p][bin]);
+                }
+            }
+            fprintf(stderr, "\n");
+        }
+    }
+}
+
+
+/*
+ * claim_ring
+ *   DESCRIPTION: Give the calling thread a ring if it has none.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: the thread's ring, or NULL if all rings are taken
+ *   SIDE EFFECTS: none
+ */
+static prof_ring_t* claim_ring() {
+    uint32_t t; /* index of the new ring */
+
+    if (NULL == my_ring) {
+        t = __atomic_load_n(&n_rings, __ATOMIC_RELAXED);
+        do {
+            if (PROF_MAX_THREADS <= t) {
+                return NULL;
+            }
+        } while (!__atomic_compare_exchange_n(&n_rings, &t, t + 1, 0,
+                                              __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+        my_ring = &rings[t];
+    }
+    return my_ring;
+}
+
+
+/*
+ * catch_usr1
+ *   DESCRIPTION: Signal handler for SIGUSR1: ask for a dump at the next
+ *                prof_poll.
+ *   INPUTS: sig -- signal number(ignored)
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void catch_usr1(int sig) {
+    dump_wanted = 1;
+}
+
+
+/*
+ * prof_now
+ *   DESCRIPTION: Read CLOCK_MONOTONIC.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: the time in nanoseconds(never 0)
+ *   SIDE EFFECTS: none
+ */
+static uint64_t prof_now() {
+    struct timespec now; /* current time */
+
+    (void)clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+#endif /* PROFILE */
@@ -0,0 +1,102 @@
+/* tab:4
+ *
+ * prof.h - per-tick phase profiler header file
+ *
+ * Permission to use, copy, modify, and distribute this software and its
+ * documentation for any purpose, without fee, and without written agreement is
+ * hereby granted, provided that the above copyright notice and the following
+ * two paragraphs appear in all copies of this software.
+ *
+ * IN NO EVENT SHALL THE AUTHOR OR THE UNIVERSITY OF ILLINOIS BE LIABLE TO
+ * ANY PARTY FOR DIRECT, INDIRECT, SPECIAL, INCIDENTAL, OR CONSEQUENTIAL
+ * DAMAGES ARISING OUT  OF THE USE OF THIS SOFTWARE AND ITS DOCUMENTATION,
+ * EVEN IF THE AUTHOR AND/OR THE UNIVERSITY OF ILLINOIS HAS BEEN ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THE AUTHOR AND THE UNIVERSITY OF ILLINOIS SPECIFICALLY DISCLAIM ANY
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  THE SOFTWARE
+ * PROVIDED HEREUNDER IS ON AN "AS IS" BASIS, AND NEITHER THE AUTHOR NOR
+ * THE UNIVERSITY OF ILLINOIS HAS ANY OBLIGATION TO PROVIDE MAINTENANCE,
+ * SUPPORT, UPDATES, ENHANCEMENTS, OR MODIFICATIONS."
+ *
+ * Filename:      prof.h
+ */
+
+#ifndef PROF_H
+#define PROF_H
+
+
+#include <stdint.h>
+
+
+/*
+ * If PROFILE is not 0, the game records the start and length of each
+ * phase of its ticks(see prof_phase_t), and on exit, or at the next tick
+ * after it receives SIGUSR1, writes them as a Chrome/Perfetto trace(to
+ * the file named by the PROF_TRACE environment variable, or to
+ * adventure-trace.json) and prints a latency histogram for each phase.
+ * Otherwise the PROF_ macros below compile to nothing.
+ */
+#ifndef PROFILE
+#define PROFILE 0
+#endif
+
+/* phases of a tick */
+typedef enum {
+    PROF_TICK,           /* work done in one game loop tick          */
+    PROF_WAIT,           /* waiting for a tick or for input          */
+    PROF_KEYBOARD,       /* reading keyboard commands(get_command)   */
+    PROF_TUX,            /* reading Tux buttons(get_tux_command)     */
+    PROF_MSG_LOCK,       /* copying the status message under lock    */
+    PROF_STATUS_BAR,     /* drawing and copying the status bar       */
+    PROF_COMMAND,        /* carrying out a command                   */
+    PROF_ENTER_ROOM,     /* preparing and drawing a new room         */
+    PROF_DRAW_LINE,      /* draw_horiz_line and draw_vert_line       */
+    PROF_DRAW_RECT,      /* draw_rect                                */
+    PROF_VIEW_MOVE,      /* moving the view window in the buffer     */
+    PROF_SHOW_SCREEN,    /* copying a screen to video memory         */
+    PROF_PRERENDER,      /* rendering a nearby room's entry frame    */
+    NUM_PROF_PHASES
+} prof_phase_t;
+
+#if (PROFILE != 0)
+
+#define PROF_INIT()         prof_init()
+#define PROF_THREAD(name)   prof_thread(name)
+#define PROF_BEGIN(phase)   prof_begin(phase)
+#define PROF_END(phase)     prof_end(phase)
+#define PROF_POLL()         prof_poll()
+#define PROF_DUMP()         prof_dump()
+
+/* Dump the profile when SIGUSR1 arrives(see prof_poll). */
+extern void prof_init(void);
+
+/* Name the calling thread in the trace. */
+extern void prof_thread(const char* name);
+
+/*
+ * Mark the start and end of a phase in the calling thread.  Phases of
+ * different kinds may nest; a phase may not nest within itself.
+ */
+extern void prof_begin(prof_phase_t phase);
+extern void prof_end(prof_phase_t phase);
+
+/* Dump the profile if SIGUSR1 has arrived since the last dump. */
+extern void prof_poll(void);
+
+/* Write the trace and print the histograms. */
+extern void prof_dump(void);
+
+#else /* PROFILE == 0 */
+
+#define PROF_INIT()         do {} while (0)
+#define PROF_THREAD(name)   do {} while (0)
+#define PROF_BEGIN(phase)   do {} while (0)
+#define PROF_END(phase)     do {} while (0)
+#define PROF_POLL()         do {} while (0)
+#define PROF_DUMP()         do {} while (0)
+
+#endif /* PROFILE */
+
+#endif /* PROF_H */
@@ -0,0 +1,1308 @@
+/* tab:4
+ *
+ * quantize.c - room photo palette selection
+ *
+ * Permission to use, copy, modify, and distribute this software and its
+ * documentation for any purpose, without fee, and without written agreement is
+ * hereby granted, provided that the above copyright notice and the following
+ * two paragraphs appear in all copies of this software.
+ *
+ * IN NO EVENT SHALL THE AUTHOR OR THE UNIVERSITY OF ILLINOIS BE LIABLE TO
+ * ANY PARTY FOR DIRECT, INDIRECT, SPECIAL, INCIDENTAL, OR CONSEQUENTIAL
+ * DAMAGES ARISING OUT  OF THE USE OF THIS SOFTWARE AND ITS DOCUMENTATION,
+ * EVEN IF THE AUTHOR AND/OR THE UNIVERSITY OF ILLINOIS HAS BEEN ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THE AUTHOR AND THE UNIVERSITY OF ILLINOIS SPECIFICALLY DISCLAIM ANY
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  THE SOFTWARE
+ * PROVIDED HEREUNDER IS ON AN "AS IS" BASIS, AND NEITHER THE AUTHOR NOR
+ * THE UNIVERSITY OF ILLINOIS HAS ANY OBLIGATION TO PROVIDE MAINTENANCE,
+ * SUPPORT, UPDATES, ENHANCEMENTS, OR MODIFICATIONS."
+ *
+ * Filename:      quantize.c
+ */
+
+
+/*
+ * This file holds the palette selection for room photos.  It is shared by
+ * the game(read_photo, for 5:6:5 photos) and by the mp2pphoto utility,
+ * which does the same work offline and writes palettized photos.
+ *
+ * Several algorithms(quantizers) are available; each chooses the
+ * QUANT_N_COLORS colors and maps every pixel to one of them.  The one used
+ * by quantize_photo is chosen with select_quantizer.  Palette colors and
+ * distances are computed in 6:6:6 RGB, the precision of the VGA palette.
+ *
+ * The octree quantizers spend most of their time finding the octree cell
+ * of each pixel, once to count and once to map.  That work is done a
+ * chunk of pixels at a time by an index kernel: plain C, SSE2(8 pixels
+ * per step), or AVX2(16 pixels per step).  The fastest kernel the CPU
+ * supports is used unless another is chosen with select_quant_kernel.
+ *
+ * The octree quantizers read the photo a row at a time, so they can also
+ * be run on rows supplied by the caller(quantize_photo_rows), for example
+ * straight from a mapped file; their tables are then allocated rather
+ * than kept on the stack.
+ */
+
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "quantize.h"
+
+
+/*
+ * If QUANT_SIMD is set to 0, only the plain C index kernel is built.
+ * Otherwise the SSE2 and AVX2 kernels are also built when compiling for
+ * x86 with gcc, and are used if the CPU supports them.
+ */
+#ifndef QUANT_SIMD
+#define QUANT_SIMD 1
+#endif
+
+#if (1 == QUANT_SIMD && defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__)))
+#define HAVE_X86_KERNELS 1
+#include <immintrin.h>
+#else
+#define HAVE_X86_KERNELS 0
+#endif
+
+
+/* parameters defined for this file */
+#define N_565_COLORS  65536 /* number of distinct 5:6:5 pixel values     */
+#define KMEANS_PASSES 4     /* refinement passes made by the k-means one */
+#define QUANT_CHUNK   1024  /* pixels indexed per index kernel call     */
+
+
+/* an octree node: color statistics for one level-2 or level-4 cell */
+typedef struct octree_node_t octree_node_t;
+struct octree_node_t {
+    uint16_t      idx_by_rgb;   /* index of the node by RGB value          */
+    uint16_t      level2_idx;   /* level-2 parent(level-4 nodes only)      */
+    uint16_t      palette_idx;  /* VGA color chosen for the node           */
+    unsigned long red_sum;      /* sum of 5-bit red values of pixels       */
+    unsigned long green_sum;    /* sum of 6-bit green values of pixels     */
+    unsigned long blue_sum;     /* sum of 5-bit blue values of pixels      */
+    unsigned int  pixel_number; /* number of pixels in the node            */
+};
+
+/*
+ * Octree color statistics gathered by octree_count, one array per field.
+ * Even and odd pixels are counted in separate banks so that neighboring
+ * pixels in the same cell do not wait on each other's updates; the banks
+ * are merged into octree nodes at the end.
+ */
+typedef struct octree_hist_t octree_hist_t;
+struct octree_hist_t {
+    uint32_t count[2][LEVEL4_NODE_NUMBER]; /* pixels in each cell       */
+    uint32_t red[2][LEVEL4_NODE_NUMBER];   /* sum of 5-bit red values   */
+    uint32_t green[2][LEVEL4_NODE_NUMBER]; /* sum of 6-bit green values */
+    uint32_t blue[2][LEVEL4_NODE_NUMBER];  /* sum of 5-bit blue values  */
+};
+
+/* the working state of an octree quantizer */
+typedef struct octree_t octree_t;
+struct octree_t {
+    octree_hist_t hist;                       /* level-4 statistics */
+    octree_node_t level4[LEVEL4_NODE_NUMBER]; /* level-4 nodes      */
+    octree_node_t level2[LEVEL2_NODE_NUMBER]; /* level-2 nodes      */
+};
+
+/* an index kernel: finds the level-4 octree cell of each of n pixels */
+typedef struct quant_kernel_t quant_kernel_t;
+struct quant_kernel_t {
+    const char* name;                  /* name used to select the kernel */
+    int32_t (*supported)(void);        /* CPU check(NULL if none needed)  */
+    void (*index4)(const uint16_t* pixels, uint32_t n, uint16_t* idx);
+};
+
+/* one distinct pixel value in a photo, with its number of pixels */
+typedef struct color_count_t color_count_t;
+struct color_count_t {
+    uint16_t color; /* 5:6:5 pixel value          */
+    uint32_t count; /* number of pixels with value */
+};
+
+/* a box of colors for median cut: a range of a color_count_t array */
+typedef struct mc_box_t mc_box_t;
+struct mc_box_t {
+    uint32_t start; /* first color in box        */
+    uint32_t end;   /* one past last color in box */
+    uint32_t count; /* number of pixels in box   */
+};
+
+
+/* local functions--see function headers for details */
+static int compare_b(const void* p1, const void* p2);
+static int compare_g(const void* p1, const void* p2);
+static int compare_pixel_counts(const void* p1, const void* p2);
+static int compare_pixel_counts_idx(const void* p1, const void* p2);
+static int compare_r(const void* p1, const void* p2);
+static color_count_t* count_colors(const uint16_t* pixels, uint32_t n_pixels,
+                                   uint32_t* n_colors);
+static const quant_kernel_t* get_kernel(void);
+#if (1 == HAVE_X86_KERNELS)
+static int32_t has_avx2(void);
+static int32_t has_sse2(void);
+static void index4_avx2(const uint16_t* pixels, uint32_t n, uint16_t* idx);
+#endif
+static void index4_scalar(const uint16_t* pixels, uint32_t n, uint16_t* idx);
+#if (1 == HAVE_X86_KERNELS)
+static void index4_sse2(const uint16_t* pixels, uint32_t n, uint16_t* idx);
+#endif
+static void map_with_lut(const color_count_t* colors, uint32_t n_colors,
+                         const uint8_t* best, const uint16_t* pixels,
+                         uint32_t n_pixels, uint8_t* img);
+static uint8_t nearest_color(const uint8_t palette[QUANT_N_COLORS][3],
+                             uint16_t pixel);
+static void node_color(const octree_node_t* node, uint8_t color[3]);
+static void octree_count(octree_t* tree, quant_row_fn get_row, const void* src,
+                         uint32_t width, uint32_t height);
+static void octree_finish(octree_t* tree, quant_row_fn get_row, const void* src,
+                          uint32_t width, uint32_t height,
+                          uint8_t palette[QUANT_N_COLORS][3], uint8_t* img);
+static void octree_quantize(octree_t* tree, int32_t topk, quant_row_fn get_row,
+                            const void* src, uint32_t width, uint32_t height,
+                            uint8_t palette[QUANT_N_COLORS][3], uint8_t* img);
+static const uint16_t* pixel_array_row(const void* src, uint32_t y);
+static void quantize_kmeans(const uint16_t* pixels, uint32_t n_pixels,
+                            uint8_t palette[QUANT_N_COLORS][3], uint8_t* img);
+static void quantize_median_cut(const uint16_t* pixels, uint32_t n_pixels,
+                                uint8_t palette[QUANT_N_COLORS][3], uint8_t* img);
+static void quantize_octree(const uint16_t* pixels, uint32_t n_pixels,
+                            uint8_t palette[QUANT_N_COLORS][3], uint8_t* img);
+static int32_t quantize_octree_rows(quant_row_fn get_row, const void* src,
+                                    uint32_t width, uint32_t height,
+                                    uint8_t palette[QUANT_N_COLORS][3], uint8_t* img);
+static void quantize_octree_topk(const uint16_t* pixels, uint32_t n_pixels,
+                                 uint8_t palette[QUANT_N_COLORS][3], uint8_t* img);
+static int32_t quantize_octree_topk_rows(quant_row_fn get_row, const void* src,
+                                         uint32_t width, uint32_t height,
+                                         uint8_t palette[QUANT_N_COLORS][3],
+                                         uint8_t* img);
+static void select_top_nodes(octree_node_t level4[LEVEL4_NODE_NUMBER], int32_t k);
+
+
+/*
+ * the available quantizers, default first; the list ends with an entry
+ * with a NULL name
+ */
+static const quantizer_t quantizers[] = {
+    {"octree", "most common 4:4:4 octree cells plus 2:2:2 cells(full sort)",
+     quantize_octree, quantize_octree_rows},
+    {"octree-topk", "same colors as octree, but selects the top cells without a full sort",
+     quantize_octree_topk, quantize_octree_topk_rows},
+    {"median-cut", "median cut of the distinct colors in the photo",
+     quantize_median_cut, NULL},
+    {"kmeans", "octree palette refined by a few k-means passes",
+     quantize_kmeans, NULL},
+    {NULL, NULL, NULL, NULL}
+};
+
+/*
+ * The quantizer used by quantize_photo.  Set only by select_quantizer,
+ * which must not be called while photos are being quantized.
+ */
+static const quantizer_t* cur_quantizer = &quantizers[0];
+
+/*
+ * the index kernels, fastest first; the list ends with an entry with a
+ * NULL name
+ */
+static const quant_kernel_t kernels[] = {
+#if (1 == HAVE_X86_KERNELS)
+    {"avx2", has_avx2, index4_avx2},
+    {"sse2", has_sse2, index4_sse2},
+#endif
+    {"scalar", NULL, index4_scalar},
+    {NULL, NULL, NULL}
+};
+
+/*
+ * The index kernel chosen with select_quant_kernel, or NULL to use the
+ * fastest one that the CPU supports.
+ */
+static const quant_kernel_t* cur_kernel = NULL;
+
+
+/* level-4 cell of a 5:6:5 pixel: RRRRRGGGGGGBBBBB -> RRRRGGGGBBBB */
+#define LEVEL4_IDX(p) ((((p) >> 4) & 0xF00) | (((p) >> 3) & 0x0F0) | (((p) >> 1) & 0x00F))
+
+/* level-2 cell holding a level-4 cell: RRRRGGGGBBBB -> RRGGBB */
+#define LEVEL2_OF_LEVEL4(i) ((((i) >> 6) & 0x30) | (((i) >> 4) & 0x0C) | (((i) >> 2) & 0x03))
+
+/* macros to extract 6-bit RGB components from a 5:6:5 pixel */
+#define PIXEL_R6(p) ((((p) >> 11) & 0x1F) << 1)
+#define PIXEL_G6(p) (((p) >> 5) & 0x3F)
+#define PIXEL_B6(p) (((p) & 0x1F) << 1)
+
+
+/*
+ * compare_b
+ *   DESCRIPTION: qsort comparison function that orders colors by blue.
+ *   INPUTS: p1 -- first color_count_t to be compared
+ *           p2 -- second color_count_t to be compared
+ *   OUTPUTS: none
+ *   RETURN VALUE: negative, zero, or positive as p1 is less, equal, greater
+ *   SIDE EFFECTS: none
+ */
+static int compare_b(const void* p1, const void* p2) {
+    return (int)PIXEL_B6(((const color_count_t*)p1)->color) -
+           (int)PIXEL_B6(((const color_count_t*)p2)->color);
+}
+
+
+/*
+ * compare_g
+ *   DESCRIPTION: qsort comparison function that orders colors by green.
+ *   INPUTS: p1 -- first color_count_t to be compared
+ *           p2 -- second color_count_t to be compared
+ *   OUTPUTS: none
+ *   RETURN VALUE: negative, zero, or positive as p1 is less, equal, greater
+ *   SIDE EFFECTS: none
+ */
+static int compare_g(const void* p1, const void* p2) {
+    return (int)PIXEL_G6(((const color_count_t*)p1)->color) -
+           (int)PIXEL_G6(((const color_count_t*)p2)->color);
+}
+
+
+/*
+ * compare_pixel_counts
+ *   DESCRIPTION: qsort comparison function that orders octree nodes from
+ *                most to fewest pixels.
+ *   INPUTS: p1 -- first node to be compared
+ *           p2 -- second node to be compared
+ *   OUTPUTS: none
+ *   RETURN VALUE: -1 if p1 has more pixels than p2, 1 if fewer, else 0
+ *   SIDE EFFECTS: none
+ */
+static int compare_pixel_counts(const void* p1, const void* p2) {
+    const octree_node_t* node_1 = p1; /* first node  */
+    const octree_node_t* node_2 = p2; /* second node */
+
+    if (node_2->pixel_number < node_1->pixel_number) {
+        return -1;
+    }
+    if (node_2->pixel_number > node_1->pixel_number) {
+        return 1;
+    }
+    return 0;
+}
+
+
+/*
+ * compare_pixel_counts_idx
+ *   DESCRIPTION: Like compare_pixel_counts, but breaks ties by node index
+ *                so that the order is total.
+ *   INPUTS: p1 -- first node to be compared
+ *           p2 -- second node to be compared
+ *   OUTPUTS: none
+ *   RETURN VALUE: -1 if p1 comes first, 1 if p2 comes first, else 0
+ *   SIDE EFFECTS: none
+ */
+static int compare_pixel_counts_idx(const void* p1, const void* p2) {
+    const octree_node_t* node_1 = p1; /* first node  */
+    const octree_node_t* node_2 = p2; /* second node */
+    int                  order;   /* order by counts */
+
+    if (0 != (order = compare_pixel_counts(p1, p2))) {
+        return order;
+    }
+    return (node_1->idx_by_rgb < node_2->idx_by_rgb ? -1 :
+            node_1->idx_by_rgb > node_2->idx_by_rgb);
+}
+
+
+/*
+ * compare_r
+ *   DESCRIPTION: qsort comparison function that orders colors by red.
+ *   INPUTS: p1 -- first color_count_t to be compared
+ *           p2 -- second color_count_t to be compared
+ *   OUTPUTS: none
+ *   RETURN VALUE: negative, zero, or positive as p1 is less, equal, greater
+ *   SIDE EFFECTS: none
+ */
+static int compare_r(const void* p1, const void* p2) {
+    return (int)PIXEL_R6(((const color_count_t*)p1)->color) -
+           (int)PIXEL_R6(((const color_count_t*)p2)->color);
+}
+
+
+/*
+ * count_colors
+ *   DESCRIPTION: Find the distinct pixel values in a photo and the number
+ *                of pixels with each.
+ *   INPUTS: pixels -- 5:6:5 RGB pixels of the photo
+ *           n_pixels -- number of pixels
+ *   OUTPUTS: n_colors -- number of distinct values
+ *   RETURN VALUE: newly allocated array of values in increasing order, or
+ *                 NULL if memory can't be allocated
+ *   SIDE EFFECTS: dynamically allocates memory
+ */
+static color_count_t* count_colors(const uint16_t* pixels, uint32_t n_pixels,
+                                   uint32_t* n_colors) {
+    uint32_t*      hist;   /* pixels with each value */
+    color_count_t* colors; /* the distinct values    */
+    uint32_t       i;      /* index over pixels      */
+    uint32_t       n;      /* distinct values found  */
+
+    if (NULL == (hist = calloc(N_565_COLORS, sizeof (hist[0])))) {
+        return NULL;
+    }
+    for (i = 0; n_pixels > i; i++) {
+        hist[pixels[i]]++;
+    }
+    for (i = 0, n = 0; N_565_COLORS > i; i++) {
+        n += (0 != hist[i]);
+    }
+    if (NULL == (colors = malloc((0 < n ? n : 1) * sizeof (colors[0])))) {
+        free(hist);
+        return NULL;
+    }
+    for (i = 0, n = 0; N_565_COLORS > i; i++) {
+        if (0 != hist[i]) {
+            colors[n].color = i;
+            colors[n++].count = hist[i];
+        }
+    }
+    free(hist);
+    *n_colors = n;
+    return colors;
+}
+
+
+/*
+ * find_quantizer
+ *   DESCRIPTION: Look up a quantizer by name.
+ *   INPUTS: name -- name of the quantizer
+ *   OUTPUTS: none
+ *   RETURN VALUE: the quantizer, or NULL if there is none by that name
+ *   SIDE EFFECTS: none
+ */
+const quantizer_t* find_quantizer(const char* name) {
+    const quantizer_t* q; /* index over quantizers */
+
+    for (q = quantizers; NULL != q->name; q++) {
+        if (0 == strcmp(name, q->name)) {
+            return q;
+        }
+    }
+    return NULL;
+}
+
+
+/*
+ * get_kernel
+ *   DESCRIPTION: Find the index kernel to use: the one chosen with
+ *                select_quant_kernel, or else the fastest one that the CPU
+ *                supports.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: the index kernel
+ *   SIDE EFFECTS: none
+ */
+static const quant_kernel_t* get_kernel(void) {
+    const quant_kernel_t* k; /* index over kernels */
+
+    if (NULL != cur_kernel) {
+        return cur_kernel;
+    }
+    /* The plain C kernel, last in the list, needs no support. */
+    for (k = kernels; NULL != k->supported && !k->supported(); k++) {
+    }
+    return k;
+}
+
+
+#if (1 == HAVE_X86_KERNELS)
+/*
+ * has_avx2
+ *   DESCRIPTION: Check whether the CPU supports AVX2.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: 1 if so, 0 if not
+ *   SIDE EFFECTS: none
+ */
+static int32_t has_avx2(void) {
+    __builtin_cpu_init();
+    return (0 != __builtin_cpu_supports("avx2"));
+}
+
+
+/*
+ * has_sse2
+ *   DESCRIPTION: Check whether the CPU supports SSE2.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: 1 if so, 0 if not
+ *   SIDE EFFECTS: none
+ */
+static int32_t has_sse2(void) {
+    __builtin_cpu_init();
+    return (0 != __builtin_cpu_supports("sse2"));
+}
+
+
+/*
+ * index4_avx2
+ *   DESCRIPTION: Index kernel using AVX2: find the level-4 octree cell of
+ *                each pixel, 16 pixels per step.  Use only if the CPU
+ *                supports AVX2.
+ *   INPUTS: pixels -- 5:6:5 RGB pixels
+ *           n -- number of pixels
+ *   OUTPUTS: idx -- level-4 cell of each pixel
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+__attribute__((target("avx2")))
+static void index4_avx2(const uint16_t* pixels, uint32_t n, uint16_t* idx) {
+    const __m256i red = _mm256_set1_epi16(0x0F00);   /* red field mask   */
+    const __m256i green = _mm256_set1_epi16(0x00F0); /* green field mask */
+    const __m256i blue = _mm256_set1_epi16(0x000F);  /* blue field mask  */
+    __m256i       p;                                 /* 16 pixels        */
+    uint32_t      i;                                 /* index over pixels */
+
+    for (i = 0; n >= i + 16; i += 16) {
+        p = _mm256_loadu_si256((const __m256i*)&pixels[i]);
+        _mm256_storeu_si256((__m256i*)&idx[i],
+            _mm256_or_si256(_mm256_or_si256(
+                _mm256_and_si256(_mm256_srli_epi16(p, 4), red),
+                _mm256_and_si256(_mm256_srli_epi16(p, 3), green)),
+                _mm256_and_si256(_mm256_srli_epi16(p, 1), blue)));
+    }
+    index4_scalar(&pixels[i], n - i, &idx[i]);
+}
+#endif /* HAVE_X86_KERNELS */
+
+
+/*
+ * index4_scalar
+ *   DESCRIPTION: Index kernel in plain C: find the level-4 octree cell of
+ *                each pixel.
+ *   INPUTS: pixels -- 5:6:5 RGB pixels
+ *           n -- number of pixels
+ *   OUTPUTS: idx -- level-4 cell of each pixel
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void index4_scalar(const uint16_t* pixels, uint32_t n, uint16_t* idx) {
+    uint32_t i; /* index over pixels */
+
+    for (i = 0; n > i; i++) {
+        idx[i] = LEVEL4_IDX(pixels[i]);
+    }
+}
+
+
+#if (1 == HAVE_X86_KERNELS)
+/*
+ * index4_sse2
+ *   DESCRIPTION: Index kernel using SSE2: find the level-4 octree cell of
+ *                each pixel, 8 pixels per step.  Use only if the CPU
+ *                supports SSE2.
+ *   INPUTS: pixels -- 5:6:5 RGB pixels
+ *           n -- number of pixels
+ *   OUTPUTS: idx -- level-4 cell of each pixel
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+__attribute__((target("sse2")))
+static void index4_sse2(const uint16_t* pixels, uint32_t n, uint16_t* idx) {
+    const __m128i red = _mm_set1_epi16(0x0F00);   /* red field mask    */
+    const __m128i green = _mm_set1_epi16(0x00F0); /* green field mask  */
+    const __m128i blue = _mm_set1_epi16(0x000F);  /* blue field mask   */
+    __m128i       p;                              /* 8 pixels          */
+    uint32_t      i;                              /* index over pixels */
+
+    for (i = 0; n >= i + 8; i += 8) {
+        p = _mm_loadu_si128((const __m128i*)&pixels[i]);
+        _mm_storeu_si128((__m128i*)&idx[i],
+            _mm_or_si128(_mm_or_si128(
+                _mm_and_si128(_mm_srli_epi16(p, 4), red),
+                _mm_and_si128(_mm_srli_epi16(p, 3), green)),
+                _mm_and_si128(_mm_srli_epi16(p, 1), blue)));
+    }
+    index4_scalar(&pixels[i], n - i, &idx[i]);
+}
+#endif /* HAVE_X86_KERNELS */
+
+
+/*
+ * map_with_lut
+ *   DESCRIPTION: Map the pixels of a photo to VGA colors given the
+ *                palette entry chosen for each distinct pixel value.
+ *   INPUTS: colors -- distinct pixel values(see count_colors)
+ *           n_colors -- number of distinct values
+ *           best -- palette entry for each distinct value
+ *           pixels -- 5:6:5 RGB pixels of the photo
+ *           n_pixels -- number of pixels
+ *   OUTPUTS: img -- VGA color index for each pixel
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void map_with_lut(const color_count_t* colors, uint32_t n_colors,
+                         const uint8_t* best, const uint16_t* pixels,
+                         uint32_t n_pixels, uint8_t* img) {
+    uint8_t  lut[N_565_COLORS]; /* VGA color for each pixel value */
+    uint32_t i;                 /* index over colors/pixels       */
+
+    for (i = 0; n_colors > i; i++) {
+        lut[colors[i].color] = QUANT_FIRST_COLOR + best[i];
+    }
+    for (i = 0; n_pixels > i; i++) {
+        img[i] = lut[pixels[i]];
+    }
+}
+
+
+/*
+ * nearest_color
+ *   DESCRIPTION: Find the palette entry closest to a pixel(squared
+ *                distance in 6:6:6 RGB).
+ *   INPUTS: palette -- the palette
+ *           pixel -- 5:6:5 RGB pixel
+ *   OUTPUTS: none
+ *   RETURN VALUE: index of the closest palette entry
+ *   SIDE EFFECTS: none
+ */
+static uint8_t nearest_color(const uint8_t palette[QUANT_N_COLORS][3],
+                             uint16_t pixel) {
+    int32_t r = PIXEL_R6(pixel); /* pixel red      */
+    int32_t g = PIXEL_G6(pixel); /* pixel green    */
+    int32_t b = PIXEL_B6(pixel); /* pixel blue     */
+    int32_t best = 0;            /* closest entry  */
+    int32_t best_d = 0x7FFFFFFF; /* its distance   */
+    int32_t d;                   /* distance       */
+    int32_t i;                   /* index over palette */
+
+    for (i = 0; QUANT_N_COLORS > i; i++) {
+        d = (palette[i][0] - r) * (palette[i][0] - r);
+        if (best_d <= d) {
+            continue;
+        }
+        d += (palette[i][1] - g) * (palette[i][1] - g);
+        if (best_d <= d) {
+            continue;
+        }
+        d += (palette[i][2] - b) * (palette[i][2] - b);
+        if (best_d > d) {
+            best_d = d;
+            best = i;
+        }
+    }
+    return best;
+}
+
+
+/*
+ * node_color
+ *   DESCRIPTION: Compute the palette color for an octree node: the average
+ *                of its pixels, as 6:6:6 RGB.
+ *   INPUTS: node -- the octree node
+ *   OUTPUTS: color -- the palette color
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void node_color(const octree_node_t* node, uint8_t color[3]) {
+    uint32_t r_average = 0; /* average 5-bit red   */
+    uint32_t g_average = 0; /* average 6-bit green */
+    uint32_t b_average = 0; /* average 5-bit blue  */
+
+    if (0 != node->pixel_number) {
+        r_average = node->red_sum / node->pixel_number;
+        g_average = node->green_sum / node->pixel_number;
+        b_average = node->blue_sum / node->pixel_number;
+    }
+    color[0] = (uint8_t)(r_average & 0x1F) << 1;
+    color[1] = (uint8_t)(g_average & 0x3F);
+    color[2] = (uint8_t)(b_average & 0x1F) << 1;
+}
+
+
+/*
+ * octree_count
+ *   DESCRIPTION: Gather the level-4 and level-2 octree color statistics
+ *                for a photo.  Only level-4 cells are counted; each
+ *                level-2 node is the sum of the 64 level-4 cells in it.
+ *   INPUTS: tree -- octree state
+ *           get_row -- gets a row of 5:6:5 RGB pixels of the photo
+ *           src -- passed to get_row
+ *           width -- pixels per row
+ *           height -- number of rows
+ *   OUTPUTS: tree -- level-4 and level-2 nodes filled in, indexed by RGB
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void octree_count(octree_t* tree, quant_row_fn get_row, const void* src,
+                         uint32_t width, uint32_t height) {
+    const quant_kernel_t* kernel = get_kernel(); /* index kernel          */
+    octree_hist_t*        hist = &tree->hist;    /* per-field statistics  */
+    octree_node_t*        level4 = tree->level4; /* level-4 nodes         */
+    octree_node_t*        level2 = tree->level2; /* level-2 nodes         */
+    const uint16_t*       pixels;                /* one row of pixels     */
+    uint16_t              idx[QUANT_CHUNK];      /* cells of a chunk      */
+    uint32_t              n;                     /* pixels in a chunk     */
+    uint32_t              y;                     /* index over rows       */
+    uint32_t              i;                     /* index over pixels     */
+    uint32_t              j;                     /* index in a chunk      */
+    uint32_t              b;                     /* bank of a pixel       */
+    uint16_t              pixel;                 /* one 5:6:5 pixel       */
+    octree_node_t*        node;                  /* one node              */
+
+    /* Gather level-4 statistics a chunk of a row at a time. */
+    (void)memset(hist, 0, sizeof (*hist));
+    for (y = 0; height > y; y++) {
+        pixels = get_row(src, y);
+        for (i = 0; width > i; i += n) {
+            n = (QUANT_CHUNK < width - i ? QUANT_CHUNK : width - i);
+            kernel->index4(&pixels[i], n, idx);
+            for (j = 0; n > j; j++) {
+                pixel = pixels[i + j];
+                b = (j & 1);
+                hist->count[b][idx[j]]++;
+                hist->red[b][idx[j]] += (pixel >> 11) & 0x001F;
+                hist->green[b][idx[j]] += (pixel >> 5) & 0x003F;
+                hist->blue[b][idx[j]] += pixel & 0x001F;
+            }
+        }
+    }
+
+    /* Clear the level-2 nodes. */
+    for (i = 0; LEVEL2_NODE_NUMBER > i; i++) {
+        level2[i].idx_by_rgb = i;
+        level2[i].level2_idx = 65;
+        level2[i].palette_idx = -1;
+        level2[i].red_sum = 0;
+        level2[i].green_sum = 0;
+        level2[i].blue_sum = 0;
+        level2[i].pixel_number = 0;
+    }
+
+    /*
+     * Merge the banks into the level-4 nodes and add each into its level-2
+     * node(level2_idx 65 marks an unused level-4 node).
+     */
+    for (i = 0; LEVEL4_NODE_NUMBER > i; i++) {
+        node = &level4[i];
+        node->idx_by_rgb = i;
+        node->palette_idx = -1;
+        node->pixel_number = hist->count[0][i] + hist->count[1][i];
+        node->red_sum = hist->red[0][i] + hist->red[1][i];
+        node->green_sum = hist->green[0][i] + hist->green[1][i];
+        node->blue_sum = hist->blue[0][i] + hist->blue[1][i];
+        if (0 == node->pixel_number) {
+            node->level2_idx = 65;
+            continue;
+        }
+        node->level2_idx = LEVEL2_OF_LEVEL4(i);
+        level2[node->level2_idx].pixel_number += node->pixel_number;
+        level2[node->level2_idx].red_sum += node->red_sum;
+        level2[node->level2_idx].green_sum += node->green_sum;
+        level2[node->level2_idx].blue_sum += node->blue_sum;
+    }
+}
+
+
+/*
+ * octree_finish
+ *   DESCRIPTION: Choose the palette from octree statistics and map the
+ *                pixels.  The first LEVEL4_NODE_USED level-4 nodes(which
+ *                the caller has put in order, most pixels first) get their
+ *                own colors; all other pixels use the color of their
+ *                level-2 node.
+ *   INPUTS: tree -- octree state: level-4 nodes, chosen nodes first, and
+ *                   level-2 nodes, indexed by RGB
+ *           get_row -- gets a row of 5:6:5 RGB pixels of the photo
+ *           src -- passed to get_row
+ *           width -- pixels per row
+ *           height -- number of rows
+ *   OUTPUTS: palette -- chosen colors(6:6:6 RGB)
+ *            img -- VGA color index for each pixel, top row first
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: changes palette_idx fields of nodes
+ */
+static void octree_finish(octree_t* tree, quant_row_fn get_row, const void* src,
+                          uint32_t width, uint32_t height,
+                          uint8_t palette[QUANT_N_COLORS][3], uint8_t* img) {
+    const quant_kernel_t* kernel = get_kernel();    /* index kernel        */
+    octree_node_t*        level4 = tree->level4;    /* level-4 nodes       */
+    octree_node_t*        level2 = tree->level2;    /* level-2 nodes       */
+    const uint16_t*       pixels;                   /* one row of pixels   */
+    uint8_t               lut[LEVEL4_NODE_NUMBER];  /* VGA color by cell   */
+    uint16_t              idx[QUANT_CHUNK];         /* cells of a chunk    */
+    uint32_t              n;                        /* pixels in a chunk   */
+    uint32_t              y;                        /* index over rows     */
+    uint32_t              i;                        /* index over nodes    */
+    uint32_t              j;                        /* index in a chunk    */
+
+    /* The chosen level-4 nodes get the first colors. */
+    for (i = 0; LEVEL4_NODE_USED > i; i++) {
+        node_color(&level4[i], palette[i]);
+        level4[i].palette_idx = QUANT_FIRST_COLOR + i;
+        lut[level4[i].idx_by_rgb] = level4[i].palette_idx;
+    }
+
+    /* The level-2 nodes get the rest. */
+    for (i = 0; LEVEL2_NODE_NUMBER > i; i++) {
+        node_color(&level2[i], palette[LEVEL4_NODE_USED + i]);
+        level2[i].palette_idx = QUANT_FIRST_COLOR + LEVEL4_NODE_USED + i;
+    }
+
+    /* Other level-4 nodes use the color of their level-2 node. */
+    for (i = LEVEL4_NODE_USED; LEVEL4_NODE_NUMBER > i; i++) {
+        if (LEVEL2_NODE_NUMBER > level4[i].level2_idx) {
+            level4[i].palette_idx = level2[level4[i].level2_idx].palette_idx;
+        }
+        lut[level4[i].idx_by_rgb] = level4[i].palette_idx;
+    }
+
+    /* Map the pixels through the table, a chunk of a row at a time. */
+    for (y = 0; height > y; y++, img += width) {
+        pixels = get_row(src, y);
+        for (i = 0; width > i; i += n) {
+            n = (QUANT_CHUNK < width - i ? QUANT_CHUNK : width - i);
+            kernel->index4(&pixels[i], n, idx);
+            for (j = 0; n > j; j++) {
+                img[i + j] = lut[idx[j]];
+            }
+        }
+    }
+}
+
+
+/*
+ * octree_quantize
+ *   DESCRIPTION: Run an octree quantizer: count, put the level-4 nodes in
+ *                order, then choose the palette and map the pixels.
+ *   INPUTS: tree -- octree state(contents ignored)
+ *           topk -- 1 to order only the chosen nodes(see
+ *                   select_top_nodes), or 0 to sort them all
+ *           get_row -- gets a row of 5:6:5 RGB pixels of the photo
+ *           src -- passed to get_row
+ *           width -- pixels per row
+ *           height -- number of rows
+ *   OUTPUTS: palette -- chosen colors(6:6:6 RGB)
+ *            img -- VGA color index for each pixel, top row first
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void octree_quantize(octree_t* tree, int32_t topk, quant_row_fn get_row,
+                            const void* src, uint32_t width, uint32_t height,
+                            uint8_t palette[QUANT_N_COLORS][3], uint8_t* img) {
+    octree_count(tree, get_row, src, width, height);
+    if (topk) {
+        select_top_nodes(tree->level4, LEVEL4_NODE_USED);
+    } else {
+        qsort(tree->level4, LEVEL4_NODE_NUMBER, sizeof (tree->level4[0]),
+              compare_pixel_counts);
+    }
+    octree_finish(tree, get_row, src, width, height, palette, img);
+}
+
+
+/*
+ * pixel_array_row
+ *   DESCRIPTION: Row function(see quant_row_fn) for pixels already in one
+ *                array, treated as a single row.
+ *   INPUTS: src -- the pixels
+ *           y -- row wanted(always 0)
+ *   OUTPUTS: none
+ *   RETURN VALUE: the pixels
+ *   SIDE EFFECTS: none
+ */
+static const uint16_t* pixel_array_row(const void* src, uint32_t y) {
+    return src;
+}
+
+
+/*
+ * quant_kernel_by_index
+ *   DESCRIPTION: Get the name of one of the index kernels built in.
+ *   INPUTS: idx -- index of the kernel(0 is the fastest)
+ *   OUTPUTS: none
+ *   RETURN VALUE: the kernel's name, or NULL if idx is out of range
+ *   SIDE EFFECTS: none
+ */
+const char* quant_kernel_by_index(int32_t idx) {
+    int32_t n; /* number of kernels */
+
+    for (n = 0; NULL != kernels[n].name; n++) {
+    }
+    return (0 <= idx && n > idx ? kernels[idx].name : NULL);
+}
+
+
+/*
+ * quant_kernel_name
+ *   DESCRIPTION: Get the name of the index kernel in use.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: the kernel's name
+ *   SIDE EFFECTS: none
+ */
+const char* quant_kernel_name(void) {
+    return get_kernel()->name;
+}
+
+
+/*
+ * quantize_kmeans
+ *   DESCRIPTION: Quantizer: start from the octree palette, then make
+ *                KMEANS_PASSES passes of k-means(Lloyd) refinement over
+ *                the distinct colors of the photo, weighted by pixel
+ *                count, and map each pixel to its nearest color.  Falls
+ *                back to the octree quantizer if memory runs out.
+ *   INPUTS: pixels -- 5:6:5 RGB pixels of the photo
+ *           n_pixels -- number of pixels
+ *   OUTPUTS: palette -- chosen colors(6:6:6 RGB)
+ *            img -- VGA color index for each pixel
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void quantize_kmeans(const uint16_t* pixels, uint32_t n_pixels,
+                            uint8_t palette[QUANT_N_COLORS][3], uint8_t* img) {
+    color_count_t* colors;                /* distinct pixel values       */
+    uint32_t       n_colors;              /* number of distinct values   */
+    uint8_t*       best;                  /* palette entry for each value */
+    uint64_t       sum[QUANT_N_COLORS][3]; /* weighted sums per entry     */
+    uint64_t       weight[QUANT_N_COLORS]; /* pixels per entry            */
+    uint32_t       i;                     /* index over values           */
+    int32_t        j;                     /* index over palette entries  */
+    int32_t        pass;                  /* index over passes           */
+
+    /* The octree palette is the starting point. */
+    quantize_octree(pixels, n_pixels, palette, img);
+    if (NULL == (colors = count_colors(pixels, n_pixels, &n_colors))) {
+        return;
+    }
+    if (NULL == (best = malloc((0 < n_colors ? n_colors : 1) * sizeof (best[0])))) {
+        free(colors);
+        return;
+    }
+
+    for (pass = 0; KMEANS_PASSES >= pass; pass++) {
+
+        /* Assign each value to the nearest palette entry. */
+        for (i = 0; n_colors > i; i++) {
+            best[i] = nearest_color((const uint8_t (*)[3])palette, colors[i].color);
+        }
+        if (KMEANS_PASSES == pass) {
+            break;
+        }
+
+        /* Move each entry to the mean of its values(if it has any). */
+        (void)memset(sum, 0, sizeof (sum));
+        (void)memset(weight, 0, sizeof (weight));
+        for (i = 0; n_colors > i; i++) {
+            sum[best[i]][0] += (uint64_t)PIXEL_R6(colors[i].color) * colors[i].count;
+            sum[best[i]][1] += (uint64_t)PIXEL_G6(colors[i].color) * colors[i].count;
+            sum[best[i]][2] += (uint64_t)PIXEL_B6(colors[i].color) * colors[i].count;
+            weight[best[i]] += colors[i].count;
+        }
+        for (j = 0; QUANT_N_COLORS > j; j++) {
+            if (0 != weight[j]) {
+                palette[j][0] = (sum[j][0] + weight[j] / 2) / weight[j];
+                palette[j][1] = (sum[j][1] + weight[j] / 2) / weight[j];
+                palette[j][2] = (sum[j][2] + weight[j] / 2) / weight[j];
+            }
+        }
+    }
+
+    map_with_lut(colors, n_colors, best, pixels, n_pixels, img);
+    free(best);
+    free(colors);
+}
+
+
+/*
+ * quantize_median_cut
+ *   DESCRIPTION: Quantizer: median cut.  Starting with one box holding
+ *                all distinct colors of the photo, repeatedly split the
+ *                box with the most pixels along its longest side at the
+ *                median pixel, until there is a box for each palette
+ *                color(or no box can be split).  Each box's color is the
+ *                mean of its pixels.  Falls back to the octree quantizer
+ *                if memory runs out.
+ *   INPUTS: pixels -- 5:6:5 RGB pixels of the photo
+ *           n_pixels -- number of pixels
+ *   OUTPUTS: palette -- chosen colors(6:6:6 RGB)
+ *            img -- VGA color index for each pixel
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void quantize_median_cut(const uint16_t* pixels, uint32_t n_pixels,
+                                uint8_t palette[QUANT_N_COLORS][3], uint8_t* img) {
+    color_count_t* colors;              /* distinct pixel values          */
+    uint32_t       n_colors;            /* number of distinct values      */
+    uint8_t*       best;                /* palette entry for each value   */
+    mc_box_t       box[QUANT_N_COLORS]; /* the boxes                      */
+    int32_t        n_boxes;             /* number of boxes                */
+    int32_t        split;               /* box to split                   */
+    int32_t        lo[3];               /* smallest component in box      */
+    int32_t        hi[3];               /* largest component in box       */
+    int32_t        c[3];                /* components of one color        */
+    int32_t        axis;                /* longest side of box            */
+    uint64_t       sum[3];              /* weighted component sums        */
+    uint32_t       half;                /* pixels below the split         */
+    uint32_t       i;                   /* index over values              */
+    int32_t        j;                   /* index over boxes/components    */
+    static int (* const compare[3])(const void*, const void*) = {
+        compare_r, compare_g, compare_b
+    };
+
+    if (NULL == (colors = count_colors(pixels, n_pixels, &n_colors)) ||
+        NULL == (best = malloc((0 < n_colors ? n_colors : 1) * sizeof (best[0])))) {
+        free(colors);
+        quantize_octree(pixels, n_pixels, palette, img);
+        return;
+    }
+
+    box[0].start = 0;
+    box[0].end = n_colors;
+    box[0].count = n_pixels;
+    for (n_boxes = 1; QUANT_N_COLORS > n_boxes; n_boxes++) {
+
+        /* Pick the box with the most pixels that has two or more colors. */
+        split = -1;
+        for (j = 0; n_boxes > j; j++) {
+            if (1 < box[j].end - box[j].start &&
+                (0 > split || box[split].count < box[j].count)) {
+                split = j;
+            }
+        }
+        if (0 > split) {
+            break;
+        }
+
+        /* Find its longest side and sort its colors along that side. */
+        lo[0] = lo[1] = lo[2] = 63;
+        hi[0] = hi[1] = hi[2] = 0;
+        for (i = box[split].start; box[split].end > i; i++) {
+            c[0] = PIXEL_R6(colors[i].color);
+            c[1] = PIXEL_G6(colors[i].color);
+            c[2] = PIXEL_B6(colors[i].color);
+            for (j = 0; 3 > j; j++) {
+                lo[j] = (lo[j] < c[j] ? lo[j] : c[j]);
+                hi[j] = (hi[j] > c[j] ? hi[j] : c[j]);
+            }
+        }
+        axis = 0;
+        for (j = 1; 3 > j; j++) {
+            if (hi[j] - lo[j] > hi[axis] - lo[axis]) {
+                axis = j;
+            }
+        }
+        qsort(&colors[box[split].start], box[split].end - box[split].start,
+              sizeof (colors[0]), compare[axis]);
+
+        /* Split at the median pixel, leaving at least one color per box. */
+        half = 0;
+        for (i = box[split].start; box[split].end - 1 > i + 1; i++) {
+            half += colors[i].count;
+            if (half >= box[split].count / 2) {
+                break;
+            }
+        }
+        if (box[split].end - 1 <= i + 1) {
+            half += colors[i].count;
+        }
+        box[n_boxes].start = i + 1;
+        box[n_boxes].end = box[split].end;
+        box[n_boxes].count = box[split].count - half;
+        box[split].end = i + 1;
+        box[split].count = half;
+    }
+
+    /* Each box's color is the mean of its pixels; unused entries are black. */
+    (void)memset(palette, 0, QUANT_N_COLORS * sizeof (palette[0]));
+    for (j = 0; n_boxes > j; j++) {
+        sum[0] = sum[1] = sum[2] = 0;
+        for (i = box[j].start; box[j].end > i; i++) {
+            sum[0] += (uint64_t)PIXEL_R6(colors[i].color) * colors[i].count;
+            sum[1] += (uint64_t)PIXEL_G6(colors[i].color) * colors[i].count;
+            sum[2] += (uint64_t)PIXEL_B6(colors[i].color) * colors[i].count;
+            best[i] = j;
+        }
+        if (0 != box[j].count) {
+            palette[j][0] = (sum[0] + box[j].count / 2) / box[j].count;
+            palette[j][1] = (sum[1] + box[j].count / 2) / box[j].count;
+            palette[j][2] = (sum[2] + box[j].count / 2) / box[j].count;
+        }
+    }
+
+    map_with_lut(colors, n_colors, best, pixels, n_pixels, img);
+    free(best);
+    free(colors);
+}
+
+
+/*
+ * quantize_octree
+ *   DESCRIPTION: Quantizer: the LEVEL4_NODE_USED level-4 octree nodes
+ *                holding the most pixels(found by sorting all nodes) get
+ *                their own colors; all other pixels use the color of their
+ *                level-2 node.
+ *   INPUTS: pixels -- 5:6:5 RGB pixels of the photo
+ *           n_pixels -- number of pixels
+ *   OUTPUTS: palette -- chosen colors(6:6:6 RGB)
+ *            img -- VGA color index for each pixel
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void quantize_octree(const uint16_t* pixels, uint32_t n_pixels,
+                            uint8_t palette[QUANT_N_COLORS][3], uint8_t* img) {
+    octree_t tree; /* octree state */
+
+    octree_quantize(&tree, 0, pixel_array_row, pixels, n_pixels, 1, palette, img);
+}
+
+
+/*
+ * quantize_octree_rows
+ *   DESCRIPTION: Row-at-a-time version of quantize_octree(see
+ *                quantize_photo_rows).
+ *   INPUTS: get_row -- gets a row of 5:6:5 RGB pixels of the photo
+ *           src -- passed to get_row
+ *           width -- pixels per row
+ *           height -- number of rows
+ *   OUTPUTS: palette -- chosen colors(6:6:6 RGB)
+ *            img -- VGA color index for each pixel, top row first
+ *   RETURN VALUE: 1 on success, or 0 if memory runs out
+ *   SIDE EFFECTS: none
+ */
+static int32_t quantize_octree_rows(quant_row_fn get_row, const void* src,
+                                    uint32_t width, uint32_t height,
+                                    uint8_t palette[QUANT_N_COLORS][3], uint8_t* img) {
+    octree_t* tree; /* octree state */
+
+    if (NULL == (tree = malloc(sizeof (*tree)))) {
+        return 0;
+    }
+    octree_quantize(tree, 0, get_row, src, width, height, palette, img);
+    free(tree);
+    return 1;
+}
+
+
+/*
+ * quantize_octree_topk
+ *   DESCRIPTION: Quantizer: as quantize_octree, but only the chosen
+ *                level-4 nodes are put in order(see select_top_nodes).
+ *                Ties between nodes with equal pixel counts are broken by
+ *                node index, so results can differ from quantize_octree
+ *                only in which of several equally common nodes is chosen.
+ *   INPUTS: pixels -- 5:6:5 RGB pixels of the photo
+ *           n_pixels -- number of pixels
+ *   OUTPUTS: palette -- chosen colors(6:6:6 RGB)
+ *            img -- VGA color index for each pixel
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void quantize_octree_topk(const uint16_t* pixels, uint32_t n_pixels,
+                                 uint8_t palette[QUANT_N_COLORS][3], uint8_t* img) {
+    octree_t tree; /* octree state */
+
+    octree_quantize(&tree, 1, pixel_array_row, pixels, n_pixels, 1, palette, img);
+}
+
+
+/*
+ * quantize_octree_topk_rows
+ *   DESCRIPTION: Row-at-a-time version of quantize_octree_topk(see
+ *                quantize_photo_rows).
+ *   INPUTS: get_row -- gets a row of 5:6:5 RGB pixels of the photo
+ *           src -- passed to get_row
+ *           width -- pixels per row
+ *           height -- number of rows
+ *   OUTPUTS: palette -- chosen colors(6:6:6 RGB)
+ *            img -- VGA color index for each pixel, top row first
+ *   RETURN VALUE: 1 on success, or 0 if memory runs out
+ *   SIDE EFFECTS: none
+ */
+static int32_t quantize_octree_topk_rows(quant_row_fn get_row, const void* src,
+                                         uint32_t width, uint32_t height,
+                                         uint8_t palette[QUANT_N_COLORS][3],
+                                         uint8_t* img) {
+    octree_t* tree; /* octree state */
+
+    if (NULL == (tree = malloc(sizeof (*tree)))) {
+        return 0;
+    }
+    octree_quantize(tree, 1, get_row, src, width, height, palette, img);
+    free(tree);
+    return 1;
+}
+
+
+/*
+ * quantize_photo
+ *   DESCRIPTION: Choose the palette colors for a room photo and map its
+ *                pixels to VGA color indices, using the quantizer chosen
+ *                with select_quantizer(octree by default).
+ *   INPUTS: pixels -- 5:6:5 RGB pixels of the photo
+ *           n_pixels -- number of pixels
+ *   OUTPUTS: palette -- chosen colors(6:6:6 RGB) for VGA colors
+ *                       QUANT_FIRST_COLOR and up
+ *            img -- VGA color index for each pixel
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void quantize_photo(const uint16_t* pixels, uint32_t n_pixels,
+                    uint8_t palette[QUANT_N_COLORS][3], uint8_t* img) {
+    cur_quantizer->quantize(pixels, n_pixels, palette, img);
+}
+
+
+/*
+ * quantize_photo_rows
+ *   DESCRIPTION: As quantize_photo, but read the pixels a row at a time:
+ *                one pass over the rows to choose the palette and another
+ *                to map them.  Only the quantizers with a quantize_rows
+ *                function can do this.
+ *   INPUTS: get_row -- gets a row of 5:6:5 RGB pixels of the photo
+ *           src -- passed to get_row
+ *           width -- pixels per row
+ *           height -- number of rows
+ *   OUTPUTS: palette -- chosen colors(6:6:6 RGB) for VGA colors
+ *                       QUANT_FIRST_COLOR and up
+ *            img -- VGA color index for each pixel, top row first
+ *   RETURN VALUE: 1 on success, or 0 if the selected quantizer cannot
+ *                 read rows or memory runs out
+ *   SIDE EFFECTS: none
+ */
+int32_t quantize_photo_rows(quant_row_fn get_row, const void* src,
+                            uint32_t width, uint32_t height,
+                            uint8_t palette[QUANT_N_COLORS][3], uint8_t* img) {
+    if (NULL == cur_quantizer->quantize_rows) {
+        return 0;
+    }
+    return cur_quantizer->quantize_rows(get_row, src, width, height, palette, img);
+}
+
+
+/*
+ * quantizer_by_index
+ *   DESCRIPTION: Get one of the available quantizers.
+ *   INPUTS: idx -- index of the quantizer(0 is the default)
+ *   OUTPUTS: none
+ *   RETURN VALUE: the quantizer, or NULL if idx is out of range
+ *   SIDE EFFECTS: none
+ */
+const quantizer_t* quantizer_by_index(int32_t idx) {
+    int32_t n; /* number of quantizers */
+
+    for (n = 0; NULL != quantizers[n].name; n++) {
+    }
+    return (0 <= idx && n > idx ? &quantizers[idx] : NULL);
+}
+
+
+/*
+ * select_quant_kernel
+ *   DESCRIPTION: Choose the index kernel used by the octree quantizers.
+ *                Must not be called while photos are being quantized.
+ *   INPUTS: name -- name of the kernel, or NULL for the fastest one that
+ *                   the CPU supports
+ *   OUTPUTS: none
+ *   RETURN VALUE: 1 on success, or 0 if there is no kernel by that name or
+ *                 the CPU does not support it(the choice is then unchanged)
+ *   SIDE EFFECTS: changes the kernel used by quantize_photo
+ */
+int32_t select_quant_kernel(const char* name) {
+    const quant_kernel_t* k; /* index over kernels */
+
+    if (NULL == name) {
+        cur_kernel = NULL;
+        return 1;
+    }
+    for (k = kernels; NULL != k->name; k++) {
+        if (0 == strcmp(name, k->name)) {
+            if (NULL != k->supported && !k->supported()) {
+                return 0;
+            }
+            cur_kernel = k;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+/*
+ * select_quantizer
+ *   DESCRIPTION: Choose the quantizer used by quantize_photo.  Must not
+ *                be called while photos are being quantized.
+ *   INPUTS: name -- name of the quantizer, or NULL for the default
+ *   OUTPUTS: none
+ *   RETURN VALUE: 1 on success, or 0 if there is no quantizer by that
+ *                 name(the choice is then unchanged)
+ *   SIDE EFFECTS: changes the quantizer used by quantize_photo
+ */
+int32_t select_quantizer(const char* name) {
+    const quantizer_t* q; /* the quantizer */
+
+    if (NULL == name) {
+        cur_quantizer = &quantizers[0];
+        return 1;
+    }
+    if (NULL == (q = find_quantizer(name))) {
+        return 0;
+    }
+    cur_quantizer = q;
+    return 1;
+}
+
+
+/*
+ * select_top_nodes
+ *   DESCRIPTION: Partially order octree nodes: move the k nodes with the
+ *                most pixels(ties broken by node index) to the front of
+ *                the array, in order, leaving the rest in no particular
+ *                order.  Uses quickselect, then sorts only the first k.
+ *   INPUTS: level4 -- level-4 nodes
+ *           k -- number of nodes wanted
+ *   OUTPUTS: level4 -- the nodes, partially ordered
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void select_top_nodes(octree_node_t level4[LEVEL4_NODE_NUMBER], int32_t k) {
+    int32_t       left = 0;                      /* first node in range   */
+    int32_t       right = LEVEL4_NODE_NUMBER - 1; /* last node in range    */
+    int32_t       store;                         /* partition boundary    */
+    int32_t       i;                             /* index over range      */
+    octree_node_t pivot;                         /* partition value       */
+    octree_node_t tmp;                           /* for swaps             */
+
+    while (left < right) {
+
+        /* Partition around the middle node(Lomuto scheme). */
+        pivot = level4[(left + right) / 2];
+        level4[(left + right) / 2] = level4[right];
+        level4[right] = pivot;
+        for (store = left, i = left; right > i; i++) {
+            if (0 > compare_pixel_counts_idx(&level4[i], &pivot)) {
+                tmp = level4[i];
+                level4[i] = level4[store];
+                level4[store++] = tmp;
+            }
+        }
+        level4[right] = level4[store];
+        level4[store] = pivot;
+
+        /* Continue in the part holding position k. */
+        if (store == k) {
+            break;
+        }
+        if (store < k) {
+            left = store + 1;
+        }
+        else {
+            right = store - 1;
+        }
+    }
+    qsort(level4, k, sizeof (level4[0]), compare_pixel_counts_idx);
+}
@@ -0,0 +1,117 @@
+/* tab:4
+ *
+ * quantize.h - room photo palette selection header file
+ *
+ * Permission to use, copy, modify, and distribute this software and its
+ * documentation for any purpose, without fee, and without written agreement is
+ * hereby granted, provided that the above copyright notice and the following
+ * two paragraphs appear in all copies of this software.
+ *
+ * IN NO EVENT SHALL THE AUTHOR OR THE UNIVERSITY OF ILLINOIS BE LIABLE TO
+ * ANY PARTY FOR DIRECT, INDIRECT, SPECIAL, INCIDENTAL, OR CONSEQUENTIAL
+ * DAMAGES ARISING OUT  OF THE USE OF THIS SOFTWARE AND ITS DOCUMENTATION,
+ * EVEN IF THE AUTHOR AND/OR THE UNIVERSITY OF ILLINOIS HAS BEEN ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THE AUTHOR AND THE UNIVERSITY OF ILLINOIS SPECIFICALLY DISCLAIM ANY
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  THE SOFTWARE
+ * PROVIDED HEREUNDER IS ON AN "AS IS" BASIS, AND NEITHER THE AUTHOR NOR
+ * THE UNIVERSITY OF ILLINOIS HAS ANY OBLIGATION TO PROVIDE MAINTENANCE,
+ * SUPPORT, UPDATES, ENHANCEMENTS, OR MODIFICATIONS."
+ *
+ * Filename:      quantize.h
+ */
+
+#ifndef QUANTIZE_H
+#define QUANTIZE_H
+
+
+#include <stdint.h>
+
+
+/*
+ * Room photos are drawn with the 192 VGA colors above the 64 used for
+ * objects and the status bar.  The first QUANT_LEVEL4_USED are taken from
+ * the most common level-4 octree nodes(4:4:4 RGB); the rest are the
+ * level-2 nodes(2:2:2 RGB), which catch every remaining pixel.
+ */
+#define QUANT_FIRST_COLOR  64    /* VGA color index of first photo color */
+#define QUANT_N_COLORS     192   /* number of photo colors               */
+#define LEVEL4_NODE_NUMBER 4096
+#define LEVEL2_NODE_NUMBER 64
+#define LEVEL4_NODE_USED   128
+
+
+/*
+ * Supplies row y(0 is the top row) of a room photo's 5:6:5 pixels from
+ * src for quantize_photo_rows.  The rows may be asked for more than once
+ * and in any order.
+ */
+typedef const uint16_t* (*quant_row_fn)(const void* src, uint32_t y);
+
+/*
+ * A palette selection algorithm.  The quantize function chooses a palette
+ * for a room photo and maps its 5:6:5 pixels to VGA color indices; it
+ * must be safe to call from several threads at once.  Quantizers that
+ * need only a histogram of the photo also have a quantize_rows function,
+ * which does the same work a row at a time(see quantize_photo_rows); for
+ * the others it is NULL.
+ */
+typedef struct quantizer_t quantizer_t;
+struct quantizer_t {
+    const char* name;        /* name used to select the quantizer */
+    const char* description; /* one-line description              */
+    void (*quantize)(const uint16_t* pixels, uint32_t n_pixels,
+                     uint8_t palette[QUANT_N_COLORS][3], uint8_t* img);
+    int32_t (*quantize_rows)(quant_row_fn get_row, const void* src,
+                             uint32_t width, uint32_t height,
+                             uint8_t palette[QUANT_N_COLORS][3], uint8_t* img);
+};
+
+/*
+ * Choose a palette for a room photo and map its 5:6:5 pixels to VGA
+ * color indices with the selected quantizer.  Palette colors are 6:6:6 RGB.
+ */
+extern void quantize_photo(const uint16_t* pixels, uint32_t n_pixels,
+                           uint8_t palette[QUANT_N_COLORS][3], uint8_t* img);
+
+/*
+ * As quantize_photo, but the pixels are read a row at a time with get_row,
+ * once to choose the palette and once to map them, so the photo never has
+ * to be held in memory.  img is filled top row first.  Returns 0 if the
+ * selected quantizer cannot work this way or memory runs out(img is then
+ * unchanged).
+ */
+extern int32_t quantize_photo_rows(quant_row_fn get_row, const void* src,
+                                   uint32_t width, uint32_t height,
+                                   uint8_t palette[QUANT_N_COLORS][3], uint8_t* img);
+
+/* Look up a quantizer by name(NULL if none). */
+extern const quantizer_t* find_quantizer(const char* name);
+
+/* Get the idx'th available quantizer(NULL past the end; 0 is the default). */
+extern const quantizer_t* quantizer_by_index(int32_t idx);
+
+/*
+ * Choose the quantizer used by quantize_photo(NULL for the default).
+ * Returns 0 if there is no quantizer by that name.  Call only while no
+ * photos are being quantized.
+ */
+extern int32_t select_quantizer(const char* name);
+
+/*
+ * Choose the index kernel("scalar", "sse2", or "avx2") used by the octree
+ * quantizers(NULL for the fastest one that the CPU supports).  Returns 0
+ * if there is no kernel by that name or the CPU lacks support for it.
+ * Call only while no photos are being quantized.
+ */
+extern int32_t select_quant_kernel(const char* name);
+
+/* Get the name of the idx'th index kernel built in(NULL past the end). */
+extern const char* quant_kernel_by_index(int32_t idx);
+
+/* Get the name of the index kernel in use. */
+extern const char* quant_kernel_name(void);
+
+#endif /* QUANTIZE_H */
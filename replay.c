@@ -0,0 +1,425 @@
+/* tab:4
+ *
+ * replay.c - input recording and replay
+ *
+ * Permission to use, copy, modify, and distribute this software and its
+ * documentation for any purpose, without fee, and without written agreement is
+ * hereby granted, provided that the above copyright notice and the following
+ * two paragraphs appear in all copies of this software.
+ *
+ * IN NO EVENT SHALL THE AUTHOR OR THE UNIVERSITY OF ILLINOIS BE LIABLE TO
+ * ANY PARTY FOR DIRECT, INDIRECT, SPECIAL, INCIDENTAL, OR CONSEQUENTIAL
+ * DAMAGES ARISING OUT  OF THE USE OF THIS SOFTWARE AND ITS DOCUMENTATION,
+ * EVEN IF THE AUTHOR AND/OR THE UNIVERSITY OF ILLINOIS HAS BEEN ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THE AUTHOR AND THE UNIVERSITY OF ILLINOIS SPECIFICALLY DISCLAIM ANY
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  THE SOFTWARE
+ * PROVIDED HEREUNDER IS ON AN "AS IS" BASIS, AND NEITHER THE AUTHOR NOR
+ * THE UNIVERSITY OF ILLINOIS HAS ANY OBLIGATION TO PROVIDE MAINTENANCE,
+ * SUPPORT, UPDATES, ENHANCEMENTS, OR MODIFICATIONS."
+ *
+ * Filename:      replay.c
+ */
+
+
+/*
+ * A recording holds everything that the game loop takes from outside: the
+ * seed for srand(which places objects), and, for each step of the game
+ * loop(one wait for a tick or for input), the commands from the keyboard
+ * and the Tux controller and the typed command when it changes.  Given
+ * the same recording, the game goes through the same rooms and draws the
+ * same screens, so replaying a recording as fast as possible(with the
+ * emulated VGA of adventure_hl, see the Makefile) times the whole game
+ * repeatably.
+ *
+ * Recordings are text, one event per line after a header:
+ *
+ *     adventure-script 1
+ *     seed <seed>
+ *     <step> <tick> keys <cmd>
+ *     <step> <tick> tux <cmd>
+ *     <step> <tick> typed <typed command>
+ *     <step> <tick> end
+ *
+ * where cmd is a cmd_t value.  Commands from the Tux thread are recorded
+ * in the step the game loop is in; when replaying, the game loop carries
+ * them out itself, at most one command per step(a later command in the
+ * same step waits for the next step).
+ */
+
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "replay.h"
+#include "tick.h"
+
+
+/* parameters defined for this file */
+#define SCRIPT_MAGIC    "adventure-script 1"
+#define SCRIPT_LINE_LEN 80     /* longest line in a recording */
+
+
+/* types local to this file */
+
+/* kinds of events in a recording */
+typedef enum {
+    EV_KEYS, EV_TUX, EV_TYPED, EV_END, NUM_EV_KINDS
+} ev_kind_t;
+
+/* an event read from a recording */
+typedef struct script_event_t script_event_t;
+struct script_event_t {
+    uint64_t  step;                       /* game loop step               */
+    uint64_t  tick;                       /* ticks since the game began   */
+    ev_kind_t kind;                       /* kind of event                */
+    cmd_t     cmd;                        /* command(for EV_KEYS, EV_TUX) */
+    char      typed[MAX_TYPED_LEN + 1];   /* typed command(for EV_TYPED)  */
+};
+
+
+/* file-scope variables */
+
+static const char* const ev_name[NUM_EV_KINDS] = {"keys", "tux", "typed", "end"};
+
+/*
+ * The game loop step and tick are written by the game loop and read by the
+ * Tux thread; the lock keeps the two threads' lines of a recording whole.
+ */
+static uint64_t cur_step = 0;           /* steps taken by the game loop */
+static uint64_t cur_tick = 0;           /* ticks since the game began   */
+static pthread_mutex_t rec_lock = PTHREAD_MUTEX_INITIALIZER;
+static FILE* rec = NULL;                /* recording being written      */
+static char rec_typed[MAX_TYPED_LEN + 1] = {'\0'}; /* typed command recorded */
+
+static int32_t replay_on = 0;           /* replaying a recording?       */
+static script_event_t* script = NULL;   /* recording being replayed     */
+static int32_t n_events = 0;            /* events in the recording      */
+static int32_t next_event = 0;          /* next event to replay         */
+static int32_t replay_real_time = 0;    /* replay paced by ticks?       */
+
+static replay_stats_t stats;            /* replay statistics            */
+static struct timespec cmd_time;        /* time the last command began  */
+static int32_t cmd_pending = 0;         /* command awaiting its screen  */
+
+
+/* local functions--see function headers for details */
+static void record_event(ev_kind_t kind, int32_t cmd, const char* typed);
+
+
+/*
+ * start_recording
+ *   DESCRIPTION: Open a recording and write its header.
+ *   INPUTS: fname -- file for the recording
+ *           seed -- seed passed to srand
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, or -1 on failure
+ *   SIDE EFFECTS: creates the file; prints an error message on failure
+ */
+int32_t start_recording(const char* fname, unsigned int seed) {
+    if (NULL == (rec = fopen(fname, "w"))) {
+        perror(fname);
+        return -1;
+    }
+    fprintf(rec, "%s\nseed %u\n", SCRIPT_MAGIC, seed);
+    return 0;
+}
+
+
+/*
+ * start_replay
+ *   DESCRIPTION: Read a recording to be replayed.
+ *   INPUTS: fname -- file holding the recording
+ *           real_time -- nonzero to pace steps by the ticks recorded, or
+ *                        0 to take them as fast as possible
+ *   OUTPUTS: seed -- seed to pass to srand
+ *   RETURN VALUE: 0 on success, or -1 on failure
+ *   SIDE EFFECTS: dynamically allocates memory for the events; prints an
+ *                 error message on failure
+ */
+int32_t start_replay(const char* fname, int32_t real_time, unsigned int* seed) {
+    FILE*               f;          /* the recording                  */
+    char                line[SCRIPT_LINE_LEN]; /* one line of it      */
+    unsigned long long  step, tick; /* step and tick of an event      */
+    char                kind[8];    /* kind of an event               */
+    int                 cmd;        /* command of an event            */
+    int                 pos;        /* position of the event's value  */
+    int32_t             max = 0;    /* room for events                */
+    script_event_t*     ev;         /* an event                       */
+    script_event_t*     grown;      /* reallocated events             */
+    int32_t             k;          /* index over kinds of events     */
+
+    if (NULL == (f = fopen(fname, "r"))) {
+        perror(fname);
+        return -1;
+    }
+    if (NULL == fgets(line, sizeof (line), f) ||
+        0 != strncmp(line, SCRIPT_MAGIC "\n", sizeof (SCRIPT_MAGIC)) ||
+        NULL == fgets(line, sizeof (line), f) || 1 != sscanf(line, "seed %u", seed)) {
+        fprintf(stderr, "%s is not a recording.\n", fname);
+        (void)fclose(f);
+        return -1;
+    }
+
+    while (NULL != fgets(line, sizeof (line), f)) {
+        line[strcspn(line, "\n")] = '\0';
+        if (3 != sscanf(line, "%llu %llu %7s%n", &step, &tick, kind, &pos)) {
+            break;
+        }
+        for (k = 0; NUM_EV_KINDS > k && 0 != strcmp(kind, ev_name[k]); k++) {
+        }
+        if (NUM_EV_KINDS == k) {
+            break;
+        }
+        if (n_events == max) {
+            max = (0 == max ? 256 : 2 * max);
+            if (NULL == (grown = realloc(script, max * sizeof (*script)))) {
+                break;
+            }
+            script = grown;
+        }
+        ev = &script[n_events];
+        ev->step = step;
+        ev->tick = tick;
+        ev->kind = k;
+        ev->cmd = CMD_NONE;
+        ev->typed[0] = '\0';
+        if (EV_TYPED == k) {
+            /* The typed command follows a single space. */
+            strncpy(ev->typed, line + pos + (' ' == line[pos]), MAX_TYPED_LEN);
+            ev->typed[MAX_TYPED_LEN] = '\0';
+        } else if (EV_END != k) {
+            if (1 != sscanf(line + pos, "%d", &cmd) || 0 > cmd || NUM_COMMANDS <= cmd) {
+                break;
+            }
+            ev->cmd = cmd;
+        }
+        n_events++;
+    }
+    if (!feof(f)) {
+        fprintf(stderr, "Bad event in %s: %s\n", fname, line);
+        (void)fclose(f);
+        return -1;
+    }
+    (void)fclose(f);
+
+    /* A recording cut short(with no end event) ends when its events do. */
+    if (0 == n_events || EV_END != script[n_events - 1].kind) {
+        fprintf(stderr, "%s ends early; replaying what it holds.\n", fname);
+    }
+    replay_on = 1;
+    replay_real_time = real_time;
+    return 0;
+}
+
+
+/*
+ * replaying
+ *   DESCRIPTION: Check whether a recording is being replayed.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: 1 if so, 0 if not
+ *   SIDE EFFECTS: none
+ */
+int32_t replaying() {
+    return replay_on;
+}
+
+
+/*
+ * script_wait
+ *   DESCRIPTION: Wait between steps of the game loop.  Without a replay,
+ *                wait for the next tick or for input.  When replaying as
+ *                fast as possible, do not wait; in real time, wait until
+ *                the tick at which the next event was recorded, or for
+ *                one tick if that event belongs to a later step.
+ *   INPUTS: t -- the game loop ticker
+ *   OUTPUTS: none
+ *   RETURN VALUE: number of ticks passed(at least 1 when replaying), 0 if
+ *                 woken by input, or -1 on failure
+ *   SIDE EFFECTS: advances the step
+ */
+int32_t script_wait(ticker_t* t) {
+    int32_t  ticks = 1;      /* ticks passed                 */
+    uint64_t target;         /* tick of the next event       */
+
+    if (!replaying()) {
+        ticks = ticker_wait(t);
+    } else if (replay_real_time && n_events > next_event) {
+        target = script[next_event].tick;
+        if (cur_step + 1 == script[next_event].step) {
+            while (0 <= ticks && target > ticker_count(t)) {
+                ticks = ticker_wait(t);
+            }
+        } else if (target > ticker_count(t)) {
+            ticks = ticker_wait(t);
+        }
+    }
+    if (0 <= ticks) {
+        (void)pthread_mutex_lock(&rec_lock);
+        cur_step++;
+        cur_tick = ticker_count(t);
+        (void)pthread_mutex_unlock(&rec_lock);
+        stats.steps++;
+    }
+    return ticks;
+}
+
+
+/*
+ * script_command
+ *   DESCRIPTION: Record a command from an input source, or, when
+ *                replaying, get the next command recorded for this step
+ *                (or for an earlier one), if any.
+ *   INPUTS: src -- where the command came from
+ *           cmd -- the command(CMD_NONE if none; ignored when replaying)
+ *   OUTPUTS: none
+ *   RETURN VALUE: the command to carry out: cmd, or when replaying, the
+ *                 recorded command, CMD_NONE if none is due, or CMD_QUIT
+ *                 once the recording is over
+ *   SIDE EFFECTS: writes to the recording; starts timing the command
+ */
+cmd_t script_command(script_src_t src, cmd_t cmd) {
+    script_event_t* ev; /* next event to replay */
+
+    if (replaying()) {
+        cmd = CMD_NONE;
+        if (n_events <= next_event) {
+            cmd = CMD_QUIT;
+        } else if (cur_step >= (ev = &script[next_event])->step) {
+            if (EV_KEYS == ev->kind || EV_TUX == ev->kind) {
+                cmd = ev->cmd;
+                next_event++;
+            } else if (EV_END == ev->kind) {
+                cmd = CMD_QUIT;
+                next_event++;
+            }
+        }
+    } else if (CMD_NONE != cmd) {
+        record_event(SCRIPT_TUX == src ? EV_TUX : EV_KEYS, cmd, NULL);
+    }
+
+    if (CMD_NONE != cmd) {
+        (void)clock_gettime(CLOCK_MONOTONIC, &cmd_time);
+        cmd_pending = 1;
+        stats.commands++;
+    }
+    return cmd;
+}
+
+
+/*
+ * script_typed
+ *   DESCRIPTION: Record the typed command if it changed since last
+ *                recorded, or, when replaying, set it to the strings
+ *                recorded for this step(or earlier ones), if any.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: writes to the recording, or changes the typed command
+ */
+void script_typed() {
+    const char* typed; /* current typed command */
+
+    if (replaying()) {
+        while (n_events > next_event && EV_TYPED == script[next_event].kind &&
+               cur_step >= script[next_event].step) {
+            set_typed_command(script[next_event++].typed);
+        }
+    } else if (NULL != rec && 0 != strcmp(rec_typed, typed = get_typed_command())) {
+        strcpy(rec_typed, typed);
+        record_event(EV_TYPED, CMD_NONE, typed);
+    }
+}
+
+
+/*
+ * script_shown
+ *   DESCRIPTION: Note that a screen has been shown, which completes the
+ *                last command begun, if any.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: updates the replay statistics
+ */
+void script_shown() {
+    struct timespec now;  /* current time                    */
+    double          usec; /* time from command to this screen */
+
+    if (!cmd_pending) {
+        return;
+    }
+    (void)clock_gettime(CLOCK_MONOTONIC, &now);
+    usec = (now.tv_sec - cmd_time.tv_sec) * 1e6 + (now.tv_nsec - cmd_time.tv_nsec) / 1e3;
+    stats.shown++;
+    stats.latency_usec += usec;
+    if (stats.worst_usec < usec) {
+        stats.worst_usec = usec;
+    }
+    cmd_pending = 0;
+}
+
+
+/*
+ * stop_script
+ *   DESCRIPTION: Finish the recording, if any, with an end event.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: closes the recording
+ */
+void stop_script() {
+    if (NULL != rec) {
+        record_event(EV_END, CMD_NONE, NULL);
+        (void)pthread_mutex_lock(&rec_lock);
+        (void)fclose(rec);
+        rec = NULL;
+        (void)pthread_mutex_unlock(&rec_lock);
+    }
+}
+
+
+/*
+ * get_replay_stats
+ *   DESCRIPTION: Get a snapshot of the replay statistics.
+ *   INPUTS: none
+ *   OUTPUTS: stats_out -- the statistics
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void get_replay_stats(replay_stats_t* stats_out) {
+    *stats_out = stats;
+}
+
+
+/*
+ * record_event
+ *   DESCRIPTION: Write an event to the recording, if any, in the current
+ *                step.
+ *   INPUTS: kind -- kind of event
+ *           cmd -- command(for EV_KEYS and EV_TUX)
+ *           typed -- typed command(for EV_TYPED)
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: writes to the recording
+ */
+static void record_event(ev_kind_t kind, int32_t cmd, const char* typed) {
+    (void)pthread_mutex_lock(&rec_lock);
+    if (NULL != rec) {
+        fprintf(rec, "%llu %llu %s", (unsigned long long)cur_step,
+                (unsigned long long)cur_tick, ev_name[kind]);
+        if (EV_TYPED == kind) {
+            fprintf(rec, " %s\n", typed);
+        } else if (EV_END != kind) {
+            fprintf(rec, " %d\n", cmd);
+        } else {
+            fprintf(rec, "\n");
+        }
+    }
+    (void)pthread_mutex_unlock(&rec_lock);
+}
@@ -0,0 +1,96 @@
+/* tab:4
+ *
+ * replay.h - input recording and replay header file
+ *
+ * Permission to use, copy, modify, and distribute this software and its
+ * documentation for any purpose, without fee, and without written agreement is
+ * hereby granted, provided that the above copyright notice and the following
+ * two paragraphs appear in all copies of this software.
+ *
+ * IN NO EVENT SHALL THE AUTHOR OR THE UNIVERSITY OF ILLINOIS BE LIABLE TO
+ * ANY PARTY FOR DIRECT, INDIRECT, SPECIAL, INCIDENTAL, OR CONSEQUENTIAL
+ * DAMAGES ARISING OUT  OF THE USE OF THIS SOFTWARE AND ITS DOCUMENTATION,
+ * EVEN IF THE AUTHOR AND/OR THE UNIVERSITY OF ILLINOIS HAS BEEN ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THE AUTHOR AND THE UNIVERSITY OF ILLINOIS SPECIFICALLY DISCLAIM ANY
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  THE SOFTWARE
+ * PROVIDED HEREUNDER IS ON AN "AS IS" BASIS, AND NEITHER THE AUTHOR NOR
+ * THE UNIVERSITY OF ILLINOIS HAS ANY OBLIGATION TO PROVIDE MAINTENANCE,
+ * SUPPORT, UPDATES, ENHANCEMENTS, OR MODIFICATIONS."
+ *
+ * Filename:      replay.h
+ */
+
+#ifndef REPLAY_H
+#define REPLAY_H
+
+
+#include <stdint.h>
+
+#include "input.h"
+#include "types.h"
+
+
+/* where a recorded command came from */
+typedef enum {SCRIPT_KEYS, SCRIPT_TUX, NUM_SCRIPT_SOURCES} script_src_t;
+
+/* replay statistics(see get_replay_stats) */
+typedef struct replay_stats_t replay_stats_t;
+struct replay_stats_t {
+    uint64_t steps;         /* game loop steps taken                      */
+    uint32_t commands;      /* commands replayed                          */
+    uint32_t shown;         /* commands followed by a screen shown        */
+    double   latency_usec;  /* total time from command to screen shown    */
+    double   worst_usec;    /* longest time from command to screen shown  */
+};
+
+
+/*
+ * Start recording the game's input to a file, beginning with the seed
+ * used for srand.  Returns 0 on success, or -1 on failure.
+ */
+extern int32_t start_recording(const char* fname, unsigned int seed);
+
+/*
+ * Start replaying a recording instead of reading input.  With real_time
+ * nonzero, steps are paced by the ticks recorded; otherwise they run as
+ * fast as possible.  Returns 0 on success(with the recorded srand seed
+ * in *seed), or -1 on failure.
+ */
+extern int32_t start_replay(const char* fname, int32_t real_time, unsigned int* seed);
+
+/* Is a recording being replayed? */
+extern int32_t replaying(void);
+
+/*
+ * Wait between steps of the game loop: for the next tick or input(see
+ * ticker_wait), or as the recording being replayed dictates.  Returns
+ * the number of ticks passed, 0 if woken by input, or -1 on failure.
+ */
+extern int32_t script_wait(ticker_t* t);
+
+/*
+ * Record the command from an input source(CMD_NONE if none), and return
+ * it.  When replaying, return the next recorded command instead(in the
+ * step in which it was recorded), and CMD_QUIT when the recording ends.
+ */
+extern cmd_t script_command(script_src_t src, cmd_t cmd);
+
+/*
+ * Record the typed command if it changed, or, when replaying, set it to
+ * the string recorded for this step, if any.
+ */
+extern void script_typed(void);
+
+/* Note that a screen has been shown(for command latency). */
+extern void script_shown(void);
+
+/* Finish the recording, if any. */
+extern void stop_script(void);
+
+/* Get a snapshot of the replay statistics. */
+extern void get_replay_stats(replay_stats_t* stats);
+
+#endif /* REPLAY_H */
@@ -0,0 +1,478 @@
+/* tab:4
+ *
+ * residency.c - room photo residency manager
+ *
+ * Permission to use, copy, modify, and distribute this software and its
+ * documentation for any purpose, without fee, and without written agreement is
+ * hereby granted, provided that the above copyright notice and the following
+ * two paragraphs appear in all copies of this software.
+ *
+ * IN NO EVENT SHALL THE AUTHOR OR THE UNIVERSITY OF ILLINOIS BE LIABLE TO
+ * ANY PARTY FOR DIRECT, INDIRECT, SPECIAL, INCIDENTAL, OR CONSEQUENTIAL
+ * DAMAGES ARISING OUT  OF THE USE OF THIS SOFTWARE AND ITS DOCUMENTATION,
+ * EVEN IF THE AUTHOR AND/OR THE UNIVERSITY OF ILLINOIS HAS BEEN ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THE AUTHOR AND THE UNIVERSITY OF ILLINOIS SPECIFICALLY DISCLAIM ANY
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  THE SOFTWARE
+ * PROVIDED HEREUNDER IS ON AN "AS IS" BASIS, AND NEITHER THE AUTHOR NOR
+ * THE UNIVERSITY OF ILLINOIS HAS ANY OBLIGATION TO PROVIDE MAINTENANCE,
+ * SUPPORT, UPDATES, ENHANCEMENTS, OR MODIFICATIONS."
+ *
+ * Filename:      residency.c
+ */
+
+
+/*
+ * Room photos are large(up to 1MB of pixels each), and only one is on
+ * the screen at a time.  This file keeps track of which photos are in
+ * memory.  Photos are registered when the world is built(only the header
+ * is read), loaded when first displayed, and freed, least recently
+ * displayed first, when the pixels in memory would exceed a byte budget.
+ * A background thread loads photos that are likely to be displayed soon
+ * (see prefetch_photos) so that the player seldom waits for a load.
+ *
+ * With no budget(the default), photos are never freed, and the world
+ * loads them all up front as before.
+ */
+
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "assert.h"
+#include "photo.h"
+#include "photo_headers.h"
+#include "residency.h"
+
+
+/* parameters defined for this file */
+#ifndef PHOTO_BUDGET
+#define PHOTO_BUDGET 0     /* bytes of photo pixels to keep(0 for no limit) */
+#endif
+#define MAX_PREFETCH 64    /* longest prefetch list                          */
+
+
+/* types local to this file(declared in types.h) */
+
+/* a registered room photo */
+struct res_photo_t {
+    char*          fname;   /* photo file name                          */
+    photo_header_t hdr;     /* photo size                               */
+    photo_t*       photo;   /* the photo, or NULL if not in memory      */
+    int32_t        loading; /* nonzero while the photo is being loaded  */
+    int32_t        wanted;  /* nonzero if on the prefetch list          */
+    uint32_t       stamp;   /* time of last display(larger is later)    */
+    res_photo_t*   next;    /* next registered photo                    */
+};
+
+
+/* file-scope variables */
+
+/*
+ * The lock protects all of the variables below and all fields of
+ * registered photos other than fname and hdr(which never change).
+ * Photos are loaded without holding the lock; the loading field marks
+ * them in the meantime.
+ */
+static pthread_mutex_t res_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  res_loaded = PTHREAD_COND_INITIALIZER; /* load done     */
+static pthread_cond_t  res_work = PTHREAD_COND_INITIALIZER;   /* list changed  */
+static res_photo_t*    res_list = NULL;    /* all registered photos             */
+static res_photo_t*    res_current = NULL; /* photo acquired last(never freed)  */
+static uint32_t        res_clock = 0;      /* source of display time stamps     */
+static size_t          res_loading_bytes = 0; /* bytes of photos being loaded */
+static res_stats_t     res_stats = {PHOTO_BUDGET}; /* statistics and budget     */
+
+/* the prefetch list and the background thread that works through it */
+static res_photo_t*    prefetch_list[MAX_PREFETCH];
+static int32_t         prefetch_n = 0;       /* length of list                  */
+static int32_t         prefetch_next = 0;    /* next photo in list to consider  */
+static int32_t         prefetch_started = 0; /* background thread running?     */
+static pthread_t       prefetch_tid;         /* background thread               */
+
+
+/* local functions--see function headers for details */
+static int32_t evict_photos(size_t need, int32_t spare_wanted);
+static void install_photo(res_photo_t* rp, photo_t* p);
+static size_t photo_bytes(const res_photo_t* rp);
+static void* prefetch_thread(void* ignore);
+
+
+/*
+ * acquire_photo
+ *   DESCRIPTION: Get a registered room photo for display.  If the photo
+ *                is not in memory, it is loaded(or, if the background
+ *                thread is already loading it, this call waits).  The
+ *                photo stays in memory at least until another photo is
+ *                acquired.
+ *   INPUTS: rp -- the registered photo
+ *   OUTPUTS: none
+ *   RETURN VALUE: the room photo
+ *   SIDE EFFECTS: may free other photos to stay within the budget;
+ *                 terminates the program if the photo can't be loaded
+ */
+photo_t* acquire_photo(res_photo_t* rp) {
+    photo_t* p; /* the photo */
+
+    (void)pthread_mutex_lock(&res_lock);
+
+    /* Count a hit or miss once per display of a photo. */
+    if (res_current != rp) {
+        res_current = rp;
+        rp->stamp = ++res_clock;
+        if (NULL != rp->photo) {
+            res_stats.hits++;
+        }
+        else {
+            res_stats.misses++;
+        }
+    }
+
+    /* Wait for any load in progress, then load the photo if necessary. */
+    while (rp->loading) {
+        (void)pthread_cond_wait(&res_loaded, &res_lock);
+    }
+    if (NULL == rp->photo) {
+
+        /* Make room, freeing photos not on the prefetch list first. */
+        if (!evict_photos(photo_bytes(rp), 1)) {
+            (void)evict_photos(photo_bytes(rp), 0);
+        }
+
+        rp->loading = 1;
+        res_loading_bytes += photo_bytes(rp);
+        (void)pthread_mutex_unlock(&res_lock);
+        p = read_photo(rp->fname);
+        (void)pthread_mutex_lock(&res_lock);
+        rp->loading = 0;
+        res_loading_bytes -= photo_bytes(rp);
+        (void)pthread_cond_broadcast(&res_loaded);
+        if (NULL == p) {
+            (void)pthread_mutex_unlock(&res_lock);
+            PANIC("can't load room photo");
+        }
+        install_photo(rp, p);
+    }
+    p = rp->photo;
+
+    (void)pthread_mutex_unlock(&res_lock);
+    return p;
+}
+
+
+/*
+ * evict_photos
+ *   DESCRIPTION: Free photos, least recently displayed first, until
+ *                another photo of a given size fits within the budget
+ *                along with the photos in memory and those being loaded.
+ *                The photo acquired last is never freed.  Must be called
+ *                with the lock held.
+ *   INPUTS: need -- bytes about to be added
+ *           spare_wanted -- nonzero to spare photos on the prefetch list
+ *   OUTPUTS: none
+ *   RETURN VALUE: 1 if the photo fits, or 0 if not
+ *   SIDE EFFECTS: frees photos; updates statistics
+ */
+static int32_t evict_photos(size_t need, int32_t spare_wanted) {
+    res_photo_t* rp;     /* index over registered photos */
+    res_photo_t* victim; /* photo to free                */
+
+    while (0 != res_stats.budget &&
+           res_stats.budget < res_stats.resident_bytes + res_loading_bytes + need) {
+
+        /* Find the least recently displayed photo that can be freed. */
+        victim = NULL;
+        for (rp = res_list; NULL != rp; rp = rp->next) {
+            if (NULL != rp->photo && res_current != rp && !(spare_wanted && rp->wanted) &&
+                (NULL == victim || victim->stamp > rp->stamp)) {
+                victim = rp;
+            }
+        }
+        if (NULL == victim) {
+            return 0;
+        }
+
+        free_photo(victim->photo);
+        victim->photo = NULL;
+        res_stats.resident_bytes -= photo_bytes(victim);
+        res_stats.n_resident--;
+        res_stats.evictions++;
+    }
+    return 1;
+}
+
+
+/*
+ * get_photo_budget
+ *   DESCRIPTION: Get the byte budget for photo pixels in memory.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: the budget in bytes, or 0 if there is no limit
+ *   SIDE EFFECTS: none
+ */
+size_t get_photo_budget() {
+    size_t budget; /* the budget */
+
+    (void)pthread_mutex_lock(&res_lock);
+    budget = res_stats.budget;
+    (void)pthread_mutex_unlock(&res_lock);
+    return budget;
+}
+
+
+/*
+ * get_residency_stats
+ *   DESCRIPTION: Get a snapshot of the residency statistics.
+ *   INPUTS: none
+ *   OUTPUTS: stats -- the statistics
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void get_residency_stats(res_stats_t* stats) {
+    (void)pthread_mutex_lock(&res_lock);
+    *stats = res_stats;
+    (void)pthread_mutex_unlock(&res_lock);
+}
+
+
+/*
+ * install_photo
+ *   DESCRIPTION: Record that a photo has been loaded.  Must be called with
+ *                the lock held.
+ *   INPUTS: rp -- the registered photo
+ *           p -- the photo just loaded
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: updates statistics
+ */
+static void install_photo(res_photo_t* rp, photo_t* p) {
+    rp->photo = p;
+    res_stats.resident_bytes += photo_bytes(rp);
+    res_stats.n_resident++;
+    if (res_stats.peak_bytes < res_stats.resident_bytes) {
+        res_stats.peak_bytes = res_stats.resident_bytes;
+    }
+}
+
+
+/*
+ * peek_photo
+ *   DESCRIPTION: Get a registered room photo if it is in memory, without
+ *                loading it or counting a display.  Photos on the prefetch
+ *                list are freed only when a photo is acquired(or once the
+ *                list is replaced), so such a photo can be used until then.
+ *   INPUTS: rp -- the registered photo
+ *   OUTPUTS: none
+ *   RETURN VALUE: the room photo, or NULL if not in memory(or loading)
+ *   SIDE EFFECTS: none
+ */
+photo_t* peek_photo(res_photo_t* rp) {
+    photo_t* p; /* the photo */
+
+    (void)pthread_mutex_lock(&res_lock);
+    p = (rp->loading ? NULL : rp->photo);
+    (void)pthread_mutex_unlock(&res_lock);
+    return p;
+}
+
+
+/*
+ * photo_bytes
+ *   DESCRIPTION: Get the number of bytes counted against the budget for
+ *                a photo: one per pixel.
+ *   INPUTS: rp -- the registered photo
+ *   OUTPUTS: none
+ *   RETURN VALUE: size of the photo's pixel data in bytes
+ *   SIDE EFFECTS: none
+ */
+static size_t photo_bytes(const res_photo_t* rp) {
+    return (size_t)rp->hdr.width * rp->hdr.height;
+}
+
+
+/*
+ * prefetch_photos
+ *   DESCRIPTION: Replace the list of photos to be loaded in the
+ *                background.  Photos are loaded in list order for as long
+ *                as they fit within the budget without freeing any photo
+ *                on the list.  Starts the background thread if necessary.
+ *   INPUTS: list -- photos to load, most important first
+ *           n -- number of photos in list(at most MAX_PREFETCH are used)
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: wakes the background thread
+ */
+void prefetch_photos(res_photo_t* const* list, int32_t n) {
+    res_photo_t* rp;  /* index over registered photos */
+    int32_t      idx; /* index over list              */
+
+    (void)pthread_mutex_lock(&res_lock);
+
+    for (rp = res_list; NULL != rp; rp = rp->next) {
+        rp->wanted = 0;
+    }
+    if (MAX_PREFETCH < n) {
+        n = MAX_PREFETCH;
+    }
+    for (idx = 0; n > idx; idx++) {
+        prefetch_list[idx] = list[idx];
+        list[idx]->wanted = 1;
+    }
+    prefetch_n = n;
+    prefetch_next = 0;
+
+    /* If the thread can't be started, photos are loaded on demand. */
+    if (!prefetch_started &&
+        0 == pthread_create(&prefetch_tid, NULL, prefetch_thread, NULL)) {
+        (void)pthread_detach(prefetch_tid);
+        prefetch_started = 1;
+    }
+    (void)pthread_cond_signal(&res_work);
+
+    (void)pthread_mutex_unlock(&res_lock);
+}
+
+
+/*
+ * prefetch_thread
+ *   DESCRIPTION: Body of the background thread: loads the photos on the
+ *                prefetch list that are not in memory, stopping when the
+ *                next photo does not fit, and then waits for a new list.
+ *   INPUTS: ignore -- ignored
+ *   OUTPUTS: none
+ *   RETURN VALUE: does not return
+ *   SIDE EFFECTS: loads and frees photos; updates statistics
+ */
+static void* prefetch_thread(void* ignore) {
+    res_photo_t* rp; /* photo to load    */
+    photo_t*     p;  /* the loaded photo */
+
+    (void)pthread_mutex_lock(&res_lock);
+    while (1) {
+        while (prefetch_n <= prefetch_next) {
+            (void)pthread_cond_wait(&res_work, &res_lock);
+        }
+        rp = prefetch_list[prefetch_next++];
+        if (NULL != rp->photo || rp->loading) {
+            continue;
+        }
+
+        /* Stop if the photo doesn't fit without freeing wanted photos. */
+        if (!evict_photos(photo_bytes(rp), 1)) {
+            prefetch_next = prefetch_n;
+            continue;
+        }
+
+        rp->loading = 1;
+        res_loading_bytes += photo_bytes(rp);
+        (void)pthread_mutex_unlock(&res_lock);
+        p = read_photo(rp->fname);
+        (void)pthread_mutex_lock(&res_lock);
+        rp->loading = 0;
+        res_loading_bytes -= photo_bytes(rp);
+        (void)pthread_cond_broadcast(&res_loaded);
+
+        /* Failures are left for acquire_photo to report. */
+        if (NULL != p) {
+            install_photo(rp, p);
+            res_stats.prefetches++;
+            (void)evict_photos(0, 1);
+        }
+    }
+
+    /* not reached */
+    return NULL;
+}
+
+
+/*
+ * register_photo
+ *   DESCRIPTION: Register a room photo file with the residency manager.
+ *                The header is read and checked; the photo itself is read
+ *                now only if requested.
+ *   INPUTS: fname -- file name of the room photo
+ *           preload -- nonzero to load the photo immediately
+ *   OUTPUTS: none
+ *   RETURN VALUE: the registered photo on success, or NULL on failure
+ *   SIDE EFFECTS: dynamically allocates memory; safe to call from
+ *                 several threads at once
+ */
+res_photo_t* register_photo(const char* fname, int32_t preload) {
+    res_photo_t* rp;        /* the registered photo */
+    photo_t*     p = NULL;  /* the loaded photo     */
+
+    if (NULL == (rp = malloc(sizeof (*rp)))) {
+        return NULL;
+    }
+    if (NULL == (rp->fname = strdup(fname)) ||
+        !read_photo_header(fname, &rp->hdr) ||
+        (preload && NULL == (p = read_photo(fname)))) {
+        free(rp->fname);
+        free(rp);
+        return NULL;
+    }
+    rp->photo = NULL;
+    rp->loading = 0;
+    rp->wanted = 0;
+    rp->stamp = 0;
+
+    (void)pthread_mutex_lock(&res_lock);
+    if (NULL != p) {
+        install_photo(rp, p);
+    }
+    rp->next = res_list;
+    res_list = rp;
+    (void)pthread_mutex_unlock(&res_lock);
+
+    return rp;
+}
+
+
+/*
+ * res_photo_height
+ *   DESCRIPTION: Get height of a registered room photo in pixels(without
+ *                loading it).
+ *   INPUTS: rp -- the registered photo
+ *   OUTPUTS: none
+ *   RETURN VALUE: height of the photo in pixels
+ *   SIDE EFFECTS: none
+ */
+uint32_t res_photo_height(const res_photo_t* rp) {
+    return rp->hdr.height;
+}
+
+
+/*
+ * res_photo_width
+ *   DESCRIPTION: Get width of a registered room photo in pixels(without
+ *                loading it).
+ *   INPUTS: rp -- the registered photo
+ *   OUTPUTS: none
+ *   RETURN VALUE: width of the photo in pixels
+ *   SIDE EFFECTS: none
+ */
+uint32_t res_photo_width(const res_photo_t* rp) {
+    return rp->hdr.width;
+}
+
+
+/*
+ * set_photo_budget
+ *   DESCRIPTION: Set the byte budget for photo pixels in memory, freeing
+ *                photos if necessary.
+ *   INPUTS: bytes -- the budget in bytes, or 0 for no limit
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: may free photos
+ */
+void set_photo_budget(size_t bytes) {
+    (void)pthread_mutex_lock(&res_lock);
+    res_stats.budget = bytes;
+    if (!evict_photos(0, 1)) {
+        (void)evict_photos(0, 0);
+    }
+    (void)pthread_mutex_unlock(&res_lock);
+}
@@ -0,0 +1,87 @@
+/* tab:4
+ *
+ * residency.h - room photo residency manager header file
+ *
+ * Permission to use, copy, modify, and distribute this software and its
+ * documentation for any purpose, without fee, and without written agreement is
+ * hereby granted, provided that the above copyright notice and the following
+ * two paragraphs appear in all copies of this software.
+ *
+ * IN NO EVENT SHALL THE AUTHOR OR THE UNIVERSITY OF ILLINOIS BE LIABLE TO
+ * ANY PARTY FOR DIRECT, INDIRECT, SPECIAL, INCIDENTAL, OR CONSEQUENTIAL
+ * DAMAGES ARISING OUT  OF THE USE OF THIS SOFTWARE AND ITS DOCUMENTATION,
+ * EVEN IF THE AUTHOR AND/OR THE UNIVERSITY OF ILLINOIS HAS BEEN ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THE AUTHOR AND THE UNIVERSITY OF ILLINOIS SPECIFICALLY DISCLAIM ANY
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  THE SOFTWARE
+ * PROVIDED HEREUNDER IS ON AN "AS IS" BASIS, AND NEITHER THE AUTHOR NOR
+ * THE UNIVERSITY OF ILLINOIS HAS ANY OBLIGATION TO PROVIDE MAINTENANCE,
+ * SUPPORT, UPDATES, ENHANCEMENTS, OR MODIFICATIONS."
+ *
+ * Filename:      residency.h
+ */
+
+#ifndef RESIDENCY_H
+#define RESIDENCY_H
+
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "types.h"
+
+
+/* residency statistics(see get_residency_stats) */
+typedef struct res_stats_t res_stats_t;
+struct res_stats_t {
+    size_t   budget;         /* byte budget(0 for no limit)               */
+    size_t   resident_bytes; /* pixel bytes of photos now in memory       */
+    size_t   peak_bytes;     /* largest value of resident_bytes           */
+    uint32_t n_resident;     /* number of photos now in memory            */
+    uint32_t hits;           /* visits to photos already in memory        */
+    uint32_t misses;         /* visits that had to wait for a load        */
+    uint32_t prefetches;     /* photos loaded by the prefetch thread      */
+    uint32_t evictions;      /* photos freed to stay within the budget    */
+};
+
+
+/*
+ * Register a room photo file: its header is read and checked, but the
+ * photo is only loaded now if preload is nonzero.  Returns NULL on failure.
+ */
+extern res_photo_t* register_photo(const char* fname, int32_t preload);
+
+/*
+ * Get a registered photo for display, loading it first if necessary.
+ * The photo stays in memory until another photo is acquired.
+ */
+extern photo_t* acquire_photo(res_photo_t* rp);
+
+/*
+ * Get a registered photo if it is in memory(NULL if not), without loading
+ * it or counting a display.  A photo on the prefetch list stays in memory
+ * until a photo is acquired or the list is replaced.
+ */
+extern photo_t* peek_photo(res_photo_t* rp);
+
+/* Get the size of a registered photo(without loading it). */
+extern uint32_t res_photo_height(const res_photo_t* rp);
+extern uint32_t res_photo_width(const res_photo_t* rp);
+
+/*
+ * Replace the list of photos to be loaded in the background, most
+ * important first.  Photos on the list are evicted only when a photo
+ * must be loaded for display.
+ */
+extern void prefetch_photos(res_photo_t* const* list, int32_t n);
+
+/* Get and set the byte budget for photo pixels(0 for no limit). */
+extern size_t get_photo_budget(void);
+extern void set_photo_budget(size_t bytes);
+
+/* Get a snapshot of the residency statistics. */
+extern void get_residency_stats(res_stats_t* stats);
+
+#endif /* RESIDENCY_H */
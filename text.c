@@ -566,6 +566,118 @@ unsigned char font_data[256][16] = {
 
 
 
+/* colors of the status bar */
+#define BAR_BG_COLOR 0x30		//background
+#define BAR_FG_COLOR 0x00		//text
+
+/*
+ * Every glyph of font_data in planar form, built by build_glyph_masks:
+ * for each column phase(the glyph's first column mod 4), row and plane,
+ * the two bytes of the plane covered by the glyph row, as masks with 0xFF
+ * for each pixel of the glyph that is set.  Plane q's two bytes start at
+ * the byte holding the glyph's first column, or at the next byte if q is
+ * less than the phase.
+ */
+static unsigned char glyph_mask[256][4][FONT_HEIGHT][4][2];
+static int glyph_masks_built = 0;
+
+static void build_glyph_masks(void);
+static int text_length(const char* string, int mode);
+
+
+//build_glyph_masks
+//description:this function will fill glyph_mask from font_data
+//input:none
+//output:none
+//return value:none
+//side effect: fills glyph_mask
+static void build_glyph_masks(void){
+	int ch;										//character
+	int phase;									//first column of the glyph mod 4
+	int plane;									//plane of the status bar
+	int row_index;								//row of the glyph
+	int first;									//first column of the glyph in the plane
+	
+	for(ch=0; ch<256; ch++)
+		for(phase=0; phase<4; phase++)
+			for(plane=0; plane<4; plane++){
+				first = (plane - phase) & 3;	//columns first and first+4 go to this plane
+				for(row_index=0; row_index<FONT_HEIGHT; row_index++){
+					glyph_mask[ch][phase][row_index][plane][0] = (font_data[ch][row_index] & (0x80 >> first)) ? 0xFF : 0x00;
+					glyph_mask[ch][phase][row_index][plane][1] = (font_data[ch][row_index] & (0x08 >> first)) ? 0xFF : 0x00;
+				}
+			}
+	glyph_masks_built = 1;
+}
+
+
+//text_length
+//description:this function will find the number of characters drawn for a string
+//input:string: the string
+//		mode: as for convert_text_graph
+//output:none
+//return value:the length of the string, plus one for the '_' added in mode 2
+//side effect:none
+static int text_length(const char* string, int mode){
+	int len = strlen(string);					//length of the string
+	
+	if(mode == 2 && (len == 0 || string[len-1] != '_') && len < 20)		//'_' is added at the end
+		len++;
+	return len;
+}
+
+
+//text_graph_extent
+//description:this function will find the columns of the bar that a string covers
+//input:string: the string
+//		mode: as for convert_text_graph(0, 1 or 2)
+//output:start: first column covered(may be negative)
+//		width: number of columns covered
+//return value:none
+//side effect:none
+void text_graph_extent(const char* string, int mode, int* start, int* width){
+	*width = FONT_WIDTH*text_length(string, mode);
+	if(mode == 0)		//center
+		*start = (IMAGE_X_DIM-*width)/2;
+	else if(mode == 1)	//left
+		*start = 0;
+	else				//right
+		*start = IMAGE_X_DIM-*width;
+}
+
+
+//clear_text_graph
+//description:this function will clear some columns of the text rows of the bar to the background
+//input:start: first column to clear(may be negative)
+//		width: number of columns to clear
+//output:none
+//return value:none
+//side effect: changes the status bar buffer
+void clear_text_graph(int start, int width){
+	int plane;									//plane of the status bar
+	int first,last;								//first and last byte of the columns in the plane
+	int row_index;								//row of the bar
+	
+	if(start < 0){								//clip to the bar
+		width += start;
+		start = 0;
+	}
+	if(width > IMAGE_X_DIM-start)
+		width = IMAGE_X_DIM-start;
+	if(width <= 0)
+		return;
+	for(plane=0; plane<4; plane++){
+		first = (start + ((plane-start) & 3)) >> 2;						//first column in the plane
+		last = (start+width-1 - ((start+width-1-plane) & 3)) >> 2;		//last column in the plane
+		if(first > last)
+			continue;
+		for(row_index=1; row_index<=FONT_HEIGHT; row_index++)
+			memset(status_bar + plane*PLANE_STATUS_BAR_SIZE + row_index*IMAGE_X_WIDTH + first,
+				BAR_BG_COLOR, last-first+1);
+	}
+}
+
+
 //convert_text_graph
 //description:this function will take a string and produce a buffer that contains the graphic message of the string
 //input:string: the string which will be printed in the bar 
@@ -580,46 +692,61 @@ void convert_text_graph(const char* string, int mode){
 	int char_index;								//which character in string 
 	int cur_char_ascii;							//the ASCII code of the character
 	int char_start_in_buffer;					//where character start in the buffer
-	int row_index,colomn_index;					//row index and column index of the character
-	int check_bit;								//which pixel is checked
-	int p_off;									//pixel offset
-	int pixel_location;							//the location of pixel in the bar
-	int char_colomn;							// the column of the character
-	char string_copy[strlen(string)];			//copy of input string 
+	int row_index;								//row index of the character
+	int phase;									//column of the character mod 4
+	int plane;									//plane of the status bar
+	int byte;									//first byte of the character in the plane
+	int k;										//index over the two bytes
+	int len;									//length of the string
+	int first_char,last_char;					//characters wholly inside the bar
+	unsigned char* row;							//row of a plane of the bar
+	const unsigned char* mask;					//masks of one glyph row in one plane
+	unsigned short mask16,pixels16;				//both masks and both bytes of the bar
+	char string_copy[strlen(string)+2];			//copy of input string, with room for '_'
 	strcpy(string_copy,string);
 	
+	if(!glyph_masks_built)
+		build_glyph_masks();
+	
 	if(mode ==3 || mode ==0){
-		memset(status_bar, 0x030, STATUS_BAR_SIZE);		//clean all data in the bar
+		memset(status_bar, BAR_BG_COLOR, STATUS_BAR_SIZE);		//clean all data in the bar
 		if(mode==3)
 			return;
 	}
-	if(mode == 2 && string_copy[strlen(string_copy)-1] != '_' && strlen(string_copy) < 20)		//add '_' at the end of the string
+	//calculate where the string should start in bar
+	text_graph_extent(string_copy, mode, &char_start_in_buffer, &len);
+	len = text_length(string_copy, mode);
+	if(len > (int)strlen(string_copy))		//add '_' at the end of the string
 		strcat(string_copy,"_");
 	
-	//calculate where the string should start in bar
-	if(mode == 0)		//start at center
-		char_start_in_buffer = (IMAGE_X_DIM-8*strlen(string_copy))/2;
-	else if(mode == 1)	//start at left
-		char_start_in_buffer = 0;
-	else if(mode == 2)	//start at right
-		char_start_in_buffer = IMAGE_X_DIM-8*strlen(string_copy);
+	//find the characters that lie wholly inside the bar
+	phase = char_start_in_buffer & 3;
+	first_char = (char_start_in_buffer >= 0) ? 0 : (7-char_start_in_buffer)/8;
+	last_char = (IMAGE_X_DIM-8-char_start_in_buffer)/8;
+	if(last_char > len-1)
+		last_char = len-1;
 	
-	//produce the status bar
-	for(char_index=0; char_index<strlen(string_copy); char_index++){
-		cur_char_ascii = (int)string_copy[char_index];
-		char_colomn = 8*char_index + char_start_in_buffer;
-		for(row_index=0; row_index<16; row_index++){
-			check_bit = 0x80;
-			for(colomn_index=0; colomn_index<8;colomn_index++){
-				if((font_data[cur_char_ascii][row_index] & check_bit) != 0){
-					p_off = colomn_index & 3;
-					pixel_location = p_off*PLANE_STATUS_BAR_SIZE + (row_index+1)*IMAGE_X_WIDTH + (colomn_index+char_colomn)/4;	//calculate the location of the pixel
-					status_bar[pixel_location] = 0x00;
+	//produce the status bar a row of a plane at a time, two masked bytes per glyph
+	for(row_index=0; row_index<FONT_HEIGHT; row_index++){
+		for(plane=0; plane<4; plane++){
+			row = status_bar + plane*PLANE_STATUS_BAR_SIZE + (row_index+1)*IMAGE_X_WIDTH;
+			byte = (char_start_in_buffer >> 2) + (plane < phase);
+			for(char_index=0; char_index<len; char_index++, byte+=2){
+				cur_char_ascii = (unsigned char)string_copy[char_index];
+				mask = glyph_mask[cur_char_ascii][phase][row_index][plane];
+				if(char_index >= first_char && char_index <= last_char){		//both bytes at once
+					memcpy(&mask16, mask, 2);
+					memcpy(&pixels16, row+byte, 2);
+					pixels16 = (pixels16 & ~mask16) | ((BAR_FG_COLOR * 0x0101) & mask16);
+					memcpy(row+byte, &pixels16, 2);
+					continue;
+				}
+				for(k=0; k<2; k++){
+					if(byte+k >= 0 && byte+k < IMAGE_X_WIDTH)		//clip to the bar
+						row[byte+k] = (row[byte+k] & ~mask[k]) | (BAR_FG_COLOR & mask[k]);
 				}
-				check_bit = check_bit/2;	//move to next check pixel
 			}
 		}
-	
 	}
 	return;
 }
@@ -47,4 +47,10 @@ extern unsigned char font_data[256][16];
 /* function that convert text to graph*/
 void convert_text_graph(const char* string, int mode);
 
+/* find the columns of the status bar covered by a string drawn by convert_text_graph */
+void text_graph_extent(const char* string, int mode, int* start, int* width);
+
+/* clear some columns of the text in the status bar to the background */
+void clear_text_graph(int start, int width);
+
 #endif /* TEXT_H */
@@ -0,0 +1,278 @@
+/* tab:4
+ *
+ * tick.c - game loop tick scheduler
+ *
+ * Permission to use, copy, modify, and distribute this software and its
+ * documentation for any purpose, without fee, and without written agreement is
+ * hereby granted, provided that the above copyright notice and the following
+ * two paragraphs appear in all copies of this software.
+ *
+ * IN NO EVENT SHALL THE AUTHOR OR THE UNIVERSITY OF ILLINOIS BE LIABLE TO
+ * ANY PARTY FOR DIRECT, INDIRECT, SPECIAL, INCIDENTAL, OR CONSEQUENTIAL
+ * DAMAGES ARISING OUT  OF THE USE OF THIS SOFTWARE AND ITS DOCUMENTATION,
+ * EVEN IF THE AUTHOR AND/OR THE UNIVERSITY OF ILLINOIS HAS BEEN ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THE AUTHOR AND THE UNIVERSITY OF ILLINOIS SPECIFICALLY DISCLAIM ANY
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  THE SOFTWARE
+ * PROVIDED HEREUNDER IS ON AN "AS IS" BASIS, AND NEITHER THE AUTHOR NOR
+ * THE UNIVERSITY OF ILLINOIS HAS ANY OBLIGATION TO PROVIDE MAINTENANCE,
+ * SUPPORT, UPDATES, ENHANCEMENTS, OR MODIFICATIONS."
+ *
+ * Filename:      tick.c
+ */
+
+
+/*
+ * The game loop and the Tux controller thread each run on a tick of
+ * TICK_USEC.  A ticker sleeps until the next tick rather than spinning on
+ * the clock: ticks are absolute deadlines on CLOCK_MONOTONIC, kept by a
+ * timerfd, so lateness in one tick never delays the ones after it, and
+ * the number of expirations read from the timer tells how many ticks
+ * were missed.  The timer shares an epoll set with the input descriptors,
+ * so that input wakes the waiting loop at once instead of at the next
+ * tick.
+ */
+
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "tick.h"
+
+
+/* parameters defined for this file */
+#define MAX_EVENTS 8   /* events taken from epoll per wait */
+
+
+/* types local to this file(declared in types.h) */
+struct ticker_t {
+    int          timer_fd;  /* timerfd firing at each tick              */
+    int          epoll_fd;  /* epoll set of the timer and watched input */
+    uint64_t     start;     /* start time in nanoseconds                */
+    tick_stats_t stats;     /* tick statistics                          */
+};
+
+
+/* local functions--see function headers for details */
+static uint64_t monotonic_nsec(void);
+
+
+/*
+ * ticker_create
+ *   DESCRIPTION: Create a ticker and start its timer.
+ *   INPUTS: period_usec -- tick length in microseconds
+ *   OUTPUTS: none
+ *   RETURN VALUE: the new ticker, or NULL(with errno set) on failure
+ *   SIDE EFFECTS: dynamically allocates memory; opens two descriptors
+ */
+ticker_t* ticker_create(uint32_t period_usec) {
+    ticker_t*          t;     /* the new ticker                  */
+    struct itimerspec  its;   /* first tick and tick period      */
+    struct epoll_event ev;    /* timer event for the epoll set   */
+    uint64_t           first; /* time of first tick(nanoseconds) */
+    int                err;   /* saved errno                     */
+
+    if (0 == period_usec) {
+        errno = EINVAL;
+        return NULL;
+    }
+    if (NULL == (t = malloc(sizeof (*t)))) {
+        return NULL;
+    }
+    (void)memset(t, 0, sizeof (*t));
+    t->stats.period_usec = period_usec;
+    t->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    t->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (0 > t->timer_fd || 0 > t->epoll_fd) {
+        goto fail;
+    }
+
+    (void)memset(&ev, 0, sizeof (ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = t->timer_fd;
+    if (0 != epoll_ctl(t->epoll_fd, EPOLL_CTL_ADD, t->timer_fd, &ev)) {
+        goto fail;
+    }
+
+    t->start = monotonic_nsec();
+    first = t->start + period_usec * 1000ULL;
+    its.it_value.tv_sec = first / 1000000000;
+    its.it_value.tv_nsec = first % 1000000000;
+    its.it_interval.tv_sec = period_usec / 1000000;
+    its.it_interval.tv_nsec = (period_usec % 1000000) * 1000L;
+    if (0 != timerfd_settime(t->timer_fd, TFD_TIMER_ABSTIME, &its, NULL)) {
+        goto fail;
+    }
+    return t;
+
+fail:
+    err = errno;
+    ticker_destroy(t);
+    errno = err;
+    return NULL;
+}
+
+
+/*
+ * ticker_watch
+ *   DESCRIPTION: Add a file descriptor to those that wake ticker_wait
+ *                when readable.
+ *   INPUTS: t -- the ticker
+ *           fd -- the descriptor
+ *           edge -- nonzero to wake only when new input arrives(for
+ *                   descriptors whose input is not read by the caller),
+ *                   or 0 to wake whenever input is waiting
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, or -1(with errno set) on failure
+ *   SIDE EFFECTS: none
+ */
+int32_t ticker_watch(ticker_t* t, int fd, int32_t edge) {
+    struct epoll_event ev; /* input event for the epoll set */
+
+    (void)memset(&ev, 0, sizeof (ev));
+    ev.events = EPOLLIN | (edge ? EPOLLET : 0);
+    ev.data.fd = fd;
+    return (0 == epoll_ctl(t->epoll_fd, EPOLL_CTL_ADD, fd, &ev) ? 0 : -1);
+}
+
+
+/*
+ * ticker_wait
+ *   DESCRIPTION: Sleep until the next tick or until a watched descriptor
+ *                has input.  If one or more ticks passed unseen, they are
+ *                skipped: the next wait is for the first tick still to
+ *                come.
+ *   INPUTS: t -- the ticker
+ *   OUTPUTS: none
+ *   RETURN VALUE: number of ticks passed since the last wait that
+ *                 returned ticks, 0 if woken only by input, or -1(with
+ *                 errno set) on failure
+ *   SIDE EFFECTS: updates the tick statistics
+ */
+int32_t ticker_wait(ticker_t* t) {
+    struct epoll_event ev[MAX_EVENTS]; /* events ready                    */
+    int                n_ev;           /* number of events ready          */
+    int                i;              /* index over events               */
+    uint64_t           expired;        /* ticks passed(from the timer)    */
+    int32_t            input;          /* input is waiting                */
+    uint64_t           late;           /* lateness in microseconds        */
+    int                bin;            /* jitter histogram bin            */
+
+    while (1) {
+        if (0 > (n_ev = epoll_wait(t->epoll_fd, ev, MAX_EVENTS, -1))) {
+            if (EINTR == errno) {
+                continue;
+            }
+            return -1;
+        }
+
+        expired = 0;
+        input = 0;
+        for (i = 0; n_ev > i; i++) {
+            if (t->timer_fd != ev[i].data.fd) {
+                input = 1;
+            } else if (sizeof (expired) != read(t->timer_fd, &expired, sizeof (expired))) {
+                /* Nothing to read(EAGAIN) is a spurious wakeup. */
+                if (EAGAIN != errno) {
+                    return -1;
+                }
+                expired = 0;
+            }
+        }
+
+        if (0 != expired) {
+            /* Measure lateness against the deadline of the latest tick. */
+            t->stats.ticks += expired;
+            t->stats.missed += expired - 1;
+            late = (monotonic_nsec() - t->start) / 1000 -
+                   t->stats.ticks * t->stats.period_usec;
+            if (0x80000000ULL <= late) {
+                late = 0;  /* clocks read in the same microsecond */
+            }
+            if (t->stats.worst_usec < late) {
+                t->stats.worst_usec = late;
+            }
+            for (bin = 0; TICK_JITTER_BINS - 1 > bin &&
+                 TICK_JITTER_BOUND(bin) <= late; bin++) {
+            }
+            t->stats.jitter[bin]++;
+            return (expired > 0x7FFFFFFF ? 0x7FFFFFFF : (int32_t)expired);
+        }
+        if (input) {
+            t->stats.input_wakes++;
+            return 0;
+        }
+    }
+}
+
+
+/*
+ * ticker_count
+ *   DESCRIPTION: Get the number of ticks since a ticker started, counting
+ *                those skipped.
+ *   INPUTS: t -- the ticker
+ *   OUTPUTS: none
+ *   RETURN VALUE: number of ticks
+ *   SIDE EFFECTS: none
+ */
+uint64_t ticker_count(const ticker_t* t) {
+    return t->stats.ticks;
+}
+
+
+/*
+ * get_ticker_stats
+ *   DESCRIPTION: Get a snapshot of a ticker's statistics.
+ *   INPUTS: t -- the ticker
+ *   OUTPUTS: stats -- the statistics
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void get_ticker_stats(const ticker_t* t, tick_stats_t* stats) {
+    *stats = t->stats;
+}
+
+
+/*
+ * ticker_destroy
+ *   DESCRIPTION: Stop a ticker and release it.
+ *   INPUTS: t -- the ticker(NULL is ignored)
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: closes the ticker's descriptors and frees it
+ */
+void ticker_destroy(ticker_t* t) {
+    if (NULL == t) {
+        return;
+    }
+    if (0 <= t->timer_fd) {
+        (void)close(t->timer_fd);
+    }
+    if (0 <= t->epoll_fd) {
+        (void)close(t->epoll_fd);
+    }
+    free(t);
+}
+
+
+/*
+ * monotonic_nsec
+ *   DESCRIPTION: Read CLOCK_MONOTONIC.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: the time in nanoseconds
+ *   SIDE EFFECTS: none
+ */
+static uint64_t monotonic_nsec() {
+    struct timespec now; /* current time */
+
+    (void)clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
@@ -0,0 +1,85 @@
+/* tab:4
+ *
+ * tick.h - game loop tick scheduler header file
+ *
+ * Permission to use, copy, modify, and distribute this software and its
+ * documentation for any purpose, without fee, and without written agreement is
+ * hereby granted, provided that the above copyright notice and the following
+ * two paragraphs appear in all copies of this software.
+ *
+ * IN NO EVENT SHALL THE AUTHOR OR THE UNIVERSITY OF ILLINOIS BE LIABLE TO
+ * ANY PARTY FOR DIRECT, INDIRECT, SPECIAL, INCIDENTAL, OR CONSEQUENTIAL
+ * DAMAGES ARISING OUT  OF THE USE OF THIS SOFTWARE AND ITS DOCUMENTATION,
+ * EVEN IF THE AUTHOR AND/OR THE UNIVERSITY OF ILLINOIS HAS BEEN ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THE AUTHOR AND THE UNIVERSITY OF ILLINOIS SPECIFICALLY DISCLAIM ANY
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  THE SOFTWARE
+ * PROVIDED HEREUNDER IS ON AN "AS IS" BASIS, AND NEITHER THE AUTHOR NOR
+ * THE UNIVERSITY OF ILLINOIS HAS ANY OBLIGATION TO PROVIDE MAINTENANCE,
+ * SUPPORT, UPDATES, ENHANCEMENTS, OR MODIFICATIONS."
+ *
+ * Filename:      tick.h
+ */
+
+#ifndef TICK_H
+#define TICK_H
+
+
+#include <stdint.h>
+
+#include "types.h"
+
+
+/*
+ * The jitter histogram counts ticks by how late the loop woke for them:
+ * bin i counts lateness below TICK_JITTER_BOUND(i) microseconds(and at
+ * least the bound of bin i - 1); the last bin counts the rest.
+ */
+#define TICK_JITTER_BINS     7
+#define TICK_JITTER_BOUND(i) (16U << (2 * (i)))
+
+/* tick statistics(see get_ticker_stats) */
+typedef struct tick_stats_t tick_stats_t;
+struct tick_stats_t {
+    uint32_t period_usec;            /* tick length in microseconds        */
+    uint64_t ticks;                  /* ticks since the ticker started     */
+    uint64_t missed;                 /* ticks skipped because we were late */
+    uint64_t input_wakes;            /* waits ended by input, not a tick   */
+    uint32_t worst_usec;             /* largest lateness seen              */
+    uint64_t jitter[TICK_JITTER_BINS]; /* ticks by lateness(see above)     */
+};
+
+
+/*
+ * Create a ticker with a tick every period_usec microseconds, the first
+ * one period from now.  Returns NULL(with errno set) on failure.
+ */
+extern ticker_t* ticker_create(uint32_t period_usec);
+
+/*
+ * Wake ticker_wait when a file descriptor becomes readable.  Use edge
+ * triggering(edge nonzero) for descriptors that are not drained by their
+ * reader.  Returns 0 on success, or -1(with errno set) on failure.
+ */
+extern int32_t ticker_watch(ticker_t* t, int fd, int32_t edge);
+
+/*
+ * Wait for the next tick or for input on a watched descriptor.  Returns
+ * the number of ticks that have passed(more than one if we were late;
+ * the extra ticks are skipped), 0 if woken by input, or -1(with errno
+ * set) on failure.
+ */
+extern int32_t ticker_wait(ticker_t* t);
+
+/* Get the number of ticks since the ticker started. */
+extern uint64_t ticker_count(const ticker_t* t);
+
+/* Get a snapshot of the tick statistics. */
+extern void get_ticker_stats(const ticker_t* t, tick_stats_t* stats);
+
+/* Release a ticker and its descriptors. */
+extern void ticker_destroy(ticker_t* t);
+
+#endif /* TICK_H */
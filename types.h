@@ -38,8 +38,15 @@
 typedef struct photo_t photo_t;
 typedef struct image_t image_t;
 
+/* types defined in residency.c */
+typedef struct res_photo_t res_photo_t;
+
+/* types defined in tick.c */
+typedef struct ticker_t ticker_t;
+
 /* types defined in world.h */
 typedef struct room_t room_t;
 typedef struct object_t object_t;
+typedef struct obj_link_t obj_link_t;
 
 #endif /* TYPES_H */
@@ -34,16 +34,57 @@
  */
 
 
+#include <pthread.h>
 #include <string.h>
 #include <strings.h>
+#include <time.h>
 
 #include "assert.h"
 #include "photo.h"
+#include "residency.h"
 #include "world.h"
 
 
 /* parameters defined for this file */
 
+/*
+ * Room photos and object images are decoded and quantized by a pool of
+ * worker threads when the world is built.  LOAD_WORKERS gives the size of
+ * the pool(0 means one thread per online CPU, 1 loads everything in the
+ * calling thread).  The time taken for the whole world is printed to
+ * stderr; REPORT_LOAD_TIMES also prints the time taken for each image.
+ */
+#ifndef LOAD_WORKERS
+#define LOAD_WORKERS      0
+#endif
+#ifndef REPORT_LOAD_TIMES
+#define REPORT_LOAD_TIMES 0
+#endif
+#define MAX_LOAD_WORKERS  16
+
+/*
+ * When the player enters a room, photos for rooms up to PREFETCH_HOPS
+ * moves away are loaded in the background(see residency.c).
+ */
+#ifndef PREFETCH_HOPS
+#define PREFETCH_HOPS     2
+#endif
+
+/*
+ * Besides its list of contents, each room lists its objects by the bands
+ * of rows and of columns of the room photo that their images cover, so
+ * that drawing a line of the room need only look at the objects near the
+ * line.  Bands are OBJ_BAND_DIM pixels wide; positions past the last band
+ * fall in the last band.  An object image covers at most OBJ_MAX_BANDS
+ * bands in either direction.
+ */
+#define OBJ_BAND_SHIFT    5
+#define OBJ_BAND_DIM      (1 << OBJ_BAND_SHIFT)
+#define OBJ_ROW_BANDS     (MAX_PHOTO_HEIGHT / OBJ_BAND_DIM)
+#define OBJ_COL_BANDS     (MAX_PHOTO_WIDTH / OBJ_BAND_DIM)
+#define OBJ_MAX_BANDS     ((MAX_OBJECT_WIDTH > MAX_OBJECT_HEIGHT ?          \
+                            MAX_OBJECT_WIDTH : MAX_OBJECT_HEIGHT) / OBJ_BAND_DIM + 2)
+
 /* room identifiers */
 enum {
     R_NONE = -1,
@@ -173,17 +214,28 @@ enum {
 
 /* types local to this file(declared in types.h) */
 
+/* an entry for an object in the list of one row or column band of a room */
+struct obj_link_t {
+    object_t*    obj;       /* the object                     */
+    obj_link_t*  next;      /* next object in the band        */
+};
+
 /*
  * The structure representing a room in the world. The backpack/inventory
  * is also a 'room'(#0, R_INVENTORY).
  */
 struct room_t {
-    const char* name;       /* name of room                   */
-    photo_t*    view;       /* photo currently shown for room */
-    object_t*   contents;   /* linked list of objects in room */
-    room_t*     left;       /* room to the "left"             */
-    room_t*     enter;      /* doors, etc.                    */
-    room_t*     right;      /* room to the "right"            */
+    const char*  name;      /* name of room                   */
+    res_photo_t* view;      /* photo currently shown for room */
+    object_t*    contents;  /* linked list of objects in room */
+    room_t*      left;      /* room to the "left"             */
+    room_t*      enter;     /* doors, etc.                    */
+    room_t*      right;     /* room to the "right"            */
+    obj_link_t*  row_band[OBJ_ROW_BANDS]; /* objects by row band    */
+    obj_link_t*  col_band[OBJ_COL_BANDS]; /* objects by column band */
+    uint32_t     version;   /* count of changes to the image  */
+    int32_t      n_damage;  /* changed rectangles(-1 for all) */
+    room_damage_t damage[MAX_ROOM_DAMAGE]; /* changed rectangles    */
 };
 
 /*
@@ -197,6 +249,8 @@ struct object_t {
     room_t*      loc;         /* in what 'room'?                */
     uint16_t     x, y;        /* location within room photo     */
     image_t*     img;         /* image for use in room          */
+    obj_link_t   row_link[OBJ_MAX_BANDS]; /* entries in row bands */
+    obj_link_t   col_link[OBJ_MAX_BANDS]; /* entries in col bands */
 };
 
 /*
@@ -348,21 +402,56 @@ static const obj_data_t obj_data[N_OBJECTS] = {
 typedef struct swap_data_t swap_data_t;
 struct swap_data_t {
     int32_t id;
+    int32_t room;                /* room whose photo is swapped */
     const char* const filename;
 };
 
 /* the swap photo descriptions */
 static const swap_data_t swap_data[N_SWAPS] = {
-    { SWAP_CIRCLE, "images/circlen2.photo"},   /* alternate for Boneyard */
-    { SWAP_CAR,    "images/caropen.photo" }    /* open/closed car photos */
+    { SWAP_CIRCLE, R_CIRCLE_N,  "images/circlen2.photo"},   /* alternate for Boneyard */
+    { SWAP_CAR,    R_CAR_SITE,  "images/caropen.photo" }    /* open/closed car photos */
+};
+
+/*
+ * One image to be loaded while building the world.  The jobs for all
+ * rooms, objects, and swap photos are collected into an array in the
+ * same order as the data arrays above and handed out to the loader
+ * threads one at a time; the results are then wired into the world by
+ * the calling thread in array order, so the outcome(including the
+ * sequence of calls to rand) does not depend on the number of threads.
+ */
+typedef struct load_job_t load_job_t;
+struct load_job_t {
+    const char* filename; /* image file name                           */
+    int32_t     is_photo; /* 1 for a room photo, 0 for an object image */
+    int32_t     preload;  /* 1 to load a room photo now, 0 on demand   */
+    void*       result;   /* res_photo_t* or image_t*(NULL on failure) */
+    double      msec;     /* time taken to load the image              */
+};
+
+/* The shared queue of load jobs. */
+typedef struct load_queue_t load_queue_t;
+struct load_queue_t {
+    pthread_mutex_t lock;   /* protects next                  */
+    int32_t         next;   /* index of next job to hand out  */
+    int32_t         n_jobs; /* number of jobs in job array    */
+    load_job_t*     job;    /* array of jobs                  */
 };
 
 
 /* functions local to this file--see function headers for details */
+static void band_range(int32_t pos, int32_t len, int32_t n_bands,
+                       int32_t* first, int32_t* last);
+static void bands_insert(object_t* o);
+static void bands_remove(object_t* o);
+static void damage_object(const object_t* o);
 static void do_photo_swap(room_t* r, int32_t which);
+static double elapsed_msec(const struct timespec* start);
 static object_t* find_in_room(const room_t* r, const char* arg);
 static void insert_object_at(object_t* o, room_t* r, int32_t x, int32_t y);
 static void insert_object(object_t* o, room_t* r);
+static int32_t load_images(load_job_t* job, int32_t n_jobs);
+static void* load_worker(void* arg);
 static void move_object_to_inventory(object_t* obj);
 static object_t* obj_special_get(room_t* r, const char* arg);
 static int32_t player_flag_is_set(int32_t fnum);
@@ -379,7 +468,152 @@ static void remove_object(object_t* o);
 static room_t   room[N_ROOMS];                       /* rooms                */
 static object_t object[N_OBJECTS];                   /* objects              */
 static uint32_t player_flags[(NUM_FLAGS + 31) / 32]; /* accomplishment flags */
-static photo_t* swap_photo[N_SWAPS];                 /* swapping photos      */
+static res_photo_t* swap_photo[N_SWAPS];             /* swapping photos      */
+
+
+/*
+ * band_range
+ *   DESCRIPTION: Find the bands covered by an object image along one
+ *                direction.
+ *   INPUTS: pos -- position of the image in the room photo
+ *           len -- size of the image in pixels
+ *           n_bands -- number of bands in the room
+ *   OUTPUTS: first -- first band covered
+ *            last -- last band covered(less than first if none)
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void band_range(int32_t pos, int32_t len, int32_t n_bands,
+                       int32_t* first, int32_t* last) {
+    *first = pos >> OBJ_BAND_SHIFT;
+    *last = (pos + len - 1) >> OBJ_BAND_SHIFT;
+    if (n_bands <= *first) {
+        *first = n_bands - 1;
+    }
+    if (n_bands <= *last) {
+        *last = n_bands - 1;
+    }
+    if (0 >= len) {
+        *last = *first - 1;
+    }
+}
+
+
+/*
+ * bands_insert
+ *   DESCRIPTION: Add an object to the row and column bands of its room
+ *                that its image covers.  The object goes at the front of
+ *                each band's list, as it does in the room's contents.
+ *   INPUTS: o -- the object(with its location and position set)
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: changes the room's bands
+ */
+static void bands_insert(object_t* o) {
+    int32_t first; /* first band covered     */
+    int32_t last;  /* last band covered      */
+    int32_t b;     /* index over bands       */
+
+    band_range(o->y, image_height(o->img), OBJ_ROW_BANDS, &first, &last);
+    for (b = first; last >= b; b++) {
+        o->row_link[b - first].obj = o;
+        o->row_link[b - first].next = o->loc->row_band[b];
+        o->loc->row_band[b] = &o->row_link[b - first];
+    }
+    band_range(o->x, image_width(o->img), OBJ_COL_BANDS, &first, &last);
+    for (b = first; last >= b; b++) {
+        o->col_link[b - first].obj = o;
+        o->col_link[b - first].next = o->loc->col_band[b];
+        o->loc->col_band[b] = &o->col_link[b - first];
+    }
+}
+
+
+/*
+ * bands_remove
+ *   DESCRIPTION: Take an object out of the row and column bands of its
+ *                room.
+ *   INPUTS: o -- the object(still in the room)
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: changes the room's bands
+ */
+static void bands_remove(object_t* o) {
+    int32_t      first; /* first band covered              */
+    int32_t      last;  /* last band covered               */
+    int32_t      b;     /* index over bands                */
+    obj_link_t** find;  /* index over pointers to entries  */
+
+    band_range(o->y, image_height(o->img), OBJ_ROW_BANDS, &first, &last);
+    for (b = first; last >= b; b++) {
+        for (find = &o->loc->row_band[b]; NULL != *find; find = &(*find)->next) {
+            if (&o->row_link[b - first] == *find) {
+                *find = (*find)->next;
+                break;
+            }
+        }
+    }
+    band_range(o->x, image_width(o->img), OBJ_COL_BANDS, &first, &last);
+    for (b = first; last >= b; b++) {
+        for (find = &o->loc->col_band[b]; NULL != *find; find = &(*find)->next) {
+            if (&o->col_link[b - first] == *find) {
+                *find = (*find)->next;
+                break;
+            }
+        }
+    }
+}
+
+
+/*
+ * damage_object
+ *   DESCRIPTION: Record the area covered by an object's image as changed
+ *                in the object's room.  When the room already holds
+ *                MAX_ROOM_DAMAGE rectangles, they are merged into one
+ *                rectangle covering them all and the object.
+ *   INPUTS: o -- the object(may be in limbo, in which case nothing changes)
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: changes the room's damage rectangles
+ */
+static void damage_object(const object_t* o) {
+    room_t*        r;     /* the object's room                */
+    room_damage_t* d;     /* new(or merged) rectangle         */
+    int32_t        x1;    /* one past right edge of merge     */
+    int32_t        y1;    /* one past bottom edge of merge    */
+    int32_t        idx;   /* index over rectangles            */
+
+    r = o->loc;
+    if (NULL == r || 0 > r->n_damage) {
+        return;
+    }
+    if (MAX_ROOM_DAMAGE > r->n_damage) {
+        d = &r->damage[r->n_damage++];
+        d->x = o->x;
+        d->y = o->y;
+        d->w = image_width(o->img);
+        d->h = image_height(o->img);
+        return;
+    }
+
+    /* Out of room: merge everything into the first rectangle. */
+    d = &r->damage[0];
+    x1 = o->x + image_width(o->img);
+    y1 = o->y + image_height(o->img);
+    d->w += d->x;
+    d->h += d->y;
+    d->x = (d->x < o->x ? d->x : o->x);
+    d->y = (d->y < o->y ? d->y : o->y);
+    for (idx = 1; MAX_ROOM_DAMAGE > idx; idx++) {
+        d->x = (d->x < r->damage[idx].x ? d->x : r->damage[idx].x);
+        d->y = (d->y < r->damage[idx].y ? d->y : r->damage[idx].y);
+        x1 = (x1 > r->damage[idx].x + r->damage[idx].w ? x1 : r->damage[idx].x + r->damage[idx].w);
+        y1 = (y1 > r->damage[idx].y + r->damage[idx].h ? y1 : r->damage[idx].y + r->damage[idx].h);
+    }
+    d->w = (x1 > d->w ? x1 : d->w) - d->x;
+    d->h = (y1 > d->h ? y1 : d->h) - d->y;
+    r->n_damage = 1;
+}
 
 
 /*
@@ -389,15 +623,36 @@ static photo_t* swap_photo[N_SWAPS];                 /* swapping photos      */
  *           which -- index into array of stored photos
  *   OUTPUTS: none
  *   RETURN VALUE: none
- *   SIDE EFFECTS: none
+ *   SIDE EFFECTS: marks the whole room as changed
  */
 static void do_photo_swap(room_t* r, int32_t which) {
-    photo_t* tmp;    /* temporary variable to help with swap */
+    res_photo_t* tmp;    /* temporary variable to help with swap */
 
     /* Swap the photos. */
     tmp               = r->view;
     r->view           = swap_photo[which];
     swap_photo[which] = tmp;
+
+    /* Everything in the room must be redrawn. */
+    r->version++;
+    r->n_damage = -1;
+}
+
+
+/*
+ * elapsed_msec
+ *   DESCRIPTION: Measure time elapsed since a given starting time.
+ *   INPUTS: start -- the starting time(from CLOCK_MONOTONIC)
+ *   OUTPUTS: none
+ *   RETURN VALUE: milliseconds elapsed since start
+ *   SIDE EFFECTS: none
+ */
+static double elapsed_msec(const struct timespec* start) {
+    struct timespec now; /* current time */
+
+    (void)clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((now.tv_sec - start->tv_sec) * 1000.0 +
+            (now.tv_nsec - start->tv_nsec) / 1000000.0);
 }
 
 
@@ -448,10 +703,15 @@ static void insert_object_at(object_t* o, room_t* r, int32_t x, int32_t y) {
     o->x = x;
     o->y = y;
 
-    /* Now add the object to the new room's contents. */
+    /* Now add the object to the new room's contents and bands. */
     o->loc = r;
     o->next = r->contents;
     r->contents = o;
+    bands_insert(o);
+
+    /* The object's area of the new room must be redrawn. */
+    r->version++;
+    damage_object(o);
 }
 
 
@@ -475,11 +735,11 @@ static void insert_object(object_t* o, room_t* r) {
 
 
     /* Choose a random x location. */
-    range = photo_width(r->view) - image_width(o->img);
+    range = res_photo_width(r->view) - image_width(o->img);
     xpos = (0 >= range ? 0 : (rand() % range));
 
     /* Place in the lowest quarter of the roo photo if the object fits... */
-    space = photo_height(r->view);
+    space = res_photo_height(r->view);
     img_ht = image_height(o->img);
     range = space / 4 - img_ht;
     if (0 >= range) {
@@ -496,6 +756,100 @@ static void insert_object(object_t* o, room_t* r) {
 }
 
 
+/*
+ * load_images
+ *   DESCRIPTION: Load the images described by an array of load jobs using
+ *                a pool of worker threads(the calling thread included).
+ *                Each photo or image is decoded(and, for photos,
+ *                quantized) independently, so the jobs can complete in any
+ *                order.
+ *   INPUTS: job -- array of load jobs
+ *           n_jobs -- number of jobs in the array
+ *   OUTPUTS: job -- result and msec fields filled in for every job
+ *   RETURN VALUE: number of threads used
+ *   SIDE EFFECTS: falls back to fewer threads if threads can't be created
+ */
+static int32_t load_images(load_job_t* job, int32_t n_jobs) {
+    load_queue_t   q;                        /* shared job queue            */
+    pthread_t      tid[MAX_LOAD_WORKERS];    /* ids of helper threads       */
+    int32_t        n_threads;                /* number of threads to use    */
+    int32_t        n_helpers;                /* number of helpers started   */
+    int32_t        idx;                      /* index over helper threads   */
+
+    /* Decide how many threads to use(including this one). */
+    n_threads = LOAD_WORKERS;
+    if (0 >= n_threads) {
+        n_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if (MAX_LOAD_WORKERS < n_threads) {
+        n_threads = MAX_LOAD_WORKERS;
+    }
+    if (n_jobs < n_threads) {
+        n_threads = n_jobs;
+    }
+    if (1 > n_threads) {
+        n_threads = 1;
+    }
+
+    (void)pthread_mutex_init(&q.lock, NULL);
+    q.next = 0;
+    q.n_jobs = n_jobs;
+    q.job = job;
+
+    /* Start the helpers.  If one can't be started, use fewer. */
+    for (n_helpers = 0; n_threads - 1 > n_helpers; n_helpers++) {
+        if (0 != pthread_create(&tid[n_helpers], NULL, load_worker, &q)) {
+            break;
+        }
+    }
+
+    /* Help out, then wait for the helpers to finish. */
+    (void)load_worker(&q);
+    for (idx = 0; n_helpers > idx; idx++) {
+        (void)pthread_join(tid[idx], NULL);
+    }
+    (void)pthread_mutex_destroy(&q.lock);
+
+    return n_helpers + 1;
+}
+
+
+/*
+ * load_worker
+ *   DESCRIPTION: Body of a loader thread: repeatedly takes the next job
+ *                from the shared queue and loads its image until no jobs
+ *                remain.
+ *   INPUTS: arg -- pointer to the shared load queue
+ *   OUTPUTS: none
+ *   RETURN VALUE: NULL
+ *   SIDE EFFECTS: fills in the result and time of each job taken
+ */
+static void* load_worker(void* arg) {
+    load_queue_t*   q = arg; /* shared job queue      */
+    load_job_t*     job;     /* job being loaded      */
+    struct timespec start;   /* start time of the job */
+
+    while (1) {
+        /* Take the next job, if any. */
+        (void)pthread_mutex_lock(&q->lock);
+        job = (q->n_jobs > q->next ? &q->job[q->next++] : NULL);
+        (void)pthread_mutex_unlock(&q->lock);
+        if (NULL == job) {
+            return NULL;
+        }
+
+        (void)clock_gettime(CLOCK_MONOTONIC, &start);
+        if (job->is_photo) {
+            job->result = register_photo(job->filename, job->preload);
+        }
+        else {
+            job->result = read_obj_image(job->filename);
+        }
+        job->msec = elapsed_msec(&start);
+    }
+}
+
+
 /*
  * move_object_to_inventory
  *   DESCRIPTION: Move an object into the player's inventory.  Try to
@@ -608,7 +962,7 @@ static void player_set_flag(int32_t fnum) {
  *   INPUTS: o -- the object
  *   OUTPUTS: none
  *   RETURN VALUE: none
- *   SIDE EFFECTS: none
+ *   SIDE EFFECTS: marks the object's area of its room as changed
  */
 static void remove_object(object_t* o) {
     object_t** find;    /* loop index over pointers to objects in room */
@@ -616,7 +970,14 @@ static void remove_object(object_t* o) {
     /* Is object already in limbo? */
     if (NULL != o->loc) {
 
-        /* Remove from previous room(with safety check)... */
+        /* Mark the area it covered for redrawing... */
+        o->loc->version++;
+        damage_object(o);
+
+        /* ...remove it from the previous room's bands... */
+        bands_remove(o);
+
+        /* ...and from its contents(with safety check)... */
         for (find = &o->loc->contents; NULL != *find; find = &(*find)->next) {
             if (o == *find) {
                 /* We found the predecessor! Unlink the object. */
@@ -670,6 +1031,34 @@ image_t* obj_image(const object_t* obj) {
 }
 
 
+/*
+ * obj_link_next
+ *   DESCRIPTION: Get the next entry in a room's row or column band. Use
+ *                with room_row_iterate or room_col_iterate.
+ *   INPUTS: link -- an entry in the band
+ *   OUTPUTS: none
+ *   RETURN VALUE: the next entry(NULL if link is last)
+ *   SIDE EFFECTS: none
+ */
+const obj_link_t* obj_link_next(const obj_link_t* link) {
+    return link->next;
+}
+
+
+/*
+ * obj_link_object
+ *   DESCRIPTION: Get the object for an entry in a room's row or column
+ *                band.
+ *   INPUTS: link -- an entry in the band
+ *   OUTPUTS: none
+ *   RETURN VALUE: the object
+ *   SIDE EFFECTS: none
+ */
+object_t* obj_link_object(const obj_link_t* link) {
+    return link->obj;
+}
+
+
 /*
  * obj_next
  *   DESCRIPTION: Get pointer to next object in object's room. Use with
@@ -699,6 +1088,65 @@ object_t* room_contents_iterate(const room_t* r) {
 }
 
 
+/*
+ * room_exits
+ *   DESCRIPTION: Get the rooms one move away from a room.
+ *   INPUTS: r -- pointer to the room
+ *   OUTPUTS: exits -- the rooms to the "left", through the doors, etc.,
+ *                     and to the "right"(NULL where there is none)
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void room_exits(const room_t* r, const room_t* exits[N_ROOM_EXITS]) {
+    exits[0] = r->left;
+    exits[1] = r->enter;
+    exits[2] = r->right;
+}
+
+
+/*
+ * room_col_iterate
+ *   DESCRIPTION: Get the first entry in the band of a room holding a
+ *                column of the room photo. Use with obj_link_next to
+ *                iterate over the objects that may cover the column.
+ *   INPUTS: r -- pointer to the room
+ *           x -- the column
+ *   OUTPUTS: none
+ *   RETURN VALUE: the first entry(NULL if none, or if x is negative)
+ *   SIDE EFFECTS: none
+ */
+const obj_link_t* room_col_iterate(const room_t* r, int32_t x) {
+    if (0 > x) {
+        return NULL;
+    }
+    x >>= OBJ_BAND_SHIFT;
+    return r->col_band[OBJ_COL_BANDS > x ? x : OBJ_COL_BANDS - 1];
+}
+
+
+/*
+ * room_take_damage
+ *   DESCRIPTION: Get the rectangles of a room photo changed by objects
+ *                put into or taken out of the room since the last call,
+ *                and forget them.
+ *   INPUTS: r -- pointer to the room
+ *   OUTPUTS: rects -- the changed rectangles, in photo pixels
+ *   RETURN VALUE: number of rectangles, or -1 if the whole room has
+ *                 changed(its photo was swapped)
+ *   SIDE EFFECTS: clears the room's damage rectangles
+ */
+int32_t room_take_damage(room_t* r, room_damage_t rects[MAX_ROOM_DAMAGE]) {
+    int32_t n;    /* number of rectangles */
+
+    n = r->n_damage;
+    if (0 < n) {
+        (void)memcpy(rects, r->damage, n * sizeof (r->damage[0]));
+    }
+    r->n_damage = 0;
+    return n;
+}
+
+
 /*
  * room_name
  *   DESCRIPTION: Get name for a room.
@@ -712,16 +1160,57 @@ const char* room_name(const room_t* r) {
 }
 
 
+/*
+ * room_row_band_end
+ *   DESCRIPTION: Find the end of the band holding a row of a room photo
+ *                (see room_row_iterate), so that a range of rows can be
+ *                split into bands.
+ *   INPUTS: y -- the row
+ *   OUTPUTS: none
+ *   RETURN VALUE: the first row past the band(0 if y is negative, and
+ *                 INT32_MAX for the last band)
+ *   SIDE EFFECTS: none
+ */
+int32_t room_row_band_end(int32_t y) {
+    if (0 > y) {
+        return 0;
+    }
+    y >>= OBJ_BAND_SHIFT;
+    return (OBJ_ROW_BANDS - 1 > y ? (y + 1) << OBJ_BAND_SHIFT : INT32_MAX);
+}
+
+
+/*
+ * room_row_iterate
+ *   DESCRIPTION: Get the first entry in the band of a room holding a row
+ *                of the room photo. Use with obj_link_next to iterate
+ *                over the objects that may cover the row.
+ *   INPUTS: r -- pointer to the room
+ *           y -- the row
+ *   OUTPUTS: none
+ *   RETURN VALUE: the first entry(NULL if none, or if y is negative)
+ *   SIDE EFFECTS: none
+ */
+const obj_link_t* room_row_iterate(const room_t* r, int32_t y) {
+    if (0 > y) {
+        return NULL;
+    }
+    y >>= OBJ_BAND_SHIFT;
+    return r->row_band[OBJ_ROW_BANDS > y ? y : OBJ_ROW_BANDS - 1];
+}
+
+
 /*
  * room_photo
  *   DESCRIPTION: Get room photo for a room.
  *   INPUTS: r -- pointer to the room
  *   OUTPUTS: none
  *   RETURN VALUE: a pointer to room r's photo
- *   SIDE EFFECTS: none
+ *   SIDE EFFECTS: loads the photo if it is not in memory(see
+ *                 acquire_photo)
  */
 photo_t* room_photo(const room_t* r) {
-    return r->view;
+    return acquire_photo(r->view);
 }
 
 
@@ -734,7 +1223,22 @@ photo_t* room_photo(const room_t* r) {
  *   SIDE EFFECTS: none
  */
 uint32_t room_photo_height(const room_t* r) {
-    return photo_height(r->view);
+    return res_photo_height(r->view);
+}
+
+
+/*
+ * room_photo_resident
+ *   DESCRIPTION: Get the current photo of a room if it is in memory,
+ *                without loading it or counting a display(see
+ *                peek_photo).
+ *   INPUTS: r -- pointer to the room
+ *   OUTPUTS: none
+ *   RETURN VALUE: pointer to room r's photo, or NULL if not in memory
+ *   SIDE EFFECTS: none
+ */
+photo_t* room_photo_resident(const room_t* r) {
+    return peek_photo(r->view);
 }
 
 
@@ -747,27 +1251,65 @@ uint32_t room_photo_height(const room_t* r) {
  *   SIDE EFFECTS: none
  */
 uint32_t room_photo_width(const room_t* r) {
-    return photo_width(r->view);
+    return res_photo_width(r->view);
+}
+
+
+/*
+ * room_version
+ *   DESCRIPTION: Get the count of changes to a room's image(objects put
+ *                into or taken out of the room, and photo swaps).  Used
+ *                to tell whether an image of the room built earlier is
+ *                still good.
+ *   INPUTS: r -- pointer to the room
+ *   OUTPUTS: none
+ *   RETURN VALUE: the count
+ *   SIDE EFFECTS: none
+ */
+uint32_t room_version(const room_t* r) {
+    return r->version;
 }
 
 
 /*
  * build_world
  *   DESCRIPTION: Builds and connects the rooms, creates objects, and
- *                reads in all image data(could be done lazily with
- *                caching instead).
+ *                reads in image data.  Room photos are registered with
+ *                the residency manager; unless it has a byte budget, they
+ *                are also loaded now(otherwise they are loaded when
+ *                needed).  The images are loaded by a pool of worker
+ *                threads(see load_images); everything else is done in
+ *                the calling thread, in the order given by the data
+ *                arrays.
  *   INPUTS: none
  *   OUTPUTS: none
  *   RETURN VALUE: 1 on success, or 0 on failure
- *   SIDE EFFECTS: prints error messages to stderr on failure
+ *   SIDE EFFECTS: prints error messages to stderr on failure; prints the
+ *                 load time to stderr(and that of each image if
+ *                 REPORT_LOAD_TIMES is set)
  */
 int32_t build_world() {
-    int32_t idx;    /* index over data arrays   */
-    int32_t which;    /* id for current data item */
+    load_job_t      job[N_ROOMS + N_OBJECTS + N_SWAPS]; /* images to load  */
+    load_job_t*     room_job;   /* load jobs for room photos, by room id    */
+    load_job_t*     obj_job;    /* load jobs for object images, by obj. id  */
+    load_job_t*     swap_job;   /* load jobs for swap photos, by swap id    */
+    struct timespec start;      /* time at which loading started            */
+    double          total_msec; /* wall clock time taken to load all images */
+    int32_t         n_threads;  /* number of threads used for loading       */
+    int32_t         preload;    /* load room photos now?                    */
+    int32_t         idx;        /* index over data arrays                   */
+    int32_t         which;      /* id for current data item                 */
 
     /* Clear all accomplishment flags. */
     (void)memset(player_flags, 0, sizeof (player_flags));
 
+    /* Clear the load jobs; a file name marks a job as used. */
+    (void)memset(job, 0, sizeof (job));
+    preload = (0 == get_photo_budget());
+    room_job = &job[0];
+    obj_job = &job[N_ROOMS];
+    swap_job = &job[N_ROOMS + N_OBJECTS];
+
     /* Clear room data to enable sanity check for duplication. */
     (void)memset(room, 0, sizeof (room));
 
@@ -787,17 +1329,18 @@ int32_t build_world() {
             return 0;
         }
 
-        /* Set up the room. */
+        /* Set up the room; the photo is loaded below. */
         room[which].name = room_data[idx].name;
-        room[which].view = read_photo(room_data[idx].filename);
-        if (NULL == room[which].view) {
-            fprintf(stderr, "Can't read room photo %s.\n", room_data[idx].filename);
-            return 0;
-        }
         room[which].contents = NULL;
+        room[which].n_damage = 0;
+        (void)memset(room[which].row_band, 0, sizeof (room[which].row_band));
+        (void)memset(room[which].col_band, 0, sizeof (room[which].col_band));
         room[which].left  = (R_NONE == room_data[idx].left ? NULL : &room[room_data[idx].left]);
         room[which].enter = (R_NONE == room_data[idx].enter ? NULL : &room[room_data[idx].enter]);
         room[which].right = (R_NONE == room_data[idx].right ? NULL : &room[room_data[idx].right]);
+        room_job[which].filename = room_data[idx].filename;
+        room_job[which].is_photo = 1;
+        room_job[which].preload = preload;
     }
 
     /* Clear object data to enable sanity check for duplication. */
@@ -819,27 +1362,14 @@ int32_t build_world() {
             return 0;
         }
 
-        /* Set up the object. */
+        /* Set up the object; the image is loaded below. */
         object[which].name = obj_data[idx].name;
-        object[which].img = read_obj_image(obj_data[idx].filename);
-        if (NULL == object[which].img) {
-            fprintf(stderr, "Can't read object photo %s.\n", obj_data[idx].filename);
-            return 0;
-        }
         object[which].next = NULL;
         object[which].loc = NULL;
         object[which].x = 0;
         object[which].y = 0;
-
-        /* Insert it into a room if necessary. */
-        if (R_NONE != obj_data[idx].room) {
-            if (-1 != obj_data[idx].x) {
-                insert_object_at(&object[which], &room[obj_data[idx].room], obj_data[idx].x, obj_data[idx].y);
-            }
-            else {
-                insert_object(&object[which], &room[obj_data[idx].room]);
-            }
-        }
+        obj_job[which].filename = obj_data[idx].filename;
+        obj_job[which].is_photo = 0;
     }
 
     /* Clear swap photo data to enable sanity check for duplication. */
@@ -856,13 +1386,63 @@ int32_t build_world() {
             fputs("Bad index in swap data.\n", stderr);
             return 0;
         }
-        if (NULL != swap_photo[which]) {
+        if (NULL != swap_job[which].filename) {
             fprintf(stderr, "Duplicate index %d in swap data.\n", which);
             return 0;
         }
+        swap_job[which].filename = swap_data[idx].filename;
+        swap_job[which].is_photo = 1;
+        swap_job[which].preload = preload;
+    }
 
-        /* Read in the swap photo. */
-        swap_photo[which] = read_photo(swap_data[idx].filename);
+    /* Decode and quantize all of the images. */
+    (void)clock_gettime(CLOCK_MONOTONIC, &start);
+    n_threads = load_images(job, N_ROOMS + N_OBJECTS + N_SWAPS);
+    total_msec = elapsed_msec(&start);
+
+#if (REPORT_LOAD_TIMES != 0)
+    for (idx = 0; N_ROOMS + N_OBJECTS + N_SWAPS > idx; idx++) {
+        fprintf(stderr, "%-28s %8.2f ms\n", job[idx].filename, job[idx].msec);
+    }
+#endif /* REPORT_LOAD_TIMES */
+    fprintf(stderr, "Loaded %d images in %.2f ms using %d thread%s.\n",
+            N_ROOMS + N_OBJECTS + N_SWAPS, total_msec, n_threads,
+            (1 == n_threads ? "" : "s"));
+
+    /* Attach the room photos. */
+    for (idx = 0; N_ROOMS > idx; idx++) {
+        which = room_data[idx].id;
+        room[which].view = room_job[which].result;
+        if (NULL == room[which].view) {
+            fprintf(stderr, "Can't read room photo %s.\n", room_data[idx].filename);
+            return 0;
+        }
+    }
+
+    /* Attach the object images and place the objects. */
+    for (idx = 0; N_OBJECTS > idx; idx++) {
+        which = obj_data[idx].id;
+        object[which].img = obj_job[which].result;
+        if (NULL == object[which].img) {
+            fprintf(stderr, "Can't read object photo %s.\n", obj_data[idx].filename);
+            return 0;
+        }
+
+        /* Insert it into a room if necessary. */
+        if (R_NONE != obj_data[idx].room) {
+            if (-1 != obj_data[idx].x) {
+                insert_object_at(&object[which], &room[obj_data[idx].room], obj_data[idx].x, obj_data[idx].y);
+            }
+            else {
+                insert_object(&object[which], &room[obj_data[idx].room]);
+            }
+        }
+    }
+
+    /* Attach the swap photos. */
+    for (idx = 0; N_SWAPS > idx; idx++) {
+        which = swap_data[idx].id;
+        swap_photo[which] = swap_job[which].result;
         if (NULL == swap_photo[which]) {
             fprintf(stderr, "Can't read room photo %s.\n", swap_data[idx].filename);
             return 0;
@@ -888,6 +1468,69 @@ room_t* start_in_room() {
 }
 
 
+/*
+ * prefetch_near_room
+ *   DESCRIPTION: Start loading, in the background, the photos of rooms
+ *                that the player can reach from a room in PREFETCH_HOPS
+ *                moves or fewer(following left, enter, and right), nearest
+ *                first.  Photos that may be swapped into those rooms are
+ *                included.
+ *   INPUTS: r -- the player's current room
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: replaces the prefetch list(see prefetch_photos)
+ */
+void prefetch_near_room(const room_t* r) {
+    const room_t* queue[N_ROOMS];          /* rooms in breadth-first order */
+    int32_t       hops[N_ROOMS];           /* moves needed to reach room   */
+    int32_t       seen[N_ROOMS];           /* room already in queue?       */
+    res_photo_t*  list[N_ROOMS + N_SWAPS]; /* photos to prefetch           */
+    const room_t* next[3];                 /* rooms reachable from a room  */
+    int32_t       head;                    /* index of room to expand      */
+    int32_t       tail;                    /* number of rooms in queue     */
+    int32_t       n;                       /* number of photos in list     */
+    int32_t       idx;                     /* index over moves/swaps       */
+    int32_t       which;                   /* id of a room                 */
+
+    (void)memset(seen, 0, sizeof (seen));
+    queue[0] = r;
+    hops[0] = 0;
+    seen[r - room] = 1;
+    n = 0;
+
+    for (head = 0, tail = 1; tail > head; head++) {
+
+        /* Add the room's photo and any photos swapped into it. */
+        which = queue[head] - room;
+        if (0 < head) {
+            list[n++] = queue[head]->view;
+        }
+        for (idx = 0; N_SWAPS > idx; idx++) {
+            if (swap_data[idx].room == which) {
+                list[n++] = swap_photo[swap_data[idx].id];
+            }
+        }
+
+        /* Queue the rooms one more move away. */
+        if (PREFETCH_HOPS <= hops[head]) {
+            continue;
+        }
+        next[0] = queue[head]->left;
+        next[1] = queue[head]->enter;
+        next[2] = queue[head]->right;
+        for (idx = 0; 3 > idx; idx++) {
+            if (NULL != next[idx] && !seen[next[idx] - room]) {
+                seen[next[idx] - room] = 1;
+                hops[tail] = hops[head] + 1;
+                queue[tail++] = next[idx];
+            }
+        }
+    }
+
+    prefetch_photos(list, n);
+}
+
+
 /*
  * player_has_board
  *   DESCRIPTION: Check whether the player has the board in inventory.
@@ -45,17 +45,68 @@ extern uint16_t obj_get_y(const object_t* obj);
 extern image_t* obj_image(const object_t* obj);
 extern object_t* obj_next(const object_t* obj);
 extern object_t* room_contents_iterate(const room_t* r);
+
+/*
+ * Iterate over the objects in a room whose images may cover a row(or a
+ * column) of the room photo, in the same order as room_contents_iterate.
+ * Objects that do not cover the line may be included.
+ */
+extern const obj_link_t* room_row_iterate(const room_t* r, int32_t y);
+/* first row past the band holding row y(for splitting rows into bands) */
+extern int32_t room_row_band_end(int32_t y);
+extern const obj_link_t* room_col_iterate(const room_t* r, int32_t x);
+extern const obj_link_t* obj_link_next(const obj_link_t* link);
+extern object_t* obj_link_object(const obj_link_t* link);
 extern const char* room_name(const room_t* r);
 extern photo_t* room_photo(const room_t* r);
+
+/*
+ * Get a room's photo if it is in memory, without loading it or counting a
+ * display(NULL if not in memory).  The photo stays in memory at least
+ * until another photo is displayed or the rooms near the player change.
+ */
+extern photo_t* room_photo_resident(const room_t* r);
+
+/* Get the rooms one move away from a room(left, enter, right; NULL if none). */
+#define N_ROOM_EXITS 3
+extern void room_exits(const room_t* r, const room_t* exits[N_ROOM_EXITS]);
 extern uint32_t room_photo_height(const room_t* r);
 extern uint32_t room_photo_width(const room_t* r);
 
+/*
+ * Get a count of the changes to a room's image(objects put into or taken
+ * out of the room, or photo swaps).  The count differs whenever the image
+ * may have changed.
+ */
+extern uint32_t room_version(const room_t* r);
+
+/*
+ * Rectangles of a room photo(in photo pixels) whose image has changed
+ * because objects were put into or taken out of the room.  At most
+ * MAX_ROOM_DAMAGE are kept per room; more are merged into one.
+ */
+#define MAX_ROOM_DAMAGE 8
+typedef struct {
+    int32_t x, y;   /* upper left pixel of the rectangle */
+    int32_t w, h;   /* size of the rectangle in pixels   */
+} room_damage_t;
+
+/*
+ * Get and forget the changed rectangles of a room.  Returns the number
+ * of rectangles, or -1 if the whole room must be redrawn(after a photo
+ * swap).
+ */
+extern int32_t room_take_damage(room_t* r, room_damage_t rects[MAX_ROOM_DAMAGE]);
+
 /* Build the game world.  Returns 0 on failure, or 1 on success. */
 extern int32_t build_world(void);
 
 /* Get pointer to starting room for player. */
 extern room_t* start_in_room(void);
 
+/* Start loading photos for rooms near the player's room in the background. */
+extern void prefetch_near_room(const room_t* r);
+
 /*
  * checks for accelerator object ownership; these make horizontal(board)
  * and vertical(jetpack) pixel panning faster